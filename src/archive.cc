@@ -0,0 +1,484 @@
+/* archive.cc - streaming archives of the selection
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <deque>
+#include <string>
+
+using std::deque;
+using std::wstring;
+
+#include <windows.h>
+
+#include <gpg-error.h>
+
+#include "main.h"
+#include "stats.h"
+#include "tarstream.h"
+#include "archive.h"
+
+/* The number of threads reading the directories.  */
+#define ARCHIVE_WALKERS 4
+
+/* The number of entries read ahead of the writer.  The walkers wait
+   when the queue is full.  */
+#define ARCHIVE_QUEUE_SIZE 4096
+
+/* The size of the reads from the files.  */
+#define ARCHIVE_BUFFER_SIZE (256 * 1024)
+
+/* The walkers and the writer poll their events with this timeout in
+   milliseconds, so that a missed wakeup only delays them.  */
+#define ARCHIVE_POLL 50
+
+
+/* A file or directory to archive.  */
+struct archive_item_s
+{
+  wstring path;			/* The name of the file.  */
+  string name;			/* The utf-8 name in the archive.  */
+  uint64_t size;
+  time_t mtime;
+  int is_dir;
+};
+
+/* The state shared by the walkers and the writer.  All fields are
+   protected by LOCK.  */
+struct archive_s
+{
+  gpgrt_lock_t lock;
+  deque<archive_item_s> dirs;	/* Directories to read.  */
+  deque<archive_item_s> items;	/* Entries for the writer.  */
+  vector<string> skipped;	/* Directories which could not be read.  */
+  unsigned int active;		/* Walkers reading a directory.  */
+  int walked;			/* All directories have been read.  */
+  int cancel;			/* The writer has given up.  */
+  HANDLE dirs_event;
+  HANDLE items_event;
+  HANDLE space_event;
+};
+
+
+static string
+to_utf8 (const wchar_t *wstr)
+{
+  string result;
+  char *str;
+
+  str = gpgrt_wchar_to_utf8 (wstr);
+  if (str)
+    {
+      result = str;
+      free (str);
+    }
+  return result;
+}
+
+
+static time_t
+filetime_to_time (const FILETIME *ft)
+{
+  uint64_t t = ((uint64_t) ft->dwHighDateTime << 32) | ft->dwLowDateTime;
+
+  /* FILETIME counts 100 ns since 1601.  */
+  if (t < 116444736000000000ULL)
+    return 0;
+  return (time_t) ((t - 116444736000000000ULL) / 10000000);
+}
+
+
+/* Queue ITEM for the writer; wait if the queue is full.  Returns
+   false if the writer has given up.  */
+static int
+push_item (struct archive_s *ar, const archive_item_s &item)
+{
+  int cancel;
+
+  gpgrt_lock_lock (&ar->lock);
+  while (ar->items.size () >= ARCHIVE_QUEUE_SIZE && !ar->cancel)
+    {
+      gpgrt_lock_unlock (&ar->lock);
+      WaitForSingleObject (ar->space_event, ARCHIVE_POLL);
+      gpgrt_lock_lock (&ar->lock);
+    }
+  cancel = ar->cancel;
+  if (!cancel)
+    ar->items.push_back (item);
+  gpgrt_lock_unlock (&ar->lock);
+  SetEvent (ar->items_event);
+  return !cancel;
+}
+
+
+/* Read the directory DIR.  Its entry is queued before its files.
+   The subdirectories are passed to the other walkers as they are
+   found; each of them is queued by its walker before its own files,
+   so that the archive has each directory before the files in it.  */
+static void
+walk_dir (struct archive_s *ar, const archive_item_s &dir)
+{
+  WIN32_FIND_DATAW fd;
+  archive_item_s item;
+  wstring pattern;
+  HANDLE hd;
+  int go_on = 1;
+
+  if (!push_item (ar, dir))
+    return;
+
+  pattern = dir.path + L"\\*";
+  hd = FindFirstFileExW (pattern.c_str (), FindExInfoBasic, &fd,
+                         FindExSearchNameMatch, NULL,
+                         FIND_FIRST_EX_LARGE_FETCH);
+  if (hd == INVALID_HANDLE_VALUE)
+    {
+      if (GetLastError () != ERROR_FILE_NOT_FOUND)
+        {
+          gpgrt_lock_lock (&ar->lock);
+          ar->skipped.push_back (to_utf8 (dir.path.c_str ()));
+          gpgrt_lock_unlock (&ar->lock);
+        }
+      return;
+    }
+  do
+    {
+      if (!wcscmp (fd.cFileName, L".") || !wcscmp (fd.cFileName, L".."))
+        continue;
+
+      item.is_dir = !!(fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY);
+      /* Junctions and links to directories may form loops.  */
+      if (item.is_dir && (fd.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT))
+        continue;
+      item.path = dir.path + L"\\" + fd.cFileName;
+      item.name = dir.name + "/" + to_utf8 (fd.cFileName);
+      item.size = ((uint64_t) fd.nFileSizeHigh << 32) | fd.nFileSizeLow;
+      item.mtime = filetime_to_time (&fd.ftLastWriteTime);
+
+      if (item.is_dir)
+        {
+          gpgrt_lock_lock (&ar->lock);
+          ar->dirs.push_back (item);
+          go_on = !ar->cancel;
+          gpgrt_lock_unlock (&ar->lock);
+          SetEvent (ar->dirs_event);
+        }
+      else
+        go_on = push_item (ar, item);
+    }
+  while (go_on && FindNextFileW (hd, &fd));
+  FindClose (hd);
+}
+
+
+static DWORD WINAPI
+walker_thread (LPVOID arg)
+{
+  struct archive_s *ar = (struct archive_s *) arg;
+  archive_item_s dir;
+
+  for (;;)
+    {
+      gpgrt_lock_lock (&ar->lock);
+      while (ar->dirs.empty () && ar->active && !ar->cancel)
+        {
+          gpgrt_lock_unlock (&ar->lock);
+          WaitForSingleObject (ar->dirs_event, ARCHIVE_POLL);
+          gpgrt_lock_lock (&ar->lock);
+        }
+      if (ar->cancel || (ar->dirs.empty () && !ar->active))
+        {
+          /* The items of all directories have been queued.  */
+          ar->walked = 1;
+          gpgrt_lock_unlock (&ar->lock);
+          SetEvent (ar->dirs_event);
+          SetEvent (ar->items_event);
+          break;
+        }
+      dir = ar->dirs.front ();
+      ar->dirs.pop_front ();
+      ar->active++;
+      gpgrt_lock_unlock (&ar->lock);
+
+      walk_dir (ar, dir);
+
+      gpgrt_lock_lock (&ar->lock);
+      ar->active--;
+      gpgrt_lock_unlock (&ar->lock);
+      SetEvent (ar->dirs_event);
+    }
+  return 0;
+}
+
+
+static gpg_error_t
+write_to_handle (void *opaque, const void *buffer, size_t length)
+{
+  HANDLE out = (HANDLE) opaque;
+  const char *p = (const char *) buffer;
+  DWORD nwritten;
+
+  while (length)
+    {
+      if (!WriteFile (out, p, length > 0x40000000 ? 0x40000000 : length,
+                      &nwritten, NULL))
+        {
+          _gpgex_debug (DEBUG_ASSUAN, "writing the archive failed: rc=%lu",
+                        (unsigned long) GetLastError ());
+          return gpg_error (GPG_ERR_EPIPE);
+        }
+      p += nwritten;
+      length -= nwritten;
+    }
+  return 0;
+}
+
+
+/* Copy the file ITEM to TAR using BUFFER.  If the file can not be
+   opened or its name can not be stored, it is left out and R_SKIPPED
+   is set.  Returns an error if the file could not be read to the end
+   or the archive could not be written; the archive is then
+   broken.  */
+static gpg_error_t
+write_file (struct gpgex_tar_s *tar, const archive_item_s &item,
+            char *buffer, int *r_skipped)
+{
+  gpg_error_t err = 0;
+  HANDLE hd;
+  DWORD nread;
+
+  *r_skipped = 0;
+  hd = CreateFileW (item.path.c_str (), GENERIC_READ,
+                    FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                    NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (hd == INVALID_HANDLE_VALUE)
+    {
+      *r_skipped = 1;
+      return 0;
+    }
+  err = gpgex_tar_begin_file (tar, item.name.c_str (), item.size,
+                              item.mtime);
+  if (err)
+    {
+      CloseHandle (hd);
+      /* Nothing has been written for the file unless the sink
+         failed.  */
+      if (tar->err)
+        return tar->err;
+      _gpgex_debug (DEBUG_ASSUAN, "can't store '%s': %s",
+                    item.name.c_str (), gpg_strerror (err));
+      *r_skipped = 1;
+      return 0;
+    }
+
+  /* The size is the one seen by the walker.  A file which has grown
+     since is cut.  The header is already written, so a file which
+     can not be read to that size breaks the archive.  */
+  while (tar->remaining)
+    {
+      if (!ReadFile (hd, buffer, ARCHIVE_BUFFER_SIZE, &nread, NULL))
+        {
+          _gpgex_debug (DEBUG_ASSUAN, "reading '%s' failed: rc=%lu",
+                        item.name.c_str (), (unsigned long) GetLastError ());
+          err = gpg_error (GPG_ERR_EIO);
+          break;
+        }
+      if (!nread)
+        {
+          _gpgex_debug (DEBUG_ASSUAN, "file '%s' has shrunk",
+                        item.name.c_str ());
+          err = gpg_error (GPG_ERR_TRUNCATED);
+          break;
+        }
+      if (gpgex_tar_write (tar, buffer, nread) && tar->err)
+        break;
+    }
+  CloseHandle (hd);
+  if (tar->err)
+    return tar->err;
+  if (err)
+    return err;
+  return gpgex_tar_end_file (tar);
+}
+
+
+/* Return the name in the archive for the file FNAME.  */
+static string
+root_name (const wstring &fname)
+{
+  size_t end = fname.find_last_not_of (L"\\/");
+  size_t start;
+  wstring base;
+
+  if (end == wstring::npos)
+    return "";
+  start = fname.find_last_of (L"\\/:", end);
+  base = fname.substr (start == wstring::npos ? 0 : start + 1,
+                       end - (start == wstring::npos ? 0 : start + 1) + 1);
+  if (base.empty ())
+    /* A drive like "C:\".  */
+    base = fname.substr (0, 1);
+  return to_utf8 (base.c_str ());
+}
+
+
+gpg_error_t
+gpgex_archive_write (const vector<string> &filenames, HANDLE out,
+                     vector<string> &r_skipped)
+{
+  struct archive_s ar;
+  struct gpgex_tar_s tar;
+  WIN32_FILE_ATTRIBUTE_DATA fad;
+  archive_item_s item;
+  HANDLE threads[ARCHIVE_WALKERS];
+  unsigned int nthreads = 0;
+  unsigned int nskipped;
+  unsigned int i;
+  gpg_error_t err = 0;
+  wchar_t *wname;
+  char *buffer;
+  int skipped;
+
+  TRACE_BEG (DEBUG_ASSUAN, "gpgex_archive_write", out,
+             "%u files", (unsigned int) filenames.size ());
+
+  nskipped = r_skipped.size ();
+  buffer = (char *) malloc (ARCHIVE_BUFFER_SIZE);
+  if (!buffer)
+    return TRACE_GPGERR (gpg_error_from_syserror ());
+
+  /* gpgrt_lock_init expects a cleared lock.  */
+  memset (&ar.lock, 0, sizeof ar.lock);
+  gpgrt_lock_init (&ar.lock);
+  ar.active = 0;
+  ar.walked = 0;
+  ar.cancel = 0;
+  ar.dirs_event = CreateEvent (NULL, FALSE, FALSE, NULL);
+  ar.items_event = CreateEvent (NULL, FALSE, FALSE, NULL);
+  ar.space_event = CreateEvent (NULL, FALSE, FALSE, NULL);
+
+  /* The selected files are archived in their order; the selected
+     directories are given to the walkers.  */
+  for (i = 0; i < filenames.size (); i++)
+    {
+      wname = gpgrt_utf8_to_wchar (filenames[i].c_str ());
+      if (!wname)
+        {
+          r_skipped.push_back (filenames[i]);
+          continue;
+        }
+      item.path = wname;
+      gpgrt_free_wchar (wname);
+      if (!GetFileAttributesExW (item.path.c_str (), GetFileExInfoStandard,
+                                 &fad))
+        {
+          r_skipped.push_back (filenames[i]);
+          continue;
+        }
+      item.name = root_name (item.path);
+      item.is_dir = !!(fad.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY);
+      item.size = ((uint64_t) fad.nFileSizeHigh << 32) | fad.nFileSizeLow;
+      item.mtime = filetime_to_time (&fad.ftLastWriteTime);
+      if (item.name.empty ())
+        r_skipped.push_back (filenames[i]);
+      else if (item.is_dir)
+        ar.dirs.push_back (item);
+      else
+        ar.items.push_back (item);
+    }
+
+  if (ar.dirs.empty ())
+    ar.walked = 1;
+  else
+    for (i = 0; i < ARCHIVE_WALKERS; i++)
+      {
+        threads[nthreads] = CreateThread (NULL, 0, walker_thread, &ar, 0, NULL);
+        if (threads[nthreads])
+          nthreads++;
+      }
+
+  gpgex_tar_init (&tar, write_to_handle, out);
+  if (!ar.walked && !nthreads)
+    tar.err = gpg_error_from_syserror ();
+  while (!tar.err && !err)
+    {
+      gpgrt_lock_lock (&ar.lock);
+      while (ar.items.empty () && !ar.walked)
+        {
+          gpgrt_lock_unlock (&ar.lock);
+          WaitForSingleObject (ar.items_event, ARCHIVE_POLL);
+          gpgrt_lock_lock (&ar.lock);
+        }
+      if (ar.items.empty ())
+        {
+          gpgrt_lock_unlock (&ar.lock);
+          break;
+        }
+      item = ar.items.front ();
+      ar.items.pop_front ();
+      gpgrt_lock_unlock (&ar.lock);
+      SetEvent (ar.space_event);
+
+      if (item.is_dir)
+        {
+          /* Its files can not be stored either and are listed when
+             they come.  */
+          if (gpgex_tar_add_dir (&tar, item.name.c_str (), item.mtime)
+              && !tar.err)
+            r_skipped.push_back (to_utf8 (item.path.c_str ()));
+        }
+      else
+        {
+          err = write_file (&tar, item, buffer, &skipped);
+          if (skipped)
+            r_skipped.push_back (to_utf8 (item.path.c_str ()));
+        }
+    }
+  if (!tar.err && !err)
+    gpgex_tar_finish (&tar);
+  if (!err)
+    err = tar.err;
+
+  gpgrt_lock_lock (&ar.lock);
+  ar.cancel = 1;
+  gpgrt_lock_unlock (&ar.lock);
+  SetEvent (ar.space_event);
+  for (i = 0; i < nthreads; i++)
+    {
+      WaitForSingleObject (threads[i], INFINITE);
+      CloseHandle (threads[i]);
+    }
+  CloseHandle (ar.dirs_event);
+  CloseHandle (ar.items_event);
+  CloseHandle (ar.space_event);
+  gpgrt_lock_destroy (&ar.lock);
+  free (buffer);
+  r_skipped.insert (r_skipped.end (), ar.skipped.begin (), ar.skipped.end ());
+
+  (void) TRACE_LOG ("%llu bytes, %u files skipped",
+                    (unsigned long long) tar.written,
+                    (unsigned int) (r_skipped.size () - nskipped));
+  return TRACE_GPGERR (err);
+}
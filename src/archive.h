@@ -0,0 +1,47 @@
+/* archive.h - streaming archives of the selection
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#ifndef GPGEX_ARCHIVE_H
+#define GPGEX_ARCHIVE_H	1
+
+#include <vector>
+#include <string>
+
+using std::vector;
+using std::string;
+
+#include <windows.h>
+
+#include <gpg-error.h>
+
+/* Write a tar archive of FILENAMES to the handle OUT, which is
+   usually a pipe to the UI server.  Directories are included with
+   their contents; the names in the archive start with the last
+   component of each of FILENAMES.  The directory trees are read by
+   several threads in parallel, while the archive is written
+   sequentially by the calling thread; nothing is staged on disk.
+   Files which can not be opened and directories which can not be
+   read are left out and their names are appended to R_SKIPPED.
+   Returns an error if writing to OUT failed or if a file could not
+   be read to the end; the archive is then incomplete.  */
+gpg_error_t gpgex_archive_write (const vector<string> &filenames, HANDLE out,
+                                 vector<string> &r_skipped);
+
+#endif /* GPGEX_ARCHIVE_H */
@@ -0,0 +1,144 @@
+/* breaker.c - circuit breaker for failing operations
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "breaker.h"
+
+
+/* Switch BREAKER to STATE.  Must be called with the lock held.  */
+static void
+set_state (gpgex_breaker_t breaker, gpgex_breaker_state_t state)
+{
+  gpgex_breaker_state_t old = breaker->state;
+
+  if (old == state)
+    return;
+  breaker->state = state;
+  if (breaker->notify)
+    breaker->notify (old, state, breaker->failures, breaker->cooldown);
+}
+
+
+int
+gpgex_breaker_allow (gpgex_breaker_t breaker, uint64_t now)
+{
+  int allowed = 0;
+
+  gpgrt_lock_lock (&breaker->lock);
+  switch (breaker->state)
+    {
+    case GPGEX_BREAKER_CLOSED:
+      allowed = 1;
+      break;
+
+    case GPGEX_BREAKER_OPEN:
+      if (now - breaker->opened_at >= breaker->cooldown)
+        {
+          breaker->probing = 1;
+          set_state (breaker, GPGEX_BREAKER_HALF_OPEN);
+          allowed = 1;
+        }
+      break;
+
+    case GPGEX_BREAKER_HALF_OPEN:
+      /* Only one probe at a time.  */
+      if (!breaker->probing)
+        {
+          breaker->probing = 1;
+          allowed = 1;
+        }
+      break;
+    }
+  gpgrt_lock_unlock (&breaker->lock);
+
+  return allowed;
+}
+
+
+void
+gpgex_breaker_success (gpgex_breaker_t breaker)
+{
+  gpgrt_lock_lock (&breaker->lock);
+  breaker->failures = 0;
+  breaker->probing = 0;
+  breaker->cooldown = breaker->min_cooldown;
+  set_state (breaker, GPGEX_BREAKER_CLOSED);
+  gpgrt_lock_unlock (&breaker->lock);
+}
+
+
+void
+gpgex_breaker_failure (gpgex_breaker_t breaker, uint64_t now)
+{
+  gpgrt_lock_lock (&breaker->lock);
+  breaker->failures++;
+  switch (breaker->state)
+    {
+    case GPGEX_BREAKER_CLOSED:
+      if (breaker->failures >= breaker->threshold)
+        {
+          breaker->opened_at = now;
+          set_state (breaker, GPGEX_BREAKER_OPEN);
+        }
+      break;
+
+    case GPGEX_BREAKER_HALF_OPEN:
+      breaker->probing = 0;
+      breaker->opened_at = now;
+      breaker->cooldown *= 2;
+      if (breaker->cooldown > breaker->max_cooldown)
+        breaker->cooldown = breaker->max_cooldown;
+      set_state (breaker, GPGEX_BREAKER_OPEN);
+      break;
+
+    case GPGEX_BREAKER_OPEN:
+      /* A request which was allowed before the breaker opened.  */
+      break;
+    }
+  gpgrt_lock_unlock (&breaker->lock);
+}
+
+
+gpgex_breaker_state_t
+gpgex_breaker_state (gpgex_breaker_t breaker)
+{
+  gpgex_breaker_state_t state;
+
+  gpgrt_lock_lock (&breaker->lock);
+  state = breaker->state;
+  gpgrt_lock_unlock (&breaker->lock);
+  return state;
+}
+
+
+const char *
+gpgex_breaker_state_name (gpgex_breaker_state_t state)
+{
+  switch (state)
+    {
+    case GPGEX_BREAKER_CLOSED:    return "closed";
+    case GPGEX_BREAKER_OPEN:      return "open";
+    case GPGEX_BREAKER_HALF_OPEN: return "half-open";
+    }
+  return "?";
+}
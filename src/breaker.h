@@ -0,0 +1,97 @@
+/* breaker.h - circuit breaker for failing operations
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#ifndef GPGEX_BREAKER_H
+#define GPGEX_BREAKER_H	1
+
+#include <stdint.h>
+
+#include <gpg-error.h>
+
+#ifdef __cplusplus
+extern "C" {
+#if 0
+}
+#endif
+#endif
+
+/* A circuit breaker remembers failures of an operation.  After
+   THRESHOLD consecutive failures it opens and requests are rejected
+   at once.  When the cool-down has passed one probe is let through
+   (half-open); its success closes the breaker, its failure opens it
+   again with a doubled cool-down up to MAX_COOLDOWN.  Times are in
+   microseconds and passed in by the caller.  */
+
+typedef enum
+  {
+    GPGEX_BREAKER_CLOSED,
+    GPGEX_BREAKER_OPEN,
+    GPGEX_BREAKER_HALF_OPEN
+  }
+gpgex_breaker_state_t;
+
+/* Called with the lock held on each state change.  */
+typedef void (*gpgex_breaker_notify_t) (gpgex_breaker_state_t oldstate,
+                                        gpgex_breaker_state_t newstate,
+                                        unsigned int failures,
+                                        uint64_t cooldown);
+
+struct gpgex_breaker_s
+{
+  gpgrt_lock_t lock;
+  unsigned int threshold;
+  uint64_t min_cooldown;
+  uint64_t max_cooldown;
+  gpgex_breaker_notify_t notify;
+
+  gpgex_breaker_state_t state;
+  unsigned int failures;	/* Consecutive failures.  */
+  uint64_t opened_at;		/* Time the breaker opened.  */
+  uint64_t cooldown;		/* The current cool-down.  */
+  int probing;			/* A half-open probe is running.  */
+};
+typedef struct gpgex_breaker_s *gpgex_breaker_t;
+
+#define GPGEX_BREAKER_INITIALIZER(threshold, min_cooldown, max_cooldown, \
+                                  notify)				\
+  { GPGRT_LOCK_INITIALIZER, (threshold), (min_cooldown),		\
+    (max_cooldown), (notify), GPGEX_BREAKER_CLOSED, 0, 0,		\
+    (min_cooldown), 0 }
+
+/* Return true if the operation may be tried at time NOW.  If it is,
+   the caller must report the outcome with gpgex_breaker_success or
+   gpgex_breaker_failure.  */
+int gpgex_breaker_allow (gpgex_breaker_t breaker, uint64_t now);
+
+void gpgex_breaker_success (gpgex_breaker_t breaker);
+void gpgex_breaker_failure (gpgex_breaker_t breaker, uint64_t now);
+
+/* Return the current state for diagnostics.  */
+gpgex_breaker_state_t gpgex_breaker_state (gpgex_breaker_t breaker);
+const char *gpgex_breaker_state_name (gpgex_breaker_state_t state);
+
+#ifdef __cplusplus
+#if 0
+{
+#endif
+}
+#endif
+
+#endif /* GPGEX_BREAKER_H */
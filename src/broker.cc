@@ -0,0 +1,329 @@
+/* broker.cc - interface to the GpgEX broker process
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <windows.h>
+#include <sddl.h>
+
+#include <gpg-error.h>
+
+#include "main.h"
+#include "exechelp.h"
+#include "broker.h"
+
+using std::vector;
+using std::string;
+
+/* Milliseconds to wait for the broker to accept a request.  The
+   Explorer thread is blocked meanwhile.  */
+#define BROKER_TIMEOUT 2000
+
+
+/* Return the user SID of the process PROCESS as malloced copy or
+   NULL.  */
+static PSID
+get_process_sid (HANDLE process)
+{
+  HANDLE token;
+  DWORD size = 0;
+  TOKEN_USER *user = NULL;
+  PSID sid = NULL;
+
+  if (!OpenProcessToken (process, TOKEN_QUERY, &token))
+    return NULL;
+  GetTokenInformation (token, TokenUser, NULL, 0, &size);
+  if (size)
+    user = (TOKEN_USER *) malloc (size);
+  if (user && GetTokenInformation (token, TokenUser, user, size, &size)
+      && IsValidSid (user->User.Sid))
+    {
+      size = GetLengthSid (user->User.Sid);
+      sid = (PSID) malloc (size);
+      if (sid && !CopySid (size, sid, user->User.Sid))
+        {
+          free (sid);
+          sid = NULL;
+        }
+    }
+  free (user);
+  CloseHandle (token);
+  return sid;
+}
+
+
+/* Return the string form of our user SID.  Release it with
+   LocalFree.  */
+static wchar_t *
+get_own_sid_string (void)
+{
+  PSID sid;
+  wchar_t *string = NULL;
+
+  sid = get_process_sid (GetCurrentProcess ());
+  if (sid && !ConvertSidToStringSidW (sid, &string))
+    string = NULL;
+  free (sid);
+  return string;
+}
+
+
+gpg_error_t
+gpgex_broker_pipe_name (wchar_t *buffer, size_t size)
+{
+  DWORD session = 0;
+  wchar_t *sid;
+  int n;
+
+  sid = get_own_sid_string ();
+  if (!sid)
+    return gpg_error (GPG_ERR_NO_USER_ID);
+  ProcessIdToSessionId (GetCurrentProcessId (), &session);
+  n = _snwprintf (buffer, size, L"\\\\.\\pipe\\gpgex-broker-%lu-%ls",
+                  (unsigned long) session, sid);
+  LocalFree (sid);
+  if (n < 0 || (size_t) n >= size)
+    return gpg_error (GPG_ERR_TOO_SHORT);
+  return 0;
+}
+
+
+PSECURITY_DESCRIPTOR
+gpgex_broker_pipe_sd (void)
+{
+  PSECURITY_DESCRIPTOR sd;
+  wchar_t *sid;
+  wchar_t sddl[256];
+  int n;
+
+  sid = get_own_sid_string ();
+  if (!sid)
+    return NULL;
+  /* A protected DACL with full access for the user only.  */
+  n = _snwprintf (sddl, sizeof sddl / sizeof *sddl, L"D:P(A;;GA;;;%ls)", sid);
+  LocalFree (sid);
+  if (n < 0 || (size_t) n >= sizeof sddl / sizeof *sddl)
+    return NULL;
+  if (!ConvertStringSecurityDescriptorToSecurityDescriptorW
+      (sddl, SDDL_REVISION_1, &sd, NULL))
+    return NULL;
+  return sd;
+}
+
+
+/* Return true if the server end of the pipe HD is owned by a process
+   running as our user.  */
+static int
+server_is_ours (HANDLE hd)
+{
+  ULONG pid;
+  HANDLE process;
+  PSID mysid, sid = NULL;
+  int result;
+
+  if (!GetNamedPipeServerProcessId (hd, &pid))
+    return 0;
+  process = OpenProcess (PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid);
+  if (!process)
+    return 0;
+  sid = get_process_sid (process);
+  CloseHandle (process);
+  mysid = get_process_sid (GetCurrentProcess ());
+  result = sid && mysid && EqualSid (sid, mysid);
+  free (sid);
+  free (mysid);
+  return result;
+}
+
+
+int
+gpgex_broker_enabled (void)
+{
+  static int enabled = -1;
+
+  if (enabled == -1)
+    {
+      char *value;
+
+      value = gpgrt_w32_reg_get_string ("\\Software\\Gpg4win:GpgEX Broker");
+      enabled = value && *value && *value != '0';
+      free (value);
+    }
+  return enabled;
+}
+
+
+/* Start the broker which is installed next to our DLL.  */
+static void
+start_broker (void)
+{
+  wchar_t wname[MAX_PATH];
+  char *dllname, *pgmname, *p;
+
+  if (!GetModuleFileNameW (gpgex_server::instance, wname, MAX_PATH))
+    return;
+  dllname = gpgrt_wchar_to_utf8 (wname);
+  if (!dllname)
+    return;
+  p = strrchr (dllname, '\\');
+  if (p)
+    {
+      *p = 0;
+      pgmname = gpgrt_fconcat (0, dllname, GPGEX_BROKER_PGMNAME, NULL);
+      if (pgmname)
+        {
+          if (gpgex_spawn_detached (pgmname, GPGEX_BROKER_PGMNAME))
+            _gpgex_debug (DEBUG_ASSUAN, "starting '%s' failed", pgmname);
+          free (pgmname);
+        }
+    }
+  free (dllname);
+}
+
+
+/* Run an overlapped read or write of LENGTH bytes at BUFFER on the
+   pipe HD with a timeout.  Returns the number of bytes transferred or
+   -1 on error.  */
+static int
+pipe_io (HANDLE hd, int writing, void *buffer, DWORD length)
+{
+  OVERLAPPED ov;
+  DWORD nbytes = 0;
+  BOOL ok;
+
+  memset (&ov, 0, sizeof ov);
+  ov.hEvent = CreateEvent (NULL, TRUE, FALSE, NULL);
+  if (!ov.hEvent)
+    return -1;
+
+  if (writing)
+    ok = WriteFile (hd, buffer, length, NULL, &ov);
+  else
+    ok = ReadFile (hd, buffer, length, NULL, &ov);
+  if (!ok && GetLastError () != ERROR_IO_PENDING)
+    {
+      CloseHandle (ov.hEvent);
+      return -1;
+    }
+  if (WaitForSingleObject (ov.hEvent, BROKER_TIMEOUT) != WAIT_OBJECT_0)
+    {
+      CancelIo (hd);
+      GetOverlappedResult (hd, &ov, &nbytes, TRUE);
+      CloseHandle (ov.hEvent);
+      return -1;
+    }
+  ok = GetOverlappedResult (hd, &ov, &nbytes, FALSE);
+  CloseHandle (ov.hEvent);
+  return ok ? (int) nbytes : -1;
+}
+
+
+gpg_error_t
+gpgex_broker_submit (const char *cmd, const vector<string> &filenames,
+                     HWND wid)
+{
+  wchar_t pipename[GPGEX_BROKER_PIPE_NAME_SIZE];
+  gpg_error_t err;
+  HANDLE hd;
+  ULONG pid;
+  string request;
+  char buffer[64];
+  int n;
+
+  TRACE_BEG (DEBUG_ASSUAN, "gpgex_broker_submit", cmd,
+             "%u files", (unsigned int) filenames.size ());
+
+  err = gpgex_broker_pipe_name (pipename,
+                                sizeof pipename / sizeof *pipename);
+  if (err)
+    return TRACE_GPGERR (err);
+  hd = CreateFileW (pipename, GENERIC_READ | GENERIC_WRITE, 0, NULL,
+                    OPEN_EXISTING, FILE_FLAG_OVERLAPPED, NULL);
+  if (hd == INVALID_HANDLE_VALUE && GetLastError () == ERROR_PIPE_BUSY
+      && WaitNamedPipeW (pipename, 100))
+    hd = CreateFileW (pipename, GENERIC_READ | GENERIC_WRITE, 0, NULL,
+                      OPEN_EXISTING, FILE_FLAG_OVERLAPPED, NULL);
+  if (hd == INVALID_HANDLE_VALUE)
+    {
+      /* Start the broker for the next request; this one is run by
+         ourself.  */
+      if (GetLastError () == ERROR_FILE_NOT_FOUND)
+        start_broker ();
+      (void) TRACE_LOG ("broker not available: ec=%d",
+                        (int) GetLastError ());
+      return TRACE_GPGERR (gpg_error (GPG_ERR_NO_SERVICE));
+    }
+
+  /* Anyone may create a pipe with this name first.  */
+  if (!server_is_ours (hd))
+    {
+      (void) TRACE_LOG ("the broker pipe is owned by another user");
+      CloseHandle (hd);
+      return TRACE_GPGERR (gpg_error (GPG_ERR_EPERM));
+    }
+
+  /* We are the foreground process; pass this right on to the broker
+     so that it can pass it on to the UI server.  */
+  if (GetNamedPipeServerProcessId (hd, &pid))
+    AllowSetForegroundWindow (pid);
+
+  snprintf (buffer, sizeof buffer, "WID %lx\n",
+            (unsigned long) (uintptr_t) wid);
+  request = GPGEX_BROKER_VERSION_LINE "\n";
+  request += buffer;
+  request += "CMD ";
+  request += cmd;
+  request += "\n";
+  for (unsigned int i = 0; i < filenames.size (); i++)
+    {
+      if (filenames[i].find ('\n') != string::npos)
+        {
+          CloseHandle (hd);
+          return TRACE_GPGERR (gpg_error (GPG_ERR_INV_NAME));
+        }
+      request += "FILE " + filenames[i] + "\n";
+    }
+  request += "END\n";
+
+  if (pipe_io (hd, 1, (void *) request.data (), request.size ())
+      != (int) request.size ()
+      || (n = pipe_io (hd, 0, buffer, sizeof buffer - 1)) <= 0)
+    {
+      (void) TRACE_LOG ("talking to the broker failed: ec=%d",
+                        (int) GetLastError ());
+      CloseHandle (hd);
+      return TRACE_GPGERR (gpg_error (GPG_ERR_EIO));
+    }
+  CloseHandle (hd);
+
+  buffer[n] = 0;
+  if (strncmp (buffer, "OK", 2))
+    {
+      (void) TRACE_LOG ("broker replied: %s", buffer);
+      return TRACE_GPGERR (gpg_error (GPG_ERR_GENERAL));
+    }
+  return TRACE_GPGERR (0);
+}
@@ -0,0 +1,77 @@
+/* broker.h - interface to the GpgEX broker process
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#ifndef GPGEX_BROKER_H
+#define GPGEX_BROKER_H	1
+
+#include <vector>
+#include <string>
+
+#include <windows.h>
+
+#include <gpg-error.h>
+
+/* The optional broker process runs the operations for all Explorer
+   and file dialog processes of a session, so that connections to the
+   UI server, worker threads and error dialogs are kept out of the
+   Explorer.  The DLL sends a request over a named pipe:
+
+     GPGEX-BROKER 1
+     WID <window handle in hex>
+     CMD <UI server command>
+     FILE <utf-8 file name>      (zero or more times)
+     END
+
+   and the broker answers "OK" once the request has been queued or
+   "ERR <gpg error code>".  File names can't contain line feeds.
+
+   The name of the pipe contains the session and the SID of the user
+   and only the user has access to it.  Because any user can create a
+   pipe of any name, the DLL also checks that the server process runs
+   as the same user before it sends anything.  */
+
+#define GPGEX_BROKER_VERSION_LINE "GPGEX-BROKER 1"
+
+/* The name of the executable which is installed next to the DLL.  */
+#define GPGEX_BROKER_PGMNAME "gpgex-broker.exe"
+
+/* The size in wide characters of a buffer for the pipe name.  */
+#define GPGEX_BROKER_PIPE_NAME_SIZE 256
+
+/* Store the name of the broker pipe for this session and user at
+   BUFFER which has room for SIZE wide characters.  Returns 0 on
+   success.  */
+gpg_error_t gpgex_broker_pipe_name (wchar_t *buffer, size_t size);
+
+/* Return a security descriptor for the broker pipe which grants
+   access only to the current user or NULL on error.  Release it with
+   LocalFree.  */
+PSECURITY_DESCRIPTOR gpgex_broker_pipe_sd (void);
+
+/* Return true if the broker is to be used.  */
+int gpgex_broker_enabled (void);
+
+/* Hand CMD on FILENAMES to the broker.  On error the caller shall run
+   the command itself.  */
+gpg_error_t gpgex_broker_submit (const char *cmd,
+                                 const std::vector<std::string> &filenames,
+                                 HWND wid);
+
+#endif /* GPGEX_BROKER_H */
@@ -22,12 +22,15 @@
 #include <config.h>
 #endif
 
+#include <string.h>
+
 #include <vector>
 #include <string>
 #include <stdexcept>
 
 using std::vector;
 using std::string;
+using std::wstring;
 
 #include <winsock2.h>
 #include <windows.h>
@@ -36,6 +39,17 @@ using std::string;
 
 #include "main.h"
 #include "exechelp.h"
+#include "stats.h"
+#include "profile.h"
+#include "homedir.h"
+#include "breaker.h"
+#include "broker.h"
+#include "planner.h"
+#include "archive.h"
+#include "sigpair.h"
+#include "pathclass.h"
+#include "metacache.h"
+#include "preflight.h"
 
 #include "client.h"
 
@@ -49,136 +63,263 @@ _gpgex_stpcpy (char *a, const char *b)
 }
 #define stpcpy(a,b) _gpgex_stpcpy ((a), (b))
 
+/* The time in milliseconds to wait for a newly started UI server.  */
+#define LAUNCH_TIMEOUT 10000
+
+/* After this many failed attempts to start the UI server, further
+   attempts are rejected for a cool-down period which starts at 30
+   seconds and doubles up to 5 minutes.  */
+#define LAUNCH_BREAKER_THRESHOLD 2
+#define LAUNCH_BREAKER_COOLDOWN  (30 * 1000000ULL)
+#define LAUNCH_BREAKER_MAX       (300 * 1000000ULL)
 
 
 
 /* Find the gpgconf binary which is used to return installation
  * properties of the GnuPG system.  We avoid linking to gpgme to avoid
- * its overhead.  Instead we call gpgconf direcly.  */
-static const char *
-get_gpgconf_name (void)
+ * its overhead.  Instead we call gpgconf direcly.  Returns a malloced
+ * string or NULL.  */
+static char *
+find_gpgconf (const char *installdir)
 {
-  static int tried;
-  static char *name;
+  const char **tmp;
+  char *name;
+  const char *possible_names[] =
+    {
+      "GnuPG/bin/gpgconf.exe",    /* GnuPG-[VS-]Desktop */
+      "../GnuPG/bin/gpgconf.exe", /* Gpg4win.  */
+      "bin/gpgconf.exe",          /* Legacy */
+      NULL
+    };
 
-  if (!tried)
+  for (tmp = possible_names; *tmp; tmp++)
     {
-      const char **tmp;
-      const char *possible_names[] =
-        {
-          "GnuPG/bin/gpgconf.exe",    /* GnuPG-[VS-]Desktop */
-          "../GnuPG/bin/gpgconf.exe", /* Gpg4win.  */
-          "bin/gpgconf.exe",          /* Legacy */
-         NULL
-        };
+      name = gpgrt_fconcat (0, installdir, *tmp, NULL);
+      if (!name)
+        return NULL; /* Ooops.  */
+      if (!gpgrt_access (name, F_OK))
+        return name; /* Found.  */
+      free (name);
+    }
+
+  return NULL;
+}
+
 
-      tried = 1;
+/* Find the UI-server below INSTALLDIR.  Returns a malloced string
+   with the name and stores the type of the server at R_TYPE, or
+   returns NULL.  */
+static char *
+find_uiserver (const char *installdir, const char **r_type)
+{
+  const char **tmp;
+  char *name, *p;
+  const char *server_names[] = {
+#ifndef ENABLE_GPA_ONLY
+                                 "bin/kleopatra.exe",
+#endif
+                                 "bin/launch-gpa.exe",
+                                 "bin/gpa.exe",
+#ifndef ENABLE_GPA_ONLY
+                                 "kleopatra.exe",
+#endif
+                                 "launch-gpa.exe",
+                                 "gpa.exe",
+                                 NULL};
 
-      for (tmp = possible_names; *tmp; tmp++)
+  *r_type = NULL;
+  for (tmp = server_names; *tmp; tmp++)
+    {
+      name = gpgrt_fconcat (0, installdir, *tmp, NULL);
+      if (!name)
+        return NULL;
+      if (!gpgrt_access (name, F_OK))
         {
-          name = gpgrt_fconcat (0, get_gpg4win_dir (), *tmp, NULL);
-          if (!name)
-            return NULL; /* Ooops.  */
-          if (!gpgrt_access (name, F_OK))
-              return name; /* Found.  */
-          free (name);
-          name = NULL;
+          /* Found a viable candidate */
+          if (strstr (name, "kleopatra.exe"))
+            *r_type = "Kleopatra";
+          else
+            *r_type = "GPA";
+          for (p = name; *p; p++)
+            if (*p == '/')
+              *p = '\\';
+          return name;
         }
+      free (name);
     }
 
-  return name;
+  return NULL;
 }
 
 
-static const char *
-default_socket_name (void)
+/* Ask GPGCONF for the socket directory.  Returns a malloced string
+   or NULL.  */
+static char *
+query_socketdir (const char *gpgconf)
 {
-  static int tried;
-  static char *name;
+  char *dir;
+
+  if (gpgex_spawn_get_string (gpgconf, "gpgconf -0 --list-dirs socketdir",
+                              &dir))
+    return NULL;
 
-  if (!tried)
+  _gpgex_debug (DEBUG_INIT, "  got dir '%s'", dir);
+  if (!*dir)
     {
-      const char *gpgconf;
-      char *dir;
-      const char sockname[] = "\\S.uiserver";
+      free (dir);
+      return NULL;
+    }
+  return dir;
+}
 
-      tried = 1;
-      gpgconf = get_gpgconf_name ();
-      if (!gpgconf)
-        return NULL;
 
-      if (gpgex_spawn_get_string (gpgconf, "gpgconf -0 --list-dirs socketdir",
-                                  &dir))
-        return NULL;
+/* Return the socket directory for GPGCONF of the GnuPG VERSION.  It
+   is computed directly if possible; only unusual configurations and
+   unknown versions need to run gpgconf.  With init debugging enabled
+   both ways are used and compared and gpgconf wins.  */
+static char *
+resolve_socketdir (const char *gpgconf, const char *version)
+{
+  char *dir;
 
-      _gpgex_debug (DEBUG_INIT, "  got dir '%s'", dir);
-      name = (char *)malloc (strlen (dir) + strlen (sockname) + 1);
-      if (name)
-        strcpy (stpcpy (name, dir), sockname);
-      _gpgex_debug (DEBUG_INIT, "  using socket name '%s'", name? name: "(null)");
-      free (dir);
+  dir = gpgex_native_socketdir (gpgconf, gpgex_parse_gnupg_version (version));
+  if (!dir)
+    {
+      gpgex_stats_inc (GPGEX_STAT_SOCKETDIR_GPGCONF);
+      return query_socketdir (gpgconf);
     }
+  gpgex_stats_inc (GPGEX_STAT_SOCKETDIR_NATIVE);
+
+  if (_gpgex_trace_enabled (DEBUG_INIT))
+    {
+      char *check = query_socketdir (gpgconf);
 
-  return name;
+      if (check && strcasecmp (check, dir))
+        {
+          _gpgex_debug (DEBUG_INIT, "  socketdir mismatch: native '%s'"
+                        " gpgconf '%s' (version %s)", dir, check,
+                        version ? version : "unknown");
+          free (dir);
+          dir = check;
+        }
+      else
+        free (check);
+    }
+  return dir;
 }
 
 
-/* Return the name of the default UI server.  This name is used to
-   auto start an UI server if an initial connect failed.  */
-static const char *
-default_uiserver_name (void)
+/* The installation profile.  It is resolved only once per process
+   and, if possible, taken from the profile cache.  */
+static gpgex_profile_t profile;
+static int profile_tried;
+static char *socket_name;
+GPGRT_LOCK_DEFINE (profile_lock);
+
+static gpgex_profile_t
+get_profile (void)
 {
-  static char *name;
+  gpgex_profile_t result;
 
-  if (!name)
+  gpgrt_lock_lock (&profile_lock);
+  if (!profile_tried)
     {
-      const char **tmp;
-      char *p;
-      const char *server_names[] = {
-#ifndef ENABLE_GPA_ONLY
-                                     "bin/kleopatra.exe",
-#endif
-                                     "bin/launch-gpa.exe",
-                                     "bin/gpa.exe",
-#ifndef ENABLE_GPA_ONLY
-                                     "kleopatra.exe",
-#endif
-                                     "launch-gpa.exe",
-                                     "gpa.exe",
-                                     NULL};
+      const char *installdir = get_gpg4win_dir ();
+      const char *type;
+      uint64_t start;
 
-      for (tmp = server_names; *tmp; tmp++)
+      TRACE_BEG (DEBUG_INIT, "client_t::get_profile", installdir);
+
+      profile_tried = 1;
+      start = gpgex_stats_now ();
+      if (!gpgex_profile_load (installdir, &profile))
+        {
+          gpgex_stats_inc (GPGEX_STAT_PROFILE_CACHE_HITS);
+          gpgex_stats_hist (GPGEX_HIST_PROFILE_CACHED,
+                            gpgex_stats_now () - start);
+          (void) TRACE_LOG ("cached profile used (%lu usec)",
+                            (unsigned long) (gpgex_stats_now () - start));
+        }
+      else if (installdir
+               && (profile = (gpgex_profile_t) calloc (1, sizeof *profile)))
         {
-          free (name);
-          name = gpgrt_fconcat (0, get_gpg4win_dir (), *tmp, NULL);
-          if (!name)
-            return NULL;
-          if (!gpgrt_access (name, F_OK))
+          gpgex_stats_inc (GPGEX_STAT_PROFILE_CACHE_MISSES);
+          profile->installdir = strdup (installdir);
+          profile->gpgconf = find_gpgconf (installdir);
+          if (profile->gpgconf)
             {
-              /* Found a viable candidate */
-              /* Set through registry and is accessible */
-              if (strstr (name, "kleopatra.exe"))
-                {
-                  gpgex_server::ui_server = "Kleopatra";
-                }
-              else
-                {
-                  gpgex_server::ui_server = "GPA";
-                }
-              for (p = name; *p; p++)
-                if (*p == '/')
-                  *p = '\\';
-              return name;
+              profile->gnupg_version
+                = gpgex_gnupg_file_version (profile->gpgconf);
+              profile->socketdir = resolve_socketdir (profile->gpgconf,
+                                                      profile->gnupg_version);
             }
+          profile->uiserver = find_uiserver (installdir, &type);
+          if (type)
+            profile->uiserver_type = strdup (type);
+          gpgex_stats_hist (GPGEX_HIST_PROFILE_UNCACHED,
+                            gpgex_stats_now () - start);
+          (void) TRACE_LOG ("profile resolved without cache (%lu usec)",
+                            (unsigned long) (gpgex_stats_now () - start));
+          if (profile->installdir && profile->gpgconf && profile->socketdir)
+            gpgex_profile_store (profile);
+        }
+
+      if (profile && profile->socketdir)
+        {
+          const char sockname[] = "\\S.uiserver";
+
+          socket_name = (char *) malloc (strlen (profile->socketdir)
+                                         + strlen (sockname) + 1);
+          if (socket_name)
+            strcpy (stpcpy (socket_name, profile->socketdir), sockname);
         }
+      _gpgex_debug (DEBUG_INIT, "  using socket name '%s'",
+                    socket_name? socket_name : "(null)");
+      (void) TRACE_SUC ();
+    }
+  result = profile;
+  gpgrt_lock_unlock (&profile_lock);
+
+  return result;
+}
+
+
+static const char *
+default_socket_name (void)
+{
+  get_profile ();
+  return socket_name;
+}
+
+
+const char *
+client_gpgconf_name (void)
+{
+  gpgex_profile_t prof = get_profile ();
+
+  return prof ? prof->gpgconf : NULL;
+}
+
+
+/* Return the name of the default UI server.  This name is used to
+   auto start an UI server if an initial connect failed.  */
+static const char *
+default_uiserver_name (void)
+{
+  gpgex_profile_t prof = get_profile ();
+
+  if (!prof || !prof->uiserver)
+    {
       gpgex_server::ui_server = NULL;
+      return NULL;
     }
 
-  return name;
+  gpgex_server::ui_server = prof->uiserver_type;
+  return prof->uiserver;
 }
 
 
-
+
 #define tohex_lower(n) ((n) < 10 ? ((n) + '0') : (((n) - 10) + 'a'))
 
 /* Percent-escape the string STR by replacing colons with '%3a'.  If
@@ -294,7 +435,8 @@ send_options (assuan_context_t ctx, HWND hwnd, pid_t *r_pid)
   if (! rc && *r_pid != (pid_t) (-1)
       && ! AllowSetForegroundWindow (*r_pid))
     {
-      (void) TRACE_LOG ("AllowSetForegroundWindow (%u) failed");
+      (void) TRACE_LOG ("AllowSetForegroundWindow (%u) failed",
+                        (unsigned int) *r_pid);
       TRACE_RES (HRESULT_FROM_WIN32 (GetLastError ()));
 
       /* Ignore the error, though.  */
@@ -319,14 +461,151 @@ send_options (assuan_context_t ctx, HWND hwnd, pid_t *r_pid)
 }
 
 
+/* Try to connect CTX to SOCKET_NAME for at most TIMEOUT milliseconds.
+   The delay between the attempts grows from 50 ms to one second so
+   that a quickly starting server is not kept waiting.  */
 static gpg_error_t
-uiserver_connect (assuan_context_t *ctx, HWND hwnd)
+connect_with_retries (assuan_context_t ctx, const char *socket_name,
+                      unsigned int timeout)
+{
+  DWORD start = GetTickCount ();
+  DWORD delay = 50;
+  gpg_error_t rc;
+
+  for (;;)
+    {
+      rc = assuan_socket_connect (ctx, socket_name, -1, 0);
+      if (!rc || GetTickCount () - start >= timeout)
+        return rc;
+      Sleep (delay);
+      if (delay < 1000)
+        delay *= 2;
+    }
+}
+
+
+/* Start PROGRAM with CMDLINE and connect CTX to SOCKET_NAME.  This is
+   the old way of starting the server; it is used if the launch
+   coordinator is not available.  */
+static gpg_error_t
+uiserver_spawn_locked (assuan_context_t ctx, const char *socket_name,
+                       const char *program, const char *cmdline)
 {
   gpg_error_t rc;
-  const char *socket_name = NULL;
-  pid_t pid;
   lock_spawn_t lock;
 
+  /* Now try to connect again with the spawn lock taken.  */
+  if (!(rc = gpgex_lock_spawning (&lock))
+      && assuan_socket_connect (ctx, socket_name, -1, 0))
+    {
+      rc = gpgex_spawn_detached (program, cmdline);
+      if (!rc)
+        rc = connect_with_retries (ctx, socket_name, LAUNCH_TIMEOUT);
+    }
+  gpgex_unlock_spawning (&lock);
+
+  return rc;
+}
+
+
+/* Start the UI server PROGRAM with CMDLINE and connect CTX to
+   SOCKET_NAME.  Only one client starts the server; other clients
+   wait until it is ready and connect at once.  */
+static gpg_error_t
+uiserver_launch (assuan_context_t ctx, const char *socket_name,
+                 const char *program, const char *cmdline)
+{
+  gpg_error_t rc;
+  gpgex_launch_t launch;
+  int launcher;
+  uint64_t start;
+
+  TRACE_BEG (DEBUG_ASSUAN, "client_t::uiserver_launch", ctx);
+
+  if (!program)
+    {
+      (void) TRACE_LOG ("no UI server installed");
+      return TRACE_GPGERR (gpg_error (GPG_ERR_NOT_FOUND));
+    }
+
+  start = gpgex_stats_now ();
+  rc = gpgex_launch_begin (&launch, &launcher);
+  if (rc)
+    return TRACE_GPGERR (uiserver_spawn_locked (ctx, socket_name,
+                                                program, cmdline));
+
+  if (!launcher)
+    {
+      rc = gpgex_launch_wait (launch, LAUNCH_TIMEOUT, &launcher);
+      if (!rc && !launcher)
+        {
+          rc = assuan_socket_connect (ctx, socket_name, -1, 0);
+          if (rc)
+            {
+              /* Signalled but not reachable; maybe the server
+                 terminated right away.  */
+              (void) TRACE_LOG ("server ready but connect failed");
+              gpgex_launch_release (launch);
+              rc = uiserver_spawn_locked (ctx, socket_name,
+                                          program, cmdline);
+              return TRACE_GPGERR (rc);
+            }
+        }
+      else if (rc)
+        {
+          (void) TRACE_LOG ("waiting for the launcher failed");
+          gpgex_launch_release (launch);
+          rc = uiserver_spawn_locked (ctx, socket_name, program, cmdline);
+          return TRACE_GPGERR (rc);
+        }
+    }
+
+  if (launcher)
+    {
+      /* Another client may have started the server meanwhile.  */
+      rc = assuan_socket_connect (ctx, socket_name, -1, 0);
+      if (rc)
+        {
+          rc = gpgex_spawn_detached (program, cmdline);
+          if (!rc)
+            rc = connect_with_retries (ctx, socket_name, LAUNCH_TIMEOUT);
+        }
+      gpgex_launch_done (launch, !rc);
+    }
+  gpgex_launch_release (launch);
+
+  if (!rc)
+    gpgex_stats_hist (GPGEX_HIST_LAUNCH, gpgex_stats_now () - start);
+  (void) TRACE_LOG ("launcher=%d", launcher);
+  return TRACE_GPGERR (rc);
+}
+
+
+static void
+launch_breaker_notify (gpgex_breaker_state_t oldstate,
+                       gpgex_breaker_state_t newstate,
+                       unsigned int failures, uint64_t cooldown)
+{
+  _gpgex_debug (DEBUG_ASSUAN, "UI server launch breaker: %s -> %s "
+                "(failures=%u cooldown=%lus)",
+                gpgex_breaker_state_name (oldstate),
+                gpgex_breaker_state_name (newstate),
+                failures, (unsigned long) (cooldown / 1000000));
+}
+
+/* Process wide record of failures to start the UI server.  */
+static struct gpgex_breaker_s launch_breaker =
+  GPGEX_BREAKER_INITIALIZER (LAUNCH_BREAKER_THRESHOLD,
+                             LAUNCH_BREAKER_COOLDOWN, LAUNCH_BREAKER_MAX,
+                             launch_breaker_notify);
+
+
+static gpg_error_t
+uiserver_connect (assuan_context_t *ctx, HWND hwnd, pid_t *r_pid)
+{
+  gpg_error_t rc;
+  const char *socket_name = NULL;
+
   TRACE_BEG (DEBUG_ASSUAN, "client_t::uiserver_connect", ctx);
 
   socket_name = default_socket_name ();
@@ -336,7 +615,7 @@ uiserver_connect (assuan_context_t *ctx, HWND hwnd)
       return TRACE_GPGERR (gpg_error (GPG_ERR_INV_ARG));
     }
 
-  (void) TRACE_LOG1 ("socket name: %s", socket_name);
+  (void) TRACE_LOG ("socket name: %s", socket_name);
   rc = assuan_new (ctx);
   if (rc)
     {
@@ -347,8 +626,6 @@ uiserver_connect (assuan_context_t *ctx, HWND hwnd)
   rc = assuan_socket_connect (*ctx, socket_name, -1, 0);
   if (rc)
     {
-      int count;
-
       (void) TRACE_LOG ("UI server not running, starting it");
       const char *cmdline = NULL;
       const char *program = default_uiserver_name ();
@@ -359,26 +636,27 @@ uiserver_connect (assuan_context_t *ctx, HWND hwnd)
           cmdline = "--daemon";
         }
 
-      /* Now try to connect again with the spawn lock taken.  */
-      if (!(rc = gpgex_lock_spawning (&lock))
-          && assuan_socket_connect (*ctx, socket_name, -1, 0))
+      if (!gpgex_breaker_allow (&launch_breaker, gpgex_stats_now ()))
         {
-          rc = gpgex_spawn_detached (program, cmdline);
-          if (!rc)
-            {
-              /* Give it a bit of time to start up and try a couple of
-                 times.  */
-              for (count = 0; count < 10; count++)
-                {
-                  Sleep (1000);
-                  rc = assuan_socket_connect (*ctx, socket_name, -1, 0);
-                  if (!rc)
-                    break;
-                }
-            }
-
+          (void) TRACE_LOG ("UI server failed to start recently, not trying");
+          gpgex_stats_inc (GPGEX_STAT_LAUNCH_REJECTS);
+          rc = gpg_error (GPG_ERR_NOT_OPERATIONAL);
         }
-      gpgex_unlock_spawning (&lock);
+      else
+        {
+          rc = uiserver_launch (*ctx, socket_name, program, cmdline);
+          if (rc)
+            gpgex_breaker_failure (&launch_breaker, gpgex_stats_now ());
+          else
+            gpgex_breaker_success (&launch_breaker);
+        }
+    }
+  else
+    {
+      /* The server is running, maybe started by other means.  This
+         ends a run of failed launches even while the breaker is
+         closed, since only consecutive failures may open it.  */
+      gpgex_breaker_success (&launch_breaker);
     }
 
   if (! rc)
@@ -386,7 +664,7 @@ uiserver_connect (assuan_context_t *ctx, HWND hwnd)
       if (debug_flags & DEBUG_ASSUAN)
 	assuan_set_log_stream (*ctx, debug_file);
 
-      rc = send_options (*ctx, hwnd, &pid);
+      rc = send_options (*ctx, hwnd, r_pid);
       if (rc)
 	{
 	  assuan_release (*ctx);
@@ -397,127 +675,1537 @@ uiserver_connect (assuan_context_t *ctx, HWND hwnd)
   return TRACE_GPGERR (rc);
 }
 
-typedef struct async_arg
+/* The commands we use.  Bit N of server_caps_s.commands is set if
+   the server supports command N.  */
+static const char *const uiserver_commands[] =
+  {
+    "DECRYPT_VERIFY_FILES",
+    "DECRYPT_FILES",
+    "VERIFY_FILES",
+    "ENCRYPT_SIGN_FILES",
+    "ENCRYPT_FILES",
+    "SIGN_FILES",
+    "IMPORT_FILES",
+    "CHECKSUM_CREATE_FILES",
+    "CHECKSUM_VERIFY_FILES",
+    "PREP_ENCRYPT",
+    "ENCRYPT",
+    NULL
+  };
+
+/* What we know about a UI server instance.  */
+struct server_caps_s
 {
-  const char *cmd;
-  vector<string> filenames;
-  HWND wid;
-} async_arg_t;
+  pid_t pid;
+  char version[64];
+  int have_help;		/* The server answers HELP <cmd>.  */
+  unsigned int commands;	/* Supported commands.  */
+};
+
+/* The capabilities of the last few UI server instances; a restarted
+   server gets a new PID and is probed again.  */
+#define CAPS_CACHE_SIZE 4
+static struct server_caps_s caps_cache[CAPS_CACHE_SIZE];
+static unsigned int caps_cache_next;
+GPGRT_LOCK_DEFINE (caps_lock);
+
+/* Number of files from which on the FILE commands are pipelined and
+   the number of commands sent before reading the responses.  */
+#define PIPELINE_MIN_FILES 8
+#define PIPELINE_WINDOW 64
+
+/* Sharding of large selections: the maximum number of shards, the
+   minimum number of files and the cost of a file in addition to its
+   size.  */
+#define MAX_SHARDS 16
+#define SHARD_MIN_FILES 16
+#define SHARD_PER_FILE_COST (64 * 1024)
 
-static DWORD WINAPI
-call_assuan_async (LPVOID arg)
+
+static gpg_error_t
+getinfo_version_cb (void *opaque, const void *buffer, size_t length)
 {
-  async_arg_t *async_args = (async_arg_t *)arg;
-  int rc = 0;
-  int connect_failed = 0;
-  const char *cmd = async_args->cmd;
-  const vector<string> filenames = async_args->filenames;
+  struct server_caps_s *caps = (struct server_caps_s *) opaque;
+  size_t n = strlen (caps->version);
 
-  assuan_context_t ctx = NULL;
-  string msg;
+  if (length > sizeof caps->version - 1 - n)
+    length = sizeof caps->version - 1 - n;
+  memcpy (caps->version + n, buffer, length);
+  caps->version[n + length] = 0;
+  return 0;
+}
 
-  TRACE_BEG2 (DEBUG_ASSUAN, "client_t::call_assuan_async", 0,
-              "%s on %u files", cmd, filenames.size ());
 
-  rc = uiserver_connect (&ctx, async_args->wid);
-  if (rc)
+/* Ask the server at CTX with PID for its capabilities.  */
+static void
+probe_server_caps (assuan_context_t ctx, pid_t pid,
+                   struct server_caps_s *caps)
+{
+  char line[64];
+  int i;
+
+  TRACE_BEG (DEBUG_ASSUAN, "client_t::probe_server_caps", ctx,
+             "pid=%lu", (unsigned long) pid);
+
+  memset (caps, 0, sizeof *caps);
+  caps->pid = pid;
+  gpgex_stats_inc (GPGEX_STAT_CAPS_PROBES);
+
+  assuan_transact (ctx, "GETINFO version", getinfo_version_cb, caps,
+                   NULL, NULL, NULL, NULL);
+
+  /* A server without HELP is assumed to support all commands.  Only
+     an explicit "unknown command" marks a command as unsupported.  */
+  caps->have_help = !assuan_transact (ctx, "HELP GETINFO",
+                                      NULL, NULL, NULL, NULL, NULL, NULL);
+  for (i = 0; uiserver_commands[i]; i++)
     {
-      connect_failed = 1;
-      goto leave;
+      snprintf (line, sizeof line, "HELP %s", uiserver_commands[i]);
+      if (!caps->have_help
+          || gpg_err_code (assuan_transact (ctx, line, NULL, NULL, NULL,
+                                            NULL, NULL, NULL))
+             != GPG_ERR_UNKNOWN_COMMAND)
+        caps->commands |= 1 << i;
     }
 
-    /* Set the input files.  We don't specify the output files.  */
-    for (unsigned int i = 0; i < filenames.size (); i++)
-      {
-        msg = "FILE " + escape (filenames[i]);
+  (void) TRACE_SUC ("version='%s' help=%d commands=%#x",
+                    caps->version, caps->have_help, caps->commands);
+}
+
 
-        (void) TRACE_LOG1 ("sending cmd: %s", msg.c_str ());
+/* Store the capabilities of the server at CTX with PID at R_CAPS.
+   They are probed only once per server instance.  */
+static void
+get_server_caps (assuan_context_t ctx, pid_t pid,
+                 struct server_caps_s *r_caps)
+{
+  unsigned int i;
 
-        rc = assuan_transact (ctx, msg.c_str (),
-                              NULL, NULL, NULL, NULL, NULL, NULL);
-        if (rc)
-          goto leave;
+  gpgrt_lock_lock (&caps_lock);
+  for (i = 0; i < CAPS_CACHE_SIZE; i++)
+    if (caps_cache[i].pid == pid && pid != (pid_t) (-1) && pid)
+      {
+        *r_caps = caps_cache[i];
+        gpgrt_lock_unlock (&caps_lock);
+        return;
       }
+  gpgrt_lock_unlock (&caps_lock);
 
-    /* Set the --nohup option, so that the operation continues and
-       completes in the background.  */
-    msg = ((string) cmd) + " --nohup";
-    (void) TRACE_LOG1 ("sending cmd: %s", msg.c_str ());
-    rc = assuan_transact (ctx, msg.c_str (),
-                          NULL, NULL, NULL, NULL, NULL, NULL);
+  probe_server_caps (ctx, pid, r_caps);
 
-  /* Fall-through.  */
- leave:
-  TRACE_GPGERR (rc);
-  if (ctx)
-    assuan_release (ctx);
-  if (rc)
+  gpgrt_lock_lock (&caps_lock);
+  caps_cache[caps_cache_next++ % CAPS_CACHE_SIZE] = *r_caps;
+  gpgrt_lock_unlock (&caps_lock);
+}
+
+
+/* Return true if the server with CAPS supports CMD.  */
+static int
+server_has_command (const struct server_caps_s *caps, const char *cmd)
+{
+  int i;
+
+  for (i = 0; uiserver_commands[i]; i++)
+    if (!strcmp (uiserver_commands[i], cmd))
+      return !!(caps->commands & (1 << i));
+  return 1;  /* Not known to us; let the server decide.  */
+}
+
+
+/* Read the response to a command sent with assuan_write_line.  */
+static gpg_error_t
+read_response (assuan_context_t ctx)
+{
+  gpg_error_t rc;
+  char *line;
+  size_t len;
+
+  for (;;)
     {
-      char buf[256];
+      rc = assuan_read_line (ctx, &line, &len);
+      if (rc)
+        return rc;
+      if (len >= 2 && line[0] == 'O' && line[1] == 'K'
+          && (len == 2 || line[2] == ' '))
+        return 0;
+      if (len >= 3 && !strncmp (line, "ERR", 3)
+          && (len == 3 || line[3] == ' '))
+        {
+          rc = len > 4 ? strtoul (line + 4, NULL, 10) : 0;
+          return rc ? rc : gpg_error (GPG_ERR_ASSUAN_SERVER_FAULT);
+        }
+      /* Ignore status and comment lines.  */
+    }
+}
 
-      if (connect_failed)
-        snprintf (buf, sizeof (buf),
-                  _("Can not connect to the GnuPG user interface%s%s%s:\r\n%s"),
-                  gpgex_server::ui_server? " (":"",
-                  gpgex_server::ui_server? gpgex_server::ui_server:"",
-                  gpgex_server::ui_server? ")":"",
-                  gpg_strerror (rc));
-      else
-        snprintf (buf, sizeof (buf),
-                  _("Error returned by the GnuPG user interface%s%s%s:\r\n%s"),
-                  gpgex_server::ui_server? " (":"",
-                  gpgex_server::ui_server? gpgex_server::ui_server:"",
-                  gpgex_server::ui_server? ")":"",
-                  gpg_strerror (rc));
-      MessageBox (async_args->wid, buf, "GpgEX", MB_ICONINFORMATION);
+
+/* Send a FILE command for each of FILENAMES and wait for each
+   response before sending the next one.  */
+static gpg_error_t
+send_files_sequential (assuan_context_t ctx, const vector<string> &filenames)
+{
+  gpg_error_t rc = 0;
+  string msg;
+
+  for (unsigned int i = 0; !rc && i < filenames.size (); i++)
+    {
+      msg = "FILE " + escape (filenames[i]);
+      _gpgex_debug (DEBUG_ASSUAN, "sending cmd: %s", msg.c_str ());
+      rc = assuan_transact (ctx, msg.c_str (),
+                            NULL, NULL, NULL, NULL, NULL, NULL);
     }
-  delete async_args;
-  return 0;
+  return rc;
 }
 
-void
-client_t::call_assuan (const char *cmd, vector<string> &filenames)
+
+/* Send the FILE commands for FILENAMES without waiting for each
+   response; up to PIPELINE_WINDOW commands are in flight.  This saves
+   a round trip per file for large selections.  */
+static gpg_error_t
+send_files_pipelined (assuan_context_t ctx, const vector<string> &filenames)
 {
-  TRACE_BEG (DEBUG_ASSUAN, "client_t::call_assuan", cmd);
-  async_arg_t * args = new async_arg_t;
-  args->cmd = cmd;
-  args->filenames = filenames;
-  args->wid = this->window;
+  gpg_error_t rc = 0;
+  gpg_error_t err;
+  size_t sent = 0;
+  size_t acked = 0;
+  string msg;
 
-  /* We move the call in a different thread as the Windows explorer
-     is blocked until our call finishes. We don't want that.
-     Additionally Kleopatra / Qt5 SendsMessages to the parent
-     window provided in wid. Qt does this with blocking calls
-     so Kleopatra blocks until the explorer processes more
-     Window Messages and we block the explorer. This is
-     a deadlock. */
-  CreateThread (NULL, 0, call_assuan_async, (LPVOID) args, 0,
-                NULL);
-  return;
+  for (;;)
+    {
+      while (!rc && sent < filenames.size ()
+             && sent - acked < PIPELINE_WINDOW)
+        {
+          msg = "FILE " + escape (filenames[sent]);
+          rc = assuan_write_line (ctx, msg.c_str ());
+          if (!rc)
+            sent++;
+        }
+      if (acked == sent)
+        break;
+
+      /* Read all responses to keep the protocol in sync, but send
+         nothing more after an error.  */
+      err = read_response (ctx);
+      acked++;
+      if (err && !rc)
+        rc = err;
+    }
+  return rc;
 }
 
-
+
+/* Idle connections to the UI server kept for reuse.  The DLL does
+   not keep connections; the broker enables this with
+   client_keep_connections.  */
+static vector<assuan_context_t> idle_connections;
+static unsigned int max_idle_connections;
+GPGRT_LOCK_DEFINE (idle_lock);
+
+
 void
-client_t::decrypt_verify (vector<string> &filenames)
+client_keep_connections (unsigned int max)
 {
-  this->call_assuan ("DECRYPT_VERIFY_FILES", filenames);
+  gpgrt_lock_lock (&idle_lock);
+  max_idle_connections = max;
+  while (idle_connections.size () > max)
+    {
+      assuan_release (idle_connections.back ());
+      idle_connections.pop_back ();
+    }
+  gpgrt_lock_unlock (&idle_lock);
 }
 
 
-void
-client_t::verify (vector<string> &filenames)
+/* Return a connection to the UI server at CTX; either an idle one or
+   a new one.  The PID of the server is stored at R_PID.  */
+static gpg_error_t
+acquire_connection (assuan_context_t *ctx, HWND hwnd, pid_t *r_pid)
 {
-  this->call_assuan ("VERIFY_FILES", filenames);
+  for (;;)
+    {
+      *ctx = NULL;
+      gpgrt_lock_lock (&idle_lock);
+      if (!idle_connections.empty ())
+        {
+          *ctx = idle_connections.back ();
+          idle_connections.pop_back ();
+        }
+      gpgrt_lock_unlock (&idle_lock);
+
+      if (!*ctx)
+        return uiserver_connect (ctx, hwnd, r_pid);
+
+      if (!assuan_transact (*ctx, "RESET",
+                            NULL, NULL, NULL, NULL, NULL, NULL)
+          && !send_options (*ctx, hwnd, r_pid))
+        return 0;
+
+      /* The server has gone away.  */
+      _gpgex_debug (DEBUG_ASSUAN, "dropping stale connection %p", *ctx);
+      assuan_release (*ctx);
+    }
 }
 
 
-void
-client_t::decrypt (vector<string> &filenames)
+/* Release the connection CTX or keep it for reuse if it is still
+   USABLE.  */
+static void
+release_connection (assuan_context_t ctx, int usable)
+{
+  if (!ctx)
+    return;
+
+  if (usable)
+    {
+      gpgrt_lock_lock (&idle_lock);
+      if (idle_connections.size () < max_idle_connections)
+        {
+          idle_connections.push_back (ctx);
+          ctx = NULL;
+        }
+      gpgrt_lock_unlock (&idle_lock);
+    }
+  if (ctx)
+    assuan_release (ctx);
+}
+
+
+/* Run CMD on FILENAMES using one connection.  */
+static gpg_error_t
+run_command_once (const char *cmd, const vector<string> &filenames,
+                  HWND wid, int *r_connect_failed)
+{
+  int rc = 0;
+  assuan_context_t ctx = NULL;
+  struct server_caps_s caps;
+  string msg;
+  uint64_t start;
+  pid_t pid;
+
+  TRACE_BEG (DEBUG_ASSUAN, "client_t::run_command_once", 0,
+             "%s on %u files", cmd, (unsigned int) filenames.size ());
+
+  *r_connect_failed = 0;
+
+  start = gpgex_stats_now ();
+  rc = acquire_connection (&ctx, wid, &pid);
+  if (rc)
+    {
+      gpgex_stats_inc (GPGEX_STAT_CONNECT_FAILURES);
+      *r_connect_failed = 1;
+      goto leave;
+    }
+  gpgex_stats_hist (GPGEX_HIST_CONNECT, gpgex_stats_now () - start);
+
+  get_server_caps (ctx, pid, &caps);
+  if (!server_has_command (&caps, cmd))
+    {
+      (void) TRACE_LOG ("server does not support %s", cmd);
+      rc = gpg_error (GPG_ERR_NOT_SUPPORTED);
+      goto leave;
+    }
+
+  /* Set the input files.  We don't specify the output files.  */
+  if (filenames.size () >= PIPELINE_MIN_FILES)
+    {
+      gpgex_stats_inc (GPGEX_STAT_PIPELINED_SUBMITS);
+      rc = send_files_pipelined (ctx, filenames);
+    }
+  else
+    rc = send_files_sequential (ctx, filenames);
+  if (rc)
+    goto leave;
+
+  /* Set the --nohup option, so that the operation continues and
+     completes in the background.  */
+  msg = ((string) cmd) + " --nohup";
+  (void) TRACE_LOG ("sending cmd: %s", msg.c_str ());
+  rc = assuan_transact (ctx, msg.c_str (),
+                        NULL, NULL, NULL, NULL, NULL, NULL);
+
+  /* Fall-through.  */
+ leave:
+  release_connection (ctx, !rc);
+  return TRACE_GPGERR (rc);
+}
+
+
+/* Return the number of concurrent operations a large selection is
+   split into.  This is configured with the registry value "GpgEX
+   Shards"; the default of 1 disables sharding.  */
+static unsigned int
+get_shard_count (void)
+{
+  static int count = -1;
+
+  if (count == -1)
+    {
+      char *value;
+      int n = 1;
+
+      value = gpgrt_w32_reg_get_string ("\\Software\\Gpg4win:GpgEX Shards");
+      if (value)
+        n = atoi (value);
+      free (value);
+      if (n < 1)
+        n = 1;
+      else if (n > MAX_SHARDS)
+        n = MAX_SHARDS;
+      count = n;
+    }
+  return count;
+}
+
+
+/* Return true if the files are to be submitted in the order of the
+   selection.  This is configured with the registry value "GpgEX Keep
+   Order"; by default the files are ordered for I/O locality.  */
+static int
+get_keep_order (void)
+{
+  static int keep = -1;
+
+  if (keep == -1)
+    {
+      char *value;
+
+      value = gpgrt_w32_reg_get_string
+        ("\\Software\\Gpg4win:GpgEX Keep Order");
+      keep = value && atoi (value) > 0;
+      free (value);
+    }
+  return keep;
+}
+
+
+/* The time in milliseconds to spend on summing up the sizes of the
+   files in the selected folders.  */
+#define DIRSIZE_TIMEOUT 2000
+
+/* Add the sizes of the files below the directory WDIR to *R_SIZE
+   until DIRSIZE_TIMEOUT milliseconds after the tick count START.
+   Returns false if not all of them were added.  */
+static int
+add_tree_size (const wchar_t *wdir, DWORD start, uint64_t *r_size)
+{
+  vector<wstring> pending;
+  wstring dir;
+  WIN32_FIND_DATAW fd;
+  HANDLE hd;
+  int complete = 1;
+
+  pending.push_back (wdir);
+  while (!pending.empty ())
+    {
+      if (GetTickCount () - start >= DIRSIZE_TIMEOUT)
+        return 0;
+      dir = pending.back ();
+      pending.pop_back ();
+
+      hd = FindFirstFileExW ((dir + L"\\*").c_str (), FindExInfoBasic, &fd,
+                             FindExSearchNameMatch, NULL,
+                             FIND_FIRST_EX_LARGE_FETCH);
+      if (hd == INVALID_HANDLE_VALUE)
+        {
+          complete = 0;
+          continue;
+        }
+      do
+        {
+          if (!wcscmp (fd.cFileName, L".") || !wcscmp (fd.cFileName, L".."))
+            continue;
+          if (!(fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+            *r_size += ((uint64_t) fd.nFileSizeHigh << 32) | fd.nFileSizeLow;
+          /* Junctions and links to directories may form loops.  */
+          else if (!(fd.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT))
+            pending.push_back (dir + L"\\" + fd.cFileName);
+        }
+      while (FindNextFileW (hd, &fd));
+      FindClose (hd);
+    }
+  return complete;
+}
+
+
+/* Return the size of the file with the utf-8 name FNAME or 0.  The
+   size of a directory is the sum of the files below it as far as it
+   could be taken before the time given for add_tree_size; if that
+   sum is not complete, *R_PARTIAL is set.  */
+static uint64_t
+get_file_size (const char *fname, DWORD start, int *r_partial)
+{
+  WIN32_FILE_ATTRIBUTE_DATA fad;
+  wchar_t *wfname;
+  uint64_t size = 0;
+
+  wfname = gpgrt_utf8_to_wchar (fname);
+  if (!wfname)
+    return 0;
+  if (!GetFileAttributesExW (wfname, GetFileExInfoStandard, &fad))
+    ;
+  else if (!(fad.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+    size = ((uint64_t) fad.nFileSizeHigh << 32) | fad.nFileSizeLow;
+  else if (!add_tree_size (wfname, start, &size))
+    *r_partial = 1;
+  gpgrt_free_wchar (wfname);
+  return size;
+}
+
+
+/* Store the canonical utf-8 name of the file FNAME at R_NAME and its
+   identity at R_ID.  Short names, junctions and symbolic links are
+   resolved by the system.  A file which can not be opened keeps its
+   name and has no identity.  */
+static void
+get_file_identity (const char *fname, string &r_name,
+                   struct gpgex_file_id_s *r_id)
+{
+  BY_HANDLE_FILE_INFORMATION info;
+  wchar_t *wfname;
+  wchar_t *wname;
+  char *name;
+  HANDLE hd;
+  DWORD n;
+
+  memset (r_id, 0, sizeof *r_id);
+  r_name = fname;
+
+  wfname = gpgrt_utf8_to_wchar (fname);
+  if (!wfname)
+    return;
+  /* Without access rights the file is not recalled from the cloud
+     and directories can be opened too.  */
+  hd = CreateFileW (wfname, 0,
+                    FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                    NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+  gpgrt_free_wchar (wfname);
+  if (hd == INVALID_HANDLE_VALUE)
+    return;
+
+  if (GetFileInformationByHandle (hd, &info))
+    {
+      r_id->volume = info.dwVolumeSerialNumber;
+      r_id->file = (((uint64_t) info.nFileIndexHigh << 32)
+                    | info.nFileIndexLow);
+      r_id->valid = 1;
+      r_id->is_dir = !!(info.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY);
+    }
+
+  n = GetFinalPathNameByHandleW (hd, NULL, 0,
+                                 FILE_NAME_NORMALIZED | VOLUME_NAME_DOS);
+  wname = n ? (wchar_t *) malloc (n * sizeof *wname) : NULL;
+  if (wname
+      && GetFinalPathNameByHandleW (hd, wname, n, (FILE_NAME_NORMALIZED
+                                                   | VOLUME_NAME_DOS)) < n)
+    {
+      /* The "\\?\" prefix is ignored by gpgex_plan_dedup.  */
+      name = gpgrt_wchar_to_utf8 (wname);
+      if (name)
+        r_name = name;
+      free (name);
+    }
+  free (wname);
+  CloseHandle (hd);
+}
+
+
+/* Store the files of FILENAMES at R_FILES in their order, without
+   those which are selected twice, under another name or through a
+   selected directory.  */
+static void
+dedup_selection (const vector<string> &filenames, vector<string> &r_files)
+{
+  size_t n = filenames.size ();
+  vector<string> canon (n);
+  vector<struct gpgex_file_id_s> ids (n);
+  vector<const char *> names (n);
+  vector<unsigned char> keep (n);
+  size_t i;
+
+  TRACE_BEG (DEBUG_ASSUAN, "dedup_selection", &filenames,
+             "%u files", (unsigned int) n);
+
+  if (n < 2)
+    {
+      r_files = filenames;
+      (void) TRACE_SUC ();
+      return;
+    }
+
+  for (i = 0; i < n; i++)
+    {
+      get_file_identity (filenames[i].c_str (), canon[i], &ids[i]);
+      names[i] = canon[i].c_str ();
+    }
+  if (gpgex_plan_dedup (&names[0], &ids[0], n, &keep[0]))
+    {
+      r_files = filenames;
+      (void) TRACE_SUC ("planner failed");
+      return;
+    }
+
+  r_files.clear ();
+  for (i = 0; i < n; i++)
+    if (keep[i])
+      r_files.push_back (filenames[i]);
+    else
+      {
+        (void) TRACE_LOG ("dropping %s", filenames[i].c_str ());
+        gpgex_stats_inc (GPGEX_STAT_DUPLICATES);
+      }
+  (void) TRACE_SUC ("%u files kept", (unsigned int) r_files.size ());
+}
+
+
+/* The time in milliseconds for the pre-flight check of all files.
+   The files not checked in time are sent unchecked.  */
+#define PREFLIGHT_TIME 2000
+
+/* The bytes read from the start of each file.  The I/O policy may
+   allow less.  */
+#define PREFLIGHT_HEAD_SIZE 4096
+
+/* Move the files which do not apply to CMD from FILES to R_SKIPPED.
+   The metadata cache is used if it knows the file; otherwise the
+   start of the file is read, except from network drives and cloud
+   placeholders.  The time taken for each file is recorded.  */
+static void
+preflight_selection (gpgex_preflight_cmd_t cmd, vector<string> &files,
+                     vector<string> &r_skipped)
+{
+  struct gpgex_io_budget_s budget;
+  struct gpgex_meta_s meta;
+  char buffer[PREFLIGHT_HEAD_SIZE];
+  gpgex_preflight_t result;
+  gpgex_path_type_t type;
+  uint64_t deadline, start, usec;
+  size_t size;
+  size_t i, kept;
+  int n;
+
+  TRACE_BEG (DEBUG_ASSUAN, "preflight_selection", cmd,
+             "%u files", (unsigned int) files.size ());
+
+  deadline = gpgex_stats_now () + PREFLIGHT_TIME * 1000ULL;
+  kept = 0;
+  for (i = 0; i < files.size (); i++)
+    {
+      const char *fname = files[i].c_str ();
+
+      start = gpgex_stats_now ();
+      result = GPGEX_PREFLIGHT_KEEP;
+      if (start < deadline)
+        {
+          if (gpgex_metacache_get (fname, &meta) == GPGEX_META_HIT
+              && (meta.flags & GPGEX_META_OPENPGP))
+            result = gpgex_preflight_meta (cmd, meta.flags);
+          else
+            {
+              /* Each file gets the budget of the policy; the deadline
+                 limits the total.  A short read is the whole file.  */
+              type = gpgex_probe_path (fname);
+              size = gpgex_io_policy (type)->max_bytes;
+              if (size > sizeof buffer)
+                size = sizeof buffer;
+              gpgex_io_budget_init (&budget);
+              n = gpgex_read_head (fname, type, &budget, buffer, size);
+              if (n >= 0)
+                result = gpgex_preflight_head (cmd, buffer, n,
+                                               (size_t) n < size);
+            }
+          usec = gpgex_stats_now () - start;
+          gpgex_stats_hist (GPGEX_HIST_PREFLIGHT, usec);
+          (void) TRACE_LOG ("%s: %s in %u us", fname,
+                            gpgex_preflight_name (result),
+                            (unsigned int) usec);
+        }
+
+      if (result == GPGEX_PREFLIGHT_KEEP)
+        files[kept++].swap (files[i]);
+      else
+        {
+          r_skipped.push_back (files[i]);
+          gpgex_stats_inc (GPGEX_STAT_PREFLIGHT_SKIPS);
+        }
+    }
+  files.resize (kept);
+
+  (void) TRACE_SUC ("%u kept, %u skipped", (unsigned int) kept,
+                    (unsigned int) r_skipped.size ());
+}
+
+
+struct shard_s
+{
+  const char *cmd;
+  vector<string> filenames;
+  HWND wid;
+  gpg_error_t rc;
+  int connect_failed;
+};
+
+
+static DWORD WINAPI
+run_shard (LPVOID arg)
+{
+  struct shard_s *shard = (struct shard_s *) arg;
+
+  shard->rc = run_command_once (shard->cmd, shard->filenames, shard->wid,
+                                &shard->connect_failed);
+  return 0;
+}
+
+
+/* Split FILENAMES into NSHARDS shards of about the same total size
+   and run CMD on them over concurrent connections.  The outcome of
+   each shard is stored at R_RESULT.  Returns the first error.  */
+static gpg_error_t
+run_command_sharded (const char *cmd, const vector<string> &filenames,
+                     const vector<uint64_t> &sizes, HWND wid,
+                     unsigned int nshards, client_result_s *r_result)
+{
+  vector<unsigned int> plan (filenames.size ());
+  vector<shard_s> shards;
+  vector<HANDLE> threads;
+  gpg_error_t rc = 0;
+  unsigned int nfailed = 0;
+  unsigned int nconnect = 0;
+  int used;
+  size_t i;
+
+  TRACE_BEG (DEBUG_ASSUAN, "client_t::run_command_sharded", 0,
+             "%s on %u files in %u shards", cmd,
+             (unsigned int) filenames.size (), nshards);
+
+  used = gpgex_plan_shards (&sizes[0], sizes.size (), nshards,
+                            SHARD_PER_FILE_COST, &plan[0]);
+  if (used <= 1)
+    return TRACE_GPGERR (run_command_once (cmd, filenames, wid,
+                                           &r_result->connect_failed));
+
+  shards.resize (used);
+  for (i = 0; i < (size_t) used; i++)
+    {
+      shards[i].cmd = cmd;
+      shards[i].wid = wid;
+      shards[i].rc = 0;
+      shards[i].connect_failed = 0;
+    }
+  for (i = 0; i < filenames.size (); i++)
+    shards[plan[i]].filenames.push_back (filenames[i]);
+
+  /* The first shard is run by ourself.  */
+  for (i = 1; i < shards.size (); i++)
+    {
+      HANDLE th = CreateThread (NULL, 0, run_shard, &shards[i], 0, NULL);
+
+      if (th)
+        threads.push_back (th);
+      else
+        run_shard (&shards[i]);
+    }
+  run_shard (&shards[0]);
+  for (i = 0; i < threads.size (); i++)
+    {
+      WaitForSingleObject (threads[i], INFINITE);
+      CloseHandle (threads[i]);
+    }
+
+  r_result->shards.resize (shards.size ());
+  for (i = 0; i < shards.size (); i++)
+    {
+      r_result->shards[i].nfiles = shards[i].filenames.size ();
+      r_result->shards[i].rc = shards[i].rc;
+      if (shards[i].rc)
+        {
+          if (!rc)
+            rc = shards[i].rc;
+          nfailed++;
+          if (shards[i].connect_failed)
+            nconnect++;
+          (void) TRACE_LOG ("shard %u: %s", (unsigned int) i,
+                            gpg_strerror (shards[i].rc));
+        }
+    }
+  r_result->connect_failed = nconnect && nconnect == nfailed;
+  gpgex_stats_inc (GPGEX_STAT_SHARDED_SUBMITS);
+
+  (void) TRACE_LOG ("%u of %d shards failed", nfailed, used);
+  return TRACE_GPGERR (rc);
+}
+
+
+/* The pseudo command which encrypts the files into one archive.  */
+#define ARCHIVE_COMMAND "ENCRYPT_ARCHIVE"
+
+/* The buffer size of the pipe to the UI server.  */
+#define ARCHIVE_PIPE_SIZE (1024 * 1024)
+
+
+/* Create the file for the encrypted archive of FILENAMES next to the
+   first of them.  It is named after the file if there is only one,
+   and else after the directory.  An existing file is never replaced.
+   The name of the new file is stored at R_NAME.  Returns
+   INVALID_HANDLE_VALUE on error.  */
+static HANDLE
+create_archive_file (const vector<string> &filenames, string &r_name)
+{
+  string base = filenames[0];
+  string dir, name;
+  char suffix[32];
+  wchar_t *wname;
+  HANDLE hd = INVALID_HANDLE_VALUE;
+  size_t pos;
+  int i;
+
+  while (base.size () > 1 && (base[base.size () - 1] == '\\'
+                              || base[base.size () - 1] == '/'))
+    base.erase (base.size () - 1);
+  if (filenames.size () > 1)
+    {
+      pos = base.find_last_of ("\\/");
+      dir = pos == string::npos ? string (".") : base.substr (0, pos);
+      pos = dir.find_last_of ("\\/:");
+      if (pos == string::npos || pos + 1 == dir.size ())
+        base = dir + "\\archive";
+      else
+        base = dir + "\\" + dir.substr (pos + 1);
+    }
+
+  for (i = 1; i < 100 && hd == INVALID_HANDLE_VALUE; i++)
+    {
+      if (i == 1)
+        snprintf (suffix, sizeof suffix, ".tar.gpg");
+      else
+        snprintf (suffix, sizeof suffix, " (%d).tar.gpg", i);
+      name = base + suffix;
+      wname = gpgrt_utf8_to_wchar (name.c_str ());
+      if (!wname)
+        break;
+      hd = CreateFileW (wname, GENERIC_WRITE, 0, NULL, CREATE_NEW,
+                        FILE_ATTRIBUTE_NORMAL, NULL);
+      gpgrt_free_wchar (wname);
+      if (hd == INVALID_HANDLE_VALUE && GetLastError () != ERROR_FILE_EXISTS)
+        break;
+    }
+  if (hd != INVALID_HANDLE_VALUE)
+    r_name = name;
+  return hd;
+}
+
+
+/* Give the handle HD to the UI server with PID and use it as its
+   input or output as given by WHAT.  The handle is duplicated into
+   the server process, so that the server can use it directly.  */
+static gpg_error_t
+send_handle (assuan_context_t ctx, pid_t pid, const char *what, HANDLE hd)
+{
+  HANDLE proc, remote;
+  gpg_error_t rc;
+  char line[64];
+
+  proc = OpenProcess (PROCESS_DUP_HANDLE, FALSE, pid);
+  if (!proc)
+    return gpg_error (GPG_ERR_EACCES);
+  if (!DuplicateHandle (GetCurrentProcess (), hd, proc, &remote,
+                        0, FALSE, DUPLICATE_SAME_ACCESS))
+    {
+      CloseHandle (proc);
+      return gpg_error (GPG_ERR_EACCES);
+    }
+
+  snprintf (line, sizeof line, "%s FD=%lu",
+            what, (unsigned long) (uintptr_t) remote);
+  _gpgex_debug (DEBUG_ASSUAN, "sending cmd: %s", line);
+  rc = assuan_transact (ctx, line, NULL, NULL, NULL, NULL, NULL, NULL);
+  if (rc)
+    DuplicateHandle (proc, remote, NULL, NULL, 0, FALSE,
+                     DUPLICATE_CLOSE_SOURCE);
+  CloseHandle (proc);
+  return rc;
+}
+
+
+/* The arguments of the archive writer thread.  */
+struct archive_arg_s
+{
+  const vector<string> *filenames;
+  HANDLE pipe;
+  gpg_error_t rc;
+  vector<string> *skipped;
+};
+
+
+static DWORD WINAPI
+archive_thread (LPVOID arg)
+{
+  struct archive_arg_s *aa = (struct archive_arg_s *) arg;
+
+  aa->rc = gpgex_archive_write (*aa->filenames, aa->pipe, *aa->skipped);
+  /* This is the end of the input for the UI server.  */
+  CloseHandle (aa->pipe);
+  return 0;
+}
+
+
+/* Encrypt FILENAMES into one archive.  The tar stream is written to
+   a pipe which is the input of the ENCRYPT command of the UI server;
+   the UI server asks for the recipients with PREP_ENCRYPT and writes
+   the result to a new file next to the selection.  The names of the
+   files and directories which could not be read and are missing from
+   the archive are stored at R_SKIPPED.  On error the archive is
+   deleted.  */
+static gpg_error_t
+run_archive (const vector<string> &filenames, HWND wid,
+             vector<string> &r_skipped, int *r_connect_failed)
+{
+  gpg_error_t rc;
+  assuan_context_t ctx = NULL;
+  struct server_caps_s caps;
+  struct archive_arg_s aa;
+  HANDLE output = INVALID_HANDLE_VALUE;
+  HANDLE input = NULL;
+  HANDLE th = NULL;
+  string outname;
+  wchar_t *wname;
+  pid_t pid;
+
+  TRACE_BEG (DEBUG_ASSUAN, "client_t::run_archive", 0,
+             "%u files", (unsigned int) filenames.size ());
+
+  *r_connect_failed = 0;
+  if (filenames.empty ())
+    return TRACE_GPGERR (gpg_error (GPG_ERR_NO_DATA));
+  aa.filenames = &filenames;
+  aa.pipe = NULL;
+  aa.rc = 0;
+  aa.skipped = &r_skipped;
+
+  rc = acquire_connection (&ctx, wid, &pid);
+  if (rc)
+    {
+      gpgex_stats_inc (GPGEX_STAT_CONNECT_FAILURES);
+      *r_connect_failed = 1;
+      goto leave;
+    }
+  get_server_caps (ctx, pid, &caps);
+  if (!server_has_command (&caps, "PREP_ENCRYPT")
+      || !server_has_command (&caps, "ENCRYPT"))
+    {
+      (void) TRACE_LOG ("server does not support ENCRYPT");
+      rc = gpg_error (GPG_ERR_NOT_SUPPORTED);
+      goto leave;
+    }
+
+  /* Let the user pick the recipients before anything is created.  */
+  rc = assuan_transact (ctx, "PREP_ENCRYPT --protocol=OpenPGP",
+                        NULL, NULL, NULL, NULL, NULL, NULL);
+  if (rc)
+    goto leave;
+
+  output = create_archive_file (filenames, outname);
+  if (output == INVALID_HANDLE_VALUE)
+    {
+      rc = gpg_error (GPG_ERR_EEXIST);
+      goto leave;
+    }
+  if (!CreatePipe (&input, &aa.pipe, NULL, ARCHIVE_PIPE_SIZE))
+    {
+      input = aa.pipe = NULL;
+      rc = gpg_error (GPG_ERR_EPIPE);
+      goto leave;
+    }
+  rc = send_handle (ctx, pid, "INPUT", input);
+  if (!rc)
+    rc = send_handle (ctx, pid, "OUTPUT", output);
+  /* Only the UI server uses them now; our read end must be closed so
+     that the writer notices when the server stops reading.  */
+  CloseHandle (input);
+  input = NULL;
+  CloseHandle (output);
+  output = INVALID_HANDLE_VALUE;
+  if (rc)
+    goto leave;
+
+  th = CreateThread (NULL, 0, archive_thread, &aa, 0, NULL);
+  if (!th)
+    {
+      rc = gpg_error (GPG_ERR_GENERAL);
+      goto leave;
+    }
+  aa.pipe = NULL;
+
+  (void) TRACE_LOG ("sending cmd: ENCRYPT to %s", outname.c_str ());
+  rc = assuan_transact (ctx, "ENCRYPT --protocol=OpenPGP",
+                        NULL, NULL, NULL, NULL, NULL, NULL);
+
+  /* If the server has not read everything, the writer may still wait
+     for the pipe.  */
+  if (WaitForSingleObject (th, rc ? 1000 : INFINITE) == WAIT_TIMEOUT)
+    {
+      CancelSynchronousIo (th);
+      WaitForSingleObject (th, INFINITE);
+    }
+  CloseHandle (th);
+  if (!rc)
+    rc = aa.rc;
+  if (!r_skipped.empty ())
+    (void) TRACE_LOG ("%u files could not be read",
+                      (unsigned int) r_skipped.size ());
+  gpgex_stats_inc (GPGEX_STAT_ARCHIVES);
+
+ leave:
+  if (aa.pipe)
+    CloseHandle (aa.pipe);
+  if (input)
+    CloseHandle (input);
+  if (output != INVALID_HANDLE_VALUE)
+    CloseHandle (output);
+  if (rc && !outname.empty ())
+    {
+      /* Do not leave a partial archive.  */
+      wname = gpgrt_utf8_to_wchar (outname.c_str ());
+      if (wname)
+        {
+          DeleteFileW (wname);
+          gpgrt_free_wchar (wname);
+        }
+    }
+  release_connection (ctx, !rc);
+  return TRACE_GPGERR (rc);
+}
+
+
+/* Run CMD on FILENAMES, ordered for I/O locality and split into
+   shards as configured.  Only commands which do not ask the user
+   anything are split.  SIZES holds the sizes of the files or is
+   empty; it is filled in if they are needed.  */
+static gpg_error_t
+run_command_planned (const char *cmd, const vector<string> &filenames,
+                     vector<uint64_t> &sizes, HWND wid,
+                     client_result_s *r_result)
+{
+  unsigned int nshards;
+  int keep_order;
+  int shard;
+  size_t i;
+
+  nshards = get_shard_count ();
+  keep_order = get_keep_order ();
+  shard = (nshards > 1 && filenames.size () >= SHARD_MIN_FILES
+           && gpgex_plan_shardable (cmd));
+
+  if ((keep_order || filenames.size () < 2) && !shard)
+    return run_command_once (cmd, filenames, wid,
+                             &r_result->connect_failed);
+
+  if (sizes.size () != filenames.size ())
+    {
+      DWORD start = GetTickCount ();
+      int partial = 0;
+
+      sizes.resize (filenames.size ());
+      for (i = 0; i < filenames.size (); i++)
+        sizes[i] = get_file_size (filenames[i].c_str (), start, &partial);
+    }
+
+  if (!keep_order)
+    {
+      vector<const char *> names (filenames.size ());
+      vector<size_t> order (filenames.size ());
+
+      for (i = 0; i < filenames.size (); i++)
+        names[i] = filenames[i].c_str ();
+      if (!gpgex_plan_locality (&names[0], &sizes[0], names.size (),
+                                &order[0]))
+        {
+          vector<string> ordered (filenames.size ());
+          vector<uint64_t> ordered_sizes (filenames.size ());
+
+          for (i = 0; i < order.size (); i++)
+            {
+              ordered[i] = filenames[order[i]];
+              ordered_sizes[i] = sizes[order[i]];
+            }
+          if (shard)
+            return run_command_sharded (cmd, ordered, ordered_sizes, wid,
+                                        nshards, r_result);
+          return run_command_once (cmd, ordered, wid,
+                                   &r_result->connect_failed);
+        }
+    }
+
+  if (shard)
+    return run_command_sharded (cmd, filenames, sizes, wid, nshards,
+                                r_result);
+  return run_command_once (cmd, filenames, wid, &r_result->connect_failed);
+}
+
+
+/* Return true if the UI-server writes ASCII armored files.  This is
+   only used for the estimate of the output size and is configured
+   with the registry value "GpgEX Armor".  */
+static int
+get_armor (void)
+{
+  static int armor = -1;
+
+  if (armor == -1)
+    {
+      char *value;
+
+      value = gpgrt_w32_reg_get_string ("\\Software\\Gpg4win:GpgEX Armor");
+      armor = value && atoi (value) > 0;
+      free (value);
+    }
+  return armor;
+}
+
+
+/* The free space is not checked if less than this is written.  */
+#define FREESPACE_MIN_NEED (64 * 1024 * 1024ULL)
+
+/* The time in milliseconds to wait for the free space of all
+   volumes.  Volumes which do not answer in time are not checked.  */
+#define FREESPACE_TIMEOUT 3000
+
+/* A query for the free space of a volume.  It is shared with the
+   thread doing the query, which may outlive the wait for it.  */
+struct freespace_s
+{
+  LONG refs;
+  wchar_t *root;
+  uint64_t avail;
+  int ok;
+};
+
+
+static void
+freespace_release (struct freespace_s *fs)
+{
+  if (InterlockedDecrement (&fs->refs))
+    return;
+  gpgrt_free_wchar (fs->root);
+  free (fs);
+}
+
+
+static DWORD WINAPI
+freespace_thread (LPVOID arg)
+{
+  struct freespace_s *fs = (struct freespace_s *) arg;
+  ULARGE_INTEGER avail;
+
+  if (GetDiskFreeSpaceExW (fs->root, &avail, NULL, NULL))
+    {
+      fs->avail = avail.QuadPart;
+      fs->ok = 1;
+    }
+  freespace_release (fs);
+  return 0;
+}
+
+
+/* Print SIZE for humans to BUFFER of LENGTH bytes.  */
+static void
+format_size (uint64_t size, char *buffer, size_t length)
+{
+  static const char *const units[] = { "KB", "MB", "GB", "TB", "PB" };
+  double value = (double) size / 1024;
+  unsigned int i = 0;
+
+  while (value >= 1024 && i + 1 < sizeof units / sizeof units[0])
+    {
+      value /= 1024;
+      i++;
+    }
+  snprintf (buffer, length, "%.1f %s", value, units[i]);
+}
+
+
+/* Estimate the output of CMD on FILENAMES and compare it with the
+   free space of the volumes it goes to.  The volumes are queried in
+   parallel, since network drives may be slow to answer.  If the
+   space looks too small, the user is asked whether to go on, or with
+   CLIENT_NO_UI in FLAGS the volumes are stored at R_RESULT and the
+   operation is cancelled.  The sizes of the files are stored at
+   SIZES for later use.  Returns false if the operation is to be
+   cancelled.  */
+static int
+check_free_space (const char *cmd, const vector<string> &filenames,
+                  vector<uint64_t> &sizes, HWND wid, unsigned int flags,
+                  client_result_s *r_result)
+{
+  gpgex_output_kind_t kind;
+  struct gpgex_volume_need_s *volumes;
+  size_t nvolumes;
+  vector<const char *> names (filenames.size ());
+  struct freespace_s *queries[MAXIMUM_WAIT_OBJECTS];
+  HANDLE threads[MAXIMUM_WAIT_OBJECTS];
+  DWORD nthreads;
+  uint64_t total;
+  string msg;
+  char need[32], avail[32];
+  char line[512];
+  size_t i;
+  DWORD start;
+  int partial = 0;
+  int go_on = 1;
+
+  TRACE_BEG (DEBUG_ASSUAN, "check_free_space", cmd,
+             "%u files", (unsigned int) filenames.size ());
+
+  kind = gpgex_plan_output_kind (cmd);
+  if (kind == GPGEX_OUTPUT_NONE || filenames.empty ())
+    {
+      (void) TRACE_SUC ("no output");
+      return 1;
+    }
+
+  sizes.resize (filenames.size ());
+  start = GetTickCount ();
+  for (i = 0; i < filenames.size (); i++)
+    {
+      sizes[i] = get_file_size (filenames[i].c_str (), start, &partial);
+      names[i] = filenames[i].c_str ();
+    }
+  if (gpgex_plan_volumes (kind, &names[0], &sizes[0], names.size (),
+                          get_armor (), &volumes, &nvolumes))
+    {
+      (void) TRACE_SUC ("planner failed");
+      return 1;
+    }
+
+  /* If a folder could not be summed up in time, the total is only a
+     lower bound and the volumes are checked anyway.  */
+  total = 0;
+  for (i = 0; i < nvolumes; i++)
+    total += volumes[i].need;
+  if (total < FREESPACE_MIN_NEED && !partial)
+    {
+      gpgex_plan_volumes_free (volumes, nvolumes);
+      (void) TRACE_SUC ("only %llu bytes", (unsigned long long) total);
+      return 1;
+    }
+
+  nthreads = 0;
+  for (i = 0; i < nvolumes && nthreads < MAXIMUM_WAIT_OBJECTS; i++)
+    {
+      struct freespace_s *fs;
+
+      fs = (struct freespace_s *) calloc (1, sizeof *fs);
+      if (!fs)
+        break;
+      fs->root = gpgrt_utf8_to_wchar (volumes[i].root);
+      fs->refs = 2;
+      threads[nthreads] = fs->root ? CreateThread (NULL, 0, freespace_thread,
+                                                   fs, 0, NULL) : NULL;
+      if (!threads[nthreads])
+        {
+          gpgrt_free_wchar (fs->root);
+          free (fs);
+          break;
+        }
+      queries[nthreads++] = fs;
+    }
+  if (nthreads)
+    WaitForMultipleObjects (nthreads, threads, TRUE, FREESPACE_TIMEOUT);
+
+  for (i = 0; i < nthreads; i++)
+    {
+      /* The result may only be read once the thread is done.  */
+      if (WaitForSingleObject (threads[i], 0) == WAIT_OBJECT_0
+          && queries[i]->ok)
+        {
+          (void) TRACE_LOG ("%s: need %llu, free %llu", volumes[i].root,
+                            (unsigned long long) volumes[i].need,
+                            (unsigned long long) queries[i]->avail);
+          if (volumes[i].need > queries[i]->avail)
+            {
+              client_volume_s vol;
+
+              vol.root = volumes[i].root;
+              vol.need = volumes[i].need;
+              vol.avail = queries[i]->avail;
+              r_result->nospace.push_back (vol);
+              format_size (volumes[i].need, need, sizeof need);
+              format_size (queries[i]->avail, avail, sizeof avail);
+              snprintf (line, sizeof line,
+                        _("%s: about %s needed, %s free"),
+                        volumes[i].root, need, avail);
+              msg += "\r\n";
+              msg += line;
+            }
+        }
+      else
+        (void) TRACE_LOG ("%s: not checked", volumes[i].root);
+      CloseHandle (threads[i]);
+      freespace_release (queries[i]);
+    }
+  gpgex_plan_volumes_free (volumes, nvolumes);
+
+  if (!msg.empty () && (flags & CLIENT_NO_UI))
+    {
+      gpgex_stats_inc (GPGEX_STAT_SPACE_WARNINGS);
+      go_on = 0;
+    }
+  else if (!msg.empty ())
+    {
+      gpgex_stats_inc (GPGEX_STAT_SPACE_WARNINGS);
+      msg = (string (_("The output may not fit on these drives:")) + "\r\n"
+             + msg + "\r\n\r\n" + _("Do you want to continue anyway?"));
+      go_on = MessageBox (wid, msg.c_str (), "GpgEX",
+                          MB_ICONWARNING | MB_YESNO | MB_DEFBUTTON2) == IDYES;
+    }
+
+  (void) TRACE_SUC ("go_on=%i", go_on);
+  return go_on;
+}
+
+
+/* The number of files named in a message.  */
+#define FILE_LIST_SHOWN 10
+
+/* Tell the user TEXT about the files FILES.  */
+static void
+show_file_list (HWND wid, const char *text, const vector<string> &files)
+{
+  string msg;
+  char buf[64];
+  size_t i;
+
+  msg = text;
+  msg += "\r\n";
+  for (i = 0; i < files.size () && i < FILE_LIST_SHOWN; i++)
+    {
+      msg += "\r\n";
+      msg += files[i];
+    }
+  if (i < files.size ())
+    {
+      snprintf (buf, sizeof (buf), _("and %u more"),
+                (unsigned int) (files.size () - i));
+      msg += "\r\n";
+      msg += buf;
+    }
+  MessageBox (wid, msg.c_str (), "GpgEX", MB_ICONINFORMATION);
+}
+
+
+gpg_error_t
+client_run_command (const char *cmd, const vector<string> &filenames,
+                    HWND wid, unsigned int flags, client_result_s *r_result)
+{
+  vector<string> files;
+  vector<uint64_t> sizes;
+  int noui = !!(flags & CLIENT_NO_UI);
+  int import;
+  gpg_error_t rc;
+
+  r_result->connect_failed = 0;
+  r_result->shards.clear ();
+  r_result->skipped.clear ();
+  r_result->missing.clear ();
+  r_result->nospace.clear ();
+
+  /* The server would do the work again for each duplicate.  */
+  dedup_selection (filenames, files);
+
+  if (!strcmp (cmd, ARCHIVE_COMMAND))
+    {
+      if (!check_free_space (cmd, files, sizes, wid, flags, r_result))
+        return noui ? gpg_error (GPG_ERR_ENOSPC) : 0;
+      rc = run_archive (files, wid, r_result->skipped,
+                        &r_result->connect_failed);
+      if (!rc && !noui && !r_result->skipped.empty ())
+        show_file_list (wid, _("These files and folders could not be read "
+                               "and are not in the archive:"),
+                        r_result->skipped);
+      return rc;
+    }
+
+  /* Send each detached signature once instead of the signature and
+     its data file, and catch signatures without data here instead
+     of on the server.  A data file with its signature next to it is
+     sent as the signature, since the server would not find it.  */
+  if (!strcmp (cmd, "VERIFY_FILES") || !strcmp (cmd, "DECRYPT_VERIFY_FILES"))
+    {
+      struct gpgex_sigpairs_s pairs;
+
+      gpgex_sigpair_plan (files, 1, &pairs);
+      r_result->missing.swap (pairs.missing);
+      if (!noui && !r_result->missing.empty ())
+        show_file_list (wid, _("The signed data was not found for these "
+                               "signatures:"), r_result->missing);
+      files.swap (pairs.files);
+    }
+
+  /* Each file which the server can not use costs a full operation
+     and an error message.  */
+  import = !strcmp (cmd, "IMPORT_FILES");
+  if (import || !strcmp (cmd, "DECRYPT_VERIFY_FILES"))
+    {
+      preflight_selection (import ? GPGEX_PREFLIGHT_IMPORT
+                           : GPGEX_PREFLIGHT_DECRYPT_VERIFY,
+                           files, r_result->skipped);
+      if (!noui && !r_result->skipped.empty ())
+        show_file_list (wid, (import
+                              ? _("These files were left out because they "
+                                  "contain no certificates:")
+                              : _("These files were left out because they "
+                                  "are neither encrypted nor signed:")),
+                        r_result->skipped);
+    }
+
+  if (files.empty ())
+    return 0;
+
+  /* A job which runs out of space fails only at its end.  */
+  if (!check_free_space (cmd, files, sizes, wid, flags, r_result))
+    return noui ? gpg_error (GPG_ERR_ENOSPC) : 0;
+
+  return run_command_planned (cmd, files, sizes, wid, r_result);
+}
+
+
+void
+client_show_error (HWND wid, gpg_error_t rc, const client_result_s *result)
+{
+  char buf[256];
+  string msg;
+  unsigned int nfailed;
+  size_t i;
+
+  if (result->connect_failed)
+    snprintf (buf, sizeof (buf),
+              _("Can not connect to the GnuPG user interface%s%s%s:\r\n%s"),
+              gpgex_server::ui_server? " (":"",
+              gpgex_server::ui_server? gpgex_server::ui_server:"",
+              gpgex_server::ui_server? ")":"",
+              gpg_strerror (rc));
+  else
+    snprintf (buf, sizeof (buf),
+              _("Error returned by the GnuPG user interface%s%s%s:\r\n%s"),
+              gpgex_server::ui_server? " (":"",
+              gpgex_server::ui_server? gpgex_server::ui_server:"",
+              gpgex_server::ui_server? ")":"",
+              gpg_strerror (rc));
+  msg = buf;
+
+  /* Each shard may have failed for a reason of its own.  */
+  nfailed = 0;
+  for (i = 0; i < result->shards.size (); i++)
+    if (result->shards[i].rc)
+      nfailed++;
+  if (nfailed)
+    {
+      snprintf (buf, sizeof (buf), _("%u of %u shards failed:"),
+                nfailed, (unsigned int) result->shards.size ());
+      msg = msg + "\r\n\r\n" + buf;
+      for (i = 0; i < result->shards.size (); i++)
+        if (result->shards[i].rc)
+          {
+            snprintf (buf, sizeof (buf), _("Shard %u (%u files): %s"),
+                      (unsigned int) i + 1, result->shards[i].nfiles,
+                      gpg_strerror (result->shards[i].rc));
+            msg = msg + "\r\n" + buf;
+          }
+    }
+  MessageBox (wid, msg.c_str (), "GpgEX", MB_ICONINFORMATION);
+}
+
+
+typedef struct async_arg
+{
+  const char *cmd;
+  vector<string> filenames;
+  HWND wid;
+} async_arg_t;
+
+static DWORD WINAPI
+call_assuan_async (LPVOID arg)
+{
+  async_arg_t *async_args = (async_arg_t *)arg;
+  gpg_error_t rc;
+  client_result_s result;
+
+  rc = client_run_command (async_args->cmd, async_args->filenames,
+                           async_args->wid, 0, &result);
+  if (rc)
+    client_show_error (async_args->wid, rc, &result);
+  delete async_args;
+  gpgex_stats_dec (GPGEX_STAT_QUEUE_DEPTH);
+  return 0;
+}
+
+void
+client_t::call_assuan (const char *cmd, vector<string> &filenames)
+{
+  TRACE_BEG (DEBUG_ASSUAN, "client_t::call_assuan", cmd);
+
+  gpgex_stats_op (cmd);
+
+  /* If enabled, let the broker do the work outside of the Explorer.  */
+  if (gpgex_broker_enabled ()
+      && !gpgex_broker_submit (cmd, filenames, this->window))
+    return;
+
+  async_arg_t * args = new async_arg_t;
+  args->cmd = cmd;
+  args->filenames = filenames;
+  args->wid = this->window;
+
+  gpgex_stats_gauge_inc (GPGEX_STAT_QUEUE_DEPTH, GPGEX_STAT_QUEUE_DEPTH_MAX);
+
+  /* We move the call in a different thread as the Windows explorer
+     is blocked until our call finishes. We don't want that.
+     Additionally Kleopatra / Qt5 SendsMessages to the parent
+     window provided in wid. Qt does this with blocking calls
+     so Kleopatra blocks until the explorer processes more
+     Window Messages and we block the explorer. This is
+     a deadlock. */
+  HANDLE th = CreateThread (NULL, 0, call_assuan_async, (LPVOID) args, 0,
+                            NULL);
+  if (th)
+    CloseHandle (th);
+  else
+    {
+      (void) TRACE_LOG ("CreateThread failed: %i", (int) GetLastError ());
+      gpgex_stats_dec (GPGEX_STAT_QUEUE_DEPTH);
+      delete args;
+    }
+  return;
+}
+
+
+void
+client_t::decrypt_verify (vector<string> &filenames)
+{
+  this->call_assuan ("DECRYPT_VERIFY_FILES", filenames);
+}
+
+
+void
+client_t::verify (vector<string> &filenames)
+{
+  this->call_assuan ("VERIFY_FILES", filenames);
+}
+
+
+void
+client_t::decrypt (vector<string> &filenames)
 {
   this->call_assuan ("DECRYPT_FILES", filenames);
 }
 
 
+void
+client_t::encrypt_archive (vector<string> &filenames)
+{
+  this->call_assuan (ARCHIVE_COMMAND, filenames);
+}
+
+
 void
 client_t::sign_encrypt (vector<string> &filenames)
 {
@@ -21,6 +21,7 @@
 #ifndef CLIENT_H
 #define CLIENT_H
 
+#include <stdint.h>
 #include <vector>
 #include <string>
 
@@ -29,6 +30,8 @@ using std::string;
 
 #include <windows.h>
 
+#include <gpg-error.h>
+
 class client_t
 {
  private:
@@ -47,10 +50,71 @@ class client_t
   void verify (vector<string> &filenames);
   void sign_encrypt (vector<string> &filenames);
   void encrypt (vector<string> &filenames);
+  void encrypt_archive (vector<string> &filenames);
   void sign (vector<string> &filenames);
   void import (vector<string> &filenames);
   void create_checksums (vector<string> &filenames);
   void verify_checksums (vector<string> &filenames);
 };
 
+
+/* The outcome of a shard of a command.  */
+struct client_shard_result_s
+{
+  unsigned int nfiles;
+  gpg_error_t rc;
+};
+
+/* A volume on which the output may not fit.  */
+struct client_volume_s
+{
+  string root;
+  uint64_t need;
+  uint64_t avail;
+};
+
+/* What client_run_command did besides its return code.  */
+struct client_result_s
+{
+  int connect_failed;		/* The UI server could not be reached.  */
+  vector<client_shard_result_s> shards;	/* Empty if not sharded.  */
+  vector<string> skipped;	/* Files left out.  */
+  vector<string> missing;	/* Signatures without their data.  */
+  vector<client_volume_s> nospace;
+};
+
+/* Flags for client_run_command.  */
+#define CLIENT_NO_UI	1	/* Don't ask or tell the user anything.  */
+
+/* Run CMD on FILENAMES synchronously.  WID is the parent window for
+   the UI server.  The details are stored at R_RESULT; CONNECT_FAILED
+   is set there if the UI server could not be reached.  If the files
+   were split into shards, the outcome of each is listed there and
+   the first error is returned.  The files which were left out are
+   shown to the user, or only listed in R_RESULT if FLAGS has
+   CLIENT_NO_UI.  The pseudo command ENCRYPT_ARCHIVE encrypts all
+   files and directories into one tar archive.  Files which are
+   selected twice are dropped.  For the verify commands the detached
+   signatures are paired with their data files.  For decryption and
+   import the files which do not apply are left out.  If the output
+   may not fit on the target drives the user is asked first, or with
+   CLIENT_NO_UI the volumes are listed in R_RESULT and
+   GPG_ERR_ENOSPC is returned.  */
+gpg_error_t client_run_command (const char *cmd,
+                                const vector<string> &filenames,
+                                HWND wid, unsigned int flags,
+                                client_result_s *r_result);
+
+/* Tell the user about the error RC and the details RESULT returned
+   by client_run_command.  */
+void client_show_error (HWND wid, gpg_error_t rc,
+                        const client_result_s *result);
+
+/* Keep up to MAX idle connections to the UI server for reuse.  */
+void client_keep_connections (unsigned int max);
+
+/* Return the name of gpgconf or NULL.  This may run gpgconf and must
+   not be called from the menu path.  */
+const char *client_gpgconf_name (void);
+
 #endif	/* ! CLIENT_H */
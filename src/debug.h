@@ -24,6 +24,7 @@
 #include <gpg-error.h>
 
 #include <stdio.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -37,168 +38,115 @@ extern "C" {
 #define DEBUG_CONTEXT_MENU	2
 #define DEBUG_ASSUAN		4
 
+/* The trace categories compiled into the binary.  Trace calls for
+   other categories are removed by the compiler.  Configure with
+   --disable-trace to remove all of them.  */
+#ifndef GPGEX_TRACE_COMPILED
+# ifdef DISABLE_TRACE
+#  define GPGEX_TRACE_COMPILED	0
+# else
+#  define GPGEX_TRACE_COMPILED	(DEBUG_INIT | DEBUG_CONTEXT_MENU \
+				 | DEBUG_ASSUAN)
+# endif
+#endif
+
 /* No flags on means no debugging.  */
 extern unsigned int debug_flags;
 
 /* Debug log stream.  */
 extern FILE *debug_file;
 
-
+
 #define STRINGIFY(v) #v
 
 /* Log the formatted string FORMAT in categories FLAGS.  */
-void _gpgex_debug (unsigned int flags, const char *format, ...);
+void _gpgex_debug (unsigned int flags, const char *format, ...)
+  GPGRT_ATTR_PRINTF (2, 3);
+
+/* Log a trace line for function FUNC with the tag TAGNAME=TAG.
+   FORMAT starts with the kind of line ("enter: ", "leave: ", ...); a
+   trailing ": " is stripped from the output.  */
+void _gpgex_trace (unsigned int flags, const char *func,
+		   const char *tagname, void *tag,
+		   const char *format, ...) GPGRT_ATTR_PRINTF (5, 6);
+
+/* True if tracing for category LVL is enabled.  Arguments to the
+   trace macros are only evaluated if this is true; for categories
+   not compiled in this is a constant false.  */
+#define _gpgex_trace_enabled(lvl)					\
+  ((GPGEX_TRACE_COMPILED & (lvl)) && (debug_flags & (lvl)))
+
+
+/* The trace macros take an optional printf style format string
+   literal and its arguments as the last arguments.  The format is
+   checked by the compiler.  */
 
 #define _TRACE(lvl, name, tag)					\
-  int _gpgex_trace_level = lvl;					\
+  unsigned int _gpgex_trace_level = lvl;			\
   const char *const _gpgex_trace_func = name;			\
   const char *const _gpgex_trace_tagname = STRINGIFY (tag);	\
-  void *_gpgex_trace_tag = (void *) tag
-
-#define TRACE_BEG(lvl, name, tag)			     \
-  _TRACE (lvl, name, tag);				     \
-  _gpgex_debug (_gpgex_trace_level, "%s (%s=0x%x): enter\n", \
-		_gpgex_trace_func, _gpgex_trace_tagname,     \
-		_gpgex_trace_tag)
-#define TRACE_BEG0(lvl, name, tag, fmt)					\
-  _TRACE (lvl, name, tag);						\
-  _gpgex_debug (_gpgex_trace_level, "%s (%s=0x%x): enter: " fmt "\n",	\
-		_gpgex_trace_func, _gpgex_trace_tagname,		\
-		_gpgex_trace_tag)
-#define TRACE_BEG1(lvl, name, tag, fmt, arg1)				\
-  _TRACE (lvl, name, tag);						\
-  _gpgex_debug (_gpgex_trace_level, "%s (%s=0x%x): enter: " fmt "\n",	\
-		_gpgex_trace_func, _gpgex_trace_tagname,		\
-		_gpgex_trace_tag, arg1)
-#define TRACE_BEG2(lvl, name, tag, fmt, arg1, arg2)		      \
-  _TRACE (lvl, name, tag);					      \
-  _gpgex_debug (_gpgex_trace_level, "%s (%s=0x%x): enter: " fmt "\n", \
-		_gpgex_trace_func, _gpgex_trace_tagname,	      \
-		_gpgex_trace_tag, arg1, arg2)
-#define TRACE_BEG3(lvl, name, tag, fmt, arg1, arg2, arg3)	      \
-  _TRACE (lvl, name, tag);					      \
-  _gpgex_debug (_gpgex_trace_level, "%s (%s=0x%x): enter: " fmt "\n", \
-		_gpgex_trace_func, _gpgex_trace_tagname,	      \
-		_gpgex_trace_tag, arg1, arg2, arg3)
-#define TRACE_BEG4(lvl, name, tag, fmt, arg1, arg2, arg3, arg4)	      \
-  _TRACE (lvl, name, tag);					      \
-  _gpgex_debug (_gpgex_trace_level, "%s (%s=0x%x): enter: " fmt "\n", \
-		_gpgex_trace_func, _gpgex_trace_tagname,	      \
-		_gpgex_trace_tag, arg1, arg2, arg3, arg4)
-#define TRACE_BEG5(lvl, name, tag, fmt, arg1, arg2, arg3, arg4, arg5) \
-  _TRACE (lvl, name, tag);					      \
-  _gpgex_debug (_gpgex_trace_level, "%s (%s=0x%x): enter: " fmt "\n", \
-		_gpgex_trace_func, _gpgex_trace_tagname,	      \
-		_gpgex_trace_tag, arg1, arg2, arg3, arg4, arg5)
-#define TRACE_BEG12(lvl, name, tag, fmt, arg1, arg2, arg3, arg4,	\
-		    arg5, arg6, arg7, arg8, arg9, arg10, arg11, arg12)	\
-  _TRACE (lvl, name, tag);						\
-  _gpgex_debug (_gpgex_trace_level, "%s (%s=0x%x): enter: " fmt "\n",	\
-		_gpgex_trace_func, _gpgex_trace_tagname,		\
-		_gpgex_trace_tag, arg1, arg2, arg3, arg4, arg5, arg6,	\
-		arg7, arg8, arg9, arg10, arg11, arg12)
-#define TRACE_BEG13(lvl, name, tag, fmt, arg1, arg2, arg3, arg4,	\
-		    arg5, arg6, arg7, arg8, arg9, arg10, arg11, arg12,	\
-		    arg13)						\
-  _TRACE (lvl, name, tag);						\
-  _gpgex_debug (_gpgex_trace_level, "%s (%s=0x%x): enter: " fmt "\n",	\
-		_gpgex_trace_func, _gpgex_trace_tagname,		\
-		_gpgex_trace_tag, arg1, arg2, arg3, arg4, arg5, arg6,	\
-		arg7, arg8, arg9, arg10, arg11, arg12, arg13)
-#define TRACE_BEG22(lvl, name, tag, fmt, arg1, arg2, arg3, arg4,	\
-		   arg5, arg6, arg7, arg8, arg9, arg10, arg11, arg12,	\
-		   arg13, arg14, arg15, arg16, arg17, arg18, arg19,	\
-		   arg20, arg21, arg22)					\
-  _TRACE (lvl, name, tag);						\
-  _gpgex_debug (_gpgex_trace_level, "%s (%s=0x%x): enter: " fmt "\n",	\
-		_gpgex_trace_func, _gpgex_trace_tagname,		\
-		_gpgex_trace_tag, arg1, arg2, arg3, arg4, arg5, arg6,	\
-		arg7, arg8, arg9, arg10, arg11, arg12, arg13, arg14,	\
-		arg15, arg16, arg17, arg18, arg19, arg20, arg21,	\
-		arg22)
-
-#define TRACE(lvl, name, tag)						\
-  (_gpgex_debug (lvl, "%s (%s=0x%x): call\n",				\
-		 name, STRINGIFY (tag), (void *)(uintptr_t)tag), 0)
-#define TRACE0(lvl, name, tag, fmt)					\
-  (_gpgex_debug (lvl, "%s (%s=0x%x): call: " fmt "\n",			\
-		 name, STRINGIFY (tag), (void *) tag), 0)
-#define TRACE1(lvl, name, tag, fmt, arg1)			       \
-  (_gpgex_debug (lvl, "%s (%s=0x%x): call: " fmt "\n",		       \
-		 name, STRINGIFY (tag), (void *) tag, arg1), 0)
-#define TRACE2(lvl, name, tag, fmt, arg1, arg2)			       \
-  (_gpgex_debug (lvl, "%s (%s=0x%x): call: " fmt "\n",		       \
-		 name, STRINGIFY (tag), (void *) tag, arg1, arg2), 0)
-#define TRACE3(lvl, name, tag, fmt, arg1, arg2, arg3)		       \
-  (_gpgex_debug (lvl, "%s (%s=0x%x): call: " fmt "\n",		       \
-		 name, STRINGIFY (tag), (void *) tag, arg1, arg2,      \
-		 arg3), 0)
-#define TRACE6(lvl, name, tag, fmt, arg1, arg2, arg3, arg4, arg5, arg6)	\
-  (_gpgex_debug (lvl, "%s (%s=0x%x): call: " fmt "\n",			\
-		 name, STRINGIFY (tag), (void *) tag, arg1, arg2, arg3,	\
-		 arg4, arg5, arg6), 0)
+  void *_gpgex_trace_tag = (void *) (uintptr_t) tag
+
+#define _TRACE_LINE(what, ...)						\
+  (_gpgex_trace_enabled (_gpgex_trace_level)				\
+   ? _gpgex_trace (_gpgex_trace_level, _gpgex_trace_func,		\
+		   _gpgex_trace_tagname, _gpgex_trace_tag,		\
+		   what ": " __VA_ARGS__)				\
+   : (void) 0)
+
+#define TRACE_BEG(lvl, name, tag, ...)			\
+  _TRACE (lvl, name, tag);				\
+  do { _TRACE_LINE ("enter", __VA_ARGS__); } while (0)
+
+#define TRACE(lvl, name, tag, ...)					\
+  (_gpgex_trace_enabled (lvl)						\
+   ? _gpgex_trace (lvl, name, STRINGIFY (tag), (void *) (uintptr_t) tag, \
+		   "call: " __VA_ARGS__)				\
+   : (void) 0, 0)
+
+#define TRACE_SUC(...)  (_TRACE_LINE ("leave", __VA_ARGS__), 0)
+
+#define TRACE_LOG(...)  (_TRACE_LINE ("check", __VA_ARGS__), 0)
 
 #define TRACE_GPGERR(err)						\
-  err == 0 ? (TRACE_SUC ()) :						\
-    (_gpgex_debug (_gpgex_trace_level, "%s (%s=0x%x): error: %s <%s>\n", \
-		   _gpgex_trace_func, _gpgex_trace_tagname,		\
-		   _gpgex_trace_tag, gpg_strerror (err),		\
-		   gpg_strsource (err)), (err))
+  _gpgex_trace_gpgerr (_gpgex_trace_level, _gpgex_trace_func,		\
+		       _gpgex_trace_tagname, _gpgex_trace_tag, (err))
 
 #define TRACE_RES(err)							\
-  err == S_OK ? (TRACE_SUC ()) :					\
-    (_gpgex_debug (_gpgex_trace_level, "%s (%s=0x%x): %s: ec=%x\n",	\
-		   _gpgex_trace_func, _gpgex_trace_tagname,		\
-		   _gpgex_trace_tag,					\
-		   SUCCEEDED (err) ? "leave" : "error",			\
-		   err), (err))
-
-#define TRACE_SUC()						   \
-  (_gpgex_debug (_gpgex_trace_level, "%s (%s=0x%x): leave\n",	   \
-		 _gpgex_trace_func, _gpgex_trace_tagname,	   \
-		 _gpgex_trace_tag), 0)
-#define TRACE_SUC0(fmt)							\
-  (_gpgex_debug (_gpgex_trace_level, "%s (%s=0x%x): leave: " fmt "\n",	\
-		 _gpgex_trace_func, _gpgex_trace_tagname,		\
-		 _gpgex_trace_tag), 0)
-#define TRACE_SUC1(fmt, arg1)						\
-  (_gpgex_debug (_gpgex_trace_level, "%s (%s=0x%x): leave: " fmt "\n",	\
-		 _gpgex_trace_func, _gpgex_trace_tagname,		\
-		 _gpgex_trace_tag, arg1), 0)
-#define TRACE_SUC2(fmt, arg1, arg2)					\
-  (_gpgex_debug (_gpgex_trace_level, "%s (%s=0x%x): leave: " fmt "\n",	\
-		 _gpgex_trace_func, _gpgex_trace_tagname,		\
-		 _gpgex_trace_tag, arg1, arg2), 0)
-#define TRACE_SUC5(fmt, arg1, arg2, arg3, arg4, arg5)			\
-  (_gpgex_debug (_gpgex_trace_level, "%s (%s=0x%x): leave: " fmt "\n",	\
-		 _gpgex_trace_func, _gpgex_trace_tagname,		\
-		 _gpgex_trace_tag, arg1, arg2, arg3, arg4, arg5), 0)
-
-#define TRACE_LOG(fmt)							\
-  (_gpgex_debug (_gpgex_trace_level, "%s (%s=0x%x): check: " fmt "\n",	\
-		 _gpgex_trace_func, _gpgex_trace_tagname,		\
-		 _gpgex_trace_tag), 0)
-#define TRACE_LOG1(fmt, arg1)						\
-  (_gpgex_debug (_gpgex_trace_level, "%s (%s=0x%x): check: " fmt "\n",	\
-		 _gpgex_trace_func, _gpgex_trace_tagname,		\
-		 _gpgex_trace_tag, arg1), 0)
-#define TRACE_LOG2(fmt, arg1, arg2)					\
-  (_gpgex_debug (_gpgex_trace_level, "%s (%s=0x%x): check: " fmt "\n",	\
-		 _gpgex_trace_func, _gpgex_trace_tagname,		\
-		 _gpgex_trace_tag, arg1, arg2), 0)
-#define TRACE_LOG3(fmt, arg1, arg2, arg3)				\
-  (_gpgex_debug (_gpgex_trace_level, "%s (%s=0x%x): check: " fmt "\n",	\
-		 _gpgex_trace_func, _gpgex_trace_tagname,		\
-		 _gpgex_trace_tag, arg1, arg2, arg3), 0)
-#define TRACE_LOG4(fmt, arg1, arg2, arg3, arg4)				\
-  (_gpgex_debug (_gpgex_trace_level, "%s (%s=0x%x): check: " fmt "\n",	\
-		 _gpgex_trace_func, _gpgex_trace_tagname,		\
-		 _gpgex_trace_tag, arg1, arg2, arg3, arg4), 0)
-#define TRACE_LOG6(fmt, arg1, arg2, arg3, arg4, arg5, arg6)		\
-  (_gpgex_debug (_gpgex_trace_level, "%s (%s=0x%x): check: " fmt "\n",	\
-		 _gpgex_trace_func, _gpgex_trace_tagname,		\
-		 _gpgex_trace_tag, arg1, arg2, arg3, arg4, arg5,	\
-		 arg6), 0)
+  _gpgex_trace_res (_gpgex_trace_level, _gpgex_trace_func,		\
+		    _gpgex_trace_tagname, _gpgex_trace_tag, (err))
+
+
+/* Helper for TRACE_GPGERR.  Evaluates ERR only once.  */
+static inline gpg_error_t
+_gpgex_trace_gpgerr (unsigned int lvl, const char *func,
+		     const char *tagname, void *tag, gpg_error_t err)
+{
+  if (!_gpgex_trace_enabled (lvl))
+    ;
+  else if (!err)
+    _gpgex_trace (lvl, func, tagname, tag, "leave: ");
+  else
+    _gpgex_trace (lvl, func, tagname, tag, "error: %s <%s>",
+		  gpg_strerror (err), gpg_strsource (err));
+  return err;
+}
+
+
+/* Helper for TRACE_RES.  ERR is a HRESULT.  */
+static inline long
+_gpgex_trace_res (unsigned int lvl, const char *func,
+		  const char *tagname, void *tag, long err)
+{
+  if (!_gpgex_trace_enabled (lvl))
+    ;
+  else if (!err)
+    _gpgex_trace (lvl, func, tagname, tag, "leave: ");
+  else
+    _gpgex_trace (lvl, func, tagname, tag, "%s: ec=%lx",
+		  err >= 0 ? "leave" : "error", (unsigned long) err);
+  return err;
+}
 
 #ifdef __cplusplus
 #if 0
@@ -0,0 +1,648 @@
+/* exechelp-posix.c - fork and exec helpers for POSIX
+ * Copyright (C) 2004, 2007, 2026 g10 Code GmbH
+ *
+ * This file is part of GpgEX.
+ *
+ * GpgEX is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * GpgEX is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA
+ */
+
+/* GpgEX itself is only used on Windows.  This implementation of the
+   exechelp interface allows to run and measure the spawn and server
+   launch code on other systems.  CMDLINE is split into arguments
+   like a Windows command line; PGMNAME is the file to execute.  The
+   spawn sentinel is a file lock instead of a named mutex.  */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/file.h>
+
+#include <gpg-error.h>
+
+#include "debug.h"
+#include "stats.h"
+#include "membuf.h"
+#include "exechelp.h"
+
+extern char **environ;
+
+/* The time in milliseconds gpgex_spawn_get_string waits for the
+   child.  */
+#define SPAWN_GET_STRING_TIMEOUT 10000
+
+/* The time in milliseconds gpgex_lock_spawning waits for the lock.
+   This matches the W32 version.  */
+#define LOCK_SPAWNING_TIMEOUT 6000
+
+
+/* Split the Windows style command line CMDLINE into a NULL
+   terminated and malloced argument vector.  Double quotes group
+   arguments and a backslash escapes a double quote.  */
+static char **
+build_argv (const char *cmdline)
+{
+  char **argv;
+  char *buffer, *d;
+  const char *s;
+  int argc = 0;
+  int in_arg, in_quote;
+
+  /* Each argument needs at least two characters including the
+     delimiter, so this is an upper bound.  */
+  argv = (char **) calloc (strlen (cmdline) / 2 + 2, sizeof *argv);
+  buffer = (char *) malloc (strlen (cmdline) + 1);
+  if (!argv || !buffer)
+    {
+      free (argv);
+      free (buffer);
+      return NULL;
+    }
+
+  in_arg = in_quote = 0;
+  for (s = cmdline, d = buffer; *s; s++)
+    {
+      if (!in_quote && (*s == ' ' || *s == '\t'))
+        {
+          if (in_arg)
+            {
+              *d++ = 0;
+              in_arg = 0;
+            }
+          continue;
+        }
+      if (!in_arg)
+        {
+          argv[argc++] = d;
+          in_arg = 1;
+        }
+      if (*s == '\\' && s[1] == '"')
+        *d++ = *++s;
+      else if (*s == '"')
+        in_quote = !in_quote;
+      else
+        *d++ = *s;
+    }
+  *d = 0;
+  argv[argc] = NULL;
+  if (!argc)
+    {
+      /* Make sure that the buffer is released along with ARGV.  */
+      argv[0] = buffer;
+      *buffer = 0;
+    }
+  return argv;
+}
+
+
+static void
+release_argv (char **argv)
+{
+  if (argv)
+    {
+      free (argv[0]);
+      free (argv);
+    }
+}
+
+
+/* Return the current time in milliseconds.  */
+static uint64_t
+now_ms (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+/* Return the milliseconds left from TIMEOUT since START or -1 if
+   there is no timeout.  */
+static int
+remaining_time (uint64_t start, unsigned int timeout)
+{
+  uint64_t elapsed;
+
+  if (!timeout)
+    return -1;
+  elapsed = now_ms () - start;
+  return elapsed < timeout ? (int) (timeout - elapsed) : 0;
+}
+
+
+/* Wait for PID for at most WAIT milliseconds (-1 for no limit).
+   Returns true and stores the status at R_STATUS if the process has
+   terminated.  */
+static int
+wait_child (pid_t pid, int wait, int *r_status)
+{
+  uint64_t start = now_ms ();
+  struct timespec delay = { 0, 1000000 };
+
+  for (;;)
+    {
+      pid_t rc = waitpid (pid, r_status, wait < 0 ? 0 : WNOHANG);
+
+      if (rc == pid)
+        return 1;
+      if (rc < 0 && errno != EINTR)
+        return 0;
+      if (wait >= 0 && now_ms () - start >= (uint64_t) wait)
+        return 0;
+      if (rc == 0)
+        nanosleep (&delay, NULL);
+    }
+}
+
+
+/* Return the malloced name of the spawn sentinel file.  */
+static char *
+get_sentinel_name (void)
+{
+  const char *dir = getenv ("XDG_RUNTIME_DIR");
+  char *name;
+
+  if (!dir || !*dir)
+    dir = "/tmp";
+  if (gpgrt_asprintf (&name, "%s/gpgex-spawn-sentinel-%lu", dir,
+                      (unsigned long) getuid ()) < 0)
+    return NULL;
+  return name;
+}
+
+
+/* Lock a spawning process.  The caller needs to provide the address
+   of a variable to store the lock information.  The lock is an
+   advisory lock on a sentinel file; it is released by the system if
+   the process dies.  */
+gpg_error_t
+gpgex_lock_spawning (lock_spawn_t *lock)
+{
+  struct timespec delay = { 0, 10000000 };
+  uint64_t start;
+  char *fname;
+  int fd;
+
+  _TRACE (DEBUG_ASSUAN, "gpgex_lock_spawning", lock);
+
+  *lock = -1;
+
+  fname = get_sentinel_name ();
+  if (!fname)
+    return gpg_error_from_syserror ();
+  fd = open (fname, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600);
+  if (fd == -1)
+    {
+      gpg_error_t err = gpg_error_from_syserror ();
+
+      (void) TRACE_LOG ("failed to open the spawn sentinel '%s': %s",
+                        fname, strerror (errno));
+      gpgrt_free (fname);
+      return err;
+    }
+  gpgrt_free (fname);
+
+  start = now_ms ();
+  while (flock (fd, LOCK_EX | LOCK_NB))
+    {
+      if (errno != EWOULDBLOCK && errno != EINTR)
+        {
+          (void) TRACE_LOG ("error locking the spawn sentinel: %s",
+                            strerror (errno));
+          close (fd);
+          return gpg_error (GPG_ERR_GENERAL);
+        }
+      if (now_ms () - start >= LOCK_SPAWNING_TIMEOUT)
+        {
+          (void) TRACE_LOG ("error waiting for the spawn sentinel: timeout");
+          close (fd);
+          return gpg_error (GPG_ERR_GENERAL);
+        }
+      nanosleep (&delay, NULL);
+    }
+
+  *lock = fd;
+  return 0;
+}
+
+
+/* Unlock the spawning process.  */
+void
+gpgex_unlock_spawning (lock_spawn_t *lock)
+{
+  if (*lock != -1)
+    {
+      _TRACE (DEBUG_ASSUAN, "gpgex_unlock_spawning", lock);
+
+      if (flock (*lock, LOCK_UN))
+        (void) TRACE_LOG ("failed to release the spawn sentinel: %s",
+                          strerror (errno));
+      close (*lock);
+      *lock = -1;
+    }
+}
+
+
+/* The launch coordinator uses the spawn sentinel file; its first
+   byte is '1' while a launched server is known to be ready.  Waiters
+   poll for the byte and for the lock being released.  */
+#define LAUNCH_POLL_INTERVAL 5  /* Milliseconds.  */
+
+struct gpgex_launch_s
+{
+  int fd;		/* The opened sentinel file.  */
+  int owner;		/* True if we hold the lock.  */
+};
+
+
+/* Set the ready byte of the sentinel for LAUNCH to VALUE.  Errors
+   are ignored; waiters then time out and fall back.  */
+static int
+launch_set_ready (gpgex_launch_t launch, int value)
+{
+  char c = value ? '1' : '0';
+
+  return pwrite (launch->fd, &c, 1, 0) == 1;
+}
+
+
+static int
+launch_is_ready (gpgex_launch_t launch)
+{
+  char c;
+
+  return pread (launch->fd, &c, 1, 0) == 1 && c == '1';
+}
+
+
+/* Take ownership of the sentinel for LAUNCH.  */
+static void
+launch_take_ownership (gpgex_launch_t launch)
+{
+  launch->owner = 1;
+  launch_set_ready (launch, 0);
+}
+
+
+gpg_error_t
+gpgex_launch_begin (gpgex_launch_t *r_launch, int *r_launcher)
+{
+  gpgex_launch_t launch;
+  char *fname;
+
+  TRACE_BEG (DEBUG_ASSUAN, "gpgex_launch_begin", r_launch);
+
+  *r_launch = NULL;
+  *r_launcher = 0;
+
+  fname = get_sentinel_name ();
+  if (!fname)
+    return TRACE_GPGERR (gpg_error_from_syserror ());
+  launch = (gpgex_launch_t) calloc (1, sizeof *launch);
+  if (!launch)
+    {
+      gpgrt_free (fname);
+      return TRACE_GPGERR (gpg_error_from_syserror ());
+    }
+  launch->fd = open (fname, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600);
+  gpgrt_free (fname);
+  if (launch->fd == -1)
+    {
+      gpg_error_t err = gpg_error_from_syserror ();
+
+      (void) TRACE_LOG ("failed to open the sentinel: %s", strerror (errno));
+      free (launch);
+      return TRACE_GPGERR (err);
+    }
+
+  if (!flock (launch->fd, LOCK_EX | LOCK_NB))
+    {
+      launch_take_ownership (launch);
+      *r_launcher = 1;
+    }
+  else if (errno != EWOULDBLOCK)
+    {
+      gpg_error_t err = gpg_error_from_syserror ();
+
+      (void) TRACE_LOG ("error locking the sentinel: %s", strerror (errno));
+      gpgex_launch_release (launch);
+      return TRACE_GPGERR (err);
+    }
+
+  *r_launch = launch;
+  (void) TRACE_SUC ("launcher=%d", *r_launcher);
+  return 0;
+}
+
+
+gpg_error_t
+gpgex_launch_wait (gpgex_launch_t launch, unsigned int timeout,
+                   int *r_launcher)
+{
+  struct timespec delay = { 0, LAUNCH_POLL_INTERVAL * 1000000 };
+  uint64_t start = now_ms ();
+
+  TRACE_BEG (DEBUG_ASSUAN, "gpgex_launch_wait", launch,
+             "timeout=%u", timeout);
+
+  *r_launcher = launch->owner;
+  if (launch->owner)
+    return TRACE_GPGERR (0);
+
+  for (;;)
+    {
+      if (launch_is_ready (launch))
+        return TRACE_GPGERR (0);
+      if (!flock (launch->fd, LOCK_EX | LOCK_NB))
+        {
+          /* Check again; the launcher sets the byte before it
+             releases the lock.  */
+          if (launch_is_ready (launch))
+            {
+              flock (launch->fd, LOCK_UN);
+              return TRACE_GPGERR (0);
+            }
+          (void) TRACE_LOG ("launcher gave up - taking over");
+          launch_take_ownership (launch);
+          *r_launcher = 1;
+          return TRACE_GPGERR (0);
+        }
+      if (now_ms () - start >= timeout)
+        return TRACE_GPGERR (gpg_error (GPG_ERR_TIMEOUT));
+      nanosleep (&delay, NULL);
+    }
+}
+
+
+void
+gpgex_launch_done (gpgex_launch_t launch, int ready)
+{
+  if (launch && launch->owner)
+    {
+      _TRACE (DEBUG_ASSUAN, "gpgex_launch_done", launch);
+
+      (void) TRACE_LOG ("ready=%d", ready);
+      if (ready)
+        launch_set_ready (launch, 1);
+      if (flock (launch->fd, LOCK_UN))
+        (void) TRACE_LOG ("failed to release the sentinel: %s",
+                          strerror (errno));
+      launch->owner = 0;
+    }
+}
+
+
+void
+gpgex_launch_release (gpgex_launch_t launch)
+{
+  if (!launch)
+    return;
+
+  gpgex_launch_done (launch, 0);
+  close (launch->fd);
+  free (launch);
+}
+
+
+/* Thread to reap a detached child so that it does not stay a
+   zombie.  */
+static void *
+reaper_thread (void *arg)
+{
+  pid_t pid = (pid_t) (intptr_t) arg;
+  int status;
+
+  while (waitpid (pid, &status, 0) == -1 && errno == EINTR)
+    ;
+  return NULL;
+}
+
+
+/* Fork and exec the program with /dev/null as stdin, stdout and
+   stderr.  Returns 0 on success or an error code.  */
+gpg_error_t
+gpgex_spawn_detached (const char *pgmname, const char *cmdline)
+{
+  posix_spawn_file_actions_t actions;
+  posix_spawnattr_t attr;
+  pthread_attr_t tattr;
+  pthread_t thread;
+  char **argv;
+  pid_t pid;
+  int rc;
+
+  TRACE_BEG (DEBUG_ASSUAN, "gpgex_spawn_detached", cmdline,
+	     "pgm=%s cmdline=%s", pgmname, cmdline);
+
+  argv = build_argv (cmdline);
+  if (!argv)
+    return gpg_error_from_syserror ();
+
+  posix_spawn_file_actions_init (&actions);
+  posix_spawn_file_actions_addopen (&actions, 0, "/dev/null", O_RDONLY, 0);
+  posix_spawn_file_actions_addopen (&actions, 1, "/dev/null", O_WRONLY, 0);
+  posix_spawn_file_actions_addopen (&actions, 2, "/dev/null", O_WRONLY, 0);
+
+  /* Like CREATE_NEW_PROCESS_GROUP.  */
+  posix_spawnattr_init (&attr);
+  posix_spawnattr_setflags (&attr, POSIX_SPAWN_SETPGROUP);
+  posix_spawnattr_setpgroup (&attr, 0);
+
+  rc = posix_spawn (&pid, pgmname, &actions, &attr, argv, environ);
+  posix_spawnattr_destroy (&attr);
+  posix_spawn_file_actions_destroy (&actions);
+  release_argv (argv);
+  if (rc)
+    {
+      (void) TRACE_LOG ("posix_spawn failed: %s", strerror (rc));
+      gpgex_stats_inc (GPGEX_STAT_SPAWN_FAILURES);
+      return gpg_error_from_errno (rc);
+    }
+  gpgex_stats_inc (GPGEX_STAT_SPAWNS);
+
+  pthread_attr_init (&tattr);
+  pthread_attr_setdetachstate (&tattr, PTHREAD_CREATE_DETACHED);
+  if (pthread_create (&thread, &tattr, reaper_thread,
+                      (void *) (intptr_t) pid))
+    (void) TRACE_LOG ("failed to start the reaper: child %d stays a zombie",
+                      (int) pid);
+  pthread_attr_destroy (&tattr);
+
+  return 0;
+}
+
+
+gpg_error_t
+gpgex_spawn_capture (const char *pgmname, const char *cmdline,
+                     unsigned int timeout, unsigned int flags,
+                     gpgex_capture_cb_t cb, void *opaque,
+                     char **r_output, size_t *r_outputlen, int *r_exitcode)
+{
+  gpg_error_t err = 0;
+  posix_spawn_file_actions_t actions;
+  char **argv;
+  int fds[2];
+  pid_t pid;
+  uint64_t start;
+  int rc;
+  int status = -1;
+  membuf_t mb;
+
+  if (r_output)
+    *r_output = NULL;
+  if (r_outputlen)
+    *r_outputlen = 0;
+  if (r_exitcode)
+    *r_exitcode = -1;
+
+  TRACE_BEG (DEBUG_ASSUAN, "gpgex_spawn_capture", cmdline,
+	     "pgm=%s cmdline=%s timeout=%u", pgmname, cmdline, timeout);
+
+  start = now_ms ();
+
+  argv = build_argv (cmdline);
+  if (!argv)
+    return gpg_error_from_syserror ();
+
+  /* Both ends are close-on-exec, so that a child spawned by another
+     thread meanwhile does not keep the write end open.  The dup2
+     below clears the flag on fd 1 of our child.  */
+  if (pipe2 (fds, O_CLOEXEC))
+    {
+      err = gpg_error_from_syserror ();
+      release_argv (argv);
+      return err;
+    }
+
+  posix_spawn_file_actions_init (&actions);
+  posix_spawn_file_actions_addopen (&actions, 0, "/dev/null", O_RDONLY, 0);
+  posix_spawn_file_actions_adddup2 (&actions, fds[1], 1);
+  posix_spawn_file_actions_addopen (&actions, 2, "/dev/null", O_WRONLY, 0);
+  posix_spawn_file_actions_addclose (&actions, fds[1]);
+
+  rc = posix_spawn (&pid, pgmname, &actions, NULL, argv, environ);
+  posix_spawn_file_actions_destroy (&actions);
+  release_argv (argv);
+  close (fds[1]);  /* This end is used by the child.  */
+  if (rc)
+    {
+      (void) TRACE_LOG ("posix_spawn failed: %s", strerror (rc));
+      gpgex_stats_inc (GPGEX_STAT_SPAWN_FAILURES);
+      close (fds[0]);
+      return gpg_error_from_errno (rc);
+    }
+  gpgex_stats_inc (GPGEX_STAT_SPAWNS);
+
+  init_membuf (&mb, 1024);
+  while (!err)
+    {
+      char readbuf[4096];
+      struct pollfd pfd;
+      ssize_t nread;
+
+      pfd.fd = fds[0];
+      pfd.events = POLLIN;
+      rc = poll (&pfd, 1, remaining_time (start, timeout));
+      if (rc < 0 && errno == EINTR)
+        continue;
+      if (rc < 0)
+        err = gpg_error_from_syserror ();
+      else if (!rc)
+        err = gpg_error (GPG_ERR_TIMEOUT);
+      else
+        {
+          nread = read (fds[0], readbuf, sizeof readbuf);
+          if (nread < 0 && errno == EINTR)
+            continue;
+          if (nread < 0)
+            err = gpg_error_from_syserror ();
+          else if (!nread)
+            break;  /* EOF.  */
+          else if (cb)
+            err = cb (opaque, readbuf, nread);
+          else
+            put_membuf (&mb, readbuf, nread);
+        }
+    }
+  close (fds[0]);  /* Ready with reading.  */
+
+  /* The child may still be running after closing its stdout.  */
+  if (!wait_child (pid, remaining_time (start, timeout), &status))
+    {
+      if (!err)
+        err = gpg_error (GPG_ERR_TIMEOUT);
+      if ((flags & GPGEX_CAPTURE_KILL))
+        {
+          (void) TRACE_LOG ("timeout - terminating the child");
+          kill (pid, SIGKILL);
+          wait_child (pid, -1, &status);
+        }
+      else
+        {
+          /* The child is not reaped and stays a zombie after it
+             terminates.  */
+          (void) TRACE_LOG ("timeout - child keeps running");
+          status = -1;
+        }
+    }
+  if (r_exitcode && status != -1 && WIFEXITED (status))
+    *r_exitcode = WEXITSTATUS (status);
+
+  put_membuf (&mb, "", 1);  /* Terminate string.  */
+  if (!err && !cb && r_output)
+    {
+      size_t len;
+
+      *r_output = get_membuf (&mb, &len);
+      if (!*r_output)
+        err = gpg_error (GPG_ERR_EIO);
+      else if (r_outputlen)
+        *r_outputlen = len - 1;
+    }
+  else
+    free (get_membuf (&mb, NULL));
+
+  if (err)
+    return TRACE_GPGERR (err);
+  (void) TRACE_SUC ("%lu ms", (unsigned long) (now_ms () - start));
+  return 0;
+}
+
+
+/* Fork and exec PGMNAME with args in CMDLINE and /dev/null connected
+ * to stdin and stderr.  Read from stdout and return the result as a
+ * malloced string at R_STRING.  Returns 0 on success or an error code.  */
+gpg_error_t
+gpgex_spawn_get_string (const char *pgmname, const char *cmdline,
+                        char **r_string)
+{
+  return gpgex_spawn_capture (pgmname, cmdline, SPAWN_GET_STRING_TIMEOUT,
+                              GPGEX_CAPTURE_KILL, NULL, NULL,
+                              r_string, NULL, NULL);
+}
@@ -33,120 +33,16 @@
 #include <gpg-error.h>
 
 #include "debug.h"
+#include "stats.h"
+#include "membuf.h"
 #include "exechelp.h"
 
 /* Define to 1 do enable debugging.  */
 #define DEBUG_W32_SPAWN 0
 
-
-struct private_membuf_s
-{
-  size_t len;
-  size_t size;
-  char *buf;
-  int out_of_core;
-};
-
-typedef struct private_membuf_s membuf_t;
-
-
-
-
-
-/* A simple implementation of a dynamic buffer.  Use init_membuf() to
-   create a buffer, put_membuf to append bytes and get_membuf to
-   release and return the buffer.  Allocation errors are detected but
-   only returned at the final get_membuf(), this helps not to clutter
-   the code with out of core checks.  */
-void
-init_membuf (membuf_t *mb, int initiallen)
-{
-  mb->len = 0;
-  mb->size = initiallen;
-  mb->out_of_core = 0;
-  mb->buf = malloc (initiallen);
-  if (!mb->buf)
-    mb->out_of_core = errno;
-}
-
-
-/* Shift the content of the membuf MB by AMOUNT bytes.  The next
-   operation will then behave as if AMOUNT bytes had not been put into
-   the buffer.  If AMOUNT is greater than the actual accumulated
-   bytes, the membuf is basically reset to its initial state.  */
-void
-clear_membuf (membuf_t *mb, size_t amount)
-{
-  /* No need to clear if we are already out of core.  */
-  if (mb->out_of_core)
-    return;
-  if (amount >= mb->len)
-    mb->len = 0;
-  else
-    {
-      mb->len -= amount;
-      memmove (mb->buf, mb->buf+amount, mb->len);
-    }
-}
-
-
-void
-put_membuf (membuf_t *mb, const void *buf, size_t len)
-{
-  if (mb->out_of_core || !len)
-    return;
-
-  if (mb->len + len >= mb->size)
-    {
-      char *p;
-
-      mb->size += len + 1024;
-      p = realloc (mb->buf, mb->size);
-      if (!p)
-        {
-          mb->out_of_core = errno ? errno : ENOMEM;
-          /* /\* Wipe out what we already accumulated.  This is required */
-          /*    in case we are storing sensitive data here.  The membuf */
-          /*    API does not provide another way to cleanup after an */
-          /*    error. *\/ */
-          /* wipememory (mb->buf, mb->len); */
-          return;
-        }
-      mb->buf = p;
-    }
-  if (buf)
-    memcpy (mb->buf + mb->len, buf, len);
-  else
-    memset (mb->buf + mb->len, 0, len);
-  mb->len += len;
-}
-
-
-void *
-get_membuf (membuf_t *mb, size_t *len)
-{
-  char *p;
-
-  if (mb->out_of_core)
-    {
-      if (mb->buf)
-        {
-          /* wipememory (mb->buf, mb->len); */
-          free (mb->buf);
-          mb->buf = NULL;
-        }
-      gpg_err_set_errno (mb->out_of_core);
-      return NULL;
-    }
-
-  p = mb->buf;
-  if (len)
-    *len = mb->len;
-  mb->buf = NULL;
-  mb->out_of_core = ENOMEM; /* hack to make sure it won't get reused. */
-  return p;
-}
-
+/* The time in milliseconds gpgex_spawn_get_string waits for the
+   child.  */
+#define SPAWN_GET_STRING_TIMEOUT 10000
 
 
 /* Lock a spawning process.  The caller needs to provide the address
@@ -163,7 +59,8 @@ gpgex_lock_spawning (lock_spawn_t *lock)
   *lock = CreateMutexW (NULL, FALSE, L"spawn_gnupg_uiserver_sentinel");
   if (!*lock)
     {
-      TRACE_LOG1 ("failed to create the spawn mutex: rc=%d", GetLastError ());
+      TRACE_LOG ("failed to create the spawn mutex: rc=%d",
+                 (int) GetLastError ());
       return gpg_error (GPG_ERR_GENERAL);
     }
 
@@ -180,8 +77,8 @@ gpgex_lock_spawning (lock_spawn_t *lock)
   if (waitrc == WAIT_TIMEOUT)
     TRACE_LOG ("error waiting for the spawn mutex: timeout");
   else
-    TRACE_LOG2 ("error waiting for the spawn mutex: (code=%d) rc=%d",
-                waitrc, GetLastError ());
+    TRACE_LOG ("error waiting for the spawn mutex: (code=%d) rc=%d",
+               waitrc, (int) GetLastError ());
   return gpg_error (GPG_ERR_GENERAL);
 }
 
@@ -195,13 +92,152 @@ gpgex_unlock_spawning (lock_spawn_t *lock)
       _TRACE (DEBUG_ASSUAN, "gpgex_unlock_spawning", lock);
 
       if (!ReleaseMutex (*lock))
-        TRACE_LOG1 ("failed to release the spawn mutex: rc=%d", GetLastError());
+        TRACE_LOG ("failed to release the spawn mutex: rc=%d",
+                   (int) GetLastError());
       CloseHandle (*lock);
       *lock = NULL;
     }
 }
 
 
+/* The name of the event signalling that a launched UI server is
+   ready.  It is a manual reset event which stays signalled until the
+   next launcher resets it.  */
+#define LAUNCH_READY_EVENT L"gpgex_uiserver_ready_event"
+
+struct gpgex_launch_s
+{
+  HANDLE mutex;		/* The spawn sentinel.  */
+  HANDLE ready;		/* The ready event.  */
+  int owner;		/* True if we own the mutex.  */
+};
+
+
+/* Take ownership of the sentinel for LAUNCH.  */
+static void
+launch_take_ownership (gpgex_launch_t launch)
+{
+  launch->owner = 1;
+  ResetEvent (launch->ready);
+}
+
+
+gpg_error_t
+gpgex_launch_begin (gpgex_launch_t *r_launch, int *r_launcher)
+{
+  gpgex_launch_t launch;
+  DWORD waitrc;
+
+  TRACE_BEG (DEBUG_ASSUAN, "gpgex_launch_begin", r_launch);
+
+  *r_launch = NULL;
+  *r_launcher = 0;
+
+  launch = (gpgex_launch_t) calloc (1, sizeof *launch);
+  if (!launch)
+    return TRACE_GPGERR (gpg_error_from_syserror ());
+
+  launch->mutex = CreateMutexW (NULL, FALSE,
+                                L"spawn_gnupg_uiserver_sentinel");
+  launch->ready = CreateEventW (NULL, TRUE, FALSE, LAUNCH_READY_EVENT);
+  if (!launch->mutex || !launch->ready)
+    {
+      (void) TRACE_LOG ("failed to create the sentinel: rc=%d",
+                        (int) GetLastError ());
+      gpgex_launch_release (launch);
+      return TRACE_GPGERR (gpg_error (GPG_ERR_GENERAL));
+    }
+
+  waitrc = WaitForSingleObject (launch->mutex, 0);
+  if (waitrc == WAIT_OBJECT_0 || waitrc == WAIT_ABANDONED)
+    {
+      launch_take_ownership (launch);
+      *r_launcher = 1;
+    }
+  else if (waitrc != WAIT_TIMEOUT)
+    {
+      (void) TRACE_LOG ("error waiting for the sentinel: (code=%d) rc=%d",
+                        (int) waitrc, (int) GetLastError ());
+      gpgex_launch_release (launch);
+      return TRACE_GPGERR (gpg_error (GPG_ERR_GENERAL));
+    }
+
+  *r_launch = launch;
+  (void) TRACE_SUC ("launcher=%d", *r_launcher);
+  return 0;
+}
+
+
+gpg_error_t
+gpgex_launch_wait (gpgex_launch_t launch, unsigned int timeout,
+                   int *r_launcher)
+{
+  HANDLE handles[2];
+  DWORD waitrc;
+
+  TRACE_BEG (DEBUG_ASSUAN, "gpgex_launch_wait", launch,
+             "timeout=%u", timeout);
+
+  *r_launcher = launch->owner;
+  if (launch->owner)
+    return TRACE_GPGERR (0);
+
+  /* If both are signalled the lower index wins; thus a launcher which
+     succeeded is never mistaken for one which gave up.  */
+  handles[0] = launch->ready;
+  handles[1] = launch->mutex;
+  waitrc = WaitForMultipleObjects (2, handles, FALSE, timeout);
+  if (waitrc == WAIT_OBJECT_0)
+    return TRACE_GPGERR (0);
+  if (waitrc == WAIT_OBJECT_0 + 1 || waitrc == WAIT_ABANDONED_0 + 1)
+    {
+      (void) TRACE_LOG ("launcher gave up - taking over");
+      launch_take_ownership (launch);
+      *r_launcher = 1;
+      return TRACE_GPGERR (0);
+    }
+  if (waitrc == WAIT_TIMEOUT)
+    return TRACE_GPGERR (gpg_error (GPG_ERR_TIMEOUT));
+
+  (void) TRACE_LOG ("error waiting for the launcher: (code=%d) rc=%d",
+                    (int) waitrc, (int) GetLastError ());
+  return TRACE_GPGERR (gpg_error (GPG_ERR_GENERAL));
+}
+
+
+void
+gpgex_launch_done (gpgex_launch_t launch, int ready)
+{
+  if (launch && launch->owner)
+    {
+      _TRACE (DEBUG_ASSUAN, "gpgex_launch_done", launch);
+
+      (void) TRACE_LOG ("ready=%d", ready);
+      if (ready)
+        SetEvent (launch->ready);
+      if (!ReleaseMutex (launch->mutex))
+        (void) TRACE_LOG ("failed to release the sentinel: rc=%d",
+                          (int) GetLastError ());
+      launch->owner = 0;
+    }
+}
+
+
+void
+gpgex_launch_release (gpgex_launch_t launch)
+{
+  if (!launch)
+    return;
+
+  gpgex_launch_done (launch, 0);
+  if (launch->mutex)
+    CloseHandle (launch->mutex);
+  if (launch->ready)
+    CloseHandle (launch->ready);
+  free (launch);
+}
+
+
 /* Fork and exec the program with /dev/null as stdin, stdout and
    stderr.  Returns 0 on success or an error code.  */
 gpg_error_t
@@ -218,8 +254,8 @@ gpgex_spawn_detached (const char *pgmname, const char *cmdline)
   STARTUPINFO si;
   int cr_flags;
 
-  TRACE_BEG2 (DEBUG_ASSUAN, "gpgex_spawn_detached", cmdline,
-	      "pgm=%s cmdline=%s", pgmname, cmdline);
+  TRACE_BEG (DEBUG_ASSUAN, "gpgex_spawn_detached", cmdline,
+	     "pgm=%s cmdline=%s", pgmname, cmdline);
 
   /* Prepare security attributes.  */
   memset (&sec_attr, 0, sizeof sec_attr);
@@ -250,9 +286,11 @@ gpgex_spawn_detached (const char *pgmname, const char *cmdline)
                       &pi            /* Returns process information.  */
                       ))
     {
-      (void) TRACE_LOG1 ("CreateProcess failed: %i\n", GetLastError ());
+      (void) TRACE_LOG ("CreateProcess failed: %i", (int) GetLastError ());
+      gpgex_stats_inc (GPGEX_STAT_SPAWN_FAILURES);
       return gpg_error (GPG_ERR_GENERAL);
     }
+  gpgex_stats_inc (GPGEX_STAT_SPAWNS);
 
   /* Process has been created suspended; resume it now. */
   CloseHandle (pi.hThread);
@@ -262,14 +300,67 @@ gpgex_spawn_detached (const char *pgmname, const char *cmdline)
 }
 
 
-/* Fork and exec PGMNAME with args in CMDLINE and /dev/null connected
- * to stdin and stderr.  Read from stdout and return the result as a
- * malloced string at R_STRING.  Returns 0 on success or an error code.  */
-gpg_error_t
-gpgex_spawn_get_string (const char *pgmname, const char *cmdline,
-                        char **r_string)
+/* Create a pipe for reading the output of a child.  The read end
+   R_READ supports overlapped I/O, which anonymous pipes do not, thus
+   a uniquely named pipe is used.  The write end R_WRITE is
+   inheritable.  */
+static gpg_error_t
+create_capture_pipe (HANDLE *r_read, HANDLE *r_write)
 {
+  static LONG counter;
   SECURITY_ATTRIBUTES sec_attr;
+  char name[80];
+
+  snprintf (name, sizeof name, "\\\\.\\pipe\\gpgex-capture-%lu-%ld",
+            (unsigned long) GetCurrentProcessId (),
+            (long) InterlockedIncrement (&counter));
+
+  *r_read = CreateNamedPipeA (name,
+                              PIPE_ACCESS_INBOUND | FILE_FLAG_OVERLAPPED
+                              | FILE_FLAG_FIRST_PIPE_INSTANCE,
+                              PIPE_TYPE_BYTE | PIPE_WAIT
+                              | PIPE_REJECT_REMOTE_CLIENTS,
+                              1, 0, 4096, 0, NULL);
+  if (*r_read == INVALID_HANDLE_VALUE)
+    return gpg_error (GPG_ERR_GENERAL);
+
+  memset (&sec_attr, 0, sizeof sec_attr);
+  sec_attr.nLength = sizeof sec_attr;
+  sec_attr.bInheritHandle = TRUE;
+
+  *r_write = CreateFileA (name, GENERIC_WRITE, 0, &sec_attr, OPEN_EXISTING,
+                          FILE_ATTRIBUTE_NORMAL, NULL);
+  if (*r_write == INVALID_HANDLE_VALUE)
+    {
+      CloseHandle (*r_read);
+      *r_read = INVALID_HANDLE_VALUE;
+      return gpg_error (GPG_ERR_GENERAL);
+    }
+  return 0;
+}
+
+
+/* Return the milliseconds left from TIMEOUT since START or INFINITE
+   if there is no timeout.  */
+static DWORD
+remaining_time (DWORD start, unsigned int timeout)
+{
+  DWORD elapsed;
+
+  if (!timeout)
+    return INFINITE;
+  elapsed = GetTickCount () - start;
+  return elapsed < timeout ? timeout - elapsed : 0;
+}
+
+
+gpg_error_t
+gpgex_spawn_capture (const char *pgmname, const char *cmdline,
+                     unsigned int timeout, unsigned int flags,
+                     gpgex_capture_cb_t cb, void *opaque,
+                     char **r_output, size_t *r_outputlen, int *r_exitcode)
+{
+  gpg_error_t err = 0;
   HANDLE rh, wh;
   PROCESS_INFORMATION pi =
     {
@@ -279,31 +370,26 @@ gpgex_spawn_get_string (const char *pgmname, const char *cmdline,
       0          /* Returns tid.  */
     };
   STARTUPINFO si;
+  OVERLAPPED ov;
+  DWORD start, exitcode;
   membuf_t mb;
 
-  *r_string = NULL;
+  if (r_output)
+    *r_output = NULL;
+  if (r_outputlen)
+    *r_outputlen = 0;
+  if (r_exitcode)
+    *r_exitcode = -1;
 
-  TRACE_BEG2 (DEBUG_ASSUAN, "gpgex_spawn_get_string", cmdline,
-	      "pgm=%s cmdline=%s", pgmname, cmdline);
+  TRACE_BEG (DEBUG_ASSUAN, "gpgex_spawn_capture", cmdline,
+	     "pgm=%s cmdline=%s timeout=%u", pgmname, cmdline, timeout);
 
-  /* Set the inherit flag for the pipe into the securit attributes.  */
-  memset (&sec_attr, 0, sizeof sec_attr);
-  sec_attr.nLength = sizeof sec_attr;
-  sec_attr.bInheritHandle = TRUE;
+  start = GetTickCount ();
 
-  /* Create a pipe to read form stdout.  */
-  if (!CreatePipe (&rh, &wh, &sec_attr, 0))
+  if (create_capture_pipe (&rh, &wh))
     {
-      TRACE_LOG1 ("CreatePipe failed: ec=%d", (int) GetLastError ());
-      return gpg_error (GPG_ERR_GENERAL);
-    }
-
-  /* Set the read end to non-inheritable.  */
-  if (!SetHandleInformation (rh, HANDLE_FLAG_INHERIT, 0))
-    {
-      TRACE_LOG1 ("SHI failed: ec=%d", (int) GetLastError ());
-      CloseHandle (rh);
-      CloseHandle (wh);
+      (void) TRACE_LOG ("creating the pipe failed: ec=%d",
+                        (int) GetLastError ());
       return gpg_error (GPG_ERR_GENERAL);
     }
 
@@ -329,33 +415,112 @@ gpgex_spawn_get_string (const char *pgmname, const char *cmdline,
                       &pi            /* Returns process information.  */
                       ))
     {
-      (void) TRACE_LOG1 ("CreateProcess failed: %i\n", GetLastError ());
+      (void) TRACE_LOG ("CreateProcess failed: %i", (int) GetLastError ());
+      gpgex_stats_inc (GPGEX_STAT_SPAWN_FAILURES);
       CloseHandle (rh);
       CloseHandle (wh);
       return gpg_error (GPG_ERR_GENERAL);
     }
+  gpgex_stats_inc (GPGEX_STAT_SPAWNS);
 
   CloseHandle (pi.hThread);
-  CloseHandle (pi.hProcess);
-
   CloseHandle (wh);  /* This end is used by the child.  */
 
+  memset (&ov, 0, sizeof ov);
+  ov.hEvent = CreateEvent (NULL, TRUE, FALSE, NULL);
+  if (!ov.hEvent)
+    err = gpg_error (GPG_ERR_GENERAL);
+
   init_membuf (&mb, 1024);
-  for (;;)
+  while (!err)
     {
-      char readbuf[1024];
+      char readbuf[4096];
       DWORD nread;
 
-      if (!ReadFile (rh, readbuf, sizeof readbuf, &nread, NULL) || !nread)
-        break;
-      put_membuf (&mb, readbuf, nread);
+      if (!ReadFile (rh, readbuf, sizeof readbuf, NULL, &ov)
+          && GetLastError () != ERROR_IO_PENDING)
+        {
+          if (GetLastError () != ERROR_BROKEN_PIPE)
+            err = gpg_error (GPG_ERR_EIO);
+          break;  /* EOF or error.  */
+        }
+
+      if (WaitForSingleObject (ov.hEvent, remaining_time (start, timeout))
+          != WAIT_OBJECT_0)
+        {
+          CancelIo (rh);
+          GetOverlappedResult (rh, &ov, &nread, TRUE);
+          err = gpg_error (GPG_ERR_TIMEOUT);
+          break;
+        }
+
+      if (!GetOverlappedResult (rh, &ov, &nread, FALSE))
+        {
+          if (GetLastError () != ERROR_BROKEN_PIPE)
+            err = gpg_error (GPG_ERR_EIO);
+          break;
+        }
+
+      if (!nread)
+        ;
+      else if (cb)
+        err = cb (opaque, readbuf, nread);
+      else
+        put_membuf (&mb, readbuf, nread);
     }
   CloseHandle (rh);  /* Ready with reading.  */
+  if (ov.hEvent)
+    CloseHandle (ov.hEvent);
+
+  /* The child may still be running after closing its stdout.  */
+  if (WaitForSingleObject (pi.hProcess, remaining_time (start, timeout))
+      != WAIT_OBJECT_0)
+    {
+      if (!err)
+        err = gpg_error (GPG_ERR_TIMEOUT);
+      if ((flags & GPGEX_CAPTURE_KILL))
+        {
+          (void) TRACE_LOG ("timeout - terminating the child");
+          TerminateProcess (pi.hProcess, 1);
+          WaitForSingleObject (pi.hProcess, 1000);
+        }
+      else
+        (void) TRACE_LOG ("timeout - child keeps running");
+    }
+  if (r_exitcode && GetExitCodeProcess (pi.hProcess, &exitcode)
+      && exitcode != STILL_ACTIVE)
+    *r_exitcode = (int) exitcode;
+  CloseHandle (pi.hProcess);
 
   put_membuf (&mb, "", 1);  /* Terminate string.  */
-  *r_string = get_membuf (&mb, NULL);
-  if (!*r_string)
-    return gpg_error (GPG_ERR_EIO);
+  if (!err && !cb && r_output)
+    {
+      size_t len;
+
+      *r_output = get_membuf (&mb, &len);
+      if (!*r_output)
+        err = gpg_error (GPG_ERR_EIO);
+      else if (r_outputlen)
+        *r_outputlen = len - 1;
+    }
+  else
+    free (get_membuf (&mb, NULL));
 
+  if (err)
+    return TRACE_GPGERR (err);
+  (void) TRACE_SUC ("%lu ms", (unsigned long) (GetTickCount () - start));
   return 0;
 }
+
+
+/* Fork and exec PGMNAME with args in CMDLINE and /dev/null connected
+ * to stdin and stderr.  Read from stdout and return the result as a
+ * malloced string at R_STRING.  Returns 0 on success or an error code.  */
+gpg_error_t
+gpgex_spawn_get_string (const char *pgmname, const char *cmdline,
+                        char **r_string)
+{
+  return gpgex_spawn_capture (pgmname, cmdline, SPAWN_GET_STRING_TIMEOUT,
+                              GPGEX_CAPTURE_KILL, NULL, NULL,
+                              r_string, NULL, NULL);
+}
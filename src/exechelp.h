@@ -30,22 +30,78 @@ extern "C" {
 #endif
 #endif
 
+#ifdef HAVE_W32_SYSTEM
 #define lock_spawn_t HANDLE
+#else
+#define lock_spawn_t int
+#endif
 
 gpg_error_t gpgex_lock_spawning (lock_spawn_t *lock);
 void gpgex_unlock_spawning (lock_spawn_t *lock);
 
+/* Coordinated launch of the UI server.  Of all clients which find
+   the server not running, one is designated as the launcher; the
+   others wait until the launcher signals that the server is ready.
+   The launcher uses the same sentinel as gpgex_lock_spawning.  */
+typedef struct gpgex_launch_s *gpgex_launch_t;
+
+/* Start a launch.  On success a new object is stored at R_LAUNCH and
+   R_LAUNCHER is set to true if the caller is the launcher and must
+   start the server and call gpgex_launch_done.  */
+gpg_error_t gpgex_launch_begin (gpgex_launch_t *r_launch, int *r_launcher);
+
+/* Wait at most TIMEOUT milliseconds until the launcher has signalled
+   readiness; then R_LAUNCHER is set to false.  If the launcher gave
+   up instead, the caller becomes the launcher and R_LAUNCHER is set
+   to true.  Returns GPG_ERR_TIMEOUT if neither happened.  */
+gpg_error_t gpgex_launch_wait (gpgex_launch_t launch, unsigned int timeout,
+                               int *r_launcher);
+
+/* Called by the launcher to signal waiters that the server is READY
+   or, if READY is false, that they may try on their own.  */
+void gpgex_launch_done (gpgex_launch_t launch, int ready);
+
+/* Release LAUNCH.  An unfinished launch is given up.  */
+void gpgex_launch_release (gpgex_launch_t launch);
+
 /* Fork and exec CMDLINE with /dev/null as stdin, stdout and stderr.
    Returns 0 on success or an error code.  */
 gpg_error_t gpgex_spawn_detached (const char *pgmname, const char *cmdline);
 
 /* Fork and exec PGMNAME with args in CMDLINE and /dev/null connected
  * to stdin and stderr.  Read from stdout and return the result as a
- * malloced string at R_STRING.  Returns 0 on success or an error code.  */
+ * malloced string at R_STRING.  Returns 0 on success or an error code.
+ * The child is killed if it does not finish within a few seconds.  */
 gpg_error_t gpgex_spawn_get_string (const char *pgmname, const char *cmdline,
                                     char **r_string);
 
 
+/* Flags for gpgex_spawn_capture.  */
+#define GPGEX_CAPTURE_KILL	1  /* Terminate the child on timeout.  */
+
+/* The type of the callback used by gpgex_spawn_capture to stream the
+   output of the child.  A return value other than 0 stops the
+   capture and is returned by gpgex_spawn_capture.  */
+typedef gpg_error_t (*gpgex_capture_cb_t) (void *opaque,
+                                           const void *buffer,
+                                           size_t length);
+
+/* Fork and exec PGMNAME with args in CMDLINE and /dev/null connected
+   to stdin and stderr.  Read from stdout until EOF or until TIMEOUT
+   milliseconds have passed; 0 means no limit.  If CB is not NULL the
+   output is passed to it, otherwise it is collected and returned as
+   a malloced and Nul terminated string at R_OUTPUT with its length
+   at R_OUTPUTLEN; both may be NULL.  The exit code of the child is
+   stored at R_EXITCODE or -1 if it is not known.  On timeout
+   GPG_ERR_TIMEOUT is returned and, if FLAGS has GPGEX_CAPTURE_KILL,
+   the child is terminated.  */
+gpg_error_t gpgex_spawn_capture (const char *pgmname, const char *cmdline,
+                                 unsigned int timeout, unsigned int flags,
+                                 gpgex_capture_cb_t cb, void *opaque,
+                                 char **r_output, size_t *r_outputlen,
+                                 int *r_exitcode);
+
+
 #ifdef __cplusplus
 #if 0
 {
@@ -22,6 +22,9 @@
 #include <config.h>
 #endif
 
+#include <stdio.h>
+#include <string.h>
+
 #include <windows.h>
 
 #include "main.h"
@@ -31,6 +34,21 @@
 
 /* The class ID in a form that can be used by certain interfaces.  */
 CLSID CLSID_gpgex = CLSID_GPGEX;
+CLSID CLSID_gpgex_encrypted = CLSID_GPGEX_ENCRYPTED;
+CLSID CLSID_gpgex_signed = CLSID_GPGEX_SIGNED;
+CLSID CLSID_gpgex_infotip = CLSID_GPGEX_INFOTIP;
+
+/* The key below which the Explorer looks for overlay handlers.  */
+#define OVERLAY_KEY \
+  "Software\\Microsoft\\Windows\\CurrentVersion\\Explorer" \
+  "\\ShellIconOverlayIdentifiers\\"
+
+/* The key below a file type for the info tip handler, which is the
+   interface ID of IQueryInfo.  */
+#define INFOTIP_KEY "\\ShellEx\\{00021500-0000-0000-C000-000000000046}"
+
+/* The file types which get our info tip.  */
+static const char *infotip_types[] = { ".gpg", ".pgp", ".asc", ".sig" };
 
 
 /* Because we do not use a type library (.tlb) resource file, we have
@@ -39,6 +57,145 @@ CLSID CLSID_gpgex = CLSID_GPGEX;
    interfaces.  So, for example, we do not need to register proxy/stub
    DLLs.  */
 
+/* Register the in-process server with the class ID CLSID_STR and the
+   human readable NAME.  */
+static void
+register_clsid (const char *clsid_str, const char *name)
+{
+  char key[MAX_PATH];
+  char value[MAX_PATH];
+  HKEY key_handle = 0;
+
+  snprintf (key, sizeof key, "CLSID\\{%s}", clsid_str);
+  RegCreateKey (HKEY_CLASSES_ROOT, key, &key_handle);
+  RegSetValueEx (key_handle, 0, 0, REG_SZ, (BYTE *) name, strlen (name) + 1);
+  RegCloseKey (key_handle);
+
+  snprintf (key, sizeof key, "CLSID\\{%s}\\InprocServer32", clsid_str);
+  RegCreateKey (HKEY_CLASSES_ROOT, key, &key_handle);
+  GetModuleFileName (gpgex_server::instance, value, MAX_PATH);
+  RegSetValueEx (key_handle, 0, 0, REG_SZ, (BYTE *) value, strlen (value) + 1);
+  strcpy (key, "ThreadingModel");
+  strcpy (value, "Apartment");
+  RegSetValueEx (key_handle, key, 0, REG_SZ,
+		 (BYTE *) value, strlen (value) + 1);
+  RegCloseKey (key_handle);
+}
+
+
+/* Unregister the class ID CLSID_STR.  */
+static void
+unregister_clsid (const char *clsid_str)
+{
+  char key[MAX_PATH];
+
+  snprintf (key, sizeof key, "CLSID\\{%s}\\InprocServer32", clsid_str);
+  RegDeleteKey (HKEY_CLASSES_ROOT, key);
+  snprintf (key, sizeof key, "CLSID\\{%s}", clsid_str);
+  RegDeleteKey (HKEY_CLASSES_ROOT, key);
+}
+
+
+/* Register the icon overlay handler with the class ID CLSID_STR as
+   NAME.  */
+static void
+register_overlay (const char *clsid_str, const char *name)
+{
+  char key[MAX_PATH];
+  char value[MAX_PATH];
+  HKEY key_handle = 0;
+
+  register_clsid (clsid_str, name);
+
+  /* The Explorer uses only the first 15 handlers in the order of
+     their names.  */
+  snprintf (key, sizeof key, OVERLAY_KEY "%s", name);
+  RegCreateKey (HKEY_LOCAL_MACHINE, key, &key_handle);
+  snprintf (value, sizeof value, "{%s}", clsid_str);
+  RegSetValueEx (key_handle, 0, 0, REG_SZ, (BYTE *) value, strlen (value) + 1);
+  RegCloseKey (key_handle);
+}
+
+
+/* Unregister the icon overlay handler with the class ID CLSID_STR
+   registered as NAME.  */
+static void
+unregister_overlay (const char *clsid_str, const char *name)
+{
+  char key[MAX_PATH];
+
+  snprintf (key, sizeof key, OVERLAY_KEY "%s", name);
+  RegDeleteKey (HKEY_LOCAL_MACHINE, key);
+  unregister_clsid (clsid_str);
+}
+
+
+/* Store the info tip handler of the file type TYPE at BUFFER of
+   LENGTH bytes.  Returns false if the type has none.  */
+static bool
+get_infotip_handler (const char *type, char *buffer, DWORD length)
+{
+  char key[MAX_PATH];
+  HKEY key_handle;
+  DWORD kind;
+  LONG rc;
+
+  snprintf (key, sizeof key, "%s" INFOTIP_KEY, type);
+  if (RegOpenKeyEx (HKEY_CLASSES_ROOT, key, 0, KEY_READ, &key_handle)
+      != ERROR_SUCCESS)
+    return false;
+  length--;
+  rc = RegQueryValueEx (key_handle, NULL, NULL, &kind, (BYTE *) buffer,
+                        &length);
+  RegCloseKey (key_handle);
+  if (rc != ERROR_SUCCESS || kind != REG_SZ)
+    return false;
+  buffer[length] = 0;
+  return *buffer != 0;
+}
+
+
+/* Register our info tip handler for the file type TYPE unless the
+   type has another one.  */
+static void
+register_infotip (const char *type)
+{
+  char key[MAX_PATH];
+  char value[MAX_PATH];
+  HKEY key_handle = 0;
+
+  if (get_infotip_handler (type, value, sizeof value)
+      && _stricmp (value, "{" CLSID_GPGEX_INFOTIP_STR "}"))
+    {
+      _gpgex_debug (DEBUG_INIT, "info tip for %s is %s, not replaced",
+                    type, value);
+      return;
+    }
+
+  snprintf (key, sizeof key, "%s" INFOTIP_KEY, type);
+  RegCreateKey (HKEY_CLASSES_ROOT, key, &key_handle);
+  strcpy (value, "{" CLSID_GPGEX_INFOTIP_STR "}");
+  RegSetValueEx (key_handle, 0, 0, REG_SZ, (BYTE *) value, strlen (value) + 1);
+  RegCloseKey (key_handle);
+}
+
+
+/* Unregister our info tip handler for the file type TYPE.  The
+   handler of someone else is kept.  */
+static void
+unregister_infotip (const char *type)
+{
+  char key[MAX_PATH];
+  char value[MAX_PATH];
+
+  if (!get_infotip_handler (type, value, sizeof value)
+      || _stricmp (value, "{" CLSID_GPGEX_INFOTIP_STR "}"))
+    return;
+  snprintf (key, sizeof key, "%s" INFOTIP_KEY, type);
+  RegDeleteKey (HKEY_CLASSES_ROOT, key);
+}
+
+
 /* Register the GpgEX component.  */
 void
 gpgex_class::init (void)
@@ -46,6 +203,7 @@ gpgex_class::init (void)
   char key[MAX_PATH];
   char value[MAX_PATH];
   HKEY key_handle = 0;
+  size_t i;
 
   /* FIXME: Error handling?  */
 
@@ -83,6 +241,13 @@ gpgex_class::init (void)
   RegSetValueEx (key_handle, 0, 0, REG_SZ, (BYTE *) value, strlen (value) + 1);
   RegCloseKey (key_handle);
 
+  register_overlay (CLSID_GPGEX_ENCRYPTED_STR, "GpgEX Encrypted");
+  register_overlay (CLSID_GPGEX_SIGNED_STR, "GpgEX Signed");
+
+  register_clsid (CLSID_GPGEX_INFOTIP_STR, "GpgEX Info Tip");
+  for (i = 0; i < sizeof infotip_types / sizeof infotip_types[0]; i++)
+    register_infotip (infotip_types[i]);
+
 #if 0
   /* We also have to approve the shell extension for Windows NT.  */
   strcpy (key, "Software\\Microsoft\\Windows\\CurrentVersion\\Shell Extensions\\Approved");
@@ -101,6 +266,8 @@ gpgex_class::init (void)
 void
 gpgex_class::deinit (void)
 {
+  size_t i;
+
   /* FIXME: Error handling?  */
 
 #if 0
@@ -109,6 +276,13 @@ gpgex_class::deinit (void)
 		  "\\Shell Extensions\\Approved", "{" CLSID_GPGEX_STR "}");
 #endif
 
+  for (i = 0; i < sizeof infotip_types / sizeof infotip_types[0]; i++)
+    unregister_infotip (infotip_types[i]);
+  unregister_clsid (CLSID_GPGEX_INFOTIP_STR);
+
+  unregister_overlay (CLSID_GPGEX_SIGNED_STR, "GpgEX Signed");
+  unregister_overlay (CLSID_GPGEX_ENCRYPTED_STR, "GpgEX Encrypted");
+
   RegDeleteKey (HKEY_CLASSES_ROOT,
 		"Directory\\ShellEx\\ContextMenuHandlers\\GpgEX");
   RegDeleteKey (HKEY_CLASSES_ROOT,
@@ -35,6 +35,25 @@
 /* The class ID in a form that can be used by certain interfaces.  */
 extern CLSID CLSID_gpgex;
 
+/* The icon overlay handlers, see gpgex-overlay.h.  The Explorer
+   takes one overlay from each class.  */
+#define CLSID_GPGEX_ENCRYPTED_STR "4F161C2F-95E5-4243-B6E9-03EC17866F13"
+#define CLSID_GPGEX_ENCRYPTED { 0x4f161c2f, 0x95e5, 0x4243,	\
+      { 0xb6, 0xe9, 0x03, 0xec, 0x17, 0x86, 0x6f, 0x13 } };
+#define CLSID_GPGEX_SIGNED_STR "9D562997-1293-49A4-9DD1-30EAD833D80A"
+#define CLSID_GPGEX_SIGNED { 0x9d562997, 0x1293, 0x49a4,		\
+      { 0x9d, 0xd1, 0x30, 0xea, 0xd8, 0x33, 0xd8, 0x0a } };
+
+extern CLSID CLSID_gpgex_encrypted;
+extern CLSID CLSID_gpgex_signed;
+
+/* The info tip handler, see gpgex-infotip.h.  */
+#define CLSID_GPGEX_INFOTIP_STR "F666428D-087E-4DC3-9A90-E47EFD246AE8"
+#define CLSID_GPGEX_INFOTIP { 0xf666428d, 0x087e, 0x4dc3,		\
+      { 0x9a, 0x90, 0xe4, 0x7e, 0xfd, 0x24, 0x6a, 0xe8 } };
+
+extern CLSID CLSID_gpgex_infotip;
+
 /* We do not use custom interfaces.  This also spares us from
    implementing and registering a proxy/stub DLL.  */
 
@@ -26,6 +26,9 @@
 
 #include "main.h"
 #include "gpgex.h"
+#include "gpgex-overlay.h"
+#include "gpgex-infotip.h"
+#include "metacache.h"
 
 #include "gpgex-factory.h"
 
@@ -35,9 +38,8 @@
 STDMETHODIMP
 gpgex_factory_t::QueryInterface (REFIID riid, void **ppv)
 {
-#define _TRACE_BEG12(a,b,c,d,e,f) TRACE_BEG12 (a,b,c,d,e,f)
-  _TRACE_BEG12 (DEBUG_INIT, "gpgex_factory_t::QueryInterface", this,
-		"riid=" GUID_FMT ", ppv=%p", GUID_ARG (riid), ppv);
+  TRACE_BEG (DEBUG_INIT, "gpgex_factory_t::QueryInterface", this,
+	     "riid=" GUID_FMT ", ppv=%p", GUID_ARG (riid), ppv);
 
   if (ppv == NULL)
     return TRACE_RES (E_INVALIDARG);
@@ -93,10 +95,9 @@ gpgex_factory_t::CreateInstance (LPUNKNOWN punkOuter, REFIID riid,
 {
   HRESULT result;
 
-#define _TRACE_BEG13(a,b,c,d,e,f,g) TRACE_BEG13 (a,b,c,d,e,f,g)
-  _TRACE_BEG13 (DEBUG_INIT, "gpgex_factory_t::CreateInstance", this,
-		"punkOuter=%lu, riid=" GUID_FMT ", ppv=%p",
-		punkOuter, GUID_ARG (riid), ppv);
+  TRACE_BEG (DEBUG_INIT, "gpgex_factory_t::CreateInstance", this,
+	     "punkOuter=%p, riid=" GUID_FMT ", ppv=%p",
+	     punkOuter, GUID_ARG (riid), ppv);
 
   /* Be nice to broken software.  */
   *ppv = NULL;
@@ -120,8 +121,8 @@ gpgex_factory_t::CreateInstance (LPUNKNOWN punkOuter, REFIID riid,
 STDMETHODIMP
 gpgex_factory_t::LockServer (BOOL fLock)
 {
-  (void) TRACE1 (DEBUG_INIT, "gpgex_factory_t::LockServer", this,
-		 "fLock=%s", fLock ? "true" : "false");
+  (void) TRACE (DEBUG_INIT, "gpgex_factory_t::LockServer", this,
+		"fLock=%s", fLock ? "true" : "false");
 
   /* Locking the singleton gpgex factory object acquires a reference
      for the server component.  */
@@ -137,3 +138,192 @@ gpgex_factory_t::LockServer (BOOL fLock)
 
 /* The global singleton instance of the GpgEX factory.  */
 gpgex_factory_t gpgex_factory;
+
+
+
+/* The overlay factories are singletons as well.  */
+
+STDMETHODIMP
+gpgex_overlay_factory_t::QueryInterface (REFIID riid, void **ppv)
+{
+  TRACE_BEG (DEBUG_INIT, "gpgex_overlay_factory_t::QueryInterface", this,
+	     "riid=" GUID_FMT ", ppv=%p", GUID_ARG (riid), ppv);
+
+  if (ppv == NULL)
+    return TRACE_RES (E_INVALIDARG);
+
+  /* Be nice to broken software.  */
+  *ppv = NULL;
+
+  if (riid == IID_IUnknown)
+    *ppv = static_cast<IUnknown *> (this);
+  else if (riid == IID_IClassFactory)
+    *ppv = static_cast<IClassFactory *> (this);
+  else
+    return TRACE_RES (E_NOINTERFACE);
+
+  reinterpret_cast<IUnknown *>(*ppv)->AddRef ();
+
+  return TRACE_RES (S_OK);
+}
+
+
+STDMETHODIMP_(ULONG)
+gpgex_overlay_factory_t::AddRef (void)
+{
+  (void) TRACE (DEBUG_INIT, "gpgex_overlay_factory_t::AddRef", this);
+
+  return 1;
+}
+
+
+STDMETHODIMP_(ULONG)
+gpgex_overlay_factory_t::Release (void)
+{
+  (void) TRACE (DEBUG_INIT, "gpgex_overlay_factory_t::Release", this);
+
+  return 1;
+}
+
+
+STDMETHODIMP
+gpgex_overlay_factory_t::CreateInstance (LPUNKNOWN punkOuter, REFIID riid,
+					 void **ppv)
+{
+  HRESULT result;
+
+  TRACE_BEG (DEBUG_INIT, "gpgex_overlay_factory_t::CreateInstance", this,
+	     "punkOuter=%p, riid=" GUID_FMT ", ppv=%p",
+	     punkOuter, GUID_ARG (riid), ppv);
+
+  /* Be nice to broken software.  */
+  *ppv = NULL;
+
+  /* Aggregation is not supported.  */
+  if (punkOuter)
+    return TRACE_RES (CLASS_E_NOAGGREGATION);
+
+  gpgex_overlay_t *overlay = new gpgex_overlay_t (this->kind);
+  if (!overlay)
+    return TRACE_RES (E_OUTOFMEMORY);
+
+  result = overlay->QueryInterface (riid, ppv);
+  if (FAILED (result))
+    delete overlay;
+
+  return TRACE_RES (result);
+}
+
+
+STDMETHODIMP
+gpgex_overlay_factory_t::LockServer (BOOL fLock)
+{
+  (void) TRACE (DEBUG_INIT, "gpgex_overlay_factory_t::LockServer", this,
+		"fLock=%s", fLock ? "true" : "false");
+
+  if (fLock)
+    gpgex_server::add_ref ();
+  else
+    gpgex_server::release ();
+
+  return S_OK;
+}
+
+
+/* The global singleton instances of the overlay factories.  */
+gpgex_overlay_factory_t gpgex_encrypted_factory (GPGEX_META_ENCRYPTED);
+gpgex_overlay_factory_t gpgex_signed_factory (GPGEX_META_SIGNED);
+
+
+
+/* The info tip factory.  */
+
+STDMETHODIMP
+gpgex_infotip_factory_t::QueryInterface (REFIID riid, void **ppv)
+{
+  TRACE_BEG (DEBUG_INIT, "gpgex_infotip_factory_t::QueryInterface", this,
+	     "riid=" GUID_FMT ", ppv=%p", GUID_ARG (riid), ppv);
+
+  if (ppv == NULL)
+    return TRACE_RES (E_INVALIDARG);
+
+  /* Be nice to broken software.  */
+  *ppv = NULL;
+
+  if (riid == IID_IUnknown)
+    *ppv = static_cast<IUnknown *> (this);
+  else if (riid == IID_IClassFactory)
+    *ppv = static_cast<IClassFactory *> (this);
+  else
+    return TRACE_RES (E_NOINTERFACE);
+
+  reinterpret_cast<IUnknown *>(*ppv)->AddRef ();
+
+  return TRACE_RES (S_OK);
+}
+
+
+STDMETHODIMP_(ULONG)
+gpgex_infotip_factory_t::AddRef (void)
+{
+  (void) TRACE (DEBUG_INIT, "gpgex_infotip_factory_t::AddRef", this);
+
+  return 1;
+}
+
+
+STDMETHODIMP_(ULONG)
+gpgex_infotip_factory_t::Release (void)
+{
+  (void) TRACE (DEBUG_INIT, "gpgex_infotip_factory_t::Release", this);
+
+  return 1;
+}
+
+
+STDMETHODIMP
+gpgex_infotip_factory_t::CreateInstance (LPUNKNOWN punkOuter, REFIID riid,
+					 void **ppv)
+{
+  HRESULT result;
+
+  TRACE_BEG (DEBUG_INIT, "gpgex_infotip_factory_t::CreateInstance", this,
+	     "punkOuter=%p, riid=" GUID_FMT ", ppv=%p",
+	     punkOuter, GUID_ARG (riid), ppv);
+
+  /* Be nice to broken software.  */
+  *ppv = NULL;
+
+  /* Aggregation is not supported.  */
+  if (punkOuter)
+    return TRACE_RES (CLASS_E_NOAGGREGATION);
+
+  gpgex_infotip_t *infotip = new gpgex_infotip_t;
+  if (!infotip)
+    return TRACE_RES (E_OUTOFMEMORY);
+
+  result = infotip->QueryInterface (riid, ppv);
+  if (FAILED (result))
+    delete infotip;
+
+  return TRACE_RES (result);
+}
+
+
+STDMETHODIMP
+gpgex_infotip_factory_t::LockServer (BOOL fLock)
+{
+  (void) TRACE (DEBUG_INIT, "gpgex_infotip_factory_t::LockServer", this,
+		"fLock=%s", fLock ? "true" : "false");
+
+  if (fLock)
+    gpgex_server::add_ref ();
+  else
+    gpgex_server::release ();
+
+  return S_OK;
+}
+
+
+/* The global singleton instance of the info tip factory.  */
+gpgex_infotip_factory_t gpgex_infotip_factory;
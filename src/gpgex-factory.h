@@ -43,4 +43,54 @@ class gpgex_factory_t : public IClassFactory
 /* The global singleton instance of the GpgEX factory.  */
 extern gpgex_factory_t gpgex_factory;
 
+
+/* The class factory of the icon overlay handlers.  KIND is passed to
+   the objects, see gpgex-overlay.h.  */
+class gpgex_overlay_factory_t : public IClassFactory
+{
+ private:
+  unsigned int kind;
+
+ public:
+  gpgex_overlay_factory_t (unsigned int kind_arg)
+    : kind (kind_arg)
+    {
+    }
+
+  /* IUnknown methods.  */
+  STDMETHODIMP QueryInterface (REFIID riid, void **ppv);
+  STDMETHODIMP_(ULONG) AddRef (void);
+  STDMETHODIMP_(ULONG) Release (void);
+
+  /* IClassFactory methods.  */
+  STDMETHODIMP CreateInstance (LPUNKNOWN punkOuter, REFIID iid,
+			       void **ppv);
+  STDMETHODIMP LockServer (BOOL fLock);
+};
+
+
+/* The global singleton instances of the overlay factories.  */
+extern gpgex_overlay_factory_t gpgex_encrypted_factory;
+extern gpgex_overlay_factory_t gpgex_signed_factory;
+
+
+/* The class factory of the info tip handler.  */
+class gpgex_infotip_factory_t : public IClassFactory
+{
+ public:
+  /* IUnknown methods.  */
+  STDMETHODIMP QueryInterface (REFIID riid, void **ppv);
+  STDMETHODIMP_(ULONG) AddRef (void);
+  STDMETHODIMP_(ULONG) Release (void);
+
+  /* IClassFactory methods.  */
+  STDMETHODIMP CreateInstance (LPUNKNOWN punkOuter, REFIID iid,
+			       void **ppv);
+  STDMETHODIMP LockServer (BOOL fLock);
+};
+
+
+/* The global singleton instance of the info tip factory.  */
+extern gpgex_infotip_factory_t gpgex_infotip_factory;
+
 #endif	/* ! GPGEX_FACTORY_H */
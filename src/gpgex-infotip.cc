@@ -0,0 +1,353 @@
+/* gpgex-infotip.cc - info tip handler
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <windows.h>
+#include <shlobj.h>
+
+#include <gpg-error.h>
+
+#include "main.h"
+#include "stats.h"
+#include "keyindex.h"
+#include "metaworker.h"
+
+#include "gpgex-class.h"
+#include "gpgex-infotip.h"
+
+
+/* GetInfoTip waits at most this many milliseconds for the worker
+   to read a file which is not in the cache.  */
+#define INFOTIP_DEADLINE 100
+
+/* The interval in milliseconds for asking the cache again.  */
+#define INFOTIP_POLL 10
+
+
+/* Append the key ID KEYID in hex to TIP.  */
+static void
+append_keyid (string &tip, const unsigned char *keyid)
+{
+  char buf[19];
+  int i;
+
+  strcpy (buf, "0x");
+  for (i = 0; i < 8; i++)
+    snprintf (buf + 2 + 2 * i, 3, "%02X", keyid[i]);
+  tip += buf;
+}
+
+
+/* Make the text of the info tip for META.  */
+static void
+format_tip (const struct gpgex_meta_s *meta, string &tip)
+{
+  static const unsigned char wildcard[8] = { 0 };
+  unsigned int i, n;
+  char buf[64];
+
+  if (meta->flags & GPGEX_META_ENCRYPTED)
+    {
+      if (!meta->nrecipients)
+	tip += _("Encrypted with a password");
+      else
+	{
+	  tip += _("Encrypted for:");
+	  n = meta->nrecipients;
+	  if (n > GPGEX_META_MAX_RECIPIENTS)
+	    n = GPGEX_META_MAX_RECIPIENTS;
+	  for (i = 0; i < n; i++)
+	    {
+	      tip += "\r\n  ";
+	      if (!memcmp (meta->recipients[i], wildcard, 8))
+		{
+		  tip += _("anonymous recipient");
+		  continue;
+		}
+	      append_keyid (tip, meta->recipients[i]);
+	      if (gpgex_keyindex_lookup (meta->recipients[i]) == 1)
+		{
+		  tip += " ";
+		  tip += _("(your key)");
+		}
+	    }
+	  if (meta->nrecipients > n)
+	    {
+	      tip += "\r\n  ";
+	      snprintf (buf, sizeof buf, _("and %u more"),
+			meta->nrecipients - n);
+	      tip += buf;
+	    }
+	}
+    }
+  else if (meta->flags & GPGEX_META_SIGNED)
+    {
+      if (meta->have_issuer)
+	{
+	  string keyid;
+
+	  append_keyid (keyid, meta->issuer);
+	  snprintf (buf, sizeof buf, _("Signed by key %s"), keyid.c_str ());
+	  tip += buf;
+	}
+      else
+	tip += _("Signed");
+    }
+
+  if (meta->flags & GPGEX_META_KEYS)
+    {
+      if (!tip.empty ())
+	tip += "\r\n";
+      tip += _("OpenPGP certificates");
+    }
+}
+
+
+gpgex_infotip_t::gpgex_infotip_t (void)
+  : refcount (0)
+{
+  TRACE_BEG (DEBUG_INIT, "gpgex_infotip_t::gpgex_infotip_t", this);
+
+  gpgex_server::add_ref ();
+
+  (void) TRACE_SUC ();
+}
+
+
+gpgex_infotip_t::~gpgex_infotip_t (void)
+{
+  TRACE_BEG (DEBUG_INIT, "gpgex_infotip_t::~gpgex_infotip_t", this);
+
+  gpgex_server::release ();
+
+  (void) TRACE_SUC ();
+}
+
+
+/* IUnknown methods implementation.  */
+
+STDMETHODIMP
+gpgex_infotip_t::QueryInterface (REFIID riid, void **ppv)
+{
+  TRACE_BEG (DEBUG_INIT, "gpgex_infotip_t::QueryInterface", this,
+	     "riid=" GUID_FMT ", ppv=%p", GUID_ARG (riid), ppv);
+
+  if (ppv == NULL)
+    return TRACE_RES (E_INVALIDARG);
+
+  /* Be nice to broken software.  */
+  *ppv = NULL;
+
+  /* IUnknown is ambiguous, see gpgex_t::QueryInterface.  */
+  if (riid == IID_IUnknown)
+    *ppv = static_cast<IQueryInfo *> (this);
+  else if (riid == IID_IQueryInfo)
+    *ppv = static_cast<IQueryInfo *> (this);
+  else if (riid == IID_IPersistFile)
+    *ppv = static_cast<IPersistFile *> (this);
+  else if (riid == IID_IPersist)
+    *ppv = static_cast<IPersistFile *> (this);
+  else
+    return TRACE_RES (E_NOINTERFACE);
+
+  reinterpret_cast<IUnknown *>(*ppv)->AddRef ();
+
+  return TRACE_RES (S_OK);
+}
+
+
+STDMETHODIMP_(ULONG)
+gpgex_infotip_t::AddRef (void)
+{
+  (void) TRACE (DEBUG_INIT, "gpgex_infotip_t::AddRef", this,
+		"new_refcount=%li", (long) this->refcount + 1);
+
+  return InterlockedIncrement (&this->refcount);
+}
+
+
+STDMETHODIMP_(ULONG)
+gpgex_infotip_t::Release (void)
+{
+  LONG count;
+
+  (void) TRACE (DEBUG_INIT, "gpgex_infotip_t::Release", this,
+		"new_refcount=%li", (long) this->refcount - 1);
+
+  count = InterlockedDecrement (&this->refcount);
+  if (count == 0)
+    delete this;
+
+  return count;
+}
+
+
+/* IPersistFile methods implementation.  Only Load is needed.  */
+
+STDMETHODIMP
+gpgex_infotip_t::GetClassID (CLSID *pClassID)
+{
+  if (!pClassID)
+    return E_POINTER;
+  *pClassID = CLSID_gpgex_infotip;
+  return S_OK;
+}
+
+
+STDMETHODIMP
+gpgex_infotip_t::IsDirty (void)
+{
+  return S_FALSE;
+}
+
+
+STDMETHODIMP
+gpgex_infotip_t::Load (LPCOLESTR pszFileName, DWORD dwMode)
+{
+  char *name;
+
+  (void) dwMode;
+
+  if (!pszFileName)
+    return E_INVALIDARG;
+  name = gpgrt_wchar_to_utf8 (pszFileName);
+  if (!name)
+    return E_OUTOFMEMORY;
+  this->filename = name;
+  free (name);
+  return S_OK;
+}
+
+
+STDMETHODIMP
+gpgex_infotip_t::Save (LPCOLESTR pszFileName, BOOL fRemember)
+{
+  (void) pszFileName;
+  (void) fRemember;
+
+  return E_NOTIMPL;
+}
+
+
+STDMETHODIMP
+gpgex_infotip_t::SaveCompleted (LPCOLESTR pszFileName)
+{
+  (void) pszFileName;
+
+  return E_NOTIMPL;
+}
+
+
+STDMETHODIMP
+gpgex_infotip_t::GetCurFile (LPOLESTR *ppszFileName)
+{
+  (void) ppszFileName;
+
+  return E_NOTIMPL;
+}
+
+
+/* IQueryInfo methods implementation.  */
+
+STDMETHODIMP
+gpgex_infotip_t::GetInfoTip (DWORD dwFlags, LPWSTR *ppwszTip)
+{
+  struct gpgex_meta_s meta;
+  uint64_t start;
+  string tip;
+  wchar_t *wtip;
+  size_t len;
+  int res;
+
+  (void) dwFlags;
+
+  TRACE_BEG (DEBUG_CONTEXT_MENU, "gpgex_infotip_t::GetInfoTip", this,
+	     "filename=%s", this->filename.c_str ());
+
+  if (!ppwszTip)
+    return TRACE_RES (E_INVALIDARG);
+  *ppwszTip = NULL;
+  if (this->filename.empty ())
+    return TRACE_RES (E_FAIL);
+
+  /* Let the key index be built for the next tip.  */
+  gpgex_keyindex_touch ();
+
+  /* Give the worker a short time to read a file which is not known
+     yet.  The cache is not locked while we wait.  An entry being
+     written is read again like a pending one.  */
+  res = gpgex_metaworker_lookup (this->filename.c_str (), &meta);
+  if (res == GPGEX_META_BUSY)
+    meta.flags = GPGEX_META_PENDING;
+  start = gpgex_stats_now ();
+  while (res != GPGEX_META_MISS && (meta.flags & GPGEX_META_PENDING)
+	 && gpgex_stats_now () - start < INFOTIP_DEADLINE * 1000)
+    {
+      Sleep (INFOTIP_POLL);
+      if (gpgex_metacache_get (this->filename.c_str (), &meta)
+	  == GPGEX_META_MISS)
+	meta.flags = GPGEX_META_PENDING;
+    }
+
+  if (meta.flags & GPGEX_META_PENDING)
+    {
+      /* The worker asks the Explorer to update the item when it has
+	 read the file.  */
+      tip = _("Reading the OpenPGP data...");
+      gpgex_stats_inc (GPGEX_STAT_INFOTIP_PLACEHOLDERS);
+    }
+  else
+    format_tip (&meta, tip);
+
+  if (tip.empty ())
+    /* Not OpenPGP data.  The Explorer shows its own tip.  */
+    return TRACE_RES (E_FAIL);
+
+  wtip = gpgrt_utf8_to_wchar (tip.c_str ());
+  if (!wtip)
+    return TRACE_RES (E_OUTOFMEMORY);
+  len = (wcslen (wtip) + 1) * sizeof (wchar_t);
+  *ppwszTip = (LPWSTR) CoTaskMemAlloc (len);
+  if (*ppwszTip)
+    memcpy (*ppwszTip, wtip, len);
+  gpgrt_free_wchar (wtip);
+  if (!*ppwszTip)
+    return TRACE_RES (E_OUTOFMEMORY);
+
+  return TRACE_RES (S_OK);
+}
+
+
+STDMETHODIMP
+gpgex_infotip_t::GetInfoFlags (DWORD *pdwFlags)
+{
+  if (!pdwFlags)
+    return E_INVALIDARG;
+  *pdwFlags = 0;
+  return E_NOTIMPL;
+}
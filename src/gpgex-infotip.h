@@ -0,0 +1,73 @@
+/* gpgex-infotip.h - info tip handler
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#ifndef GPGEX_INFOTIP_H
+#define GPGEX_INFOTIP_H	1
+
+#include <string>
+
+using std::string;
+
+#include <windows.h>
+#include <shlobj.h>
+
+
+/* The info tip handler.  The Explorer loads the file name through
+   IPersistFile and then asks for the tip, which shows the recipients
+   of encrypted files and the signer of signed files.  The tip is
+   made from the metadata cache, see metaworker.h.  If the file has
+   not been read yet, a placeholder is shown; the worker tells the
+   Explorer when the data has arrived.  */
+class gpgex_infotip_t : public IPersistFile, public IQueryInfo
+{
+ private:
+  /* Per-object reference count.  */
+  LONG refcount;
+
+  /* The utf-8 name of the file.  */
+  string filename;
+
+ public:
+  /* Constructors and destructors.  For these, we update the global
+     component reference counter.  */
+  gpgex_infotip_t (void);
+  ~gpgex_infotip_t (void);
+
+  /* IUnknown methods.  */
+  STDMETHODIMP QueryInterface (REFIID riid, void **ppv);
+  STDMETHODIMP_(ULONG) AddRef (void);
+  STDMETHODIMP_(ULONG) Release (void);
+
+  /* IPersist methods.  */
+  STDMETHODIMP GetClassID (CLSID *pClassID);
+
+  /* IPersistFile methods.  */
+  STDMETHODIMP IsDirty (void);
+  STDMETHODIMP Load (LPCOLESTR pszFileName, DWORD dwMode);
+  STDMETHODIMP Save (LPCOLESTR pszFileName, BOOL fRemember);
+  STDMETHODIMP SaveCompleted (LPCOLESTR pszFileName);
+  STDMETHODIMP GetCurFile (LPOLESTR *ppszFileName);
+
+  /* IQueryInfo methods.  */
+  STDMETHODIMP GetInfoTip (DWORD dwFlags, LPWSTR *ppwszTip);
+  STDMETHODIMP GetInfoFlags (DWORD *pdwFlags);
+};
+
+#endif	/* ! GPGEX_INFOTIP_H */
@@ -0,0 +1,247 @@
+/* gpgex-overlay.cc - icon overlay handlers
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <wchar.h>
+
+#include <windows.h>
+#include <shlobj.h>
+
+#include <gpg-error.h>
+
+#include "main.h"
+#include "stats.h"
+#include "resource.h"
+#include "metaworker.h"
+
+#include "gpgex-overlay.h"
+
+
+/* The priority of our overlays, 0 is the highest.  The version
+   control overlays use 0 and should win if a file has both.  */
+#define OVERLAY_PRIORITY 50
+
+/* How often a lookup is repeated while the worker writes the
+   entry.  */
+#define OVERLAY_BUSY_TRIES 10
+
+
+/* Return true if the overlays are enabled.  They are, unless the
+   registry value "GpgEX Overlays" is 0.  */
+static int
+get_overlays_enabled (void)
+{
+  static int enabled = -1;
+
+  if (enabled == -1)
+    {
+      char *value;
+
+      value = gpgrt_w32_reg_get_string ("\\Software\\Gpg4win:GpgEX Overlays");
+      enabled = !value || atoi (value) != 0;
+      free (value);
+    }
+  return enabled;
+}
+
+
+/* Return true if the file name PATH has one of the endings of
+   OpenPGP files.  Only those files are looked at.  */
+static int
+has_pgp_ending (const wchar_t *path)
+{
+  const wchar_t *ending;
+
+  ending = wcsrchr (path, L'.');
+  if (!ending || wcschr (ending, L'\\'))
+    return 0;
+  ending++;
+  return (!_wcsicmp (ending, L"gpg")
+	  || !_wcsicmp (ending, L"pgp")
+	  || !_wcsicmp (ending, L"asc")
+	  || !_wcsicmp (ending, L"sig"));
+}
+
+
+gpgex_overlay_t::gpgex_overlay_t (unsigned int kind_arg)
+  : refcount (0), kind (kind_arg)
+{
+  TRACE_BEG (DEBUG_INIT, "gpgex_overlay_t::gpgex_overlay_t", this,
+	     "kind=%u", kind_arg);
+
+  gpgex_server::add_ref ();
+
+  (void) TRACE_SUC ();
+}
+
+
+gpgex_overlay_t::~gpgex_overlay_t (void)
+{
+  TRACE_BEG (DEBUG_INIT, "gpgex_overlay_t::~gpgex_overlay_t", this);
+
+  gpgex_server::release ();
+
+  (void) TRACE_SUC ();
+}
+
+
+/* IUnknown methods implementation.  */
+
+STDMETHODIMP
+gpgex_overlay_t::QueryInterface (REFIID riid, void **ppv)
+{
+  TRACE_BEG (DEBUG_INIT, "gpgex_overlay_t::QueryInterface", this,
+	     "riid=" GUID_FMT ", ppv=%p", GUID_ARG (riid), ppv);
+
+  if (ppv == NULL)
+    return TRACE_RES (E_INVALIDARG);
+
+  /* Be nice to broken software.  */
+  *ppv = NULL;
+
+  if (riid == IID_IUnknown)
+    *ppv = static_cast<IUnknown *> (this);
+  else if (riid == IID_IShellIconOverlayIdentifier)
+    *ppv = static_cast<IShellIconOverlayIdentifier *> (this);
+  else
+    return TRACE_RES (E_NOINTERFACE);
+
+  reinterpret_cast<IUnknown *>(*ppv)->AddRef ();
+
+  return TRACE_RES (S_OK);
+}
+
+
+STDMETHODIMP_(ULONG)
+gpgex_overlay_t::AddRef (void)
+{
+  (void) TRACE (DEBUG_INIT, "gpgex_overlay_t::AddRef", this,
+		"new_refcount=%li", (long) this->refcount + 1);
+
+  return InterlockedIncrement (&this->refcount);
+}
+
+
+STDMETHODIMP_(ULONG)
+gpgex_overlay_t::Release (void)
+{
+  LONG count;
+
+  (void) TRACE (DEBUG_INIT, "gpgex_overlay_t::Release", this,
+		"new_refcount=%li", (long) this->refcount - 1);
+
+  count = InterlockedDecrement (&this->refcount);
+  if (count == 0)
+    delete this;
+
+  return count;
+}
+
+
+/* IShellIconOverlayIdentifier methods implementation.  */
+
+/* This is called for every file shown by the Explorer and is not
+   traced.  It must not touch the file; the answer comes from the
+   metadata cache, and a miss is answered with S_FALSE.  The worker
+   filling the cache lets the Explorer ask again.  An entry which the
+   worker is writing is read again after giving it the processor; if
+   that does not help, the Explorer is asked to come back instead of
+   being told that the file has no overlay.  */
+STDMETHODIMP
+gpgex_overlay_t::IsMemberOf (LPCWSTR pwszPath, DWORD dwAttrib)
+{
+  struct gpgex_meta_s meta;
+  char *name;
+  int res;
+  int tries;
+
+  if (!pwszPath || (dwAttrib & SFGAO_FOLDER)
+      || !get_overlays_enabled () || !has_pgp_ending (pwszPath))
+    return S_FALSE;
+
+  name = gpgrt_wchar_to_utf8 (pwszPath);
+  if (!name)
+    return S_FALSE;
+  res = gpgex_metaworker_lookup (name, &meta);
+  for (tries = 0; res == GPGEX_META_BUSY && tries < OVERLAY_BUSY_TRIES;
+       tries++)
+    {
+      SwitchToThread ();
+      res = gpgex_metaworker_lookup (name, &meta);
+    }
+  free (name);
+  if (res == GPGEX_META_BUSY)
+    {
+      SHChangeNotify (SHCNE_UPDATEITEM, SHCNF_PATHW | SHCNF_FLUSHNOWAIT,
+		      pwszPath, NULL);
+      return E_PENDING;
+    }
+  if (res == GPGEX_META_MISS || !(meta.flags & this->kind))
+    return S_FALSE;
+
+  /* Signed and encrypted files get only the lock.  */
+  if (this->kind == GPGEX_META_SIGNED && (meta.flags & GPGEX_META_ENCRYPTED))
+    return S_FALSE;
+
+  gpgex_stats_inc (GPGEX_STAT_OVERLAY_HITS);
+  return S_OK;
+}
+
+
+STDMETHODIMP
+gpgex_overlay_t::GetOverlayInfo (LPWSTR pwszIconFile, int cchMax,
+				 int *pIndex, DWORD *pdwFlags)
+{
+  DWORD len;
+
+  TRACE_BEG (DEBUG_INIT, "gpgex_overlay_t::GetOverlayInfo", this,
+	     "kind=%u", this->kind);
+
+  if (!pwszIconFile || cchMax <= 0 || !pIndex || !pdwFlags)
+    return TRACE_RES (E_INVALIDARG);
+
+  /* The icons are resources of this DLL.  A negative index is a
+     resource ID.  */
+  len = GetModuleFileNameW (gpgex_server::instance, pwszIconFile, cchMax);
+  if (len == 0 || len >= (DWORD) cchMax)
+    return TRACE_RES (E_FAIL);
+
+  *pIndex = -(this->kind == GPGEX_META_ENCRYPTED
+	      ? IDI_OVERLAY_ENCRYPTED : IDI_OVERLAY_SIGNED);
+  *pdwFlags = ISIOI_ICONFILE | ISIOI_ICONINDEX;
+
+  return TRACE_RES (S_OK);
+}
+
+
+STDMETHODIMP
+gpgex_overlay_t::GetPriority (int *pPriority)
+{
+  (void) TRACE (DEBUG_INIT, "gpgex_overlay_t::GetPriority", this);
+
+  if (!pPriority)
+    return E_INVALIDARG;
+  *pPriority = OVERLAY_PRIORITY;
+  return S_OK;
+}
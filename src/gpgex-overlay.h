@@ -0,0 +1,63 @@
+/* gpgex-overlay.h - icon overlay handlers
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#ifndef GPGEX_OVERLAY_H
+#define GPGEX_OVERLAY_H	1
+
+#include <windows.h>
+#include <shlobj.h>
+
+
+/* The icon overlay handler.  The Explorer knows only one overlay per
+   handler, so there is one class ID for each of the kinds of files
+   marked, and one instance of this class is created for each of them.
+   KIND is GPGEX_META_ENCRYPTED or GPGEX_META_SIGNED.
+
+   IsMemberOf is called for every file shown, on the UI thread of the
+   Explorer.  It is answered from the metadata cache only, see
+   metaworker.h.  */
+class gpgex_overlay_t : public IShellIconOverlayIdentifier
+{
+ private:
+  /* Per-object reference count.  */
+  LONG refcount;
+
+  /* The flag of struct gpgex_meta_s which selects the files.  */
+  unsigned int kind;
+
+ public:
+  /* Constructors and destructors.  For these, we update the global
+     component reference counter.  */
+  gpgex_overlay_t (unsigned int kind_arg);
+  ~gpgex_overlay_t (void);
+
+  /* IUnknown methods.  */
+  STDMETHODIMP QueryInterface (REFIID riid, void **ppv);
+  STDMETHODIMP_(ULONG) AddRef (void);
+  STDMETHODIMP_(ULONG) Release (void);
+
+  /* IShellIconOverlayIdentifier methods.  */
+  STDMETHODIMP IsMemberOf (LPCWSTR pwszPath, DWORD dwAttrib);
+  STDMETHODIMP GetOverlayInfo (LPWSTR pwszIconFile, int cchMax,
+			       int *pIndex, DWORD *pdwFlags);
+  STDMETHODIMP GetPriority (int *pPriority);
+};
+
+#endif	/* ! GPGEX_OVERLAY_H */
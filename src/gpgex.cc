@@ -37,6 +37,9 @@ using std::string;
 
 #include "main.h"
 #include "client.h"
+#include "stats.h"
+#include "pgpinfo.h"
+#include "keyindex.h"
 
 #include "gpgex.h"
 
@@ -55,19 +58,29 @@ using std::string;
 #define ID_CMD_VERIFY_CHECKSUMS 9
 #define ID_CMD_POPUP		10
 #define ID_CMD_ABOUT		11
-#define ID_CMD_MAX		11
+#define ID_CMD_ENCRYPT_ARCHIVE	12
+#define ID_CMD_MAX		12
 
 #define ID_CMD_STR_ABOUT         	_("About GpgEX")
 #define ID_CMD_STR_DECRYPT_VERIFY	_("Decrypt and verify")
+#define ID_CMD_STR_DECRYPT_VERIFY_NOKEY	_("Decrypt and verify (no secret key)")
 #define ID_CMD_STR_DECRYPT		_("Decrypt")
 #define ID_CMD_STR_VERIFY		_("Verify")
 #define ID_CMD_STR_SIGN_ENCRYPT		_("Sign and encrypt")
 #define ID_CMD_STR_ENCRYPT		_("Encrypt")
+#define ID_CMD_STR_ENCRYPT_ARCHIVE	_("Encrypt as one archive")
 #define ID_CMD_STR_SIGN			_("Sign")
 #define ID_CMD_STR_IMPORT		_("Import keys")
 #define ID_CMD_STR_CREATE_CHECKSUMS	_("Create checksums")
 #define ID_CMD_STR_VERIFY_CHECKSUMS	_("Verify checksums")
 
+/* The menu looks at the headers of at most this many files, reads
+   at most this many bytes of each and gives up on a file after this
+   many milliseconds.  */
+#define EXAMINE_MAX_FILES	16
+#define EXAMINE_HEAD_SIZE	4096
+#define EXAMINE_TIMEOUT		10
+
 /* Returns the string for a command id */
 static const char *
 getCaptionForId (int id)
@@ -85,6 +98,8 @@ getCaptionForId (int id)
         return ID_CMD_STR_SIGN_ENCRYPT;
       case ID_CMD_ENCRYPT:
         return ID_CMD_STR_ENCRYPT;
+      case ID_CMD_ENCRYPT_ARCHIVE:
+        return ID_CMD_STR_ENCRYPT_ARCHIVE;
       case ID_CMD_SIGN:
         return ID_CMD_STR_SIGN;
       case ID_CMD_IMPORT:
@@ -107,15 +122,20 @@ gpgex_t::reset (void)
 {
   this->filenames.clear ();
   this->all_files_gpg = TRUE;
+  this->all_keys = FALSE;
+  this->all_signatures = FALSE;
+  this->no_secret_key = FALSE;
+  gpgex_io_budget_init (&this->io_budget);
+  gpgex_prefetch_cancel (this->prefetch);
+  this->prefetch = NULL;
 }
 
 
 STDMETHODIMP
 gpgex_t::QueryInterface (REFIID riid, void **ppv)
 {
-#define _TRACE_BEG12(a,b,c,d,e,f) TRACE_BEG12(a,b,c,d,e,f)
-  _TRACE_BEG12 (DEBUG_INIT, "gpgex_t::QueryInterface", this,
-		"riid=" GUID_FMT ", ppv=%p", GUID_ARG (riid), ppv);
+  TRACE_BEG (DEBUG_INIT, "gpgex_t::QueryInterface", this,
+	     "riid=" GUID_FMT ", ppv=%p", GUID_ARG (riid), ppv);
 
   if (ppv == NULL)
     return TRACE_RES (E_INVALIDARG);
@@ -156,8 +176,8 @@ gpgex_t::QueryInterface (REFIID riid, void **ppv)
 STDMETHODIMP_(ULONG)
 gpgex_t::AddRef (void)
 {
-  (void) TRACE1 (DEBUG_INIT, "gpgex_t::AddRef", this,
-		 "new_refcount=%i", this->refcount + 1);
+  (void) TRACE (DEBUG_INIT, "gpgex_t::AddRef", this,
+		"new_refcount=%li", (long) this->refcount + 1);
 
   return InterlockedIncrement (&this->refcount);
 }
@@ -168,8 +188,8 @@ gpgex_t::Release (void)
 {
   LONG count;
 
-  (void) TRACE1 (DEBUG_INIT, "gpgex_t::Release", this,
-		 "new_refcount=%i", this->refcount - 1);
+  (void) TRACE (DEBUG_INIT, "gpgex_t::Release", this,
+		"new_refcount=%li", (long) this->refcount - 1);
 
   count = InterlockedDecrement (&this->refcount);
   if (count == 0)
@@ -179,6 +199,94 @@ gpgex_t::Release (void)
 }
 
 
+/* Return true if INFO is from an encrypted file for which the user
+   has no secret key.  False if this is not known.  */
+static bool
+is_undecryptable (const struct gpgex_pgp_info_s *info)
+{
+  static const unsigned char wildcard[8] = { 0 };
+  unsigned int i;
+
+  /* All session key packets must have been seen.  */
+  if (!info->has_pubkey_enc || !info->has_encrypted
+      || info->has_symkey_enc || info->more_recipients)
+    return false;
+
+  for (i = 0; i < info->nrecipients; i++)
+    if (!memcmp (info->recipients[i], wildcard, 8)
+        || gpgex_keyindex_lookup (info->recipients[i]))
+      return false;
+  return true;
+}
+
+
+/* Look at the headers of the files, which all have an OpenPGP
+   extension, to pick the default command.  The files are only read
+   if the I/O policy allows it, otherwise the default command is
+   decided by the extension.  */
+void
+gpgex_t::examine_files (void)
+{
+  unsigned int nkeys = 0;
+  unsigned int nsigs = 0;
+  unsigned int nlocked = 0;
+  unsigned int i;
+
+  TRACE_BEG (DEBUG_CONTEXT_MENU, "gpgex_t::examine_files", this,
+             "%u files", (unsigned int) this->filenames.size ());
+
+  /* The index is used for the next menu if it is outdated.  */
+  gpgex_keyindex_touch ();
+
+  if (this->filenames.size () > EXAMINE_MAX_FILES)
+    {
+      (void) TRACE_SUC ("too many files");
+      return;
+    }
+
+  for (i = 0; i < this->filenames.size (); i++)
+    {
+      const char *fname = this->filenames[i].c_str ();
+      struct gpgex_pgp_parser_s parser;
+      const struct gpgex_pgp_info_s *info;
+      char buffer[EXAMINE_HEAD_SIZE];
+      int n;
+
+      n = gpgex_read_head (fname, gpgex_probe_path (fname),
+                           &this->io_budget, buffer, sizeof buffer);
+      if (n < 0)
+        {
+          (void) TRACE_SUC ("can't read %s", fname);
+          return;
+        }
+      gpgex_pgp_init (&parser, sizeof buffer, EXAMINE_TIMEOUT);
+      gpgex_pgp_feed (&parser, buffer, n);
+      info = gpgex_pgp_finish (&parser);
+      if (!info->is_openpgp)
+        {
+          (void) TRACE_SUC ("%s is not OpenPGP", fname);
+          return;
+        }
+
+      if (info->has_pubkey || info->has_seckey)
+        nkeys++;
+      else if (info->has_signature && !info->has_literal
+               && !info->has_pubkey_enc && !info->has_symkey_enc
+               && !info->has_encrypted && !info->has_compressed)
+        nsigs++;
+      else if (is_undecryptable (info))
+        nlocked++;
+    }
+
+  this->all_keys = nkeys == i;
+  this->all_signatures = nsigs == i;
+  this->no_secret_key = nlocked == i;
+
+  (void) TRACE_SUC ("keys=%u signatures=%u undecryptable=%u",
+                    nkeys, nsigs, nlocked);
+}
+
+
 /* IShellExtInit methods.  */
 
 STDMETHODIMP
@@ -186,10 +294,11 @@ gpgex_t::Initialize (LPCITEMIDLIST pIDFolder, IDataObject *pDataObj,
 		     HKEY hRegKey)
 {
   HRESULT err = S_OK;
+  uint64_t start = gpgex_stats_now ();
 
-  TRACE_BEG3 (DEBUG_INIT, "gpgex_t::Initialize", this,
-	      "pIDFolder=%p, pDataObj=%p, hRegKey=%p",
-	      pIDFolder, pDataObj, hRegKey);
+  TRACE_BEG (DEBUG_INIT, "gpgex_t::Initialize", this,
+	     "pIDFolder=%p, pDataObj=%p, hRegKey=%p",
+	     pIDFolder, pDataObj, hRegKey);
 
   /* This function is called for the Shortcut (context menu),
      Drag-and-Drop, and Property Sheet extensions.  */
@@ -263,6 +372,11 @@ gpgex_t::Initialize (LPCITEMIDLIST pIDFolder, IDataObject *pDataObj,
 
   if (err != S_OK)
     this->reset ();
+  else if (this->all_files_gpg)
+    this->examine_files ();
+
+  gpgex_stats_inc (GPGEX_STAT_INITIALIZE);
+  gpgex_stats_hist (GPGEX_HIST_INITIALIZE, gpgex_stats_now () - start);
 
   return TRACE_RES (err);
 }
@@ -270,7 +384,7 @@ gpgex_t::Initialize (LPCITEMIDLIST pIDFolder, IDataObject *pDataObj,
 static HBITMAP
 getBitmap (int id)
 {
-  TRACE_BEG0 (DEBUG_CONTEXT_MENU, __func__, nullptr, "get bitmap");
+  TRACE_BEG (DEBUG_CONTEXT_MENU, __func__, nullptr, "get bitmap");
   PICTDESC pdesc;
   Gdiplus::GdiplusStartupInput gdiplusStartupInput;
   Gdiplus::Bitmap* pbitmap;
@@ -295,16 +409,16 @@ getBitmap (int id)
   hResource = FindResource (gpgex_server::instance, MAKEINTRESOURCE(id), RT_RCDATA);
   if (!hResource)
     {
-      TRACE1 (DEBUG_CONTEXT_MENU, __func__, nullptr, "Failed to find id: %i",
-                  id);
+      TRACE (DEBUG_CONTEXT_MENU, __func__, nullptr, "Failed to find id: %i",
+                 id);
       return nullptr;
     }
 
   imageSize = SizeofResource (gpgex_server::instance, hResource);
   if (!imageSize)
     {
-      TRACE1 (DEBUG_CONTEXT_MENU, __func__, nullptr, "WTF: %i",
-                  __LINE__);
+      TRACE (DEBUG_CONTEXT_MENU, __func__, nullptr, "WTF: %i",
+                 __LINE__);
       return nullptr;
     }
 
@@ -312,8 +426,8 @@ getBitmap (int id)
 
   if (!pResourceData)
     {
-      TRACE1 (DEBUG_CONTEXT_MENU, __func__, nullptr, "WTF: %i",
-                  __LINE__);
+      TRACE (DEBUG_CONTEXT_MENU, __func__, nullptr, "WTF: %i",
+                 __LINE__);
       return nullptr;
     }
 
@@ -333,8 +447,8 @@ getBitmap (int id)
               pStream->Release();
               if (!pbitmap || pbitmap->GetHBITMAP (0, &pdesc.bmp.hbitmap))
                 {
-                  TRACE1 (DEBUG_CONTEXT_MENU, __func__, nullptr, "WTF: %i",
-                  __LINE__);
+                  TRACE (DEBUG_CONTEXT_MENU, __func__, nullptr, "WTF: %i",
+                 __LINE__);
                   return nullptr;
                 }
             }
@@ -356,30 +470,32 @@ getBitmapCached (int id)
   const auto it = s_id_map.find (id);
   if (it == s_id_map.end ())
     {
+      gpgex_stats_inc (GPGEX_STAT_BITMAP_CACHE_MISSES);
       const HBITMAP icon = getBitmap (id);
       s_id_map.insert (std::make_pair (id, icon));
       return icon;
     }
+  gpgex_stats_inc (GPGEX_STAT_BITMAP_CACHE_HITS);
   return it->second;
 }
 
 static bool
 setupContextMenuIcon (int id, HMENU hMenu, UINT indexMenu)
 {
-  TRACE_BEG2 (DEBUG_CONTEXT_MENU, __func__, nullptr, "Start. menu: %p index %u",
-              hMenu, indexMenu);
+  TRACE_BEG (DEBUG_CONTEXT_MENU, __func__, nullptr, "Start. menu: %p index %u",
+             hMenu, indexMenu);
   int width = GetSystemMetrics (SM_CXMENUCHECK);
   int height = GetSystemMetrics (SM_CYMENUCHECK);
 
-  TRACE2 (DEBUG_CONTEXT_MENU, __func__, nullptr, "width %i height %i",
-          width, height);
+  TRACE (DEBUG_CONTEXT_MENU, __func__, nullptr, "width %i height %i",
+         width, height);
 
   HBITMAP bmp = getBitmapCached (id);
 
   if (!bmp)
     {
-      TRACE1 (DEBUG_CONTEXT_MENU, __func__, nullptr, "WTF: %i",
-              __LINE__);
+      TRACE (DEBUG_CONTEXT_MENU, __func__, nullptr, "WTF: %i",
+             __LINE__);
       return false;
     }
 
@@ -390,7 +506,7 @@ setupContextMenuIcon (int id, HMENU hMenu, UINT indexMenu)
 static int
 readDefaultEntry ()
 {
-  TRACE_BEG0 (DEBUG_CONTEXT_MENU, __func__, nullptr, "read default entry");
+  TRACE_BEG (DEBUG_CONTEXT_MENU, __func__, nullptr, "read default entry");
   char *entry = gpgrt_w32_reg_get_string ("\\Software\\Gpg4win:GpgExDefault");
   if (!entry)
     {
@@ -400,8 +516,8 @@ readDefaultEntry ()
   free (entry);
   if (val > ID_CMD_MAX || val < 0)
     {
-      TRACE1 (DEBUG_CONTEXT_MENU, __func__, nullptr, "invalid cmd value: %li",
-              val);
+      TRACE (DEBUG_CONTEXT_MENU, __func__, nullptr, "invalid cmd value: %li",
+             val);
       return -1;
     }
   return static_cast<int> (val);
@@ -418,10 +534,11 @@ gpgex_t::QueryContextMenu (HMENU hMenu, UINT indexMenu, UINT idCmdFirst,
 			   UINT idCmdLast, UINT uFlags)
 {
   BOOL res;
+  uint64_t start = gpgex_stats_now ();
 
-  TRACE_BEG5 (DEBUG_CONTEXT_MENU, "gpgex_t::QueryContextMenu", this,
-	      "hMenu=%p, indexMenu=%u, idCmdFirst=%u, idCmdLast=%u, uFlags=%x",
-	      hMenu, indexMenu, idCmdFirst, idCmdLast, uFlags);
+  TRACE_BEG (DEBUG_CONTEXT_MENU, "gpgex_t::QueryContextMenu", this,
+	     "hMenu=%p, indexMenu=%u, idCmdFirst=%u, idCmdLast=%u, uFlags=%x",
+	     hMenu, indexMenu, idCmdFirst, idCmdLast, uFlags);
 
   /* FIXME: Do something if idCmdLast - idCmdFirst + 1 is not big
      enough.  */
@@ -437,9 +554,20 @@ gpgex_t::QueryContextMenu (HMENU hMenu, UINT indexMenu, UINT idCmdFirst,
   /* First we add the file-specific menus.  */
   if (this->all_files_gpg)
     {
+      int def_entry = ID_CMD_DECRYPT_VERIFY;
+      const char *caption;
+
+      if (this->all_keys)
+        def_entry = ID_CMD_IMPORT;
+      else if (this->all_signatures)
+        def_entry = ID_CMD_VERIFY;
+      caption = getCaptionForId (def_entry);
+      /* The key index may be outdated or the key on a card which is
+         not inserted, so the entry is only marked.  */
+      if (def_entry == ID_CMD_DECRYPT_VERIFY && this->no_secret_key)
+        caption = ID_CMD_STR_DECRYPT_VERIFY_NOKEY;
       res = InsertMenu (hMenu, indexMenu++, MF_BYPOSITION | MF_STRING,
-			idCmdFirst + ID_CMD_DECRYPT_VERIFY,
-			ID_CMD_STR_DECRYPT_VERIFY);
+			idCmdFirst + def_entry, caption);
       if (! res)
 	return TRACE_RES (HRESULT_FROM_WIN32 (GetLastError ()));
     }
@@ -507,6 +635,10 @@ gpgex_t::QueryContextMenu (HMENU hMenu, UINT indexMenu, UINT idCmdFirst,
     res = InsertMenu (popup, idx++, MF_BYPOSITION | MF_STRING,
 		      idCmdFirst + ID_CMD_ENCRYPT,
 		      ID_CMD_STR_ENCRYPT);
+  if (res)
+    res = InsertMenu (popup, idx++, MF_BYPOSITION | MF_STRING,
+		      idCmdFirst + ID_CMD_ENCRYPT_ARCHIVE,
+		      ID_CMD_STR_ENCRYPT_ARCHIVE);
   if (res)
     res = InsertMenu (popup, idx++, MF_BYPOSITION | MF_STRING,
 		      idCmdFirst + ID_CMD_SIGN,
@@ -532,6 +664,13 @@ gpgex_t::QueryContextMenu (HMENU hMenu, UINT indexMenu, UINT idCmdFirst,
   if (! res)
     return TRACE_RES (HRESULT_FROM_WIN32 (GetLastError ()));
 
+  /* The files are likely to be read soon.  */
+  gpgex_prefetch_cancel (this->prefetch);
+  this->prefetch = gpgex_prefetch_start (this->filenames);
+
+  gpgex_stats_inc (GPGEX_STAT_MENUS_SHOWN);
+  gpgex_stats_hist (GPGEX_HIST_QUERY_MENU, gpgex_stats_now () - start);
+
   /* We should return a HRESULT that indicates success and the offset
      to the next free command ID after the last one we used, relative
      to idCmdFirst.  In other words: max_used - idCmdFirst + 1.  */
@@ -552,11 +691,11 @@ gpgex_t::GetCommandString (UINT_PTR idCommand, UINT uFlags, LPUINT lpReserved,
 {
   const char *txt;
 
-  TRACE_BEG5 (DEBUG_CONTEXT_MENU, "gpgex_t::GetCommandString", this,
-	      "idCommand=%u, uFlags=%x, lpReserved=%lu, pszName=%p, "
-	      "uMaxNameLen=%u",
-	      (unsigned int)(idCommand & 0xffffffff),
-              uFlags, lpReserved, pszName, uMaxNameLen);
+  TRACE_BEG (DEBUG_CONTEXT_MENU, "gpgex_t::GetCommandString", this,
+	     "idCommand=%u, uFlags=%x, lpReserved=%p, pszName=%p, "
+	     "uMaxNameLen=%u",
+	     (unsigned int)(idCommand & 0xffffffff),
+             uFlags, lpReserved, pszName, uMaxNameLen);
 
   if (! (uFlags & GCS_HELPTEXT))
     return TRACE_RES (E_INVALIDARG);
@@ -590,6 +729,10 @@ gpgex_t::GetCommandString (UINT_PTR idCommand, UINT uFlags, LPUINT lpReserved,
       txt = _("Encrypt the marked files.");
       break;
 
+    case ID_CMD_ENCRYPT_ARCHIVE:
+      txt = _("Encrypt the marked files and folders into one file.");
+      break;
+
     case ID_CMD_SIGN:
       txt = _("Sign the marked files.");
       break;
@@ -686,8 +829,8 @@ show_about (HWND hwnd)
 STDMETHODIMP
 gpgex_t::InvokeCommand (LPCMINVOKECOMMANDINFO lpcmi)
 {
-  TRACE_BEG1 (DEBUG_CONTEXT_MENU, "gpgex_t::InvokeCommand", this,
-	      "lpcmi=%p", lpcmi);
+  TRACE_BEG (DEBUG_CONTEXT_MENU, "gpgex_t::InvokeCommand", this,
+	     "lpcmi=%p", lpcmi);
 
   /* If lpVerb really points to a string, ignore this function call
      and bail out.  */
@@ -696,6 +839,13 @@ gpgex_t::InvokeCommand (LPCMINVOKECOMMANDINFO lpcmi)
 
   client_t client (lpcmi->hwnd);
 
+  /* Let the read ahead continue for the UI server.  */
+  if (LOWORD (lpcmi->lpVerb) != ID_CMD_ABOUT)
+    {
+      gpgex_prefetch_release (this->prefetch);
+      this->prefetch = NULL;
+    }
+
   /* Get the command index, which is the offset to IDCMDFIRST of
      QueryContextMenu, ie zero based).  */
   switch (LOWORD (lpcmi->lpVerb))
@@ -724,6 +874,10 @@ gpgex_t::InvokeCommand (LPCMINVOKECOMMANDINFO lpcmi)
       client.encrypt (this->filenames);
       break;
 
+    case ID_CMD_ENCRYPT_ARCHIVE:
+      client.encrypt_archive (this->filenames);
+      break;
+
     case ID_CMD_SIGN:
       client.sign (this->filenames);
       break;
@@ -30,6 +30,9 @@ using std::string;
 #include <windows.h>
 #include <shlobj.h>
 
+#include "prefetch.h"
+#include "pathclass.h"
+
 /* Our shell extension interface.  We use multiple inheritance to
    achieve polymorphy.
 
@@ -86,11 +89,22 @@ class gpgex_t : public IShellExtInit, public IContextMenu3
   /* TRUE if all files in filenames are directly related to GPG.  */
   BOOL all_files_gpg;
 
+  /* What the headers of the files tell, see examine_files.  */
+  BOOL all_keys;
+  BOOL all_signatures;
+  BOOL no_secret_key;
+
+  /* The time for reading file headers while the menu is built.  */
+  struct gpgex_io_budget_s io_budget;
+
+  /* The read ahead of the files while the menu is shown.  */
+  gpgex_prefetch_t prefetch;
+
  public:
   /* Constructors and destructors.  For these, we update the global
      component reference counter.  */
   gpgex_t (void)
-    : refcount (0)
+    : refcount (0), prefetch (NULL)
     {
       TRACE_BEG (DEBUG_INIT, "gpgex_t::gpgex_t", this);
 
@@ -103,6 +117,9 @@ class gpgex_t : public IShellExtInit, public IContextMenu3
     {
       TRACE_BEG (DEBUG_INIT, "gpgex_t::~gpgex_t", this);
 
+      /* The menu has been dismissed without one of our commands.  */
+      gpgex_prefetch_cancel (this->prefetch);
+
       gpgex_server::release ();
 
       (void) TRACE_SUC ();
@@ -111,6 +128,9 @@ class gpgex_t : public IShellExtInit, public IContextMenu3
   /* Reset the instance between operations.  */
   void reset (void);
 
+  /* Look at the headers of the files to pick the default command.  */
+  void examine_files (void);
+
  public:
   /* IUnknown methods.  */
   STDMETHODIMP QueryInterface (REFIID riid, void **ppv);
@@ -0,0 +1,416 @@
+/* homedir.c - native computation of GnuPG's directories
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+/* Running "gpgconf --list-dirs socketdir" costs a process creation.
+   For the common installations the socket directory can be computed
+   directly following the rules of GnuPG's common/homedir.c:
+
+   - If gpgconf.ctl exists next to gpgconf.exe the installation is a
+     portable one; the homedir is ROOTDIR\home and the socket
+     directory ROOTDIR\gnupg.  ROOTDIR is the directory of gpgconf
+     with a trailing "\bin" removed.
+
+   - Otherwise the homedir is taken from GNUPGHOME, the registry
+     value HomeDir, or defaults to APPDATA\gnupg; the socket
+     directory is LOCALAPPDATA\gnupg.
+
+   - If the homedir is not the default one, GnuPG appends a
+     sub directory derived from a SHA-1 hash of the homedir.  We do
+     not implement this and let the caller fall back to gpgconf.
+
+   A gpgconf.ctl with keywords (newer GnuPG versions allow to
+   configure the directories there) is also left to gpgconf.  */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#ifdef HAVE_W32_SYSTEM
+# include <windows.h>
+# include <shlobj.h>
+# include <gpg-error.h>
+# include "debug.h"
+#endif
+
+#include "homedir.h"
+
+
+/* Return a malloced copy of DIR with slashes replaced by
+   backslashes and trailing backslashes removed.  */
+static char *
+copy_dir_with_fixup (const char *dir)
+{
+  char *result, *p;
+  size_t n;
+
+  result = strdup (dir);
+  if (!result)
+    return NULL;
+  for (p = result; *p; p++)
+    if (*p == '/')
+      *p = '\\';
+  n = strlen (result);
+  /* Keep the backslash of "C:\".  */
+  while (n > 1 && result[n - 1] == '\\' && !(n == 3 && result[1] == ':'))
+    result[--n] = 0;
+  return result;
+}
+
+
+/* Concatenate A and B.  */
+static char *
+concat (const char *a, const char *b)
+{
+  char *result = (char *) malloc (strlen (a) + strlen (b) + 1);
+
+  if (result)
+    {
+      strcpy (result, a);
+      strcat (result, b);
+    }
+  return result;
+}
+
+
+/* Return true if the content of gpgconf.ctl has any keyword lines.  */
+static int
+ctl_has_keywords (const char *content)
+{
+  const char *p = content;
+
+  while (p && *p)
+    {
+      while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+        p++;
+      if (*p && *p != '#')
+        return 1;
+      p = strchr (p, '\n');
+    }
+  return 0;
+}
+
+
+/* Return true if DIR is an absolute file name.  */
+static int
+is_absolute (const char *dir)
+{
+  if ((dir[0] == '\\' || dir[0] == '/') && (dir[1] == '\\' || dir[1] == '/'))
+    return 1;  /* UNC name.  */
+  return (((*dir >= 'a' && *dir <= 'z') || (*dir >= 'A' && *dir <= 'Z'))
+          && dir[1] == ':' && (dir[2] == '\\' || dir[2] == '/'));
+}
+
+
+/* Return the root directory for BINDIR.  */
+static char *
+get_rootdir (const char *bindir)
+{
+  char *root = copy_dir_with_fixup (bindir);
+  size_t n;
+
+  if (!root)
+    return NULL;
+  n = strlen (root);
+  if (n > 4 && !strcasecmp (root + n - 4, "\\bin"))
+    root[n - 4] = 0;
+  return root;
+}
+
+
+unsigned int
+gpgex_parse_gnupg_version (const char *string)
+{
+  unsigned int part[3] = { 0, 0, 0 };
+  int i;
+
+  for (i = 0; i < 3; i++)
+    {
+      if (!string || *string < '0' || *string > '9')
+        return 0;
+      part[i] = strtoul (string, (char **) &string, 10);
+      if (part[i] > 255)
+        return 0;
+      if (i < 2 && *string++ != '.')
+        return 0;
+    }
+  return GPGEX_GNUPG_VERSION (part[0], part[1], part[2]);
+}
+
+
+/* Compute the socket directory for GnuPG before 2.3.  The sockets
+   are in the homedir.  */
+static char *
+compute_socketdir_22 (const struct gpgex_homedir_env_s *env)
+{
+  char *root, *stdhome;
+  const char *dir;
+
+  /* A portable installation uses ROOT\home but we don't know about
+     other files it might look at.  */
+  if (env->have_ctl)
+    return NULL;
+
+  dir = env->gnupghome;
+  if (!dir || !*dir)
+    dir = env->reg_homedir;
+  if (dir && *dir)
+    {
+      if (strchr (dir, '%') || !is_absolute (dir))
+        return NULL;
+      return copy_dir_with_fixup (dir);
+    }
+
+  if (!env->appdata || !*env->appdata)
+    return NULL;
+  root = copy_dir_with_fixup (env->appdata);
+  if (!root)
+    return NULL;
+  stdhome = concat (root, "\\gnupg");
+  free (root);
+  return stdhome;
+}
+
+
+char *
+gpgex_compute_socketdir (const struct gpgex_homedir_env_s *env)
+{
+  char *homedir = NULL;
+  char *stdhome = NULL;
+  char *result = NULL;
+  char *root = NULL;
+  const char *dir;
+
+  if (!env->bindir || !env->version)
+    return NULL;
+
+  /* Since 2.3 the sockets are below LOCALAPPDATA.  */
+  if (env->version < GPGEX_GNUPG_VERSION (2, 3, 0))
+    return compute_socketdir_22 (env);
+
+  if (env->have_ctl)
+    {
+      /* Portable installation.  */
+      if (!env->ctl_content || ctl_has_keywords (env->ctl_content))
+        return NULL;
+      root = get_rootdir (env->bindir);
+      if (root)
+        result = concat (root, "\\gnupg");
+      free (root);
+      return result;
+    }
+
+  if (!env->appdata || !*env->appdata
+      || !env->local_appdata || !*env->local_appdata)
+    return NULL;
+
+  dir = env->gnupghome;
+  if (!dir || !*dir)
+    dir = env->reg_homedir;
+  /* GnuPG does not expand environment variables here but some
+     installers write them; be safe.  */
+  if (dir && strchr (dir, '%'))
+    return NULL;
+
+  root = copy_dir_with_fixup (env->appdata);
+  if (root)
+    stdhome = concat (root, "\\gnupg");
+  free (root);
+  if (!stdhome)
+    return NULL;
+
+  if (dir && *dir)
+    {
+      homedir = copy_dir_with_fixup (dir);
+      if (!homedir || strcasecmp (homedir, stdhome))
+        {
+          /* A non-default homedir.  */
+          free (homedir);
+          free (stdhome);
+          return NULL;
+        }
+      free (homedir);
+    }
+  free (stdhome);
+
+  root = copy_dir_with_fixup (env->local_appdata);
+  if (root)
+    result = concat (root, "\\gnupg");
+  free (root);
+  return result;
+}
+
+
+
+#ifdef HAVE_W32_SYSTEM
+
+/* Return the utf-8 name of the shell folder CSIDL or NULL.  */
+static char *
+get_folder (int csidl)
+{
+  wchar_t wpath[MAX_PATH];
+
+  if (SHGetFolderPathW (NULL, csidl, NULL, 0, wpath) != S_OK)
+    return NULL;
+  return gpgrt_wchar_to_utf8 (wpath);
+}
+
+
+/* Return true if the file with the utf-8 name FNAME exists.  */
+static int
+file_exists (const char *fname)
+{
+  wchar_t *wfname = gpgrt_utf8_to_wchar (fname);
+  int result;
+
+  if (!wfname)
+    return 0;
+  result = GetFileAttributesW (wfname) != INVALID_FILE_ATTRIBUTES;
+  gpgrt_free_wchar (wfname);
+  return result;
+}
+
+
+/* Read at most 4k of the file FNAME.  Returns a malloced string or
+   NULL.  */
+static char *
+read_small_file (const char *fname)
+{
+  gpgrt_stream_t fp;
+  char *buffer;
+  size_t n = 0;
+
+  fp = gpgrt_fopen (fname, "r");
+  if (!fp)
+    return NULL;
+  buffer = (char *) malloc (4096 + 1);
+  if (buffer)
+    {
+      gpgrt_read (fp, buffer, 4096, &n);
+      buffer[n] = 0;
+    }
+  gpgrt_fclose (fp);
+  return buffer;
+}
+
+
+char *
+gpgex_gnupg_file_version (const char *fname)
+{
+  wchar_t *wfname;
+  DWORD size, dummy;
+  void *info = NULL;
+  VS_FIXEDFILEINFO *ffi;
+  UINT ffilen;
+  char *result = NULL;
+
+  wfname = gpgrt_utf8_to_wchar (fname);
+  if (!wfname)
+    return NULL;
+  size = GetFileVersionInfoSizeW (wfname, &dummy);
+  if (size)
+    info = malloc (size);
+  if (info && GetFileVersionInfoW (wfname, 0, size, info)
+      && VerQueryValueW (info, L"\\", (void **) &ffi, &ffilen)
+      && ffilen >= sizeof *ffi)
+    result = gpgrt_bsprintf ("%lu.%lu.%lu",
+                             (unsigned long) HIWORD (ffi->dwFileVersionMS),
+                             (unsigned long) LOWORD (ffi->dwFileVersionMS),
+                             (unsigned long) HIWORD (ffi->dwFileVersionLS));
+  free (info);
+  gpgrt_free_wchar (wfname);
+  return result;
+}
+
+
+char *
+gpgex_native_socketdir (const char *gpgconf, unsigned int version)
+{
+  struct gpgex_homedir_env_s env;
+  char *bindir, *p;
+  char *ctlname = NULL;
+  char *ctl_content = NULL;
+  char *gnupghome = NULL;
+  char *reg_homedir = NULL;
+  char *appdata = NULL;
+  char *local_appdata = NULL;
+  char *result = NULL;
+  wchar_t wvalue[MAX_PATH];
+  DWORD n;
+
+  TRACE_BEG (DEBUG_INIT, "gpgex_native_socketdir", gpgconf,
+             "version=%06x", version);
+
+  memset (&env, 0, sizeof env);
+  env.version = version;
+
+  bindir = strdup (gpgconf);
+  if (!bindir)
+    goto leave;
+  p = strrchr (bindir, '/');
+  if (!p || (strrchr (bindir, '\\') && strrchr (bindir, '\\') > p))
+    p = strrchr (bindir, '\\');
+  if (!p)
+    goto leave;
+  *p = 0;
+  env.bindir = bindir;
+
+  ctlname = gpgrt_fconcat (0, bindir, "gpgconf.ctl", NULL);
+  if (ctlname && file_exists (ctlname))
+    {
+      env.have_ctl = 1;
+      ctl_content = read_small_file (ctlname);
+      env.ctl_content = ctl_content;
+    }
+
+  n = GetEnvironmentVariableW (L"GNUPGHOME", wvalue, MAX_PATH);
+  if (n && n < MAX_PATH)
+    gnupghome = gpgrt_wchar_to_utf8 (wvalue);
+  env.gnupghome = gnupghome;
+
+  /* gpgrt looks first at HKCU and then at HKLM.  */
+  reg_homedir = gpgrt_w32_reg_get_string ("\\Software\\GNU\\GnuPG:HomeDir");
+  env.reg_homedir = reg_homedir;
+
+  appdata = get_folder (CSIDL_APPDATA);
+  env.appdata = appdata;
+  local_appdata = get_folder (CSIDL_LOCAL_APPDATA);
+  env.local_appdata = local_appdata;
+
+  result = gpgex_compute_socketdir (&env);
+
+ leave:
+  (void) TRACE_LOG ("socketdir='%s'", result ? result : "(unknown)");
+  free (bindir);
+  free (ctlname);
+  free (ctl_content);
+  free (gnupghome);
+  free (reg_homedir);
+  free (appdata);
+  free (local_appdata);
+  (void) TRACE_SUC ();
+  return result;
+}
+
+#endif /*HAVE_W32_SYSTEM*/
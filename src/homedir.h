@@ -0,0 +1,78 @@
+/* homedir.h - native computation of GnuPG's directories
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#ifndef GPGEX_HOMEDIR_H
+#define GPGEX_HOMEDIR_H	1
+
+#ifdef __cplusplus
+extern "C" {
+#if 0
+}
+#endif
+#endif
+
+/* Build the version number used below from its parts.  */
+#define GPGEX_GNUPG_VERSION(major,minor,micro) \
+  (((major) << 16) | ((minor) << 8) | (micro))
+
+/* The inputs GnuPG uses on Windows to decide on its home and socket
+   directory.  All strings are utf-8; NULL means "not set".  */
+struct gpgex_homedir_env_s
+{
+  unsigned int version;		/* GnuPG version or 0 if not known.  */
+  const char *bindir;		/* Directory with gpgconf.exe.  */
+  int have_ctl;			/* gpgconf.ctl exists in BINDIR.  */
+  const char *ctl_content;	/* Its content or NULL if not read.  */
+  const char *gnupghome;	/* The GNUPGHOME envvar.  */
+  const char *reg_homedir;	/* Registry Software\GNU\GnuPG:HomeDir.  */
+  const char *appdata;		/* CSIDL_APPDATA.  */
+  const char *local_appdata;	/* CSIDL_LOCAL_APPDATA.  */
+};
+
+/* Parse the version string STRING ("2.4.5" or "2.2.41-beta12") into
+   the form of GPGEX_GNUPG_VERSION.  Returns 0 if STRING is not a
+   version.  */
+unsigned int gpgex_parse_gnupg_version (const char *string);
+
+/* Compute GnuPG's socket directory from ENV the same way gpgconf
+   does.  Returns a malloced string or NULL if the configuration can
+   not be decided without gpgconf (e.g. an unknown version or a
+   non-default homedir whose socket directory is derived from a
+   hash).  */
+char *gpgex_compute_socketdir (const struct gpgex_homedir_env_s *env);
+
+#ifdef HAVE_W32_SYSTEM
+/* Return the version of the GnuPG program FNAME taken from its
+   version resource as malloced string or NULL.  */
+char *gpgex_gnupg_file_version (const char *fname);
+
+/* Collect the environment for the gpgconf binary GPGCONF of the GnuPG
+   VERSION and return the socket directory or NULL.  */
+char *gpgex_native_socketdir (const char *gpgconf, unsigned int version);
+#endif
+
+#ifdef __cplusplus
+#if 0
+{
+#endif
+}
+#endif
+
+#endif /* GPGEX_HOMEDIR_H */
@@ -0,0 +1,346 @@
+/* keyindex.cc - index of the secret keys
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <windows.h>
+
+#include <gpg-error.h>
+
+#include "main.h"
+#include "exechelp.h"
+#include "stats.h"
+#include "client.h"
+#include "keyindex.h"
+
+/* Refresh the index if it is older than this many microseconds.  */
+#define KEYINDEX_MAX_AGE (10 * 60 * 1000000ULL)
+
+/* Milliseconds to wait for the key listing.  */
+#define KEYINDEX_LIST_TIMEOUT 30000
+
+
+/* The index.  All fields are protected by KEYINDEX_LOCK, which is
+   only held for short times.  */
+static uint64_t *keyindex_ids;
+static size_t keyindex_nids;
+static int keyindex_ready;
+static int keyindex_refreshing;
+static uint64_t keyindex_time;
+static HANDLE keyindex_change = INVALID_HANDLE_VALUE;
+GPGRT_LOCK_DEFINE (keyindex_lock);
+
+
+static int
+compare_ids (const void *a_arg, const void *b_arg)
+{
+  uint64_t a = *(const uint64_t *) a_arg;
+  uint64_t b = *(const uint64_t *) b_arg;
+
+  return a < b ? -1 : a > b;
+}
+
+
+static uint64_t
+keyid_to_u64 (const unsigned char *keyid)
+{
+  uint64_t v = 0;
+  int i;
+
+  for (i = 0; i < 8; i++)
+    v = (v << 8) | keyid[i];
+  return v;
+}
+
+
+/* Parse the 16 hex digits at S into *R_VALUE.  Returns -1 if S does
+   not start with a key ID followed by a colon.  */
+static int
+parse_keyid (const char *s, uint64_t *r_value)
+{
+  uint64_t v = 0;
+  int i, c;
+
+  for (i = 0; i < 16; i++)
+    {
+      c = s[i];
+      if (c >= '0' && c <= '9')
+        c -= '0';
+      else if (c >= 'A' && c <= 'F')
+        c -= 'A' - 10;
+      else if (c >= 'a' && c <= 'f')
+        c -= 'a' - 10;
+      else
+        return -1;
+      v = (v << 4) | c;
+    }
+  if (s[16] != ':')
+    return -1;
+  *r_value = v;
+  return 0;
+}
+
+
+int
+gpgex_keyindex_parse (const char *listing, size_t length,
+                      uint64_t **r_ids, size_t *r_nids)
+{
+  const char *p, *end, *eol, *field;
+  uint64_t *ids = NULL;
+  size_t nids = 0;
+  size_t size = 0;
+  uint64_t value;
+  size_t i, n;
+  int fieldno;
+
+  *r_ids = NULL;
+  *r_nids = 0;
+
+  end = listing + length;
+  for (p = listing; p < end; p = eol + 1)
+    {
+      eol = (const char *) memchr (p, '\n', end - p);
+      if (!eol)
+        eol = end;
+      if (eol - p < 4
+          || !(!strncmp (p, "sec:", 4) || !strncmp (p, "ssb:", 4)))
+        continue;
+
+      /* The key ID is in the 5th field.  */
+      field = p;
+      for (fieldno = 1; fieldno < 5 && field < eol; field++)
+        if (*field == ':')
+          fieldno++;
+      if (fieldno < 5 || eol - field < 17 || parse_keyid (field, &value))
+        continue;
+
+      if (nids == size)
+        {
+          uint64_t *tmp;
+
+          size = size ? 2 * size : 16;
+          tmp = (uint64_t *) realloc (ids, size * sizeof *ids);
+          if (!tmp)
+            {
+              free (ids);
+              return -1;
+            }
+          ids = tmp;
+        }
+      ids[nids++] = value;
+    }
+
+  if (nids)
+    {
+      qsort (ids, nids, sizeof *ids, compare_ids);
+      for (i = n = 1; i < nids; i++)
+        if (ids[i] != ids[n - 1])
+          ids[n++] = ids[i];
+      nids = n;
+    }
+  *r_ids = ids;
+  *r_nids = nids;
+  return 0;
+}
+
+
+int
+gpgex_keyindex_lookup (const unsigned char *keyid)
+{
+  uint64_t value = keyid_to_u64 (keyid);
+  int result;
+
+  gpgrt_lock_lock (&keyindex_lock);
+  if (!keyindex_ready)
+    result = -1;
+  else
+    result = !!bsearch (&value, keyindex_ids, keyindex_nids,
+                        sizeof *keyindex_ids, compare_ids);
+  gpgrt_lock_unlock (&keyindex_lock);
+
+  return result;
+}
+
+
+/* Watch the private keys directory of GPGCONF's home directory.  */
+static HANDLE
+watch_private_keys (const char *gpgconf)
+{
+  char *homedir, *dir;
+  wchar_t *wdir;
+  HANDLE hd = INVALID_HANDLE_VALUE;
+
+  if (gpgex_spawn_get_string (gpgconf, "gpgconf -0 --list-dirs homedir",
+                              &homedir))
+    return hd;
+  dir = gpgrt_fconcat (0, homedir, "\\private-keys-v1.d", NULL);
+  free (homedir);
+  if (!dir)
+    return hd;
+  wdir = gpgrt_utf8_to_wchar (dir);
+  free (dir);
+  if (wdir)
+    {
+      hd = FindFirstChangeNotificationW (wdir, FALSE,
+                                         FILE_NOTIFY_CHANGE_FILE_NAME
+                                         | FILE_NOTIFY_CHANGE_LAST_WRITE);
+      gpgrt_free_wchar (wdir);
+    }
+  return hd;
+}
+
+
+/* Return the name of gpg.exe next to GPGCONF.  */
+static char *
+gpg_name (const char *gpgconf)
+{
+  const char *p;
+  char *name;
+
+  p = strrchr (gpgconf, '\\');
+  if (!p || (strrchr (gpgconf, '/') > p))
+    p = strrchr (gpgconf, '/');
+  if (!p)
+    return NULL;
+  name = (char *) malloc (p - gpgconf + 1 + sizeof "gpg.exe");
+  if (name)
+    {
+      memcpy (name, gpgconf, p - gpgconf + 1);
+      strcpy (name + (p - gpgconf + 1), "gpg.exe");
+    }
+  return name;
+}
+
+
+static DWORD WINAPI
+refresh_thread (LPVOID arg)
+{
+  const char *gpgconf;
+  char *gpg = NULL;
+  char *listing = NULL;
+  size_t listinglen;
+  uint64_t *ids = NULL;
+  size_t nids = 0;
+  int exitcode;
+  HANDLE change = INVALID_HANDLE_VALUE;
+  gpg_error_t err;
+
+  (void) arg;
+
+  TRACE_BEG (DEBUG_INIT, "gpgex_keyindex::refresh_thread", 0);
+
+  gpgconf = client_gpgconf_name ();
+  if (gpgconf)
+    gpg = gpg_name (gpgconf);
+  if (!gpg)
+    {
+      err = gpg_error (GPG_ERR_NOT_FOUND);
+      goto leave;
+    }
+  if (keyindex_change == INVALID_HANDLE_VALUE)
+    change = watch_private_keys (gpgconf);
+
+  err = gpgex_spawn_capture (gpg, "gpg --batch --with-colons"
+                             " --list-secret-keys",
+                             KEYINDEX_LIST_TIMEOUT, GPGEX_CAPTURE_KILL,
+                             NULL, NULL, &listing, &listinglen, &exitcode);
+  if (!err && exitcode)
+    err = gpg_error (GPG_ERR_GENERAL);
+  if (!err && gpgex_keyindex_parse (listing, listinglen, &ids, &nids))
+    err = gpg_error_from_syserror ();
+
+ leave:
+  gpgrt_lock_lock (&keyindex_lock);
+  if (!err)
+    {
+      free (keyindex_ids);
+      keyindex_ids = ids;
+      keyindex_nids = nids;
+      keyindex_ready = 1;
+      ids = NULL;
+    }
+  /* Also on error, so that we do not run gpg for every menu.  */
+  keyindex_time = gpgex_stats_now ();
+  if (change != INVALID_HANDLE_VALUE)
+    {
+      if (keyindex_change == INVALID_HANDLE_VALUE)
+        keyindex_change = change;
+      else
+        FindCloseChangeNotification (change);
+    }
+  keyindex_refreshing = 0;
+  gpgrt_lock_unlock (&keyindex_lock);
+
+  free (ids);
+  free (listing);
+  free (gpg);
+  gpgex_stats_inc (GPGEX_STAT_KEYINDEX_REFRESHES);
+  (void) TRACE_LOG ("%u secret keys", (unsigned int) nids);
+  (void) TRACE_GPGERR (err);
+  gpgex_server::release ();
+  return 0;
+}
+
+
+void
+gpgex_keyindex_touch (void)
+{
+  int refresh = 0;
+  HANDLE th;
+
+  gpgrt_lock_lock (&keyindex_lock);
+  if (!keyindex_refreshing)
+    {
+      if (!keyindex_time
+          || gpgex_stats_now () - keyindex_time > KEYINDEX_MAX_AGE)
+        refresh = 1;
+      else if (keyindex_change != INVALID_HANDLE_VALUE
+               && WaitForSingleObject (keyindex_change, 0) == WAIT_OBJECT_0)
+        {
+          FindNextChangeNotification (keyindex_change);
+          refresh = 1;
+        }
+      if (refresh)
+        keyindex_refreshing = 1;
+    }
+  gpgrt_lock_unlock (&keyindex_lock);
+
+  if (!refresh)
+    return;
+
+  /* Keep the DLL loaded until the thread has finished.  */
+  gpgex_server::add_ref ();
+  th = CreateThread (NULL, 0, refresh_thread, NULL, 0, NULL);
+  if (th)
+    CloseHandle (th);
+  else
+    {
+      gpgex_server::release ();
+      gpgrt_lock_lock (&keyindex_lock);
+      keyindex_refreshing = 0;
+      gpgrt_lock_unlock (&keyindex_lock);
+    }
+}
@@ -0,0 +1,49 @@
+/* keyindex.h - index of the secret keys
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#ifndef GPGEX_KEYINDEX_H
+#define GPGEX_KEYINDEX_H	1
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* The menu needs to know whether the user has a secret key for an
+   encrypted file, but it can't ask gpg.  Thus the key IDs of the
+   secret keys and subkeys are kept in an index which is refreshed in
+   a background thread, when it is older than a few minutes or when
+   the private keys directory has changed.  Lookups never block; as
+   long as the index has not been built they return "unknown".  */
+
+/* Return 1 if there is a secret key with the 8 byte KEYID, 0 if there
+   is none and -1 if this is not known yet.  */
+int gpgex_keyindex_lookup (const unsigned char *keyid);
+
+/* Start a refresh of the index in the background if it is outdated.
+   This returns at once.  */
+void gpgex_keyindex_touch (void);
+
+/* Parse the LENGTH bytes of "gpg --with-colons --list-secret-keys"
+   output at LISTING and store a sorted array of the key IDs as a
+   malloced array at R_IDS and their number at R_NIDS.  Returns 0 on
+   success or -1 on error with ERRNO set.  */
+int gpgex_keyindex_parse (const char *listing, size_t length,
+                          uint64_t **r_ids, size_t *r_nids);
+
+#endif /* GPGEX_KEYINDEX_H */
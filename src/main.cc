@@ -23,6 +23,7 @@
 
 #include <stdarg.h>
 #include <stdio.h>
+#include <io.h>
 #include <winsock2.h>
 #include <windows.h>
 #include <shlobj.h>
@@ -33,6 +34,7 @@
 #include "gpgex-class.h"
 #include "gpgex-factory.h"
 #include "main.h"
+#include "stats.h"
 
 
 /* This is the main part of the COM server component.  The component
@@ -135,8 +137,6 @@ i18n_init (void)
 }
 
 
-static CRITICAL_SECTION debug_lock;
-
 /* No flags on means no debugging.  */
 unsigned int debug_flags = 0;
 
@@ -144,6 +144,56 @@ unsigned int debug_flags = 0;
 FILE *debug_file;
 
 
+/* The debug output is not written by the thread calling _gpgex_debug
+   (which is usually the Explorer thread) but queued to a bounded ring
+   buffer and written by a background flusher thread.  The ring is a
+   multi-producer/single-consumer queue in the style of Vyukov's
+   bounded queue: Each slot has a sequence number which tells whether
+   it is free for the producer holding ticket SEQ or filled for the
+   consumer at position SEQ - 1.  If the ring is full the line is
+   dropped and counted; the flusher reports the number of dropped
+   lines.  */
+
+/* Number of slots in the ring.  Must be a power of two.  */
+#define DEBUG_RING_SLOTS	256
+
+/* Maximum length of one log line including the terminating nul.  */
+#define DEBUG_LINE_MAX		1024
+
+/* Time in milliseconds the flusher sleeps between two batches and
+   the idle time after which it terminates.  */
+#define DEBUG_FLUSH_INTERVAL	50
+#define DEBUG_FLUSH_IDLE	2000
+
+struct debug_slot_s
+{
+  volatile LONG seq;
+  char line[DEBUG_LINE_MAX];
+};
+
+static struct debug_slot_s *debug_ring;
+
+/* The next ticket to be taken by a producer.  */
+static volatile LONG debug_head;
+
+/* The next slot to be read by the consumer.  Only the flusher thread
+   (or debug_deinit after it is gone) touches this.  */
+static LONG debug_tail;
+
+/* Number of lines dropped because the ring was full.  */
+static volatile LONG debug_dropped;
+
+/* Set while the flusher thread is alive.  */
+static volatile LONG debug_flusher_running;
+
+/* Event to wake up the flusher early if the ring fills up.  */
+static HANDLE debug_wakeup;
+
+/* Set when the DLL is being detached.  From then on lines are
+   written synchronously.  */
+static volatile LONG debug_detaching;
+
+
 /* Get the filename of the debug file, if any.  */
 static char *
 get_debug_file (void)
@@ -152,17 +202,144 @@ get_debug_file (void)
 }
 
 
+/* Write LINE to the debug file.  If RAW is set the line is written
+   directly to the system handle without taking the lock of the
+   stream; see debug_deinit.  */
+static void
+debug_write (const char *line, int raw)
+{
+  HANDLE hd;
+  DWORD nwritten;
+
+  if (!raw)
+    {
+      fputs (line, debug_file);
+      return;
+    }
+
+  hd = (HANDLE) _get_osfhandle (_fileno (debug_file));
+  if (hd == INVALID_HANDLE_VALUE)
+    return;
+  /* Other processes may append to the same file.  */
+  SetFilePointer (hd, 0, NULL, FILE_END);
+  WriteFile (hd, line, strlen (line), &nwritten, NULL);
+}
+
+
+/* Write all queued lines to the debug file.  Must only be called by
+   one thread at a time.  If RAW is set the stream is not used; see
+   debug_write.  Returns the number of lines written.  */
+static unsigned int
+debug_drain (int raw)
+{
+  unsigned int count = 0;
+  LONG dropped;
+
+  for (;;)
+    {
+      struct debug_slot_s *slot;
+
+      slot = &debug_ring[debug_tail & (DEBUG_RING_SLOTS - 1)];
+      if (slot->seq != debug_tail + 1)
+        break;  /* Ring is empty.  */
+
+      debug_write (slot->line, raw);
+      /* Hand the slot back to the producers.  */
+      InterlockedExchange (&slot->seq, debug_tail + DEBUG_RING_SLOTS);
+      debug_tail++;
+      count++;
+    }
+
+  dropped = InterlockedExchange (&debug_dropped, 0);
+  if (dropped)
+    {
+      char buffer[64];
+
+      snprintf (buffer, sizeof buffer,
+                "gpgex: %ld debug lines dropped\n", (long) dropped);
+      debug_write (buffer, raw);
+    }
+
+  if ((count || dropped) && !raw)
+    fflush (debug_file);
+
+  return count;
+}
+
+
+/* The flusher thread.  It holds a reference on our module which is
+   released when it terminates after being idle for some time.  Thus
+   the DLL can't be unloaded while the thread runs.  */
+static DWORD WINAPI
+debug_flusher (LPVOID arg)
+{
+  DWORD idle = 0;
+
+  (void) arg;
+
+  for (;;)
+    {
+      WaitForSingleObject (debug_wakeup, DEBUG_FLUSH_INTERVAL);
+      if (debug_drain (0))
+        idle = 0;
+      else if ((idle += DEBUG_FLUSH_INTERVAL) >= DEBUG_FLUSH_IDLE)
+        {
+          InterlockedExchange (&debug_flusher_running, 0);
+          /* A producer may have queued a line after our last drain
+             but before it could see that we are going away.  */
+          if (debug_ring[debug_tail & (DEBUG_RING_SLOTS - 1)].seq
+              != debug_tail + 1
+              || InterlockedCompareExchange (&debug_flusher_running, 1, 0))
+            break;
+          idle = 0;
+        }
+    }
+
+  FreeLibraryAndExitThread (gpgex_server::instance, 0);
+  return 0;
+}
+
+
+/* Make sure that the flusher thread is running.  */
+static void
+debug_start_flusher (void)
+{
+  HMODULE module;
+  HANDLE th;
+
+  if (debug_flusher_running
+      || InterlockedCompareExchange (&debug_flusher_running, 1, 0))
+    return;
+
+  /* Take a reference on our module for the thread.  */
+  if (!GetModuleHandleExW (GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS,
+                           (LPCWSTR) debug_flusher, &module))
+    {
+      InterlockedExchange (&debug_flusher_running, 0);
+      return;
+    }
+
+  th = CreateThread (NULL, 0, debug_flusher, NULL, 0, NULL);
+  if (!th)
+    {
+      FreeLibrary (module);
+      InterlockedExchange (&debug_flusher_running, 0);
+      return;
+    }
+  CloseHandle (th);
+}
+
+
 static void
 debug_init (void)
 {
   char *filename;
+  int i;
 
   /* Sanity check.  */
   if (debug_file)
     return;
 
-  InitializeCriticalSection (&debug_lock);
-
   filename = get_debug_file ();
   if (!filename)
     return;
@@ -172,19 +349,63 @@ debug_init (void)
   if (!debug_file)
     return;
 
+  debug_ring = (struct debug_slot_s *) calloc (DEBUG_RING_SLOTS,
+                                               sizeof *debug_ring);
+  debug_wakeup = CreateEvent (NULL, FALSE, FALSE, NULL);
+  if (!debug_ring || !debug_wakeup)
+    {
+      free (debug_ring);
+      debug_ring = NULL;
+      if (debug_wakeup)
+        CloseHandle (debug_wakeup);
+      debug_wakeup = NULL;
+      fclose (debug_file);
+      debug_file = NULL;
+      return;
+    }
+  for (i = 0; i < DEBUG_RING_SLOTS; i++)
+    debug_ring[i].seq = i;
+
   /* FIXME: Make this configurable eventually.  */
   debug_flags = DEBUG_INIT | DEBUG_CONTEXT_MENU | DEBUG_ASSUAN;
 }
 
 
+/* Called on DLL_PROCESS_DETACH.  TERMINATING is set if the process
+   terminates.  In this case the flusher thread has already been
+   killed; otherwise it can't be running because it holds a reference
+   on the DLL.  Thus we can safely drain the ring from here.  However,
+   a killed flusher may have died holding the lock of the stream, or
+   the heap lock, so on termination we only write the remaining lines
+   to the system handle and leave the stream and the memory to the
+   system.  */
 static void
-debug_deinit (void)
+debug_deinit (int terminating)
 {
+  if (terminating)
+    {
+      debug_flags = 0;
+      if (debug_file)
+        debug_drain (1);
+      return;
+    }
+
+  InterlockedExchange (&debug_detaching, 1);
+
   if (debug_file)
     {
+      debug_drain (0);
       fclose (debug_file);
       debug_file = NULL;
     }
+  debug_flags = 0;
+  if (debug_wakeup)
+    {
+      CloseHandle (debug_wakeup);
+      debug_wakeup = NULL;
+    }
+  free (debug_ring);
+  debug_ring = NULL;
 }
 
 
@@ -199,29 +420,139 @@ extern "C" {
 #endif
 #endif
 
+/* Format a log line into BUFFER of size DEBUG_LINE_MAX.  If FUNC is
+   not NULL a trace prefix is prepended and a trailing ": " of the
+   formatted text is removed.  The line is always terminated by a
+   newline, truncating it if required.  */
+static void
+debug_format_line (char *buffer, const char *func, const char *tagname,
+                   void *tag, const char *format, va_list arg_ptr)
+{
+  int len = 0;
+  int n;
+
+  if (func)
+    {
+      len = snprintf (buffer, DEBUG_LINE_MAX - 1, "%s (%s=%p): ",
+                      func, tagname, tag);
+      if (len < 0 || len > DEBUG_LINE_MAX - 2)
+        len = strlen (buffer);
+    }
+
+  n = vsnprintf (buffer + len, DEBUG_LINE_MAX - 1 - len, format, arg_ptr);
+  if (n < 0 || len + n > DEBUG_LINE_MAX - 2)
+    len += strlen (buffer + len);
+  else
+    len += n;
+
+  if (func && len >= 2 && buffer[len - 2] == ':' && buffer[len - 1] == ' ')
+    len -= 2;
+  buffer[len] = 0;
+
+  if (!len || buffer[len - 1] != '\n')
+    {
+      buffer[len++] = '\n';
+      buffer[len] = 0;
+    }
+}
+
+
+/* Queue a log line.  See debug_format_line for the arguments.  */
+static void
+debug_queue (const char *func, const char *tagname, void *tag,
+             const char *format, va_list arg_ptr)
+{
+  int saved_errno;
+  DWORD saved_lasterr;
+  struct debug_slot_s *slot;
+  LONG pos;
+
+  saved_errno = errno;
+  saved_lasterr = GetLastError ();
+
+  if (debug_detaching)
+    {
+      char buffer[DEBUG_LINE_MAX];
+
+      debug_format_line (buffer, func, tagname, tag, format, arg_ptr);
+      fputs (buffer, debug_file);
+      fflush (debug_file);
+      goto leave;
+    }
+
+  /* Claim a slot.  */
+  pos = debug_head;
+  for (;;)
+    {
+      LONG dif;
+
+      slot = &debug_ring[pos & (DEBUG_RING_SLOTS - 1)];
+      dif = slot->seq - pos;
+      if (!dif)
+        {
+          LONG old = InterlockedCompareExchange (&debug_head, pos + 1, pos);
+          if (old == pos)
+            break;
+          pos = old;
+        }
+      else if (dif < 0)
+        {
+          /* The ring is full.  */
+          InterlockedIncrement (&debug_dropped);
+          SetEvent (debug_wakeup);
+          goto leave;
+        }
+      else
+        pos = debug_head;
+    }
+
+  debug_format_line (slot->line, func, tagname, tag, format, arg_ptr);
+
+  /* Publish the line.  */
+  InterlockedExchange (&slot->seq, pos + 1);
+
+  if (!debug_flusher_running)
+    debug_start_flusher ();
+  else if (pos - debug_tail >= DEBUG_RING_SLOTS / 2)
+    SetEvent (debug_wakeup);
+
+ leave:
+  SetLastError (saved_lasterr);
+  errno = saved_errno;
+}
+
+
 /* Log the formatted string FORMAT at debug level LEVEL or higher.  */
 extern
 void
 _gpgex_debug (unsigned int flags, const char *format, ...)
 {
   va_list arg_ptr;
-  int saved_errno;
-
-  saved_errno = errno;
 
   if (! (debug_flags & flags))
     return;
 
   va_start (arg_ptr, format);
-  EnterCriticalSection (&debug_lock);
-  vfprintf (debug_file, format, arg_ptr);
+  debug_queue (NULL, NULL, NULL, format, arg_ptr);
   va_end (arg_ptr);
-  if (format && *format && format[strlen (format) - 1] != '\n')
-    putc ('\n', debug_file);
-  LeaveCriticalSection (&debug_lock);
-  fflush (debug_file);
+}
 
-  errno = saved_errno;
+
+/* Log a trace line.  This is used by the TRACE macros which already
+   checked that FLAGS are enabled.  */
+extern
+void
+_gpgex_trace (unsigned int flags, const char *func, const char *tagname,
+              void *tag, const char *format, ...)
+{
+  va_list arg_ptr;
+
+  if (! (debug_flags & flags))
+    return;
+
+  va_start (arg_ptr, format);
+  debug_queue (func, tagname, tag, format, arg_ptr);
+  va_end (arg_ptr);
 }
 
 
@@ -232,7 +563,7 @@ _gpgex_debug (unsigned int flags, const char *format, ...)
 }
 #endif
 
-
+
 /* Entry point called by DLL loader.  */
 STDAPI
 DllMain (HINSTANCE hinst, DWORD reason, LPVOID reserved)
@@ -246,6 +577,8 @@ DllMain (HINSTANCE hinst, DWORD reason, LPVOID reserved)
 
       debug_init ();
 
+      gpgex_stats_init ();
+
       i18n_init ();
 
       if (debug_flags & DEBUG_ASSUAN)
@@ -255,8 +588,8 @@ DllMain (HINSTANCE hinst, DWORD reason, LPVOID reserved)
 	}
       assuan_set_gpg_err_source (GPG_ERR_SOURCE_DEFAULT);
 
-      (void) TRACE0 (DEBUG_INIT, "DllMain", hinst,
-		     "reason=DLL_PROCESS_ATTACH");
+      (void) TRACE (DEBUG_INIT, "DllMain", hinst,
+		    "reason=DLL_PROCESS_ATTACH");
 
       {
 	WSADATA wsadat;
@@ -268,10 +601,13 @@ DllMain (HINSTANCE hinst, DWORD reason, LPVOID reserved)
     {
       WSACleanup ();
 
-      (void) TRACE0 (DEBUG_INIT, "DllMain", hinst,
-		     "reason=DLL_PROCESS_DETACH");
+      (void) TRACE (DEBUG_INIT, "DllMain", hinst,
+		    "reason=DLL_PROCESS_DETACH");
+
+      gpgex_stats_deinit ();
 
-      debug_deinit ();
+      /* RESERVED is not NULL if the process terminates.  */
+      debug_deinit (reserved != NULL);
       /* We are linking statically to libgpg-error which means there
          is no DllMain in libgpg-error.  Thus we call the deinit
          function to cleanly deinitialize libgpg-error.  */
@@ -329,17 +665,30 @@ DllUnregisterServer (void)
 STDAPI
 DllGetClassObject (REFCLSID rclsid, REFIID riid, LPVOID *ppv)
 {
-  /* We have to evaluate the arguments first.  */
-#define _TRACE_BEG22(a,b,c,d,e,f) TRACE_BEG22(a,b,c,d,e,f)
-  _TRACE_BEG22 (DEBUG_INIT, "DllGetClassObject", ppv,
-		"rclsid=" GUID_FMT ", riid=" GUID_FMT,
-		GUID_ARG (rclsid), GUID_ARG (riid));
+  TRACE_BEG (DEBUG_INIT, "DllGetClassObject", ppv,
+	     "rclsid=" GUID_FMT ", riid=" GUID_FMT,
+	     GUID_ARG (rclsid), GUID_ARG (riid));
 
   if (rclsid == CLSID_gpgex)
     {
       HRESULT err = gpgex_factory.QueryInterface (riid, ppv);
       return TRACE_RES (err);
     }
+  else if (rclsid == CLSID_gpgex_encrypted)
+    {
+      HRESULT err = gpgex_encrypted_factory.QueryInterface (riid, ppv);
+      return TRACE_RES (err);
+    }
+  else if (rclsid == CLSID_gpgex_signed)
+    {
+      HRESULT err = gpgex_signed_factory.QueryInterface (riid, ppv);
+      return TRACE_RES (err);
+    }
+  else if (rclsid == CLSID_gpgex_infotip)
+    {
+      HRESULT err = gpgex_infotip_factory.QueryInterface (riid, ppv);
+      return TRACE_RES (err);
+    }
 
   /* Be nice to broken software.  */
   *ppv = NULL;
@@ -0,0 +1,291 @@
+/* metacache.c - cache of the OpenPGP metadata of files
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <gpg-error.h>
+
+#include "stats.h"
+#include "metacache.h"
+
+/* The cache is a set associative table: a name is hashed to a set of
+   METACACHE_WAYS entries, and the oldest entry of the set is
+   replaced.  */
+#define METACACHE_SETS	2048	/* Must be a power of two.  */
+#define METACACHE_WAYS	4
+
+/* Entries older than this many microseconds are stale.  */
+#define METACACHE_MAX_AGE (5 * 60 * 1000000ULL)
+
+/* How often a lookup reads a set again which has changed meanwhile.  */
+#define METACACHE_TRIES	100
+
+/* An entry is identified by two independent hashes of the folded
+   name, so that a lookup never has to follow a pointer which a
+   writer may free.  */
+struct metacache_slot_s
+{
+  uint64_t hash;
+  uint64_t hash2;
+  uint64_t stamp;		/* Time of the last store; 0 if free.  */
+  struct gpgex_meta_s meta;
+};
+
+/* Writers hold METACACHE_LOCK, fill the slot which is not current
+   and then make it current by incrementing SEQ.  Lookups take no
+   lock; they read the current slot and read it again if SEQ has
+   changed meanwhile.  A writer which is preempted while it fills a
+   slot thus does not hold up the lookups.  */
+struct metacache_entry_s
+{
+  volatile unsigned int seq;	/* The low bit selects the slot.  */
+  struct metacache_slot_s slot[2];
+};
+
+static struct metacache_entry_s metacache[METACACHE_SETS][METACACHE_WAYS];
+GPGRT_LOCK_DEFINE (metacache_lock);
+
+
+/* Return the case and separator folded character C.  */
+static int
+fold_char (int c)
+{
+  if (c == '/')
+    return '\\';
+  if (c >= 'A' && c <= 'Z')
+    return c + 'a' - 'A';
+  return c;
+}
+
+
+/* Return the FNV-1a of the folded NAME and store a second hash, a
+   multiplicative one, at R_HASH2.  */
+static uint64_t
+hash_name (const char *name, uint64_t *r_hash2)
+{
+  uint64_t h = 0xcbf29ce484222325ULL;
+  uint64_t h2 = 0;
+  int c;
+
+  for (; *name; name++)
+    {
+      c = fold_char ((unsigned char) *name);
+      h ^= (unsigned char) c;
+      h *= 0x100000001b3ULL;
+      h2 = (h2 + (unsigned char) c + 1) * 0x9e3779b97f4a7c15ULL;
+      h2 ^= h2 >> 29;
+    }
+  *r_hash2 = h2;
+  return h;
+}
+
+
+/* Return the current slot of ENTRY.  The lock must be held.  */
+static struct metacache_slot_s *
+current_slot (struct metacache_entry_s *entry)
+{
+  return &entry->slot[entry->seq & 1];
+}
+
+
+/* Return the slot of ENTRY to be filled by the writer.  The lock
+   must be held.  */
+static struct metacache_slot_s *
+next_slot (struct metacache_entry_s *entry)
+{
+  return &entry->slot[(entry->seq + 1) & 1];
+}
+
+
+/* Make the next slot of ENTRY the current one.  The lock must be
+   held.  */
+static void
+commit_slot (struct metacache_entry_s *entry)
+{
+  __atomic_store_n (&entry->seq, entry->seq + 1, __ATOMIC_RELEASE);
+}
+
+
+/* Return the entry with HASH and HASH2 or NULL.  The lock must be
+   held.  */
+static struct metacache_entry_s *
+find_entry (uint64_t hash, uint64_t hash2)
+{
+  struct metacache_entry_s *set = metacache[hash & (METACACHE_SETS - 1)];
+  struct metacache_slot_s *slot;
+  int i;
+
+  for (i = 0; i < METACACHE_WAYS; i++)
+    {
+      slot = current_slot (&set[i]);
+      if (slot->stamp && slot->hash == hash && slot->hash2 == hash2)
+        return &set[i];
+    }
+  return NULL;
+}
+
+
+void
+gpgex_meta_from_pgp (struct gpgex_meta_s *meta,
+                     const struct gpgex_pgp_info_s *info)
+{
+  unsigned int i;
+
+  memset (meta, 0, sizeof *meta);
+  if (!info->is_openpgp)
+    return;
+  meta->flags = GPGEX_META_OPENPGP;
+  if (info->has_pubkey_enc || info->has_symkey_enc || info->has_encrypted)
+    meta->flags |= GPGEX_META_ENCRYPTED;
+  else if (info->has_signature)
+    meta->flags |= GPGEX_META_SIGNED;
+  if (info->has_pubkey || info->has_seckey)
+    meta->flags |= GPGEX_META_KEYS;
+
+  meta->nrecipients = info->nrecipients + info->more_recipients;
+  for (i = 0; i < info->nrecipients && i < GPGEX_META_MAX_RECIPIENTS; i++)
+    memcpy (meta->recipients[i], info->recipients[i], 8);
+  if (info->have_issuer)
+    {
+      meta->have_issuer = 1;
+      memcpy (meta->issuer, info->issuer, 8);
+    }
+}
+
+
+int
+gpgex_metacache_get (const char *name, struct gpgex_meta_s *r_meta)
+{
+  uint64_t hash, hash2, stamp = 0;
+  struct metacache_entry_s *set, *entry;
+  const struct metacache_slot_s *slot;
+  struct gpgex_meta_s meta;
+  unsigned int seq;
+  int tries, i, found, busy;
+
+  hash = hash_name (name, &hash2);
+  set = metacache[hash & (METACACHE_SETS - 1)];
+  for (tries = 0; tries < METACACHE_TRIES; tries++)
+    {
+      busy = 0;
+      for (i = 0; i < METACACHE_WAYS; i++)
+        {
+          /* The writer may start to fill the other slot as soon as
+             it has made this one current; so the slot is only
+             known to be intact if SEQ has not changed at all.  */
+          entry = &set[i];
+          seq = __atomic_load_n (&entry->seq, __ATOMIC_ACQUIRE);
+          slot = &entry->slot[seq & 1];
+          found = (slot->stamp && slot->hash == hash
+                   && slot->hash2 == hash2);
+          if (found)
+            {
+              meta = slot->meta;
+              stamp = slot->stamp;
+            }
+          __atomic_thread_fence (__ATOMIC_ACQUIRE);
+          if (__atomic_load_n (&entry->seq, __ATOMIC_RELAXED) != seq)
+            busy = 1;
+          else if (found)
+            {
+              *r_meta = meta;
+              return (gpgex_stats_now () - stamp > METACACHE_MAX_AGE
+                      ? GPGEX_META_STALE : GPGEX_META_HIT);
+            }
+        }
+      if (!busy)
+        return GPGEX_META_MISS;
+    }
+
+  return GPGEX_META_BUSY;
+}
+
+
+int
+gpgex_metacache_put (const char *name, const struct gpgex_meta_s *meta,
+                     int nowait)
+{
+  uint64_t hash, hash2;
+  struct metacache_entry_s *entry, *set;
+  struct metacache_slot_s *slot;
+  int result;
+  int i;
+
+  hash = hash_name (name, &hash2);
+
+  if (nowait)
+    {
+      if (gpgrt_lock_trylock (&metacache_lock))
+        return -1;
+    }
+  else
+    gpgrt_lock_lock (&metacache_lock);
+
+  entry = find_entry (hash, hash2);
+  if (entry && (meta->flags & GPGEX_META_PENDING)
+      && !(current_slot (entry)->meta.flags & GPGEX_META_PENDING))
+    {
+      /* The worker was faster than the caller.  */
+      gpgrt_lock_unlock (&metacache_lock);
+      return 0;
+    }
+  if (entry)
+    result = !!memcmp (&current_slot (entry)->meta, meta, sizeof *meta);
+  else
+    {
+      set = metacache[hash & (METACACHE_SETS - 1)];
+      entry = &set[0];
+      for (i = 1; i < METACACHE_WAYS; i++)
+        if (current_slot (&set[i])->stamp < current_slot (entry)->stamp)
+          entry = &set[i];
+      result = 1;
+    }
+  slot = next_slot (entry);
+  slot->hash = hash;
+  slot->hash2 = hash2;
+  slot->meta = *meta;
+  slot->stamp = gpgex_stats_now ();
+  if (!slot->stamp)
+    slot->stamp = 1;
+  commit_slot (entry);
+  gpgrt_lock_unlock (&metacache_lock);
+
+  return result;
+}
+
+
+void
+gpgex_metacache_clear (void)
+{
+  int i, j;
+
+  gpgrt_lock_lock (&metacache_lock);
+  for (i = 0; i < METACACHE_SETS; i++)
+    for (j = 0; j < METACACHE_WAYS; j++)
+      {
+        next_slot (&metacache[i][j])->stamp = 0;
+        commit_slot (&metacache[i][j]);
+      }
+  gpgrt_lock_unlock (&metacache_lock);
+}
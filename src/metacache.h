@@ -0,0 +1,95 @@
+/* metacache.h - cache of the OpenPGP metadata of files
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#ifndef GPGEX_METACACHE_H
+#define GPGEX_METACACHE_H	1
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pgpinfo.h"
+
+#ifdef __cplusplus
+extern "C" {
+#if 0
+}
+#endif
+#endif
+
+/* Icon overlays and info tips are requested by the Explorer for
+   every visible file, on its UI thread.  They are answered from this
+   cache only; the cache is filled by a background worker.  Lookups
+   take no lock, so the writer does not make them fail; only a lookup
+   which finds its set being written again and again gives up with
+   GPGEX_META_BUSY.  The number of entries is fixed, so old entries
+   are dropped.  */
+
+#define GPGEX_META_MAX_RECIPIENTS	4
+
+/* Flags of struct gpgex_meta_s.  */
+#define GPGEX_META_OPENPGP	1	/* The file is OpenPGP data.  */
+#define GPGEX_META_ENCRYPTED	2
+#define GPGEX_META_SIGNED	4
+#define GPGEX_META_KEYS		8
+#define GPGEX_META_PENDING	16	/* Queued; no data yet.  */
+
+/* What is known about a file.  */
+struct gpgex_meta_s
+{
+  unsigned int flags;
+  unsigned int nrecipients;	/* All recipients, even if not stored.  */
+  unsigned char recipients[GPGEX_META_MAX_RECIPIENTS][8];
+  unsigned int have_issuer;
+  unsigned char issuer[8];
+};
+
+/* Results of gpgex_metacache_get.  */
+#define GPGEX_META_MISS		0
+#define GPGEX_META_HIT		1
+#define GPGEX_META_STALE	2	/* Hit, but should be refreshed.  */
+#define GPGEX_META_BUSY		3	/* Being written; not known.  */
+
+/* Derive META from the parser result INFO.  */
+void gpgex_meta_from_pgp (struct gpgex_meta_s *meta,
+                          const struct gpgex_pgp_info_s *info);
+
+/* Look up the file NAME and copy its entry to R_META.  Returns
+   GPGEX_META_MISS, GPGEX_META_HIT, GPGEX_META_STALE or
+   GPGEX_META_BUSY.  Never blocks.  */
+int gpgex_metacache_get (const char *name, struct gpgex_meta_s *r_meta);
+
+/* Store META for NAME.  If NOWAIT is set, nothing is stored if the
+   lock is taken.  A pending entry does not replace a real one.
+   Returns 1 if the entry was added or has changed, 0 if not and -1 if
+   nothing was stored.  */
+int gpgex_metacache_put (const char *name, const struct gpgex_meta_s *meta,
+                         int nowait);
+
+/* Drop all entries.  */
+void gpgex_metacache_clear (void);
+
+#ifdef __cplusplus
+#if 0
+{
+#endif
+}
+#endif
+
+#endif /* GPGEX_METACACHE_H */
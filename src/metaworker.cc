@@ -0,0 +1,243 @@
+/* metaworker.cc - background filling of the metadata cache
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <windows.h>
+#include <shlobj.h>
+
+#include <gpg-error.h>
+
+#include "main.h"
+#include "stats.h"
+#include "pathclass.h"
+#include "pgpinfo.h"
+#include "metaworker.h"
+
+/* The number of queued files.  Requests are dropped if the queue is
+   full; the Explorer asks again on the next repaint.  */
+#define METAWORKER_QUEUE_SIZE 256
+
+/* The worker exits after being idle for this many milliseconds.  */
+#define METAWORKER_IDLE 5000
+
+/* The worker reads at most this many bytes of a file and gives up
+   after this many milliseconds.  */
+#define METAWORKER_HEAD_SIZE 4096
+#define METAWORKER_TIMEOUT 50
+
+
+/* The queue.  Protected by METAWORKER_LOCK.  */
+static char *metaworker_queue[METAWORKER_QUEUE_SIZE];
+static unsigned int metaworker_head;
+static unsigned int metaworker_count;
+static int metaworker_running;
+static HANDLE metaworker_event;
+GPGRT_LOCK_DEFINE (metaworker_lock);
+
+
+/* Read the header of NAME and store the result in the cache.  */
+static void
+classify_file (const char *name)
+{
+  struct gpgex_meta_s meta;
+  struct gpgex_io_budget_s budget;
+  struct gpgex_pgp_parser_s parser;
+  char buffer[METAWORKER_HEAD_SIZE];
+  gpgex_path_type_t type;
+  wchar_t *wname;
+  int n;
+
+  memset (&meta, 0, sizeof meta);
+  type = gpgex_probe_path (name);
+  gpgex_io_budget_init (&budget);
+  n = gpgex_read_head (name, type, &budget, buffer, sizeof buffer);
+  if (n >= 0)
+    {
+      gpgex_pgp_init (&parser, sizeof buffer, METAWORKER_TIMEOUT);
+      gpgex_pgp_feed (&parser, buffer, n);
+      gpgex_meta_from_pgp (&meta, gpgex_pgp_finish (&parser));
+    }
+
+  if (gpgex_metacache_put (name, &meta, 0) == 1
+      && (meta.flags & GPGEX_META_OPENPGP))
+    {
+      /* Let the Explorer ask again for the overlay and info tip.  */
+      wname = gpgrt_utf8_to_wchar (name);
+      if (wname)
+        {
+          SHChangeNotify (SHCNE_UPDATEITEM, SHCNF_PATHW | SHCNF_FLUSHNOWAIT,
+                          wname, NULL);
+          gpgrt_free_wchar (wname);
+        }
+    }
+  gpgex_stats_inc (GPGEX_STAT_META_READS);
+}
+
+
+static DWORD WINAPI
+metaworker_thread (LPVOID arg)
+{
+  char *name;
+
+  (void) arg;
+
+  TRACE_BEG (DEBUG_CONTEXT_MENU, "metaworker_thread", 0);
+
+  /* Do not compete with the Explorer for the disk.  */
+  SetThreadPriority (GetCurrentThread (), THREAD_MODE_BACKGROUND_BEGIN);
+
+  for (;;)
+    {
+      gpgrt_lock_lock (&metaworker_lock);
+      if (metaworker_count)
+        {
+          name = metaworker_queue[metaworker_head];
+          metaworker_queue[metaworker_head] = NULL;
+          metaworker_head = (metaworker_head + 1) % METAWORKER_QUEUE_SIZE;
+          metaworker_count--;
+        }
+      else
+        name = NULL;
+      gpgrt_lock_unlock (&metaworker_lock);
+
+      if (name)
+        {
+          classify_file (name);
+          free (name);
+          continue;
+        }
+
+      if (WaitForSingleObject (metaworker_event, METAWORKER_IDLE)
+          == WAIT_TIMEOUT)
+        {
+          gpgrt_lock_lock (&metaworker_lock);
+          if (!metaworker_count)
+            {
+              metaworker_running = 0;
+              gpgrt_lock_unlock (&metaworker_lock);
+              break;
+            }
+          gpgrt_lock_unlock (&metaworker_lock);
+        }
+    }
+
+  SetThreadPriority (GetCurrentThread (), THREAD_MODE_BACKGROUND_END);
+  (void) TRACE_SUC ();
+  gpgex_server::release ();
+  return 0;
+}
+
+
+/* Queue NAME unless it is already queued.  Returns false if the
+   queue is full or busy.  */
+static int
+queue_file (const char *name)
+{
+  unsigned int i, idx;
+  int start = 0;
+  char *copy;
+  HANDLE th;
+
+  if (gpgrt_lock_trylock (&metaworker_lock))
+    return 0;
+
+  for (i = 0; i < metaworker_count; i++)
+    {
+      idx = (metaworker_head + i) % METAWORKER_QUEUE_SIZE;
+      if (!strcmp (metaworker_queue[idx], name))
+        {
+          gpgrt_lock_unlock (&metaworker_lock);
+          return 1;
+        }
+    }
+  if (metaworker_count == METAWORKER_QUEUE_SIZE
+      || !(copy = strdup (name)))
+    {
+      gpgrt_lock_unlock (&metaworker_lock);
+      return 0;
+    }
+  idx = (metaworker_head + metaworker_count) % METAWORKER_QUEUE_SIZE;
+  metaworker_queue[idx] = copy;
+  metaworker_count++;
+
+  if (!metaworker_event)
+    metaworker_event = CreateEvent (NULL, FALSE, FALSE, NULL);
+  if (!metaworker_running && metaworker_event)
+    {
+      metaworker_running = 1;
+      start = 1;
+    }
+  gpgrt_lock_unlock (&metaworker_lock);
+
+  if (start)
+    {
+      /* Keep the DLL loaded until the thread has finished.  */
+      gpgex_server::add_ref ();
+      th = CreateThread (NULL, 0, metaworker_thread, NULL, 0, NULL);
+      if (th)
+        CloseHandle (th);
+      else
+        {
+          gpgex_server::release ();
+          gpgrt_lock_lock (&metaworker_lock);
+          metaworker_running = 0;
+          gpgrt_lock_unlock (&metaworker_lock);
+        }
+    }
+  else if (metaworker_event)
+    SetEvent (metaworker_event);
+  return 1;
+}
+
+
+int
+gpgex_metaworker_lookup (const char *name, struct gpgex_meta_s *r_meta)
+{
+  struct gpgex_meta_s pending;
+  int res;
+
+  res = gpgex_metacache_get (name, r_meta);
+  if (res == GPGEX_META_HIT)
+    return res;
+  if (res == GPGEX_META_BUSY)
+    {
+      memset (r_meta, 0, sizeof *r_meta);
+      return res;
+    }
+  if (res == GPGEX_META_STALE)
+    {
+      queue_file (name);
+      return res;
+    }
+
+  memset (&pending, 0, sizeof pending);
+  pending.flags = GPGEX_META_PENDING;
+  *r_meta = pending;
+  if (!queue_file (name))
+    return GPGEX_META_MISS;
+  gpgex_metacache_put (name, &pending, 1);
+  return GPGEX_META_HIT;
+}
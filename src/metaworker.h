@@ -0,0 +1,36 @@
+/* metaworker.h - background filling of the metadata cache
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#ifndef GPGEX_METAWORKER_H
+#define GPGEX_METAWORKER_H	1
+
+#include "metacache.h"
+
+/* Look up the utf-8 file NAME in the metadata cache.  On a miss the
+   file is queued for the background worker and a pending entry is
+   returned; a stale entry is returned and queued for a refresh.
+   Never blocks.  Returns GPGEX_META_MISS if the file could not be
+   queued; R_META is then a pending entry.  GPGEX_META_BUSY is passed
+   on; the entry is being written, so nothing is queued.  When the
+   worker has read the file, the Explorer is told to update the
+   item.  */
+int gpgex_metaworker_lookup (const char *name, struct gpgex_meta_s *r_meta);
+
+#endif /* GPGEX_METAWORKER_H */
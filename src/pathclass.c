@@ -0,0 +1,255 @@
+/* pathclass.c - classification of paths for menu-time I/O
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_W32_SYSTEM
+# include <windows.h>
+# include <gpg-error.h>
+# include "debug.h"
+# include "stats.h"
+#endif
+
+#include "pathclass.h"
+
+
+/* The policy table.  Reading the first block of a local file is
+   cheap; removable media may need to spin up, so they get less time.
+   Network and placeholder files are never opened.  */
+static const struct gpgex_io_policy_s io_policies[GPGEX_PATH_N_TYPES] =
+  {
+    { 0, 0, 0 },		/* GPGEX_PATH_UNKNOWN */
+    { 1, 4096, 50 },		/* GPGEX_PATH_LOCAL */
+    { 1, 4096, 20 },		/* GPGEX_PATH_REMOVABLE */
+    { 0, 0, 0 },		/* GPGEX_PATH_NETWORK */
+    { 0, 0, 0 }			/* GPGEX_PATH_PLACEHOLDER */
+  };
+
+
+static int
+is_dirsep (int c)
+{
+  return c == '\\' || c == '/';
+}
+
+
+int
+gpgex_path_is_unc (const char *name)
+{
+  if (!is_dirsep (name[0]) || !is_dirsep (name[1]))
+    return 0;
+  if ((name[2] == '?' || name[2] == '.') && is_dirsep (name[3]))
+    {
+      /* A device path; only "\\?\UNC\" is a network path.  */
+      name += 4;
+      return ((name[0] | 0x20) == 'u' && (name[1] | 0x20) == 'n'
+              && (name[2] | 0x20) == 'c' && is_dirsep (name[3]));
+    }
+  return 1;
+}
+
+
+gpgex_path_type_t
+gpgex_classify_path (const char *name, gpgex_volume_kind_t volume,
+                     unsigned long attributes)
+{
+  if (gpgex_path_is_unc (name) || volume == GPGEX_VOLUME_REMOTE)
+    return GPGEX_PATH_NETWORK;
+  if (volume == GPGEX_VOLUME_UNKNOWN)
+    return GPGEX_PATH_UNKNOWN;
+  /* This also catches the placeholders of sync clients on local
+     drives, which would be downloaded on open.  */
+  if (attributes & (GPGEX_ATTR_OFFLINE
+                    | GPGEX_ATTR_RECALL_ON_OPEN
+                    | GPGEX_ATTR_RECALL_ON_DATA_ACCESS))
+    return GPGEX_PATH_PLACEHOLDER;
+  if (volume == GPGEX_VOLUME_REMOVABLE)
+    return GPGEX_PATH_REMOVABLE;
+  return GPGEX_PATH_LOCAL;
+}
+
+
+const struct gpgex_io_policy_s *
+gpgex_io_policy (gpgex_path_type_t type)
+{
+  if ((unsigned int) type >= GPGEX_PATH_N_TYPES)
+    type = GPGEX_PATH_UNKNOWN;
+  return &io_policies[type];
+}
+
+
+const char *
+gpgex_path_type_name (gpgex_path_type_t type)
+{
+  switch (type)
+    {
+    case GPGEX_PATH_LOCAL:       return "local";
+    case GPGEX_PATH_REMOVABLE:   return "removable";
+    case GPGEX_PATH_NETWORK:     return "network";
+    case GPGEX_PATH_PLACEHOLDER: return "placeholder";
+    default:                     return "unknown";
+    }
+}
+
+
+void
+gpgex_io_budget_init (struct gpgex_io_budget_s *budget)
+{
+  memset (budget, 0, sizeof *budget);
+}
+
+
+int
+gpgex_io_budget_allow (struct gpgex_io_budget_s *budget,
+                       gpgex_path_type_t type)
+{
+  const struct gpgex_io_policy_s *policy = gpgex_io_policy (type);
+
+  if (!policy->allow_open
+      || budget->used_us[type] >= (uint64_t) policy->budget_ms * 1000)
+    {
+      budget->denied++;
+      return 0;
+    }
+  return 1;
+}
+
+
+void
+gpgex_io_budget_charge (struct gpgex_io_budget_s *budget,
+                        gpgex_path_type_t type, uint64_t usec)
+{
+  if ((unsigned int) type < GPGEX_PATH_N_TYPES)
+    budget->used_us[type] += usec;
+}
+
+
+
+#ifdef HAVE_W32_SYSTEM
+
+/* Not defined by older SDKs.  */
+#ifndef FILE_ATTRIBUTE_RECALL_ON_OPEN
+# define FILE_ATTRIBUTE_RECALL_ON_OPEN 0x00040000
+#endif
+#ifndef FILE_ATTRIBUTE_RECALL_ON_DATA_ACCESS
+# define FILE_ATTRIBUTE_RECALL_ON_DATA_ACCESS 0x00400000
+#endif
+
+
+/* Return the kind of the volume of WFNAME.  GetDriveType does not
+   touch the network for mapped drives.  */
+static gpgex_volume_kind_t
+get_volume_kind (const wchar_t *wfname)
+{
+  wchar_t root[4];
+
+  if (!wfname[0] || wfname[1] != L':')
+    return GPGEX_VOLUME_UNKNOWN;
+  root[0] = wfname[0];
+  root[1] = L':';
+  root[2] = L'\\';
+  root[3] = 0;
+  switch (GetDriveTypeW (root))
+    {
+    case DRIVE_FIXED:     return GPGEX_VOLUME_FIXED;
+    case DRIVE_REMOVABLE:
+    case DRIVE_CDROM:     return GPGEX_VOLUME_REMOVABLE;
+    case DRIVE_REMOTE:    return GPGEX_VOLUME_REMOTE;
+    default:              return GPGEX_VOLUME_UNKNOWN;
+    }
+}
+
+
+gpgex_path_type_t
+gpgex_probe_path (const char *fname)
+{
+  gpgex_volume_kind_t volume;
+  wchar_t *wfname;
+  DWORD attr;
+
+  if (gpgex_path_is_unc (fname))
+    return GPGEX_PATH_NETWORK;
+
+  wfname = gpgrt_utf8_to_wchar (fname);
+  if (!wfname)
+    return GPGEX_PATH_UNKNOWN;
+  volume = get_volume_kind (wfname);
+  attr = 0;
+  if (volume == GPGEX_VOLUME_FIXED || volume == GPGEX_VOLUME_REMOVABLE)
+    {
+      /* Reading the attributes does not recall a placeholder.  */
+      attr = GetFileAttributesW (wfname);
+      if (attr == INVALID_FILE_ATTRIBUTES)
+        volume = GPGEX_VOLUME_UNKNOWN;
+    }
+  gpgrt_free_wchar (wfname);
+
+  return gpgex_classify_path (fname, volume, attr);
+}
+
+
+int
+gpgex_read_head (const char *fname, gpgex_path_type_t type,
+                 struct gpgex_io_budget_s *budget,
+                 void *buffer, size_t size)
+{
+  const struct gpgex_io_policy_s *policy = gpgex_io_policy (type);
+  uint64_t start;
+  wchar_t *wfname;
+  HANDLE hd;
+  DWORD nread;
+  int result = -1;
+
+  if (!gpgex_io_budget_allow (budget, type))
+    {
+      (void) TRACE (DEBUG_CONTEXT_MENU, "gpgex_read_head", 0,
+                    "not reading %s file %s",
+                    gpgex_path_type_name (type), fname);
+      return -1;
+    }
+  if (size > policy->max_bytes)
+    size = policy->max_bytes;
+
+  wfname = gpgrt_utf8_to_wchar (fname);
+  if (!wfname)
+    return -1;
+
+  start = gpgex_stats_now ();
+  hd = CreateFileW (wfname, GENERIC_READ,
+                    FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                    NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  gpgrt_free_wchar (wfname);
+  if (hd != INVALID_HANDLE_VALUE)
+    {
+      if (ReadFile (hd, buffer, (DWORD) size, &nread, NULL))
+        result = (int) nread;
+      CloseHandle (hd);
+    }
+  gpgex_io_budget_charge (budget, type, gpgex_stats_now () - start);
+
+  return result;
+}
+
+#endif /*HAVE_W32_SYSTEM*/
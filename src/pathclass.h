@@ -0,0 +1,136 @@
+/* pathclass.h - classification of paths for menu-time I/O
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#ifndef GPGEX_PATHCLASS_H
+#define GPGEX_PATHCLASS_H	1
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#if 0
+}
+#endif
+#endif
+
+/* Explorer calls the shell extension on its UI thread, so a single
+   CreateFile on a network share or on a cloud placeholder can freeze
+   it for seconds or start a download.  All file access while the
+   menu is built thus goes through a policy which depends on the type
+   of the path, and through a time budget.  The policy core is
+   portable; only the probing of the volume and the attributes is
+   system specific.  */
+
+typedef enum
+  {
+    GPGEX_PATH_UNKNOWN = 0,	/* Could not be classified.  */
+    GPGEX_PATH_LOCAL,		/* Regular file on a fixed drive.  */
+    GPGEX_PATH_REMOVABLE,	/* Removable drive or optical disc.  */
+    GPGEX_PATH_NETWORK,		/* UNC path or mapped network drive.  */
+    GPGEX_PATH_PLACEHOLDER,	/* Offline or cloud file not present.  */
+
+    GPGEX_PATH_N_TYPES
+  }
+gpgex_path_type_t;
+
+/* The kind of the volume as far as the classification is
+   concerned.  */
+typedef enum
+  {
+    GPGEX_VOLUME_UNKNOWN = 0,
+    GPGEX_VOLUME_FIXED,
+    GPGEX_VOLUME_REMOVABLE,
+    GPGEX_VOLUME_REMOTE
+  }
+gpgex_volume_kind_t;
+
+/* File attribute bits used by the classification.  They have the
+   values of the Windows FILE_ATTRIBUTE_ constants.  */
+#define GPGEX_ATTR_DIRECTORY		0x00000010
+#define GPGEX_ATTR_OFFLINE		0x00001000
+#define GPGEX_ATTR_RECALL_ON_OPEN	0x00040000
+#define GPGEX_ATTR_RECALL_ON_DATA_ACCESS 0x00400000
+
+/* The I/O policy for a path type.  */
+struct gpgex_io_policy_s
+{
+  unsigned int allow_open:1;	/* The file may be opened at all.  */
+  size_t max_bytes;		/* Read at most this much per file.  */
+  unsigned int budget_ms;	/* Time for all files of this type.  */
+};
+
+/* The time spent on menu-time I/O.  */
+struct gpgex_io_budget_s
+{
+  uint64_t used_us[GPGEX_PATH_N_TYPES];
+  unsigned int denied;		/* Accesses refused.  */
+};
+
+/* Return true if NAME is a UNC path, including the "\\?\UNC\" form.
+   This is decided from the name alone.  */
+int gpgex_path_is_unc (const char *name);
+
+/* Classify a path from the kind of its volume VOLUME and the file
+   attributes ATTRIBUTES.  NAME is used to detect UNC paths.  */
+gpgex_path_type_t gpgex_classify_path (const char *name,
+                                       gpgex_volume_kind_t volume,
+                                       unsigned long attributes);
+
+/* Return the policy for path type TYPE.  */
+const struct gpgex_io_policy_s *gpgex_io_policy (gpgex_path_type_t type);
+
+/* Return the name of TYPE for the traces.  */
+const char *gpgex_path_type_name (gpgex_path_type_t type);
+
+/* Reset BUDGET for a new menu.  */
+void gpgex_io_budget_init (struct gpgex_io_budget_s *budget);
+
+/* Return true if a file of type TYPE may be accessed under BUDGET.
+   Otherwise the caller shall decide from the name alone.  */
+int gpgex_io_budget_allow (struct gpgex_io_budget_s *budget,
+                           gpgex_path_type_t type);
+
+/* Charge USEC microseconds of I/O on a file of type TYPE to
+   BUDGET.  */
+void gpgex_io_budget_charge (struct gpgex_io_budget_s *budget,
+                             gpgex_path_type_t type, uint64_t usec);
+
+#ifdef HAVE_W32_SYSTEM
+/* Classify the file with the utf-8 name FNAME.  Network paths are
+   detected without touching the file.  */
+gpgex_path_type_t gpgex_probe_path (const char *fname);
+
+/* Read up to SIZE bytes from the start of the file FNAME of type TYPE
+   into BUFFER if the policy and BUDGET allow it.  Returns the number
+   of bytes read or -1 if the file was not read.  */
+int gpgex_read_head (const char *fname, gpgex_path_type_t type,
+                     struct gpgex_io_budget_s *budget,
+                     void *buffer, size_t size);
+#endif
+
+#ifdef __cplusplus
+#if 0
+{
+#endif
+}
+#endif
+
+#endif /* GPGEX_PATHCLASS_H */
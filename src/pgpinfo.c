@@ -0,0 +1,786 @@
+/* pgpinfo.c - OpenPGP packet header parser
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+/* Only the packet headers and the first bytes of the interesting
+   packets are looked at (RFC 4880 and RFC 9580):
+
+     1  Public-Key Encrypted Session Key: the key ID of the recipient.
+     2  Signature: the issuer key ID from a v3 signature or from the
+        issuer and issuer fingerprint subpackets.
+     4  One-Pass Signature: the issuer key ID.
+     11 Literal Data: the file name.
+
+   Everything else is skipped by its length without being copied.  */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include "stats.h"
+#include "pgpinfo.h"
+
+
+/* The states of the armor decoder.  */
+enum
+  {
+    A_START,			/* Before the first non-white byte.  */
+    A_BINARY,			/* Not armored.  */
+    A_BEGIN,			/* In the BEGIN line.  */
+    A_CLEARTEXT,		/* In the text of a cleartext signature.  */
+    A_HEADERS,			/* In the armor headers.  */
+    A_BODY,			/* In the radix-64 data.  */
+    A_END
+  };
+
+/* The states of the packet parser.  */
+enum
+  {
+    P_CTB,			/* Expecting a packet tag byte.  */
+    P_LENGTH,			/* In the length octets.  */
+    P_BODY			/* In the packet body.  */
+  };
+
+/* The number of bytes processed between checks of the deadline.  */
+#define SLICE_SIZE 65536
+
+
+static void
+set_done (struct gpgex_pgp_parser_s *parser)
+{
+  parser->done = 1;
+}
+
+
+static void
+add_recipient (struct gpgex_pgp_info_s *info, const unsigned char *keyid)
+{
+  if (info->nrecipients < GPGEX_PGP_MAX_RECIPIENTS)
+    memcpy (info->recipients[info->nrecipients++], keyid, 8);
+  else
+    info->more_recipients++;
+}
+
+
+static void
+set_issuer (struct gpgex_pgp_info_s *info, const unsigned char *keyid)
+{
+  if (!info->have_issuer)
+    {
+      memcpy (info->issuer, keyid, 8);
+      info->have_issuer = 1;
+    }
+}
+
+
+/* Look for the issuer in the signature subpacket area BUF of LEN
+   bytes.  Returns true if found.  */
+static int
+scan_subpackets (struct gpgex_pgp_info_s *info,
+                 const unsigned char *buf, size_t len)
+{
+  size_t off = 0;
+  size_t n, hlen;
+  const unsigned char *data;
+
+  while (off < len)
+    {
+      if (buf[off] < 192)
+        {
+          n = buf[off];
+          hlen = 1;
+        }
+      else if (buf[off] < 255)
+        {
+          if (len - off < 2)
+            return 0;
+          n = ((buf[off] - 192) << 8) + buf[off + 1] + 192;
+          hlen = 2;
+        }
+      else
+        {
+          if (len - off < 5)
+            return 0;
+          n = ((size_t) buf[off + 1] << 24) | (buf[off + 2] << 16)
+            | (buf[off + 3] << 8) | buf[off + 4];
+          hlen = 5;
+        }
+      off += hlen;
+      if (!n || n > len - off)
+        return 0;
+      data = buf + off + 1;
+      n--;
+      switch (buf[off] & 0x7f)
+        {
+        case 16:		/* Issuer.  */
+          if (n >= 8)
+            {
+              set_issuer (info, data);
+              return 1;
+            }
+          break;
+        case 33:		/* Issuer fingerprint.  */
+          if (n >= 21 && data[0] == 4)
+            {
+              set_issuer (info, data + 1 + 12);
+              return 1;
+            }
+          if (n >= 33 && (data[0] == 5 || data[0] == 6))
+            {
+              set_issuer (info, data + 1);
+              return 1;
+            }
+          break;
+        }
+      off += n + 1;
+    }
+  return 0;
+}
+
+
+/* Store the length of the subpacket area at BUF, which has LEN bytes,
+   at R_N and the size of its length field at R_HLEN.  Returns -1 if
+   BUF is too short.  */
+static int
+area_length (const unsigned char *buf, size_t len, int wide,
+             size_t *r_n, size_t *r_hlen)
+{
+  *r_hlen = wide ? 4 : 2;
+  if (len < *r_hlen)
+    return -1;
+  if (wide)
+    *r_n = ((size_t) buf[0] << 24) | (buf[1] << 16) | (buf[2] << 8) | buf[3];
+  else
+    *r_n = (buf[0] << 8) | buf[1];
+  return 0;
+}
+
+
+static void
+parse_signature (struct gpgex_pgp_info_s *info,
+                 const unsigned char *buf, size_t len)
+{
+  size_t off, hlen, n;
+  int wide, area;
+
+  if (info->have_issuer || len < 1)
+    return;
+  if (buf[0] == 2 || buf[0] == 3)
+    {
+      if (len >= 15 && buf[1] == 5)
+        set_issuer (info, buf + 7);
+      return;
+    }
+  if (buf[0] < 4 || buf[0] > 6)
+    return;
+
+  /* Version 4 uses two and versions 5 and 6 use four octets for the
+     length of the hashed and the unhashed subpacket area.  */
+  wide = buf[0] != 4;
+  off = 4;
+  for (area = 0; area < 2 && off < len; area++)
+    {
+      if (area_length (buf + off, len - off, wide, &n, &hlen))
+        return;
+      off += hlen;
+      /* The area may be cut off by the capture.  */
+      if (n > len - off)
+        n = len - off;
+      if (scan_subpackets (info, buf + off, n))
+        return;
+      off += n;
+    }
+}
+
+
+static void
+parse_onepass (struct gpgex_pgp_info_s *info,
+               const unsigned char *buf, size_t len)
+{
+  if (len >= 12 && buf[0] == 3)
+    set_issuer (info, buf + 4);
+  else if (len >= 5 && buf[0] == 6 && len >= 5 + (size_t) buf[4] + 32)
+    set_issuer (info, buf + 5 + buf[4]);
+}
+
+
+static void
+parse_pubkey_enc (struct gpgex_pgp_info_s *info,
+                  const unsigned char *buf, size_t len)
+{
+  static const unsigned char wildcard[8];
+
+  info->has_pubkey_enc = 1;
+  if (len >= 9 && buf[0] == 3)
+    add_recipient (info, buf + 1);
+  else if (len >= 2 && buf[0] == 6)
+    {
+      /* The key version and the fingerprint or nothing for an
+         anonymous recipient.  */
+      if (!buf[1])
+        add_recipient (info, wildcard);
+      else if (buf[1] == 21 && len >= 23 && buf[2] == 4)
+        add_recipient (info, buf + 3 + 12);
+      else if (buf[1] == 33 && len >= 35 && buf[2] == 6)
+        add_recipient (info, buf + 3);
+    }
+}
+
+
+static void
+parse_literal (struct gpgex_pgp_info_s *info,
+               const unsigned char *buf, size_t len)
+{
+  size_t n;
+
+  info->has_literal = 1;
+  if (len < 2)
+    return;
+  n = buf[1];
+  if (n > len - 2)
+    n = len - 2;
+  memcpy (info->filename, buf + 2, n);
+  info->filename[n] = 0;
+}
+
+
+/* Return the number of bytes of the packet with TAG to capture.  */
+static unsigned int
+capture_size (unsigned int tag)
+{
+  switch (tag)
+    {
+    case 1:  return 64;
+    case 2:  return GPGEX_PGP_CAPTURE;
+    case 4:  return 64;
+    case 11: return 2 + GPGEX_PGP_MAX_FILENAME;
+    default: return 0;
+    }
+}
+
+
+/* Process the packet with the captured start in PARSER.  */
+static void
+process_packet (struct gpgex_pgp_parser_s *parser)
+{
+  struct gpgex_pgp_info_s *info = &parser->info;
+  const unsigned char *buf = parser->capture;
+  size_t len = parser->caplen;
+
+  parser->capwant = 0;
+  switch (parser->tag)
+    {
+    case 1:
+      parse_pubkey_enc (info, buf, len);
+      break;
+    case 2:
+      info->has_signature = 1;
+      parse_signature (info, buf, len);
+      break;
+    case 3:
+      info->has_symkey_enc = 1;
+      break;
+    case 4:
+      info->has_signature = 1;
+      parse_onepass (info, buf, len);
+      break;
+    case 11:
+      parse_literal (info, buf, len);
+      break;
+
+    /* From here on only the data itself follows.  */
+    case 8:
+      info->has_compressed = 1;
+      set_done (parser);
+      break;
+    case 9:
+    case 18:
+    case 20:
+      info->has_encrypted = 1;
+      set_done (parser);
+      break;
+    case 5:
+    case 7:
+      info->has_seckey = 1;
+      set_done (parser);
+      break;
+    case 6:
+    case 14:
+      info->has_pubkey = 1;
+      set_done (parser);
+      break;
+    }
+}
+
+
+/* Return true if a packet stream may start with TAG.  */
+static int
+valid_first_tag (unsigned int tag)
+{
+  switch (tag)
+    {
+    case 1: case 2: case 3: case 4: case 5: case 6: case 7:
+    case 8: case 9: case 10: case 11: case 18: case 20:
+      return 1;
+    default:
+      return 0;
+    }
+}
+
+
+/* The length octets have been read; start the body.  */
+static void
+begin_packet (struct gpgex_pgp_parser_s *parser)
+{
+  if (!parser->seen_packet)
+    {
+      if (!valid_first_tag (parser->tag))
+        {
+          parser->info.invalid = 1;
+          set_done (parser);
+          return;
+        }
+      parser->seen_packet = 1;
+      parser->info.is_openpgp = 1;
+    }
+  parser->in_packet = 1;
+  parser->caplen = 0;
+  parser->capwant = capture_size (parser->tag);
+  if (!parser->capwant)
+    process_packet (parser);
+  parser->pstate = P_BODY;
+}
+
+
+/* Decode the length octets in PARSER.  Returns false if more are
+   needed.  */
+static int
+decode_length (struct gpgex_pgp_parser_s *parser)
+{
+  const unsigned char *hdr = parser->hdr;
+  unsigned int i;
+
+  if (parser->new_format && parser->hdrlen == 1)
+    {
+      if (hdr[0] < 192 || (hdr[0] >= 224 && hdr[0] < 255))
+        parser->hdrneed = 1;
+      else if (hdr[0] < 224)
+        parser->hdrneed = 2;
+      else
+        parser->hdrneed = 5;
+    }
+  if (parser->hdrlen < parser->hdrneed)
+    return 0;
+
+  parser->partial = 0;
+  if (!parser->new_format)
+    {
+      parser->remaining = 0;
+      for (i = 0; i < parser->hdrlen; i++)
+        parser->remaining = (parser->remaining << 8) | hdr[i];
+    }
+  else if (hdr[0] < 192)
+    parser->remaining = hdr[0];
+  else if (hdr[0] < 224)
+    parser->remaining = ((hdr[0] - 192) << 8) + hdr[1] + 192;
+  else if (hdr[0] < 255)
+    {
+      parser->remaining = (uint64_t) 1 << (hdr[0] & 0x1f);
+      parser->partial = 1;
+    }
+  else
+    parser->remaining = ((uint32_t) hdr[1] << 24) | (hdr[2] << 16)
+      | (hdr[3] << 8) | hdr[4];
+  return 1;
+}
+
+
+/* Parse the LEN bytes of packet data at BUF.  */
+static void
+parse_packets (struct gpgex_pgp_parser_s *parser,
+               const unsigned char *buf, size_t len)
+{
+  unsigned int c, n;
+  uint64_t skip;
+
+  while (len && !parser->done)
+    {
+      switch (parser->pstate)
+        {
+        case P_CTB:
+          c = *buf++;
+          len--;
+          if (!(c & 0x80))
+            {
+              /* Garbage after the packets is ignored.  */
+              if (!parser->seen_packet)
+                parser->info.invalid = 1;
+              set_done (parser);
+              break;
+            }
+          parser->hdrlen = 0;
+          parser->in_packet = 0;
+          parser->indeterminate = 0;
+          if ((c & 0x40))
+            {
+              parser->new_format = 1;
+              parser->tag = c & 0x3f;
+              parser->hdrneed = 1;
+            }
+          else
+            {
+              parser->new_format = 0;
+              parser->tag = (c >> 2) & 0x0f;
+              c &= 3;
+              parser->hdrneed = c == 0 ? 1 : c == 1 ? 2 : 4;
+              if (c == 3)
+                {
+                  parser->indeterminate = 1;
+                  parser->partial = 0;
+                  parser->remaining = UINT64_MAX;
+                  begin_packet (parser);
+                  break;
+                }
+            }
+          parser->pstate = P_LENGTH;
+          break;
+
+        case P_LENGTH:
+          parser->hdr[parser->hdrlen++] = *buf++;
+          len--;
+          if (!decode_length (parser))
+            break;
+          if (parser->in_packet)
+            parser->pstate = P_BODY;  /* Next partial body chunk.  */
+          else
+            begin_packet (parser);
+          break;
+
+        case P_BODY:
+          if (parser->caplen < parser->capwant)
+            {
+              n = parser->capwant - parser->caplen;
+              if (n > len)
+                n = len;
+              if (n > parser->remaining)
+                n = (unsigned int) parser->remaining;
+              memcpy (parser->capture + parser->caplen, buf, n);
+              parser->caplen += n;
+              if (parser->caplen == parser->capwant)
+                process_packet (parser);
+            }
+          skip = parser->remaining < len ? parser->remaining : len;
+          buf += skip;
+          len -= skip;
+          if (!parser->indeterminate)
+            parser->remaining -= skip;
+          if (!parser->remaining)
+            {
+              if (parser->partial)
+                {
+                  parser->hdrlen = 0;
+                  parser->hdrneed = 1;
+                  parser->pstate = P_LENGTH;
+                }
+              else
+                {
+                  if (parser->capwant)
+                    process_packet (parser);
+                  parser->pstate = P_CTB;
+                }
+            }
+          break;
+        }
+    }
+}
+
+
+/* Return the value of the radix-64 character C or -1.  */
+static int
+radix64_value (int c)
+{
+  if (c >= 'A' && c <= 'Z')
+    return c - 'A';
+  if (c >= 'a' && c <= 'z')
+    return c - 'a' + 26;
+  if (c >= '0' && c <= '9')
+    return c - '0' + 52;
+  if (c == '+')
+    return 62;
+  if (c == '/')
+    return 63;
+  return -1;
+}
+
+
+static int
+starts_with (const char *line, const char *prefix)
+{
+  return !strncmp (line, prefix, strlen (prefix));
+}
+
+
+/* Process the BEGIN line in PARSER->LINE.  */
+static void
+parse_begin_line (struct gpgex_pgp_parser_s *parser)
+{
+  struct gpgex_pgp_info_s *info = &parser->info;
+  const char *type;
+
+  if (!starts_with (parser->line, "-----BEGIN PGP "))
+    {
+      info->invalid = 1;
+      set_done (parser);
+      return;
+    }
+  type = parser->line + 15;
+  if (starts_with (type, "MESSAGE"))
+    info->armor = GPGEX_PGP_ARMOR_MESSAGE;
+  else if (starts_with (type, "SIGNATURE"))
+    info->armor = GPGEX_PGP_ARMOR_SIGNATURE;
+  else if (starts_with (type, "SIGNED MESSAGE"))
+    info->armor = GPGEX_PGP_ARMOR_SIGNED_MESSAGE;
+  else if (starts_with (type, "PUBLIC KEY BLOCK"))
+    info->armor = GPGEX_PGP_ARMOR_PUBLIC_KEY;
+  else if (starts_with (type, "PRIVATE KEY BLOCK"))
+    info->armor = GPGEX_PGP_ARMOR_PRIVATE_KEY;
+  else
+    info->armor = GPGEX_PGP_ARMOR_OTHER;
+  info->is_openpgp = 1;
+
+  if (info->armor == GPGEX_PGP_ARMOR_SIGNED_MESSAGE)
+    {
+      /* The signature follows the text.  */
+      info->has_signature = 1;
+      parser->astate = A_CLEARTEXT;
+    }
+  else
+    parser->astate = A_HEADERS;
+}
+
+
+/* Decode the radix-64 character C in PARSER.  Returns false if C is
+   not part of the data.  */
+static int
+decode_radix64 (struct gpgex_pgp_parser_s *parser, int c,
+                unsigned char *out, size_t *outlen)
+{
+  int v = radix64_value (c);
+
+  if (v < 0)
+    return 0;
+  parser->b64acc = (parser->b64acc << 6) | v;
+  parser->b64bits += 6;
+  if (parser->b64bits >= 8)
+    {
+      parser->b64bits -= 8;
+      out[(*outlen)++] = (parser->b64acc >> parser->b64bits) & 0xff;
+    }
+  return 1;
+}
+
+
+/* A line has been completed in the armor headers.  Returns true if it
+   is the first line of the data.  */
+static int
+end_header_line (struct gpgex_pgp_parser_s *parser)
+{
+  if (!parser->linelen)
+    {
+      parser->astate = A_BODY;
+      return 0;
+    }
+  /* Some encoders omit the empty line after the headers.  */
+  if (!strchr (parser->line, ':'))
+    {
+      parser->astate = A_BODY;
+      return 1;
+    }
+  return 0;
+}
+
+
+/* Parse the LEN bytes of armored input at BUF.  */
+static void
+parse_armor (struct gpgex_pgp_parser_s *parser,
+             const unsigned char *buf, size_t len)
+{
+  unsigned char out[64];
+  size_t outlen = 0;
+  size_t i, k;
+  int c;
+
+  for (i = 0; i < len && !parser->done; i++)
+    {
+      c = buf[i];
+      switch (parser->astate)
+        {
+        case A_START:
+          if ((c & 0x80))
+            {
+              parser->astate = A_BINARY;
+              parse_packets (parser, buf + i, len - i);
+              return;
+            }
+          if (c == '-')
+            {
+              parser->astate = A_BEGIN;
+              parser->linelen = 0;
+              parser->line[parser->linelen++] = c;
+            }
+          else if (!(c == ' ' || c == '\t' || c == '\r' || c == '\n'))
+            {
+              parser->info.invalid = 1;
+              set_done (parser);
+            }
+          break;
+
+        case A_BEGIN:
+        case A_CLEARTEXT:
+        case A_HEADERS:
+          if (c != '\n')
+            {
+              if (parser->linelen < sizeof parser->line - 1)
+                parser->line[parser->linelen++] = c;
+              break;
+            }
+          while (parser->linelen
+                 && (parser->line[parser->linelen - 1] == '\r'
+                     || parser->line[parser->linelen - 1] == ' '
+                     || parser->line[parser->linelen - 1] == '\t'))
+            parser->linelen--;
+          parser->line[parser->linelen] = 0;
+          if (parser->astate == A_BEGIN)
+            parse_begin_line (parser);
+          else if (parser->astate == A_CLEARTEXT)
+            {
+              if (starts_with (parser->line, "-----BEGIN PGP SIGNATURE"))
+                parser->astate = A_HEADERS;
+            }
+          else if (end_header_line (parser))
+            {
+              for (k = 0; k < parser->linelen; k++)
+                decode_radix64 (parser, parser->line[k], out, &outlen);
+              parser->at_line_start = 1;
+            }
+          else
+            parser->at_line_start = 1;
+          parser->linelen = 0;
+          break;
+
+        case A_BODY:
+          if (c == '\n')
+            parser->at_line_start = 1;
+          else if (c == ' ' || c == '\t' || c == '\r')
+            ;
+          else if (parser->at_line_start && (c == '=' || c == '-'))
+            {
+              /* The checksum or the END line.  */
+              parser->astate = A_END;
+            }
+          else
+            {
+              parser->at_line_start = 0;
+              if (!decode_radix64 (parser, c, out, &outlen))
+                parser->astate = A_END;
+            }
+          break;
+
+        case A_END:
+          break;
+        }
+
+      if (outlen > sizeof out - 4)
+        {
+          parse_packets (parser, out, outlen);
+          outlen = 0;
+        }
+      if (parser->astate == A_END)
+        {
+          parse_packets (parser, out, outlen);
+          outlen = 0;
+          set_done (parser);
+        }
+    }
+  if (outlen)
+    parse_packets (parser, out, outlen);
+}
+
+
+void
+gpgex_pgp_init (struct gpgex_pgp_parser_s *parser,
+                uint64_t max_bytes, unsigned int max_ms)
+{
+  memset (parser, 0, sizeof *parser);
+  parser->max_bytes = max_bytes;
+  if (max_ms)
+    parser->deadline = gpgex_stats_now () + (uint64_t) max_ms * 1000;
+  parser->astate = A_START;
+  parser->pstate = P_CTB;
+}
+
+
+int
+gpgex_pgp_feed (struct gpgex_pgp_parser_s *parser,
+                const void *buffer, size_t length)
+{
+  const unsigned char *buf = (const unsigned char *) buffer;
+  size_t n;
+
+  while (length && !parser->done)
+    {
+      n = length < SLICE_SIZE ? length : SLICE_SIZE;
+      if (parser->max_bytes
+          && n > parser->max_bytes - parser->info.consumed)
+        n = parser->max_bytes - parser->info.consumed;
+
+      if (parser->astate == A_BINARY)
+        parse_packets (parser, buf, n);
+      else
+        parse_armor (parser, buf, n);
+      buf += n;
+      length -= n;
+      parser->info.consumed += n;
+
+      if (parser->done)
+        break;
+      if ((parser->max_bytes && parser->info.consumed >= parser->max_bytes)
+          || (parser->deadline && gpgex_stats_now () > parser->deadline))
+        {
+          parser->info.truncated = 1;
+          set_done (parser);
+        }
+    }
+  return parser->done ? GPGEX_PGP_DONE : GPGEX_PGP_MORE;
+}
+
+
+const struct gpgex_pgp_info_s *
+gpgex_pgp_finish (struct gpgex_pgp_parser_s *parser)
+{
+  /* A packet cut off by the end of the data.  */
+  if (parser->pstate == P_BODY && parser->capwant)
+    process_packet (parser);
+  if (parser->astate == A_START && !parser->info.consumed)
+    parser->info.invalid = 1;
+  set_done (parser);
+  return &parser->info;
+}
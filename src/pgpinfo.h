@@ -0,0 +1,145 @@
+/* pgpinfo.h - OpenPGP packet header parser
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#ifndef GPGEX_PGPINFO_H
+#define GPGEX_PGPINFO_H	1
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#if 0
+}
+#endif
+#endif
+
+/* A streaming parser which learns what it can about an OpenPGP file
+   from the packet headers, without calling gpg and without allocating
+   memory.  It stops at the first encrypted or compressed data packet
+   and at the first key packet, because nothing more can be learned
+   from there on.  The input is fed in pieces of any size; armored
+   input is decoded on the fly.  The parser gives up after a number
+   of bytes and after a deadline, so it can be used on untrusted and
+   large files.  */
+
+#define GPGEX_PGP_MAX_RECIPIENTS	16
+#define GPGEX_PGP_MAX_FILENAME		255
+
+/* Size of the captured start of a packet.  */
+#define GPGEX_PGP_CAPTURE		512
+
+typedef enum
+  {
+    GPGEX_PGP_ARMOR_NONE = 0,	/* Binary.  */
+    GPGEX_PGP_ARMOR_MESSAGE,
+    GPGEX_PGP_ARMOR_SIGNATURE,
+    GPGEX_PGP_ARMOR_SIGNED_MESSAGE, /* Cleartext signature.  */
+    GPGEX_PGP_ARMOR_PUBLIC_KEY,
+    GPGEX_PGP_ARMOR_PRIVATE_KEY,
+    GPGEX_PGP_ARMOR_OTHER
+  }
+gpgex_pgp_armor_t;
+
+/* Return values of gpgex_pgp_feed.  */
+#define GPGEX_PGP_MORE	0	/* Feed more data.  */
+#define GPGEX_PGP_DONE	1	/* Nothing more to learn.  */
+
+/* What has been learned about the file.  Key IDs are stored as 8
+   bytes in the order of the packets.  */
+struct gpgex_pgp_info_s
+{
+  unsigned int is_openpgp:1;	/* Starts with a valid packet.  */
+  unsigned int invalid:1;	/* Not OpenPGP data.  */
+  unsigned int truncated:1;	/* Stopped at the byte or time limit.  */
+  unsigned int has_pubkey_enc:1; /* Public key encrypted session key.  */
+  unsigned int has_symkey_enc:1; /* Symmetric key encrypted session key.  */
+  unsigned int has_encrypted:1;	/* Encrypted data packet.  */
+  unsigned int has_compressed:1;
+  unsigned int has_signature:1;	/* Signature or one-pass signature.  */
+  unsigned int has_literal:1;
+  unsigned int has_pubkey:1;
+  unsigned int has_seckey:1;
+  unsigned int have_issuer:1;
+  gpgex_pgp_armor_t armor;
+  unsigned int nrecipients;	/* Key IDs stored in RECIPIENTS.  */
+  unsigned int more_recipients;	/* Recipients which did not fit.  */
+  unsigned char recipients[GPGEX_PGP_MAX_RECIPIENTS][8];
+  unsigned char issuer[8];	/* Of the first signature.  */
+  char filename[GPGEX_PGP_MAX_FILENAME + 1]; /* Of the literal data.  */
+  uint64_t consumed;		/* Bytes of input looked at.  */
+};
+
+/* The parser state.  Treat as opaque.  */
+struct gpgex_pgp_parser_s
+{
+  struct gpgex_pgp_info_s info;
+  uint64_t max_bytes;
+  uint64_t deadline;
+  int done;
+
+  /* Armor decoding.  */
+  int astate;
+  int at_line_start;
+  unsigned int linelen;
+  char line[80];
+  uint32_t b64acc;
+  unsigned int b64bits;
+
+  /* Packet parsing.  */
+  int pstate;
+  unsigned int tag;
+  unsigned int hdrneed;
+  unsigned int hdrlen;
+  unsigned char hdr[5];
+  int new_format;
+  int seen_packet;		/* A valid first packet was seen.  */
+  int in_packet;		/* The length of the packet is known.  */
+  int partial;			/* Partial body lengths follow.  */
+  int indeterminate;		/* Old format until end of data.  */
+  uint64_t remaining;		/* Body bytes of the current chunk.  */
+  unsigned int capwant;
+  unsigned int caplen;
+  unsigned char capture[GPGEX_PGP_CAPTURE];
+};
+
+/* Prepare PARSER to look at no more than MAX_BYTES bytes and to give
+   up after MAX_MS milliseconds.  0 means no limit.  */
+void gpgex_pgp_init (struct gpgex_pgp_parser_s *parser,
+                     uint64_t max_bytes, unsigned int max_ms);
+
+/* Feed the next LENGTH bytes of the file at BUFFER to PARSER.
+   Returns GPGEX_PGP_MORE or GPGEX_PGP_DONE.  */
+int gpgex_pgp_feed (struct gpgex_pgp_parser_s *parser,
+                    const void *buffer, size_t length);
+
+/* Tell PARSER that the end of the file has been reached and return
+   what has been learned.  */
+const struct gpgex_pgp_info_s *
+gpgex_pgp_finish (struct gpgex_pgp_parser_s *parser);
+
+#ifdef __cplusplus
+#if 0
+{
+#endif
+}
+#endif
+
+#endif /* GPGEX_PGPINFO_H */
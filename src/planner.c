@@ -0,0 +1,650 @@
+/* planner.c - planning the submission of file selections
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "planner.h"
+
+
+struct shard_item_s
+{
+  uint64_t cost;
+  size_t idx;
+};
+
+
+/* Sort by decreasing cost and, for a stable plan, by index.  */
+static int
+compare_shard_items (const void *a_arg, const void *b_arg)
+{
+  const struct shard_item_s *a = (const struct shard_item_s *) a_arg;
+  const struct shard_item_s *b = (const struct shard_item_s *) b_arg;
+
+  if (a->cost != b->cost)
+    return a->cost < b->cost ? 1 : -1;
+  return a->idx < b->idx ? -1 : a->idx > b->idx;
+}
+
+
+/* This is the LPT heuristic: Assigning the items in order of
+   decreasing cost to the least loaded shard gives a makespan of at
+   most 4/3 of the optimum.  The number of shards is small, thus a
+   linear scan for the least loaded one is sufficient.  */
+int
+gpgex_plan_shards (const uint64_t *sizes, size_t n, unsigned int nshards,
+                   uint64_t per_item, unsigned int *r_shard)
+{
+  struct shard_item_s *items;
+  uint64_t *load;
+  unsigned int used = 0;
+  unsigned int k, best;
+  size_t i;
+
+  if (!nshards)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+  if (nshards > n)
+    nshards = n;
+  if (nshards <= 1)
+    {
+      for (i = 0; i < n; i++)
+        r_shard[i] = 0;
+      return n ? 1 : 0;
+    }
+
+  items = (struct shard_item_s *) malloc (n * sizeof *items);
+  load = (uint64_t *) calloc (nshards, sizeof *load);
+  if (!items || !load)
+    {
+      free (items);
+      free (load);
+      return -1;
+    }
+
+  for (i = 0; i < n; i++)
+    {
+      items[i].cost = sizes[i] + per_item;
+      items[i].idx = i;
+    }
+  qsort (items, n, sizeof *items, compare_shard_items);
+
+  for (i = 0; i < n; i++)
+    {
+      best = 0;
+      for (k = 1; k < nshards; k++)
+        if (load[k] < load[best])
+          best = k;
+      if (!load[best])
+        used++;
+      load[best] += items[i].cost;
+      r_shard[items[i].idx] = best;
+    }
+
+  free (items);
+  free (load);
+  return used;
+}
+
+
+int
+gpgex_plan_shardable (const char *cmd)
+{
+  /* The encrypt and sign commands ask for the recipients or the
+     signing key.  */
+  static const char *const commands[] =
+    {
+      "DECRYPT_VERIFY_FILES",
+      "DECRYPT_FILES",
+      "VERIFY_FILES",
+      "IMPORT_FILES",
+      "CHECKSUM_CREATE_FILES",
+      "CHECKSUM_VERIFY_FILES",
+      NULL
+    };
+  int i;
+
+  for (i = 0; commands[i]; i++)
+    if (!strcmp (commands[i], cmd))
+      return 1;
+  return 0;
+}
+
+
+
+struct locality_item_s
+{
+  const char *name;       /* Without the prefix of the volume.  */
+  size_t volumelen;
+  size_t dirlen;
+  unsigned int sizeclass;
+  size_t idx;
+};
+
+
+/* Files of up to 64 KiB are in size class 0; above that each class
+   covers a factor of 4.  */
+static unsigned int
+size_class (uint64_t size)
+{
+  unsigned int class = 0;
+
+  size >>= 16;
+  while (size)
+    {
+      class++;
+      size >>= 2;
+    }
+  return class;
+}
+
+
+static int
+is_dirsep (int c)
+{
+  return c == '\\' || c == '/';
+}
+
+
+/* Return the length of the volume part of NAME: "C:", "\\server\share"
+   and the same with a "\\?\" or "\\?\UNC\" prefix.  The offset of
+   the volume name without these prefixes is stored at R_START, so
+   that all spellings of a volume compare equal.  */
+static size_t
+volume_length (const char *name, size_t *r_start)
+{
+  const char *p = name;
+  int parts;
+
+  if (is_dirsep (p[0]) && is_dirsep (p[1])
+      && (p[2] == '?' || p[2] == '.') && is_dirsep (p[3]))
+    {
+      p += 4;
+      *r_start = 4;
+      if (((p[0] | 0x20) == 'u') && ((p[1] | 0x20) == 'n')
+          && ((p[2] | 0x20) == 'c') && is_dirsep (p[3]))
+        {
+          p += 4;
+          *r_start = 8;
+          goto unc;
+        }
+    }
+  else if (is_dirsep (p[0]) && is_dirsep (p[1]))
+    {
+      p += 2;
+      *r_start = 2;
+      goto unc;
+    }
+  else
+    *r_start = 0;
+
+  if (p[0] && p[1] == ':')
+    return p + 2 - name;
+  return p - name;
+
+ unc:
+  /* Server and share.  */
+  for (parts = 0; *p && parts < 2; parts++)
+    {
+      while (*p && !is_dirsep (*p))
+        p++;
+      if (parts < 1 && *p)
+        p++;
+    }
+  return p - name;
+}
+
+
+/* Compare the first LEN bytes of A and B like the file system does,
+   ignoring the case of ASCII letters and the kind of the directory
+   separator.  */
+static int
+compare_path_prefix (const char *a, const char *b, size_t len)
+{
+  size_t i;
+  int ca, cb;
+
+  for (i = 0; i < len; i++)
+    {
+      ca = (unsigned char) a[i];
+      cb = (unsigned char) b[i];
+      if (ca == '/')
+        ca = '\\';
+      else if (ca >= 'A' && ca <= 'Z')
+        ca += 'a' - 'A';
+      if (cb == '/')
+        cb = '\\';
+      else if (cb >= 'A' && cb <= 'Z')
+        cb += 'a' - 'A';
+      if (ca != cb)
+        return ca - cb;
+    }
+  return 0;
+}
+
+
+static int
+compare_path_parts (const char *a, size_t alen, const char *b, size_t blen)
+{
+  int cmp;
+
+  cmp = compare_path_prefix (a, b, alen < blen ? alen : blen);
+  if (cmp)
+    return cmp;
+  return alen < blen ? -1 : alen > blen;
+}
+
+
+static int
+compare_locality_items (const void *a_arg, const void *b_arg)
+{
+  const struct locality_item_s *a = (const struct locality_item_s *) a_arg;
+  const struct locality_item_s *b = (const struct locality_item_s *) b_arg;
+  int cmp;
+
+  cmp = compare_path_parts (a->name, a->volumelen, b->name, b->volumelen);
+  if (cmp)
+    return cmp;
+  cmp = compare_path_parts (a->name, a->dirlen, b->name, b->dirlen);
+  if (cmp)
+    return cmp;
+  if (a->sizeclass != b->sizeclass)
+    return a->sizeclass < b->sizeclass ? -1 : 1;
+  return a->idx < b->idx ? -1 : a->idx > b->idx;
+}
+
+
+int
+gpgex_plan_locality (const char *const *names, const uint64_t *sizes,
+                     size_t n, size_t *r_order)
+{
+  struct locality_item_s *items;
+  const char *p;
+  size_t start;
+  size_t i;
+
+  if (!n)
+    return 0;
+
+  items = (struct locality_item_s *) malloc (n * sizeof *items);
+  if (!items)
+    return -1;
+
+  for (i = 0; i < n; i++)
+    {
+      items[i].volumelen = volume_length (names[i], &start);
+      items[i].name = names[i] + start;
+      items[i].volumelen -= start;
+      items[i].dirlen = items[i].volumelen;
+      for (p = items[i].name + items[i].volumelen; *p; p++)
+        if (is_dirsep (*p))
+          items[i].dirlen = p - items[i].name;
+      items[i].sizeclass = size_class (sizes[i]);
+      items[i].idx = i;
+    }
+  qsort (items, n, sizeof *items, compare_locality_items);
+
+  for (i = 0; i < n; i++)
+    r_order[i] = items[i].idx;
+
+  free (items);
+  return 0;
+}
+
+
+
+struct dedup_item_s
+{
+  const char *key;        /* The name in tree order, see tree_char.  */
+  size_t len;             /* Without trailing separators.  */
+  const struct gpgex_file_id_s *id;
+  size_t idx;
+};
+
+
+/* Sort by identity and then by index, so that the first of the
+   files with the same identity comes first.  */
+static int
+compare_dedup_ids (const void *a_arg, const void *b_arg)
+{
+  const struct dedup_item_s *a = (const struct dedup_item_s *) a_arg;
+  const struct dedup_item_s *b = (const struct dedup_item_s *) b_arg;
+
+  if (a->id->valid != b->id->valid)
+    return a->id->valid ? -1 : 1;
+  if (a->id->valid)
+    {
+      if (a->id->volume != b->id->volume)
+        return a->id->volume < b->id->volume ? -1 : 1;
+      if (a->id->file != b->id->file)
+        return a->id->file < b->id->file ? -1 : 1;
+    }
+  return a->idx < b->idx ? -1 : a->idx > b->idx;
+}
+
+
+/* Map the character C of a name for the tree order: the case of
+   ASCII letters is ignored and the directory separators come before
+   all other characters, so that the contents of a directory directly
+   follow the directory.  */
+static int
+tree_char (int c)
+{
+  if (is_dirsep (c))
+    return 1;
+  if (c >= 'A' && c <= 'Z')
+    return c + 'a' - 'A';
+  return c;
+}
+
+
+static int
+compare_dedup_keys (const void *a_arg, const void *b_arg)
+{
+  const struct dedup_item_s *a = (const struct dedup_item_s *) a_arg;
+  const struct dedup_item_s *b = (const struct dedup_item_s *) b_arg;
+  int cmp;
+
+  cmp = strcmp (a->key, b->key);
+  if (cmp)
+    return cmp;
+  return a->idx < b->idx ? -1 : a->idx > b->idx;
+}
+
+
+/* Two sorts find the redundant files: by identity for the same file
+   under different names, and in tree order for equal names and for
+   the contents of selected directories, which then follow their
+   directory.  The names are mapped to the tree order once, so that
+   the sort compares plain strings.  */
+int
+gpgex_plan_dedup (const char *const *names,
+                  const struct gpgex_file_id_s *ids, size_t n,
+                  unsigned char *r_keep)
+{
+  struct dedup_item_s *items;
+  const struct dedup_item_s *item;
+  const struct dedup_item_s *dir;
+  char *keys, *key;
+  const char *name;
+  size_t start, volumelen, len;
+  size_t total;
+  size_t i, j;
+
+  if (!n)
+    return 0;
+
+  total = 0;
+  for (i = 0; i < n; i++)
+    total += strlen (names[i]) + 1;
+  items = (struct dedup_item_s *) malloc (n * sizeof *items);
+  keys = (char *) malloc (total);
+  if (!items || !keys)
+    {
+      free (items);
+      free (keys);
+      return -1;
+    }
+
+  key = keys;
+  for (i = 0; i < n; i++)
+    {
+      /* All spellings of a volume get the same key.  */
+      volumelen = volume_length (names[i], &start);
+      name = names[i] + start;
+      volumelen -= start;
+      len = strlen (name);
+      while (len > volumelen && is_dirsep (name[len - 1]))
+        len--;
+      for (j = 0; j < len; j++)
+        key[j] = tree_char ((unsigned char) name[j]);
+      key[len] = 0;
+
+      items[i].key = key;
+      items[i].len = len;
+      items[i].id = &ids[i];
+      items[i].idx = i;
+      r_keep[i] = 1;
+      key += len + 1;
+    }
+
+  qsort (items, n, sizeof *items, compare_dedup_ids);
+  for (i = 1; i < n; i++)
+    if (items[i].id->valid && items[i - 1].id->valid
+        && items[i].id->volume == items[i - 1].id->volume
+        && items[i].id->file == items[i - 1].id->file)
+      r_keep[items[i].idx] = 0;
+
+  qsort (items, n, sizeof *items, compare_dedup_keys);
+  dir = NULL;
+  for (i = 0; i < n; i++)
+    {
+      item = &items[i];
+      if (i && !strcmp (items[i - 1].key, item->key))
+        r_keep[item->idx] = 0;
+      else if (dir && item->len > dir->len && item->key[dir->len] == 1
+               && !memcmp (dir->key, item->key, dir->len))
+        r_keep[item->idx] = 0;
+      else if (item->id->is_dir)
+        dir = item;
+    }
+
+  free (keys);
+  free (items);
+  return 0;
+}
+
+
+
+/* The overheads of the OpenPGP output.  They are generous, so that
+   several recipients with large keys are covered.  */
+#define OUTPUT_ENCRYPT_OVERHEAD	4096	/* Session keys and headers.  */
+#define OUTPUT_SIGNATURE_SIZE	1024	/* One signature packet.  */
+#define OUTPUT_CHUNK_SIZE	8192	/* One length byte per chunk.  */
+
+/* A tar member takes a header block, maybe a pax header, and its data
+   rounded up to the block size.  The archive ends in two blocks.  */
+#define OUTPUT_TAR_BLOCK	512
+#define OUTPUT_TAR_MEMBER	(3 * OUTPUT_TAR_BLOCK)
+#define OUTPUT_TAR_END		(2 * OUTPUT_TAR_BLOCK)
+
+
+gpgex_output_kind_t
+gpgex_plan_output_kind (const char *cmd)
+{
+  if (!strcmp (cmd, "ENCRYPT_FILES"))
+    return GPGEX_OUTPUT_ENCRYPT;
+  if (!strcmp (cmd, "ENCRYPT_SIGN_FILES"))
+    return GPGEX_OUTPUT_SIGN_ENCRYPT;
+  if (!strcmp (cmd, "SIGN_FILES"))
+    return GPGEX_OUTPUT_SIGN;
+  if (!strcmp (cmd, "DECRYPT_FILES") || !strcmp (cmd, "DECRYPT_VERIFY_FILES"))
+    return GPGEX_OUTPUT_DECRYPT;
+  if (!strcmp (cmd, "ENCRYPT_ARCHIVE"))
+    return GPGEX_OUTPUT_ARCHIVE;
+  return GPGEX_OUTPUT_NONE;
+}
+
+
+/* Return the size of SIZE bytes in base64 with lines of 64
+   characters and CR LF, plus the armor header, checksum and
+   footer.  */
+static uint64_t
+armored_size (uint64_t size)
+{
+  uint64_t chars = (size + 2) / 3 * 4;
+
+  return chars + (chars + 63) / 64 * 2 + 128;
+}
+
+
+uint64_t
+gpgex_plan_output_size (gpgex_output_kind_t kind, uint64_t size,
+                        int armor, int input_armored)
+{
+  uint64_t out;
+
+  switch (kind)
+    {
+    case GPGEX_OUTPUT_ENCRYPT:
+    case GPGEX_OUTPUT_SIGN_ENCRYPT:
+    case GPGEX_OUTPUT_ARCHIVE:
+      out = size + size / OUTPUT_CHUNK_SIZE + OUTPUT_ENCRYPT_OVERHEAD;
+      if (kind == GPGEX_OUTPUT_SIGN_ENCRYPT)
+        out += OUTPUT_SIGNATURE_SIZE;
+      break;
+
+    case GPGEX_OUTPUT_SIGN:
+      out = OUTPUT_SIGNATURE_SIZE;
+      break;
+
+    case GPGEX_OUTPUT_DECRYPT:
+      /* The plaintext is not armored.  It is larger than the message
+         only if it was compressed, which is not known here.  */
+      return input_armored ? size / 4 * 3 : size;
+
+    default:
+      return 0;
+    }
+
+  return armor ? armored_size (out) : out;
+}
+
+
+/* Return true if NAME ends in ".asc".  */
+static int
+has_armor_suffix (const char *name)
+{
+  size_t len = strlen (name);
+
+  return len > 4 && !compare_path_prefix (name + len - 4, ".asc", 4);
+}
+
+
+/* The volumes are looked up linearly; a selection spans only a few
+   of them.  */
+int
+gpgex_plan_volumes (gpgex_output_kind_t kind,
+                    const char *const *names, const uint64_t *sizes,
+                    size_t n, int armor,
+                    struct gpgex_volume_need_s **r_volumes,
+                    size_t *r_count)
+{
+  struct gpgex_volume_need_s *volumes;
+  size_t *keystart;
+  const char *target;
+  size_t count = 0;
+  size_t start, len;
+  uint64_t size, tarsize;
+  size_t i, k;
+
+  *r_volumes = NULL;
+  *r_count = 0;
+  if (!n || kind == GPGEX_OUTPUT_NONE)
+    return 0;
+
+  volumes = (struct gpgex_volume_need_s *) calloc (n, sizeof *volumes);
+  keystart = (size_t *) calloc (n, sizeof *keystart);
+  if (!volumes || !keystart)
+    {
+      free (volumes);
+      free (keystart);
+      return -1;
+    }
+
+  tarsize = OUTPUT_TAR_END;
+  for (i = 0; i < n; i++)
+    {
+      if (kind == GPGEX_OUTPUT_ARCHIVE)
+        {
+          tarsize += ((sizes[i] + OUTPUT_TAR_BLOCK - 1)
+                      / OUTPUT_TAR_BLOCK * OUTPUT_TAR_BLOCK
+                      + OUTPUT_TAR_MEMBER);
+          if (i + 1 < n)
+            continue;
+          /* The archive is written next to the first file.  */
+          target = names[0];
+          size = gpgex_plan_output_size (kind, tarsize, armor, 0);
+        }
+      else
+        {
+          target = names[i];
+          size = gpgex_plan_output_size (kind, sizes[i], armor,
+                                         has_armor_suffix (target));
+        }
+
+      /* The root is the volume name and a backslash; the key to
+         compare starts after the "\\?\" prefix.  */
+      len = volume_length (target, &start);
+      if (len == start)
+        continue;
+      for (k = 0; k < count; k++)
+        if (!compare_path_parts (volumes[k].root + keystart[k],
+                                 strlen (volumes[k].root) - 1 - keystart[k],
+                                 target + start, len - start))
+          break;
+      if (k == count)
+        {
+          volumes[k].root = (char *) malloc (len + 2);
+          if (!volumes[k].root)
+            {
+              gpgex_plan_volumes_free (volumes, count);
+              free (keystart);
+              return -1;
+            }
+          memcpy (volumes[k].root, target, len);
+          strcpy (volumes[k].root + len, "\\");
+          keystart[k] = start;
+          count++;
+        }
+      volumes[k].need += size;
+      volumes[k].nfiles += kind == GPGEX_OUTPUT_ARCHIVE ? n : 1;
+    }
+
+  free (keystart);
+  if (!count)
+    {
+      free (volumes);
+      return 0;
+    }
+  *r_volumes = volumes;
+  *r_count = count;
+  return 0;
+}
+
+
+void
+gpgex_plan_volumes_free (struct gpgex_volume_need_s *volumes, size_t count)
+{
+  size_t k;
+
+  if (!volumes)
+    return;
+  for (k = 0; k < count; k++)
+    free (volumes[k].root);
+  free (volumes);
+}
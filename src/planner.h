@@ -0,0 +1,135 @@
+/* planner.h - planning the submission of file selections
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#ifndef GPGEX_PLANNER_H
+#define GPGEX_PLANNER_H	1
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#if 0
+}
+#endif
+#endif
+
+/* Split N items with the byte sizes SIZES into at most NSHARDS
+   shards of about the same cost.  The cost of an item is its size
+   plus PER_ITEM to account for the fixed overhead of each file.  The
+   shard of item I is stored at R_SHARD[I]; the items of a shard keep
+   their relative order.  Returns the number of shards used or -1 on
+   error with ERRNO set.  */
+int gpgex_plan_shards (const uint64_t *sizes, size_t n,
+                       unsigned int nshards, uint64_t per_item,
+                       unsigned int *r_shard);
+
+/* Return true if the UI-server command CMD may be split into
+   shards.  This is only the case for the commands which do not ask
+   the user for anything before they start, since each shard is a
+   session of its own.  */
+int gpgex_plan_shardable (const char *cmd);
+
+/* Order the N files with the utf-8 names NAMES and the byte sizes
+   SIZES for I/O locality: by volume, then by directory, then by size
+   class with the small files first.  Files which compare equal keep
+   their order.  The index of the file to be submitted at position I
+   is stored at R_ORDER[I].  Returns 0 on success or -1 on error with
+   ERRNO set.  */
+int gpgex_plan_locality (const char *const *names, const uint64_t *sizes,
+                         size_t n, size_t *r_order);
+
+/* The identity of a file.  */
+struct gpgex_file_id_s
+{
+  uint64_t volume;		/* Volume serial number.  */
+  uint64_t file;		/* File ID on the volume.  */
+  unsigned int valid:1;		/* VOLUME and FILE are known.  */
+  unsigned int is_dir:1;
+};
+
+/* Find the redundant entries among N files with the canonical utf-8
+   names NAMES and the identities IDS.  A file is redundant if an
+   earlier file has the same identity or the same name, or if it is
+   below a directory of the selection.  Names are compared like the
+   file system does.  R_KEEP[I] is set to 1 if file I is to be kept
+   and to 0 otherwise.  This takes O(N log N) time.  Returns 0 on
+   success or -1 on error with ERRNO set.  */
+int gpgex_plan_dedup (const char *const *names,
+                      const struct gpgex_file_id_s *ids, size_t n,
+                      unsigned char *r_keep);
+
+/* The output written by a command.  */
+typedef enum
+  {
+    GPGEX_OUTPUT_NONE = 0,	/* Nothing worth counting.  */
+    GPGEX_OUTPUT_ENCRYPT,	/* An encrypted copy of each file.  */
+    GPGEX_OUTPUT_SIGN_ENCRYPT,
+    GPGEX_OUTPUT_SIGN,		/* A detached signature for each file.  */
+    GPGEX_OUTPUT_DECRYPT,	/* The plaintext of each file.  */
+    GPGEX_OUTPUT_ARCHIVE	/* One encrypted archive of all files.  */
+  }
+gpgex_output_kind_t;
+
+/* Return the kind of output of the UI-server command CMD.  */
+gpgex_output_kind_t gpgex_plan_output_kind (const char *cmd);
+
+/* Return the estimated size of the output of kind KIND for an input
+   of SIZE bytes.  ARMOR is true if the output is ASCII armored and
+   INPUT_ARMORED if the input is.  Compression is not taken into
+   account, so the estimate for encryption is an upper bound for
+   data which does not compress.  */
+uint64_t gpgex_plan_output_size (gpgex_output_kind_t kind, uint64_t size,
+                                 int armor, int input_armored);
+
+/* The estimated output on one volume.  */
+struct gpgex_volume_need_s
+{
+  char *root;			/* The root directory of the volume.  */
+  uint64_t need;		/* The bytes to be written.  */
+  size_t nfiles;		/* The number of input files.  */
+};
+
+/* Estimate the output of kind KIND for the N files with the utf-8
+   names NAMES and the byte sizes SIZES, and sum it up by the volume
+   it is written to: next to each file, or next to the first one for
+   an archive.  ARMOR is as for gpgex_plan_output_size; inputs with
+   the suffix ".asc" are taken as armored.  Files with a relative
+   name are not counted.  The volumes are stored as a new array at
+   R_VOLUMES and their number at R_COUNT.  Returns 0 on success or
+   -1 on error with ERRNO set.  */
+int gpgex_plan_volumes (gpgex_output_kind_t kind,
+                        const char *const *names, const uint64_t *sizes,
+                        size_t n, int armor,
+                        struct gpgex_volume_need_s **r_volumes,
+                        size_t *r_count);
+
+/* Release the array VOLUMES with COUNT entries.  */
+void gpgex_plan_volumes_free (struct gpgex_volume_need_s *volumes,
+                              size_t count);
+
+#ifdef __cplusplus
+#if 0
+{
+#endif
+}
+#endif
+
+#endif /* GPGEX_PLANNER_H */
@@ -0,0 +1,232 @@
+/* prefetch.cc - read-ahead of the selected files
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+
+#include <windows.h>
+
+#include <gpg-error.h>
+
+#include "main.h"
+#include "stats.h"
+#include "pathclass.h"
+#include "prefetch.h"
+
+using std::vector;
+using std::string;
+
+/* The size of one read.  */
+#define PREFETCH_CHUNK (256 * 1024)
+
+/* The largest number of megabytes read ahead for one menu.  */
+#define PREFETCH_MAX_MB 1024
+
+
+struct gpgex_prefetch_s
+{
+  /* One reference for the owner and one for the thread.  */
+  LONG refcount;
+  volatile LONG cancelled;
+  vector<string> filenames;
+  uint64_t budget;
+};
+
+
+/* Return the number of megabytes to read ahead.  This is configured
+   with the registry value "GpgEX Prefetch"; the default of 0
+   disables the prefetcher.  */
+static unsigned int
+get_prefetch_mb (void)
+{
+  static int mb = -1;
+
+  if (mb == -1)
+    {
+      char *value;
+      int n = 0;
+
+      value = gpgrt_w32_reg_get_string ("\\Software\\Gpg4win:GpgEX Prefetch");
+      if (value)
+        n = atoi (value);
+      free (value);
+      if (n < 0)
+        n = 0;
+      else if (n > PREFETCH_MAX_MB)
+        n = PREFETCH_MAX_MB;
+      mb = n;
+    }
+  return mb;
+}
+
+
+static void
+prefetch_unref (gpgex_prefetch_t prefetch)
+{
+  if (!InterlockedDecrement (&prefetch->refcount))
+    {
+      delete prefetch;
+      gpgex_server::release ();
+    }
+}
+
+
+/* Read up to *BUDGET bytes of FNAME into BUFFER and subtract them
+   from *BUDGET.  */
+static void
+prefetch_file (gpgex_prefetch_t prefetch, const char *fname,
+               char *buffer, uint64_t *budget)
+{
+  gpgex_path_type_t type;
+  wchar_t *wfname;
+  HANDLE hd;
+  DWORD nread;
+
+  type = gpgex_probe_path (fname);
+  if (type != GPGEX_PATH_LOCAL && type != GPGEX_PATH_REMOVABLE)
+    {
+      (void) TRACE (DEBUG_CONTEXT_MENU, "prefetch_file", 0,
+                    "skipping %s file %s", gpgex_path_type_name (type), fname);
+      return;
+    }
+
+  wfname = gpgrt_utf8_to_wchar (fname);
+  if (!wfname)
+    return;
+  hd = CreateFileW (wfname, GENERIC_READ,
+                    FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                    NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  gpgrt_free_wchar (wfname);
+  if (hd == INVALID_HANDLE_VALUE)
+    return;
+
+  while (*budget && !prefetch->cancelled)
+    {
+      DWORD want = PREFETCH_CHUNK;
+
+      if (want > *budget)
+        want = (DWORD) *budget;
+      if (!ReadFile (hd, buffer, want, &nread, NULL) || !nread)
+        break;
+      *budget -= nread;
+    }
+  CloseHandle (hd);
+}
+
+
+static DWORD WINAPI
+prefetch_thread (LPVOID arg)
+{
+  gpgex_prefetch_t prefetch = (gpgex_prefetch_t) arg;
+  uint64_t budget = prefetch->budget;
+  char *buffer;
+  size_t i;
+
+  TRACE_BEG (DEBUG_CONTEXT_MENU, "prefetch_thread", prefetch,
+             "%u files", (unsigned int) prefetch->filenames.size ());
+
+  /* Lower the I/O and memory priority so that we never compete with
+     the Explorer or the UI server.  */
+  SetThreadPriority (GetCurrentThread (), THREAD_MODE_BACKGROUND_BEGIN);
+
+  buffer = (char *) malloc (PREFETCH_CHUNK);
+  if (buffer)
+    {
+      for (i = 0; i < prefetch->filenames.size (); i++)
+        {
+          if (!budget || prefetch->cancelled)
+            break;
+          prefetch_file (prefetch, prefetch->filenames[i].c_str (),
+                         buffer, &budget);
+        }
+      free (buffer);
+    }
+
+  SetThreadPriority (GetCurrentThread (), THREAD_MODE_BACKGROUND_END);
+  if (prefetch->cancelled)
+    gpgex_stats_inc (GPGEX_STAT_PREFETCH_CANCELS);
+
+  (void) TRACE_SUC ("%llu bytes read ahead",
+                    (unsigned long long) (prefetch->budget - budget));
+  prefetch_unref (prefetch);
+  return 0;
+}
+
+
+gpgex_prefetch_t
+gpgex_prefetch_start (const vector<string> &filenames)
+{
+  gpgex_prefetch_t prefetch;
+  unsigned int mb;
+  HANDLE th;
+
+  mb = get_prefetch_mb ();
+  if (!mb || filenames.empty ())
+    return NULL;
+
+  try
+    {
+      prefetch = new gpgex_prefetch_s;
+      prefetch->filenames = filenames;
+    }
+  catch (...)
+    {
+      return NULL;
+    }
+  prefetch->refcount = 2;
+  prefetch->cancelled = 0;
+  prefetch->budget = (uint64_t) mb * 1024 * 1024;
+
+  /* Keep the DLL loaded until the thread has finished.  */
+  gpgex_server::add_ref ();
+
+  th = CreateThread (NULL, 0, prefetch_thread, prefetch, 0, NULL);
+  if (!th)
+    {
+      delete prefetch;
+      gpgex_server::release ();
+      return NULL;
+    }
+  CloseHandle (th);
+  gpgex_stats_inc (GPGEX_STAT_PREFETCHES);
+  return prefetch;
+}
+
+
+void
+gpgex_prefetch_cancel (gpgex_prefetch_t prefetch)
+{
+  if (!prefetch)
+    return;
+  InterlockedExchange (&prefetch->cancelled, 1);
+  prefetch_unref (prefetch);
+}
+
+
+void
+gpgex_prefetch_release (gpgex_prefetch_t prefetch)
+{
+  if (!prefetch)
+    return;
+  prefetch_unref (prefetch);
+}
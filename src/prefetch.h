@@ -0,0 +1,47 @@
+/* prefetch.h - read-ahead of the selected files
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#ifndef GPGEX_PREFETCH_H
+#define GPGEX_PREFETCH_H	1
+
+#include <vector>
+#include <string>
+
+/* While the context menu is shown, the first megabytes of the
+   selected local files can be read at background I/O priority, so
+   that the UI server finds them in the file cache if the user picks
+   a command.  Network drives and files which are not fully present,
+   like cloud placeholders, are never touched.  */
+
+typedef struct gpgex_prefetch_s *gpgex_prefetch_t;
+
+/* Start reading ahead FILENAMES in a background thread.  Returns NULL
+   if the prefetcher is disabled or could not be started.  */
+gpgex_prefetch_t gpgex_prefetch_start (const std::vector<std::string>
+                                       &filenames);
+
+/* Stop the read ahead of PREFETCH as soon as possible and release
+   it.  */
+void gpgex_prefetch_cancel (gpgex_prefetch_t prefetch);
+
+/* Release PREFETCH but let the read ahead run to its end.  */
+void gpgex_prefetch_release (gpgex_prefetch_t prefetch);
+
+#endif /* GPGEX_PREFETCH_H */
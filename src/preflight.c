@@ -0,0 +1,108 @@
+/* preflight.c - pre-flight check of files for a command
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "pgpinfo.h"
+#include "metacache.h"
+#include "preflight.h"
+
+/* The time allowed for parsing the start of a file.  */
+#define PREFLIGHT_PARSE_TIMEOUT 50
+
+
+/* Return true if the LENGTH bytes at P may start S/MIME data or a
+   certificate: DER with a long or indefinite length, as used by CMS,
+   X.509 and PKCS#12, or PEM other than the OpenPGP armor.  */
+static int
+maybe_smime (const unsigned char *p, size_t length)
+{
+  size_t i;
+
+  if (length >= 2 && p[0] == 0x30 && p[1] >= 0x80 && p[1] <= 0x84)
+    return 1;
+
+  for (i = 0; i < length && strchr (" \t\r\n", p[i]); i++)
+    ;
+  return (length - i >= 11 && !memcmp (p + i, "-----BEGIN ", 11)
+          && !(length - i >= 15 && !memcmp (p + i + 11, "PGP ", 4)));
+}
+
+
+static gpgex_preflight_t
+check_keys (gpgex_preflight_cmd_t cmd, int keys)
+{
+  if (cmd == GPGEX_PREFLIGHT_IMPORT)
+    return keys ? GPGEX_PREFLIGHT_KEEP : GPGEX_PREFLIGHT_NO_KEYS;
+  return keys ? GPGEX_PREFLIGHT_ONLY_KEYS : GPGEX_PREFLIGHT_KEEP;
+}
+
+
+gpgex_preflight_t
+gpgex_preflight_head (gpgex_preflight_cmd_t cmd, const void *head,
+                      size_t length, int complete)
+{
+  struct gpgex_pgp_parser_s parser;
+  const struct gpgex_pgp_info_s *info;
+
+  gpgex_pgp_init (&parser, length, PREFLIGHT_PARSE_TIMEOUT);
+  gpgex_pgp_feed (&parser, head, length);
+  info = gpgex_pgp_finish (&parser);
+
+  if (info->is_openpgp || info->armor != GPGEX_PGP_ARMOR_NONE)
+    return check_keys (cmd, (info->has_pubkey || info->has_seckey
+                             || info->armor == GPGEX_PGP_ARMOR_PUBLIC_KEY
+                             || info->armor == GPGEX_PGP_ARMOR_PRIVATE_KEY));
+
+  if (maybe_smime ((const unsigned char *) head, length))
+    return GPGEX_PREFLIGHT_KEEP;
+  if (info->invalid || complete)
+    return GPGEX_PREFLIGHT_NO_DATA;
+  return GPGEX_PREFLIGHT_KEEP;
+}
+
+
+gpgex_preflight_t
+gpgex_preflight_meta (gpgex_preflight_cmd_t cmd, unsigned int flags)
+{
+  /* A file which is not OpenPGP may still be S/MIME.  */
+  if (!(flags & GPGEX_META_OPENPGP) || (flags & GPGEX_META_PENDING))
+    return GPGEX_PREFLIGHT_KEEP;
+  return check_keys (cmd, !!(flags & GPGEX_META_KEYS));
+}
+
+
+const char *
+gpgex_preflight_name (gpgex_preflight_t result)
+{
+  switch (result)
+    {
+    case GPGEX_PREFLIGHT_KEEP:      return "keep";
+    case GPGEX_PREFLIGHT_NO_DATA:   return "no-data";
+    case GPGEX_PREFLIGHT_NO_KEYS:   return "no-keys";
+    case GPGEX_PREFLIGHT_ONLY_KEYS: return "only-keys";
+    default:                        return "unknown";
+    }
+}
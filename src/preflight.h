@@ -0,0 +1,78 @@
+/* preflight.h - pre-flight check of files for a command
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#ifndef GPGEX_PREFLIGHT_H
+#define GPGEX_PREFLIGHT_H	1
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#if 0
+}
+#endif
+#endif
+
+/* The UI server fails one full operation for each file which does
+   not apply to the command.  The start of each file is thus checked
+   before the files are sent.  Only files which are certainly of no
+   use are left out: S/MIME data and anything which could not be
+   classified is kept.  */
+
+/* The commands which are checked.  */
+typedef enum
+  {
+    GPGEX_PREFLIGHT_DECRYPT_VERIFY,
+    GPGEX_PREFLIGHT_IMPORT
+  }
+gpgex_preflight_cmd_t;
+
+/* The result of a check.  */
+typedef enum
+  {
+    GPGEX_PREFLIGHT_KEEP = 0,	/* Applies, or not known.  */
+    GPGEX_PREFLIGHT_NO_DATA,	/* Neither OpenPGP nor S/MIME data.  */
+    GPGEX_PREFLIGHT_NO_KEYS,	/* OpenPGP data without keys.  */
+    GPGEX_PREFLIGHT_ONLY_KEYS	/* Keys, nothing to decrypt.  */
+  }
+gpgex_preflight_t;
+
+/* Check the file for CMD from its first LENGTH bytes at HEAD.  If
+   COMPLETE is true, HEAD is the whole file.  */
+gpgex_preflight_t gpgex_preflight_head (gpgex_preflight_cmd_t cmd,
+                                        const void *head, size_t length,
+                                        int complete);
+
+/* Check the file for CMD from the GPGEX_META_ flags of its entry in
+   the metadata cache.  */
+gpgex_preflight_t gpgex_preflight_meta (gpgex_preflight_cmd_t cmd,
+                                        unsigned int flags);
+
+/* Return the name of RESULT for the traces.  */
+const char *gpgex_preflight_name (gpgex_preflight_t result);
+
+#ifdef __cplusplus
+#if 0
+{
+#endif
+}
+#endif
+
+#endif /* GPGEX_PREFLIGHT_H */
@@ -0,0 +1,399 @@
+/* profile.c - cached installation profile
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <windows.h>
+#include <shlobj.h>
+
+#include <gpg-error.h>
+
+#include "debug.h"
+#include "profile.h"
+
+/* Version of the cache file format.  */
+#define PROFILE_VERSION "3"
+
+
+/* Return the malloced name of the cache file or NULL.  If DIRONLY
+   is set, return the directory.  */
+static char *
+get_cache_name (int dironly)
+{
+  wchar_t wpath[MAX_PATH];
+  char *path, *name;
+
+  if (SHGetFolderPathW (NULL, CSIDL_LOCAL_APPDATA, NULL, 0, wpath) != S_OK)
+    return NULL;
+  path = gpgrt_wchar_to_utf8 (wpath);
+  if (!path)
+    return NULL;
+  name = gpgrt_fconcat (0, path, "GpgEX",
+                        dironly ? NULL : "profile.cache", NULL);
+  free (path);
+  return name;
+}
+
+
+/* Store the last modification time of the file or directory NAME as
+   a hex string at BUFFER of size 17.  Returns 0 on success.  */
+static int
+get_mtime (const char *name, char *buffer)
+{
+  wchar_t *wname;
+  WIN32_FILE_ATTRIBUTE_DATA fad;
+  int ok;
+
+  wname = gpgrt_utf8_to_wchar (name);
+  if (!wname)
+    return -1;
+  ok = GetFileAttributesExW (wname, GetFileExInfoStandard, &fad);
+  gpgrt_free_wchar (wname);
+  if (!ok)
+    return -1;
+
+  snprintf (buffer, 17, "%08lx%08lx",
+            (unsigned long) fad.ftLastWriteTime.dwHighDateTime,
+            (unsigned long) fad.ftLastWriteTime.dwLowDateTime);
+  return 0;
+}
+
+
+/* Store the last modification time of the gpgconf.ctl file next to
+   GPGCONF at BUFFER of size 17, or "-" if there is none.  Returns 0
+   on success.  */
+static int
+get_ctl_mtime (const char *gpgconf, char *buffer)
+{
+  char *ctlname, *p;
+
+  ctlname = strdup (gpgconf);
+  if (!ctlname)
+    return -1;
+  p = strrchr (ctlname, '\\');
+  if (!p || (strrchr (ctlname, '/') && strrchr (ctlname, '/') > p))
+    p = strrchr (ctlname, '/');
+  if (!p)
+    {
+      free (ctlname);
+      return -1;
+    }
+  *p = 0;
+  p = gpgrt_fconcat (0, ctlname, "gpgconf.ctl", NULL);
+  free (ctlname);
+  if (!p)
+    return -1;
+  if (get_mtime (p, buffer))
+    strcpy (buffer, "-");
+  free (p);
+  return 0;
+}
+
+
+/* Return the value of GnuPG's HomeDir registry entry as malloced
+   utf-8 string or an empty string.  */
+static char *
+get_reg_homedir (void)
+{
+  char *value;
+
+  value = gpgrt_w32_reg_get_string ("\\Software\\GNU\\GnuPG:HomeDir");
+  if (!value)
+    return strdup ("");
+  return value;
+}
+
+
+/* Return the value of GNUPGHOME as malloced utf-8 string or an empty
+   string.  */
+static char *
+get_gnupghome (void)
+{
+  wchar_t wvalue[MAX_PATH];
+  DWORD n;
+
+  n = GetEnvironmentVariableW (L"GNUPGHOME", wvalue, MAX_PATH);
+  if (!n || n >= MAX_PATH)
+    return strdup ("");
+  return gpgrt_wchar_to_utf8 (wvalue);
+}
+
+
+void
+gpgex_profile_release (gpgex_profile_t profile)
+{
+  if (!profile)
+    return;
+  free (profile->installdir);
+  free (profile->gpgconf);
+  free (profile->gnupg_version);
+  free (profile->socketdir);
+  free (profile->uiserver);
+  free (profile->uiserver_type);
+  free (profile);
+}
+
+
+/* Load the cached profile for INSTALLDIR.  */
+gpg_error_t
+gpgex_profile_load (const char *installdir, gpgex_profile_t *r_profile)
+{
+  gpg_error_t err = 0;
+  char *fname;
+  gpgrt_stream_t fp;
+  char line[2048];
+  char mtime[17];
+  char *gnupghome = NULL;
+  char *reg_homedir = NULL;
+  int version_ok = 0;
+  int dir_ok = 0;
+  int home_ok = 0;
+  int reg_ok = 0;
+  int ctl_ok = 0;
+  gpgex_profile_t profile;
+
+  TRACE_BEG (DEBUG_INIT, "gpgex_profile_load", installdir);
+
+  *r_profile = NULL;
+  if (!installdir)
+    return TRACE_GPGERR (gpg_error (GPG_ERR_NOT_FOUND));
+
+  profile = (gpgex_profile_t) calloc (1, sizeof *profile);
+  if (!profile)
+    return TRACE_GPGERR (gpg_error_from_syserror ());
+
+  fname = get_cache_name (0);
+  if (!fname)
+    {
+      gpgex_profile_release (profile);
+      return TRACE_GPGERR (gpg_error (GPG_ERR_NOT_FOUND));
+    }
+  fp = gpgrt_fopen (fname, "r");
+  free (fname);
+  if (!fp)
+    {
+      gpgex_profile_release (profile);
+      return TRACE_GPGERR (gpg_error (GPG_ERR_NOT_FOUND));
+    }
+
+  gnupghome = get_gnupghome ();
+  reg_homedir = get_reg_homedir ();
+  while (gpgrt_fgets (line, sizeof line, fp))
+    {
+      char *value, *p;
+
+      p = strchr (line, '\n');
+      if (!p)
+        {
+          err = gpg_error (GPG_ERR_LINE_TOO_LONG);
+          break;
+        }
+      *p = 0;
+      value = strchr (line, '=');
+      if (!value)
+        continue;
+      *value++ = 0;
+
+      if (!strcmp (line, "version"))
+        version_ok = !strcmp (value, PROFILE_VERSION);
+      else if (!strcmp (line, "installdir"))
+        {
+          if (strcasecmp (value, installdir))
+            err = gpg_error (GPG_ERR_NOT_FOUND);
+          else
+            profile->installdir = strdup (value);
+        }
+      else if (!strcmp (line, "installdir-mtime"))
+        {
+          if (get_mtime (installdir, mtime) || strcmp (value, mtime))
+            err = gpg_error (GPG_ERR_NOT_FOUND);
+          else
+            dir_ok = 1;
+        }
+      else if (!strcmp (line, "gnupghome"))
+        {
+          if (!gnupghome || strcmp (value, gnupghome))
+            err = gpg_error (GPG_ERR_NOT_FOUND);
+          else
+            home_ok = 1;
+        }
+      else if (!strcmp (line, "reg-homedir"))
+        {
+          if (!reg_homedir || strcmp (value, reg_homedir))
+            err = gpg_error (GPG_ERR_NOT_FOUND);
+          else
+            reg_ok = 1;
+        }
+      else if (!strcmp (line, "gpgconf"))
+        profile->gpgconf = strdup (value);
+      else if (!strcmp (line, "gpgconf-mtime"))
+        {
+          /* gpgconf is always listed before its mtime.  */
+          if (!profile->gpgconf
+              || get_mtime (profile->gpgconf, mtime) || strcmp (value, mtime))
+            err = gpg_error (GPG_ERR_NOT_FOUND);
+        }
+      else if (!strcmp (line, "gpgconf-ctl-mtime"))
+        {
+          /* Ditto.  */
+          if (!profile->gpgconf
+              || get_ctl_mtime (profile->gpgconf, mtime)
+              || strcmp (value, mtime))
+            err = gpg_error (GPG_ERR_NOT_FOUND);
+          else
+            ctl_ok = 1;
+        }
+      else if (!strcmp (line, "gnupg-version"))
+        profile->gnupg_version = strdup (value);
+      else if (!strcmp (line, "socketdir"))
+        profile->socketdir = strdup (value);
+      else if (!strcmp (line, "uiserver"))
+        profile->uiserver = strdup (value);
+      else if (!strcmp (line, "uiserver-type"))
+        profile->uiserver_type = strdup (value);
+
+      if (err)
+        break;
+    }
+  gpgrt_fclose (fp);
+  free (gnupghome);
+  free (reg_homedir);
+
+  if (!err && (!version_ok || !dir_ok || !home_ok || !reg_ok || !ctl_ok
+               || !profile->installdir || !profile->gpgconf
+               || !profile->socketdir))
+    err = gpg_error (GPG_ERR_NOT_FOUND);
+  /* The UI-server is optional but if we know one it must still be
+     there.  */
+  if (!err && profile->uiserver && gpgrt_access (profile->uiserver, F_OK))
+    err = gpg_error (GPG_ERR_NOT_FOUND);
+
+  if (err)
+    gpgex_profile_release (profile);
+  else
+    *r_profile = profile;
+
+  return TRACE_GPGERR (err);
+}
+
+
+/* Write PROFILE to the cache file.  The file is written to a
+   temporary file first and then renamed so that concurrent readers
+   never see a partial file.  */
+gpg_error_t
+gpgex_profile_store (gpgex_profile_t profile)
+{
+  gpg_error_t err = 0;
+  char *dname = NULL;
+  char *fname = NULL;
+  char *tmpname = NULL;
+  wchar_t *wname = NULL;
+  wchar_t *wtmpname = NULL;
+  char *gnupghome = NULL;
+  char *reg_homedir = NULL;
+  char dirtime[17], conftime[17], ctltime[17];
+  gpgrt_stream_t fp;
+
+  TRACE_BEG (DEBUG_INIT, "gpgex_profile_store", profile);
+
+  if (!profile->installdir || !profile->gpgconf || !profile->socketdir
+      || get_mtime (profile->installdir, dirtime)
+      || get_mtime (profile->gpgconf, conftime)
+      || get_ctl_mtime (profile->gpgconf, ctltime))
+    return TRACE_GPGERR (gpg_error (GPG_ERR_INV_ARG));
+
+  dname = get_cache_name (1);
+  fname = get_cache_name (0);
+  if (fname)
+    tmpname = gpgrt_bsprintf ("%s.%lu.tmp", fname,
+                              (unsigned long) GetCurrentProcessId ());
+  gnupghome = get_gnupghome ();
+  reg_homedir = get_reg_homedir ();
+  if (!dname || !fname || !tmpname || !gnupghome || !reg_homedir)
+    {
+      err = gpg_error (GPG_ERR_ENOMEM);
+      goto leave;
+    }
+
+  wname = gpgrt_utf8_to_wchar (dname);
+  if (wname)
+    CreateDirectoryW (wname, NULL);
+  gpgrt_free_wchar (wname);
+
+  fp = gpgrt_fopen (tmpname, "w");
+  if (!fp)
+    {
+      err = gpg_error_from_syserror ();
+      goto leave;
+    }
+  gpgrt_fprintf (fp,
+                 "# GpgEX installation profile - do not edit\n"
+                 "version=" PROFILE_VERSION "\n"
+                 "installdir=%s\n"
+                 "installdir-mtime=%s\n"
+                 "gnupghome=%s\n"
+                 "reg-homedir=%s\n"
+                 "gpgconf=%s\n"
+                 "gpgconf-mtime=%s\n"
+                 "gpgconf-ctl-mtime=%s\n"
+                 "socketdir=%s\n",
+                 profile->installdir, dirtime, gnupghome, reg_homedir,
+                 profile->gpgconf, conftime, ctltime, profile->socketdir);
+  if (profile->gnupg_version)
+    gpgrt_fprintf (fp, "gnupg-version=%s\n", profile->gnupg_version);
+  if (profile->uiserver)
+    gpgrt_fprintf (fp, "uiserver=%s\n", profile->uiserver);
+  if (profile->uiserver_type)
+    gpgrt_fprintf (fp, "uiserver-type=%s\n", profile->uiserver_type);
+  if (gpgrt_fclose (fp))
+    {
+      err = gpg_error_from_syserror ();
+      goto leave;
+    }
+
+  wname = gpgrt_utf8_to_wchar (fname);
+  wtmpname = gpgrt_utf8_to_wchar (tmpname);
+  if (!wname || !wtmpname
+      || !MoveFileExW (wtmpname, wname, MOVEFILE_REPLACE_EXISTING))
+    {
+      (void) TRACE_LOG ("renaming '%s' failed: ec=%d",
+                        tmpname, (int) GetLastError ());
+      if (wtmpname)
+        DeleteFileW (wtmpname);
+      err = gpg_error (GPG_ERR_EIO);
+    }
+
+ leave:
+  gpgrt_free_wchar (wname);
+  gpgrt_free_wchar (wtmpname);
+  free (dname);
+  free (fname);
+  free (tmpname);
+  free (gnupghome);
+  free (reg_homedir);
+  return TRACE_GPGERR (err);
+}
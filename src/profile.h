@@ -0,0 +1,69 @@
+/* profile.h - cached installation profile
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#ifndef GPGEX_PROFILE_H
+#define GPGEX_PROFILE_H	1
+
+#include <gpg-error.h>
+
+#ifdef __cplusplus
+extern "C" {
+#if 0
+}
+#endif
+#endif
+
+/* The installation profile describes where the GnuPG installation
+   and the UI-server are.  Finding this out requires probing several
+   files and running gpgconf, thus it is cached in a file below
+   LOCALAPPDATA.  The cache is valid as long as the modification
+   times of the install directory, of gpgconf and of gpgconf.ctl as
+   well as the GNUPGHOME environment variable and the HomeDir registry
+   entry are unchanged.  */
+struct gpgex_profile_s
+{
+  char *installdir;	/* Root of the Gpg4win installation.  */
+  char *gpgconf;	/* Full name of gpgconf.exe.  */
+  char *gnupg_version;	/* Version of gpgconf.exe or NULL.  */
+  char *socketdir;	/* GnuPG's socket directory.  */
+  char *uiserver;	/* Full name of the UI-server or NULL.  */
+  char *uiserver_type;	/* "Kleopatra", "GPA" or NULL.  */
+};
+typedef struct gpgex_profile_s *gpgex_profile_t;
+
+/* Load the cached profile for INSTALLDIR and store it at R_PROFILE.
+   Returns GPG_ERR_NOT_FOUND if there is no valid cache entry.  */
+gpg_error_t gpgex_profile_load (const char *installdir,
+                                gpgex_profile_t *r_profile);
+
+/* Write PROFILE to the cache.  */
+gpg_error_t gpgex_profile_store (gpgex_profile_t profile);
+
+/* Release PROFILE.  */
+void gpgex_profile_release (gpgex_profile_t profile);
+
+#ifdef __cplusplus
+#if 0
+{
+#endif
+}
+#endif
+
+#endif /* GPGEX_PROFILE_H */
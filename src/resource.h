@@ -23,4 +23,8 @@
 
 #define IDI_ICON_16                     0x1000
 
+/* The icon overlays.  */
+#define IDI_OVERLAY_ENCRYPTED           2
+#define IDI_OVERLAY_SIGNED              3
+
 #endif // RESOURCE_H
@@ -0,0 +1,318 @@
+/* sigpair.cc - pairing of detached signatures with their data
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <unordered_map>
+#include <unordered_set>
+
+using std::unordered_map;
+using std::unordered_set;
+
+#include <windows.h>
+
+#include <gpg-error.h>
+
+#include "main.h"
+#include "stats.h"
+#include "pathclass.h"
+#include "pgpinfo.h"
+#include "sigpair.h"
+
+/* The suffixes of detached signatures in the order in which they are
+   looked for next to a data file.  */
+static const char *const sig_suffixes[] = { ".sig", ".asc", ".p7s" };
+#define N_SIG_SUFFIXES (sizeof sig_suffixes / sizeof sig_suffixes[0])
+
+/* A directory is read as a whole once this many names have been
+   looked up in it; before that the names are probed one by one, so
+   that a few files selected in a large directory stay cheap.  */
+#define SIGPAIR_LIST_MIN 8
+
+/* What is read of an ".asc" file to tell an armored signature from
+   an armored message or key, and the time allowed for parsing it.  */
+#define SIGPAIR_HEAD_SIZE 256
+#define SIGPAIR_TIMEOUT 50
+
+
+/* The names known to exist in a directory.  */
+struct sigpair_dir_s
+{
+  unsigned int probes;		/* Names looked up so far.  */
+  int listed;			/* 1 if NAMES is valid, -1 on error.  */
+  unordered_set<string> names;	/* Folded names without the directory.  */
+};
+
+/* The state of one planning run.  */
+struct sigpair_s
+{
+  unordered_set<string> selected; /* Folded names of the selection.  */
+  unordered_map<string, struct sigpair_dir_s> dirs;
+  struct gpgex_io_budget_s budget;
+};
+
+
+/* Return NAME with ASCII letters in lower case and slashes as
+   backslashes.  Other letters are compared exactly, see
+   file_exists.  */
+static string
+fold_name (const string &name)
+{
+  string folded (name);
+  size_t i;
+
+  for (i = 0; i < folded.size (); i++)
+    if (folded[i] >= 'A' && folded[i] <= 'Z')
+      folded[i] += 'a' - 'A';
+    else if (folded[i] == '/')
+      folded[i] = '\\';
+  return folded;
+}
+
+
+/* Return the length of the directory part of NAME including the
+   last separator.  */
+static size_t
+dir_length (const string &name)
+{
+  size_t pos = name.find_last_of ("\\/:");
+
+  return pos == string::npos ? 0 : pos + 1;
+}
+
+
+/* Return the length of the signature suffix of NAME or 0.  */
+static size_t
+sig_suffix_length (const string &name)
+{
+  size_t dirlen = dir_length (name);
+  size_t i, n;
+
+  for (i = 0; i < N_SIG_SUFFIXES; i++)
+    {
+      n = strlen (sig_suffixes[i]);
+      if (name.size () > dirlen + n
+          && !strcasecmp (name.c_str () + name.size () - n, sig_suffixes[i]))
+        return n;
+    }
+  return 0;
+}
+
+
+/* Read the folded names of the files in the directory DIR into
+   NAMES.  DIR is empty or ends in a separator.  Returns false on
+   error.  */
+static int
+list_directory (const string &dir, unordered_set<string> &names)
+{
+  WIN32_FIND_DATAW fd;
+  HANDLE hd;
+  wchar_t *wpattern;
+  char *name;
+
+  wpattern = gpgrt_utf8_to_wchar ((dir + "*").c_str ());
+  if (!wpattern)
+    return 0;
+  hd = FindFirstFileExW (wpattern, FindExInfoBasic, &fd,
+                         FindExSearchNameMatch, NULL,
+                         FIND_FIRST_EX_LARGE_FETCH);
+  gpgrt_free_wchar (wpattern);
+  if (hd == INVALID_HANDLE_VALUE)
+    return 0;
+
+  do
+    {
+      if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+        continue;
+      name = gpgrt_wchar_to_utf8 (fd.cFileName);
+      if (name)
+        {
+          names.insert (fold_name (name));
+          free (name);
+        }
+    }
+  while (FindNextFileW (hd, &fd));
+  FindClose (hd);
+  return 1;
+}
+
+
+/* Return true if the file NAME exists and is not a directory.  */
+static int
+probe_file (const string &name)
+{
+  wchar_t *wname;
+  DWORD attr;
+
+  wname = gpgrt_utf8_to_wchar (name.c_str ());
+  if (!wname)
+    return 0;
+  attr = GetFileAttributesW (wname);
+  gpgrt_free_wchar (wname);
+  return (attr != INVALID_FILE_ATTRIBUTES
+          && !(attr & FILE_ATTRIBUTE_DIRECTORY));
+}
+
+
+/* Return true if the file NAME exists.  The directory listings are
+   cached in CTX.  */
+static int
+file_exists (struct sigpair_s *ctx, const string &name)
+{
+  string folded = fold_name (name);
+  size_t dirlen = dir_length (folded);
+  struct sigpair_dir_s &dir = ctx->dirs[folded.substr (0, dirlen)];
+  size_t i;
+
+  if (!dir.listed && ++dir.probes >= SIGPAIR_LIST_MIN)
+    dir.listed = list_directory (name.substr (0, dirlen), dir.names) ? 1 : -1;
+  if (dir.listed > 0)
+    {
+      if (dir.names.count (folded.substr (dirlen)))
+        return 1;
+
+      /* Only a name in ASCII is known not to exist, because the case
+         of other letters is not folded.  */
+      for (i = dirlen; i < folded.size (); i++)
+        if (folded[i] & 0x80)
+          break;
+      if (i == folded.size ())
+        return 0;
+    }
+  return probe_file (name);
+}
+
+
+/* Return true if NAME, which ends in the signature suffix of length
+   SUFFIXLEN, is a detached signature.  An ".asc" file may also hold
+   an armored message or key, so its armor header is read if the I/O
+   policy allows it; if not, it is taken as a signature.  */
+static int
+is_signature (struct sigpair_s *ctx, const string &name, size_t suffixlen)
+{
+  struct gpgex_pgp_parser_s parser;
+  char buffer[SIGPAIR_HEAD_SIZE];
+  int n;
+
+  if (strcasecmp (name.c_str () + name.size () - suffixlen, ".asc"))
+    return 1;
+
+  n = gpgex_read_head (name.c_str (), gpgex_probe_path (name.c_str ()),
+                       &ctx->budget, buffer, sizeof buffer);
+  if (n < 0)
+    return 1;
+  gpgex_pgp_init (&parser, sizeof buffer, SIGPAIR_TIMEOUT);
+  gpgex_pgp_feed (&parser, buffer, n);
+  return gpgex_pgp_finish (&parser)->armor == GPGEX_PGP_ARMOR_SIGNATURE;
+}
+
+
+void
+gpgex_sigpair_plan (const vector<string> &filenames, int find_signatures,
+                    struct gpgex_sigpairs_s *r_pairs)
+{
+  struct sigpair_s ctx;
+  unordered_set<string> covered;
+  unordered_set<string> sent;
+  size_t i, j, n;
+
+  TRACE_BEG (DEBUG_ASSUAN, "gpgex_sigpair_plan", r_pairs,
+             "%u files, find_signatures=%i",
+             (unsigned int) filenames.size (), find_signatures);
+
+  r_pairs->files.clear ();
+  r_pairs->missing.clear ();
+  r_pairs->dropped = 0;
+  r_pairs->found = 0;
+  gpgex_io_budget_init (&ctx.budget);
+
+  for (i = 0; i < filenames.size (); i++)
+    ctx.selected.insert (fold_name (filenames[i]));
+
+  /* Collect the data files whose signature is selected too.  */
+  for (i = 0; i < filenames.size (); i++)
+    {
+      const string &name = filenames[i];
+      string data;
+
+      n = sig_suffix_length (name);
+      if (!n)
+        continue;
+      data = fold_name (name.substr (0, name.size () - n));
+      if (ctx.selected.count (data) && is_signature (&ctx, name, n))
+        covered.insert (data);
+    }
+
+  for (i = 0; i < filenames.size (); i++)
+    {
+      const string &name = filenames[i];
+      string folded = fold_name (name);
+      string send = name;
+
+      if (covered.count (folded))
+        {
+          r_pairs->dropped++;
+          gpgex_stats_inc (GPGEX_STAT_SIGNATURE_PAIRS);
+          continue;
+        }
+
+      n = sig_suffix_length (name);
+      if (!find_signatures)
+        ;
+      else if (n)
+        {
+          if (!ctx.selected.count (folded.substr (0, folded.size () - n))
+              && !file_exists (&ctx, name.substr (0, name.size () - n))
+              && is_signature (&ctx, name, n))
+            {
+              r_pairs->missing.push_back (name);
+              continue;
+            }
+        }
+      else
+        {
+          for (j = 0; j < N_SIG_SUFFIXES; j++)
+            {
+              string sig = name + sig_suffixes[j];
+
+              if (file_exists (&ctx, sig)
+                  && is_signature (&ctx, sig, strlen (sig_suffixes[j])))
+                {
+                  send = sig;
+                  r_pairs->found++;
+                  gpgex_stats_inc (GPGEX_STAT_SIGNATURE_PAIRS);
+                  break;
+                }
+            }
+        }
+
+      if (sent.insert (fold_name (send)).second)
+        r_pairs->files.push_back (send);
+    }
+
+  (void) TRACE_SUC ("%u to send, %u dropped, %u found, %u missing",
+                    (unsigned int) r_pairs->files.size (), r_pairs->dropped,
+                    r_pairs->found, (unsigned int) r_pairs->missing.size ());
+}
@@ -0,0 +1,56 @@
+/* sigpair.h - pairing of detached signatures with their data
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#ifndef GPGEX_SIGPAIR_H
+#define GPGEX_SIGPAIR_H	1
+
+#include <vector>
+#include <string>
+
+using std::vector;
+using std::string;
+
+/* A detached signature is verified by sending its name alone; the
+   server finds the signed data next to it by stripping the suffix.
+   The selection is thus reduced to one entry per pair before it is
+   sent, and signatures whose data file does not exist are reported
+   to the user instead of failing on the server.  */
+
+/* The result of gpgex_sigpair_plan.  */
+struct gpgex_sigpairs_s
+{
+  vector<string> files;		/* The names to send to the server.  */
+  vector<string> missing;	/* Signatures without their data file.  */
+  unsigned int dropped;		/* Data files sent as their signature.  */
+  unsigned int found;		/* Signatures found next to data files.  */
+};
+
+/* Pair the detached signatures in the utf-8 FILENAMES with their
+   data files and store the result at R_PAIRS.  Data files are
+   dropped if their signature is selected too.  If FIND_SIGNATURES
+   is true, data files selected without their signature are replaced
+   by a signature found next to them, and signatures without data are
+   moved to the missing list.  Other files are kept in their
+   order.  */
+void gpgex_sigpair_plan (const vector<string> &filenames,
+                         int find_signatures,
+                         struct gpgex_sigpairs_s *r_pairs);
+
+#endif /* GPGEX_SIGPAIR_H */
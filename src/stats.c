@@ -0,0 +1,573 @@
+/* stats.c - shared memory statistics
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_W32_SYSTEM
+# include <windows.h>
+#else
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <fcntl.h>
+# include <unistd.h>
+# include <time.h>
+#endif
+
+#include "stats.h"
+
+
+/* The name of the shared memory block.  On Windows it is local to
+   the session; on POSIX systems we append the uid.  */
+#define STATS_NAME_BASE "GpgEX-Stats-1"
+
+
+/* The block mapped by this process or NULL.  */
+static struct gpgex_stats_s *stats;
+
+#ifdef HAVE_W32_SYSTEM
+static HANDLE stats_mapping;
+#endif
+
+
+static const char *counter_names[GPGEX_STAT_N_COUNTERS] =
+  {
+    "hosts",
+    "initialize",
+    "menus-shown",
+    "connect-failures",
+    "spawns",
+    "spawn-failures",
+    "queue-depth",
+    "queue-depth-max",
+    "bitmap-cache-hits",
+    "bitmap-cache-misses",
+    "profile-cache-hits",
+    "profile-cache-misses",
+    "socketdir-native",
+    "socketdir-gpgconf",
+    "launch-rejects",
+    "caps-probes",
+    "pipelined-submits",
+    "sharded-submits",
+    "prefetches",
+    "prefetch-cancels",
+    "keyindex-refreshes",
+    "meta-reads",
+    "overlay-hits",
+    "infotip-placeholders",
+    "archives",
+    "signature-pairs",
+    "duplicates",
+    "preflight-skips",
+    "space-warnings"
+  };
+
+/* The UI-server commands counted as operations.  Never reorder;
+   only append.  */
+static const char *op_names[] =
+  {
+    "DECRYPT_VERIFY_FILES",
+    "DECRYPT_FILES",
+    "VERIFY_FILES",
+    "ENCRYPT_SIGN_FILES",
+    "ENCRYPT_FILES",
+    "SIGN_FILES",
+    "IMPORT_FILES",
+    "CHECKSUM_CREATE_FILES",
+    "CHECKSUM_VERIFY_FILES",
+    "ENCRYPT_ARCHIVE",
+    NULL
+  };
+
+static const char *hist_names[GPGEX_HIST_N_HISTS] =
+  {
+    "initialize",
+    "query-menu",
+    "connect",
+    "profile-cached",
+    "profile-uncached",
+    "launch",
+    "preflight"
+  };
+
+
+
+static inline void
+atomic_inc (volatile int32_t *p)
+{
+#ifdef HAVE_W32_SYSTEM
+  InterlockedIncrement ((LONG volatile *) p);
+#else
+  __atomic_add_fetch (p, 1, __ATOMIC_RELAXED);
+#endif
+}
+
+
+static inline int32_t
+atomic_dec (volatile int32_t *p)
+{
+#ifdef HAVE_W32_SYSTEM
+  return InterlockedDecrement ((LONG volatile *) p);
+#else
+  return __atomic_sub_fetch (p, 1, __ATOMIC_RELAXED);
+#endif
+}
+
+
+static inline int32_t
+atomic_inc_fetch (volatile int32_t *p)
+{
+#ifdef HAVE_W32_SYSTEM
+  return InterlockedIncrement ((LONG volatile *) p);
+#else
+  return __atomic_add_fetch (p, 1, __ATOMIC_RELAXED);
+#endif
+}
+
+
+/* Set *P to VALUE if VALUE is larger.  */
+static inline void
+atomic_max (volatile int32_t *p, int32_t value)
+{
+  int32_t old = *p;
+
+  while (old < value)
+    {
+#ifdef HAVE_W32_SYSTEM
+      int32_t cur = InterlockedCompareExchange ((LONG volatile *) p,
+                                                value, old);
+#else
+      int32_t cur = __sync_val_compare_and_swap (p, old, value);
+#endif
+      if (cur == old)
+        break;
+      old = cur;
+    }
+}
+
+
+/* Map the block read-write (if WRITE is set) or read-only.  Returns
+   NULL on error.  A new block is zero filled and initialized.  */
+static struct gpgex_stats_s *
+map_block (int write)
+{
+  struct gpgex_stats_s *block;
+  int created;
+
+#ifdef HAVE_W32_SYSTEM
+  HANDLE h;
+
+  if (write)
+    {
+      h = CreateFileMappingA (INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                              0, sizeof *block, "Local\\" STATS_NAME_BASE);
+      created = (h && GetLastError () != ERROR_ALREADY_EXISTS);
+    }
+  else
+    {
+      h = OpenFileMappingA (FILE_MAP_READ, FALSE,
+                            "Local\\" STATS_NAME_BASE);
+      created = 0;
+    }
+  if (!h)
+    return NULL;
+
+  block = (struct gpgex_stats_s *)
+    MapViewOfFile (h, write ? FILE_MAP_WRITE : FILE_MAP_READ,
+                   0, 0, sizeof *block);
+  if (!block)
+    {
+      CloseHandle (h);
+      return NULL;
+    }
+  if (write)
+    stats_mapping = h;
+  else
+    CloseHandle (h);  /* The view keeps the mapping alive.  */
+
+#else /*!HAVE_W32_SYSTEM*/
+  char name[64];
+  int fd;
+  struct stat st;
+
+  snprintf (name, sizeof name, "/%s-%lu", STATS_NAME_BASE,
+            (unsigned long) getuid ());
+  created = 0;
+  if (write)
+    {
+      fd = shm_open (name, O_RDWR | O_CREAT | O_EXCL, 0600);
+      if (fd != -1)
+        created = 1;
+      else
+        fd = shm_open (name, O_RDWR, 0600);
+    }
+  else
+    fd = shm_open (name, O_RDONLY, 0);
+  if (fd == -1)
+    return NULL;
+
+  if (created && ftruncate (fd, sizeof *block))
+    {
+      close (fd);
+      shm_unlink (name);
+      return NULL;
+    }
+  if (fstat (fd, &st) || st.st_size < (off_t) sizeof *block)
+    {
+      /* Another process is still creating the block or it is
+         garbage.  We don't wait but run without statistics.  */
+      close (fd);
+      return NULL;
+    }
+
+  block = (struct gpgex_stats_s *)
+    mmap (NULL, sizeof *block, write ? PROT_READ | PROT_WRITE : PROT_READ,
+          MAP_SHARED, fd, 0);
+  close (fd);
+  if (block == MAP_FAILED)
+    return NULL;
+#endif /*!HAVE_W32_SYSTEM*/
+
+  if (created)
+    {
+      /* The memory is already zero filled.  Write the version and
+         size before the magic so that a reader never sees a valid
+         magic with a wrong layout.  */
+      block->version = GPGEX_STATS_VERSION;
+      block->size = sizeof *block;
+#ifdef HAVE_W32_SYSTEM
+      MemoryBarrier ();
+#else
+      __sync_synchronize ();
+#endif
+      block->magic = GPGEX_STATS_MAGIC;
+    }
+
+  return block;
+}
+
+
+static void
+unmap_block (const struct gpgex_stats_s *block)
+{
+#ifdef HAVE_W32_SYSTEM
+  UnmapViewOfFile ((void *) block);
+#else
+  munmap ((void *) block, sizeof *block);
+#endif
+}
+
+
+
+/* Writer interface.  */
+
+/* Map the statistics block and count this process as a host.  */
+void
+gpgex_stats_init (void)
+{
+  if (stats)
+    return;
+
+  stats = map_block (1);
+  if (stats && stats->magic && (stats->magic != GPGEX_STATS_MAGIC
+                                || stats->size != sizeof *stats))
+    {
+      /* Unknown layout - don't touch it.  */
+      unmap_block (stats);
+      stats = NULL;
+    }
+  if (!stats)
+    {
+#ifdef HAVE_W32_SYSTEM
+      if (stats_mapping)
+        CloseHandle (stats_mapping);
+      stats_mapping = NULL;
+#endif
+      return;
+    }
+
+  atomic_inc (&stats->counters[GPGEX_STAT_HOSTS]);
+}
+
+
+void
+gpgex_stats_deinit (void)
+{
+  if (!stats)
+    return;
+
+  atomic_dec (&stats->counters[GPGEX_STAT_HOSTS]);
+  unmap_block (stats);
+  stats = NULL;
+#ifdef HAVE_W32_SYSTEM
+  CloseHandle (stats_mapping);
+  stats_mapping = NULL;
+#endif
+}
+
+
+void
+gpgex_stats_inc (int counter)
+{
+  if (stats && counter >= 0 && counter < GPGEX_STATS_MAX_COUNTERS)
+    atomic_inc (&stats->counters[counter]);
+}
+
+
+void
+gpgex_stats_dec (int counter)
+{
+  if (stats && counter >= 0 && counter < GPGEX_STATS_MAX_COUNTERS)
+    atomic_dec (&stats->counters[counter]);
+}
+
+
+void
+gpgex_stats_gauge_inc (int counter, int maxcounter)
+{
+  int32_t value;
+
+  if (!stats || counter < 0 || counter >= GPGEX_STATS_MAX_COUNTERS
+      || maxcounter < 0 || maxcounter >= GPGEX_STATS_MAX_COUNTERS)
+    return;
+
+  value = atomic_inc_fetch (&stats->counters[counter]);
+  atomic_max (&stats->counters[maxcounter], value);
+}
+
+
+/* Count an operation by its UI-server COMMAND.  */
+void
+gpgex_stats_op (const char *command)
+{
+  int i;
+
+  if (!stats || !command)
+    return;
+
+  for (i = 0; op_names[i]; i++)
+    if (!strcmp (op_names[i], command))
+      {
+        atomic_inc (&stats->ops[i]);
+        return;
+      }
+}
+
+
+void
+gpgex_stats_hist (int hist, uint64_t usec)
+{
+  int bucket;
+
+  if (!stats || hist < 0 || hist >= GPGEX_STATS_MAX_HISTS)
+    return;
+
+  for (bucket = 0; usec && bucket < GPGEX_STATS_BUCKETS - 1; bucket++)
+    usec >>= 1;
+  atomic_inc (&stats->hists[hist][bucket]);
+}
+
+
+uint64_t
+gpgex_stats_now (void)
+{
+#ifdef HAVE_W32_SYSTEM
+  static LARGE_INTEGER freq;
+  LARGE_INTEGER now;
+
+  if (!freq.QuadPart && !QueryPerformanceFrequency (&freq))
+    return 0;
+  QueryPerformanceCounter (&now);
+  return (uint64_t) (now.QuadPart / freq.QuadPart) * 1000000
+    + (uint64_t) (now.QuadPart % freq.QuadPart) * 1000000 / freq.QuadPart;
+#else
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+
+
+/* Reader interface.  */
+
+const char *
+gpgex_stats_counter_name (int idx)
+{
+  if (idx < 0 || idx >= GPGEX_STAT_N_COUNTERS)
+    return NULL;
+  return counter_names[idx];
+}
+
+
+const char *
+gpgex_stats_op_name (int idx)
+{
+  int i;
+
+  for (i = 0; op_names[i]; i++)
+    if (i == idx)
+      return op_names[i];
+  return NULL;
+}
+
+
+const char *
+gpgex_stats_hist_name (int idx)
+{
+  if (idx < 0 || idx >= GPGEX_HIST_N_HISTS)
+    return NULL;
+  return hist_names[idx];
+}
+
+
+const struct gpgex_stats_s *
+gpgex_stats_open_reader (void)
+{
+  return map_block (0);
+}
+
+
+void
+gpgex_stats_close_reader (const struct gpgex_stats_s *block)
+{
+  if (block)
+    unmap_block (block);
+}
+
+
+int
+gpgex_stats_snapshot (const struct gpgex_stats_s *block,
+                      struct gpgex_stats_s *snapshot)
+{
+  if (block->magic != GPGEX_STATS_MAGIC
+      || block->version != GPGEX_STATS_VERSION
+      || block->size != sizeof *block)
+    return -1;
+
+  /* The counters are updated independently, thus a plain copy is as
+     consistent as we can get without locking.  */
+  memcpy (snapshot, (const void *) block, sizeof *snapshot);
+  return 0;
+}
+
+
+uint64_t
+gpgex_stats_percentile (const struct gpgex_stats_s *snapshot,
+                        int hist, unsigned int pct, uint32_t *r_count)
+{
+  uint64_t total = 0;
+  uint64_t want, sum;
+  int i;
+
+  *r_count = 0;
+  if (hist < 0 || hist >= GPGEX_STATS_MAX_HISTS)
+    return 0;
+
+  for (i = 0; i < GPGEX_STATS_BUCKETS; i++)
+    total += (uint32_t) snapshot->hists[hist][i];
+  *r_count = (uint32_t) total;
+  if (!total)
+    return 0;
+
+  if (pct > 100)
+    pct = 100;
+  want = (total * pct + 99) / 100;
+  if (!want)
+    want = 1;
+  for (sum = 0, i = 0; i < GPGEX_STATS_BUCKETS; i++)
+    {
+      sum += (uint32_t) snapshot->hists[hist][i];
+      if (sum >= want)
+        break;
+    }
+  if (i >= GPGEX_STATS_BUCKETS)
+    i = GPGEX_STATS_BUCKETS - 1;
+
+  /* Upper bound of bucket I.  */
+  return i ? ((uint64_t) 1 << i) - 1 : 0;
+}
+
+
+void
+gpgex_stats_print (FILE *fp, const struct gpgex_stats_s *snapshot,
+                   int machine)
+{
+  int i;
+  const char *name;
+
+  for (i = 0; i < GPGEX_STATS_MAX_COUNTERS; i++)
+    {
+      name = gpgex_stats_counter_name (i);
+      if (!name && !snapshot->counters[i])
+        continue;
+      if (machine)
+        fprintf (fp, "counter:%s:%ld\n", name ? name : "",
+                 (long) snapshot->counters[i]);
+      else
+        fprintf (fp, "%-24s %10ld\n", name ? name : "(unknown)",
+                 (long) snapshot->counters[i]);
+    }
+
+  if (!machine)
+    fputs ("\nOperations:\n", fp);
+  for (i = 0; i < GPGEX_STATS_MAX_OPS; i++)
+    {
+      name = gpgex_stats_op_name (i);
+      if (!name && !snapshot->ops[i])
+        continue;
+      if (machine)
+        fprintf (fp, "op:%s:%ld\n", name ? name : "",
+                 (long) snapshot->ops[i]);
+      else
+        fprintf (fp, "  %-22s %10ld\n", name ? name : "(unknown)",
+                 (long) snapshot->ops[i]);
+    }
+
+  if (!machine)
+    fputs ("\nTimings (usec):           count     p50     p90     p99\n",
+           fp);
+  for (i = 0; i < GPGEX_STATS_MAX_HISTS; i++)
+    {
+      uint32_t count;
+      unsigned long p50, p90, p99;
+
+      name = gpgex_stats_hist_name (i);
+      p50 = (unsigned long) gpgex_stats_percentile (snapshot, i, 50, &count);
+      p90 = (unsigned long) gpgex_stats_percentile (snapshot, i, 90, &count);
+      p99 = (unsigned long) gpgex_stats_percentile (snapshot, i, 99, &count);
+      if (!name && !count)
+        continue;
+      if (machine)
+        fprintf (fp, "hist:%s:%lu:%lu:%lu:%lu\n", name ? name : "",
+                 (unsigned long) count, p50, p90, p99);
+      else
+        fprintf (fp, "  %-20s %9lu %7lu %7lu %7lu\n",
+                 name ? name : "(unknown)",
+                 (unsigned long) count, p50, p90, p99);
+    }
+}
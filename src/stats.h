@@ -0,0 +1,169 @@
+/* stats.h - shared memory statistics
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#ifndef GPGEX_STATS_H
+#define GPGEX_STATS_H	1
+
+#include <stdio.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#if 0
+}
+#endif
+#endif
+
+/* All processes hosting GpgEX in a session update one shared memory
+   block with counters and histograms.  The block can be read by the
+   gpgex-stats tool without attaching to the processes.  The layout
+   has a fixed size; new counters use the reserved slots so that old
+   and new versions of the DLL can share a block.  Only a change of
+   the layout bumps GPGEX_STATS_VERSION and thus the name of the
+   block.  */
+
+#define GPGEX_STATS_MAGIC	0x53584750  /* "PGXS" */
+#define GPGEX_STATS_VERSION	1
+
+#define GPGEX_STATS_MAX_COUNTERS	64
+#define GPGEX_STATS_MAX_OPS		16
+#define GPGEX_STATS_MAX_HISTS		8
+
+/* Histogram bucket I counts durations D (in microseconds) with
+   2^(I-1) <= D < 2^I; bucket 0 counts D == 0 and the last bucket
+   everything above.  */
+#define GPGEX_STATS_BUCKETS	24
+
+/* Counter indices.  Never reorder; only append.  */
+enum gpgex_stats_counter
+  {
+    GPGEX_STAT_HOSTS,		/* Gauge: processes with the DLL loaded.  */
+    GPGEX_STAT_INITIALIZE,	/* Calls to IShellExtInit::Initialize.  */
+    GPGEX_STAT_MENUS_SHOWN,	/* Context menus built.  */
+    GPGEX_STAT_CONNECT_FAILURES,
+    GPGEX_STAT_SPAWNS,		/* UI-server or helper processes started.  */
+    GPGEX_STAT_SPAWN_FAILURES,
+    GPGEX_STAT_QUEUE_DEPTH,	/* Gauge: operations in flight.  */
+    GPGEX_STAT_QUEUE_DEPTH_MAX,
+    GPGEX_STAT_BITMAP_CACHE_HITS,
+    GPGEX_STAT_BITMAP_CACHE_MISSES,
+    GPGEX_STAT_PROFILE_CACHE_HITS,
+    GPGEX_STAT_PROFILE_CACHE_MISSES,
+    GPGEX_STAT_SOCKETDIR_NATIVE,
+    GPGEX_STAT_SOCKETDIR_GPGCONF,
+    GPGEX_STAT_LAUNCH_REJECTS,
+    GPGEX_STAT_CAPS_PROBES,
+    GPGEX_STAT_PIPELINED_SUBMITS,
+    GPGEX_STAT_SHARDED_SUBMITS,
+    GPGEX_STAT_PREFETCHES,	/* Read aheads started.  */
+    GPGEX_STAT_PREFETCH_CANCELS,
+    GPGEX_STAT_KEYINDEX_REFRESHES,
+    GPGEX_STAT_META_READS,	/* Files read for overlays and tips.  */
+    GPGEX_STAT_OVERLAY_HITS,	/* Overlays shown.  */
+    GPGEX_STAT_INFOTIP_PLACEHOLDERS, /* Info tips without data.  */
+    GPGEX_STAT_ARCHIVES,	/* Encrypted archives made.  */
+    GPGEX_STAT_SIGNATURE_PAIRS, /* Signatures paired with data files.  */
+    GPGEX_STAT_DUPLICATES,	/* Selected files dropped as duplicates.  */
+    GPGEX_STAT_PREFLIGHT_SKIPS, /* Files left out before submission.  */
+    GPGEX_STAT_SPACE_WARNINGS,	/* Warnings about the free space.  */
+
+    GPGEX_STAT_N_COUNTERS	/* Number of known counters.  */
+  };
+
+/* Histogram indices.  Never reorder; only append.  */
+enum gpgex_stats_hist
+  {
+    GPGEX_HIST_INITIALIZE,	/* Duration of Initialize.  */
+    GPGEX_HIST_QUERY_MENU,	/* Duration of QueryContextMenu.  */
+    GPGEX_HIST_CONNECT,		/* Time to connect to the UI-server.  */
+    GPGEX_HIST_PROFILE_CACHED,	/* Profile resolution from the cache.  */
+    GPGEX_HIST_PROFILE_UNCACHED, /* Profile resolution by probing.  */
+    GPGEX_HIST_LAUNCH,		/* Time to start the UI-server.  */
+    GPGEX_HIST_PREFLIGHT,	/* Pre-flight check of one file.  */
+
+    GPGEX_HIST_N_HISTS
+  };
+
+/* The operations are counted by the index of their UI-server command
+   in the table returned by gpgex_stats_op_name.  */
+
+struct gpgex_stats_s
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t size;		/* sizeof (struct gpgex_stats_s).  */
+  uint32_t reserved;
+  volatile int32_t counters[GPGEX_STATS_MAX_COUNTERS];
+  volatile int32_t ops[GPGEX_STATS_MAX_OPS];
+  volatile int32_t hists[GPGEX_STATS_MAX_HISTS][GPGEX_STATS_BUCKETS];
+};
+
+
+/* Writer interface.  All functions do nothing if the block could not
+   be created.  */
+void gpgex_stats_init (void);
+void gpgex_stats_deinit (void);
+void gpgex_stats_inc (int counter);
+void gpgex_stats_dec (int counter);
+/* Increment the gauge COUNTER and raise MAXCOUNTER if needed.  */
+void gpgex_stats_gauge_inc (int counter, int maxcounter);
+void gpgex_stats_op (const char *command);
+void gpgex_stats_hist (int hist, uint64_t usec);
+
+/* Return a monotonic timestamp in microseconds.  */
+uint64_t gpgex_stats_now (void);
+
+/* Reader interface.  */
+
+/* Return the name of counter, operation or histogram IDX or NULL if
+   unknown.  */
+const char *gpgex_stats_counter_name (int idx);
+const char *gpgex_stats_op_name (int idx);
+const char *gpgex_stats_hist_name (int idx);
+
+/* Map the statistics block read-only.  Returns NULL if it does not
+   exist (no process has loaded GpgEX).  */
+const struct gpgex_stats_s *gpgex_stats_open_reader (void);
+void gpgex_stats_close_reader (const struct gpgex_stats_s *stats);
+
+/* Copy the live block STATS to SNAPSHOT.  Returns 0 on success or -1
+   if the block has an unknown layout.  */
+int gpgex_stats_snapshot (const struct gpgex_stats_s *stats,
+                          struct gpgex_stats_s *snapshot);
+
+/* Return an upper bound of the percentile PCT (0..100) of histogram
+   HIST in microseconds and store the number of samples at R_COUNT.  */
+uint64_t gpgex_stats_percentile (const struct gpgex_stats_s *snapshot,
+                                 int hist, unsigned int pct,
+                                 uint32_t *r_count);
+
+/* Print SNAPSHOT in a human readable or, if MACHINE is set, in a
+   colon delimited format to FP.  */
+void gpgex_stats_print (FILE *fp, const struct gpgex_stats_s *snapshot,
+                        int machine);
+
+#ifdef __cplusplus
+#if 0
+{
+#endif
+}
+#endif
+
+#endif /* GPGEX_STATS_H */
@@ -0,0 +1,351 @@
+/* submit.cc - exported batch submission API
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <windows.h>
+#include <shellapi.h>
+
+#include <gpg-error.h>
+
+#include "main.h"
+#include "stats.h"
+#include "client.h"
+#include "submit.h"
+
+
+/* The commands which may be submitted.  */
+static const char *const submit_commands[] =
+  {
+    "DECRYPT_VERIFY_FILES",
+    "DECRYPT_FILES",
+    "VERIFY_FILES",
+    "ENCRYPT_SIGN_FILES",
+    "ENCRYPT_FILES",
+    "SIGN_FILES",
+    "IMPORT_FILES",
+    "CHECKSUM_CREATE_FILES",
+    "CHECKSUM_VERIFY_FILES",
+    "ENCRYPT_ARCHIVE",
+    NULL
+  };
+
+
+/* Return the static name of COMMAND or NULL if it is not allowed.  */
+static const char *
+lookup_command (const char *command)
+{
+  int i;
+
+  for (i = 0; submit_commands[i]; i++)
+    if (!strcmp (submit_commands[i], command))
+      return submit_commands[i];
+  return NULL;
+}
+
+
+/* Write the utf-8 string STRING to the result file FP as a field.
+   The characters which end a field or a line are percent
+   escaped.  */
+static void
+write_field (gpgrt_stream_t fp, const string &string)
+{
+  size_t i;
+
+  for (i = 0; i < string.size (); i++)
+    {
+      unsigned char c = string[i];
+
+      if (c == ':' || c == '%' || c == '\n' || c == '\r')
+        gpgrt_fprintf (fp, "%%%02X", c);
+      else
+        gpgrt_fputc (c, fp);
+    }
+  gpgrt_fputc (':', fp);
+}
+
+
+/* Write the files of batch NUMBER listed in FILES to FP, each in a
+   line starting with TAG.  */
+static void
+write_file_lines (gpgrt_stream_t fp, const char *tag, unsigned int number,
+                  const vector<string> &files)
+{
+  size_t i;
+
+  for (i = 0; i < files.size (); i++)
+    {
+      gpgrt_fprintf (fp, "%s:%u:", tag, number);
+      write_field (fp, files[i]);
+      gpgrt_fputc ('\n', fp);
+    }
+}
+
+
+/* Write the details RES of batch NUMBER to FP.  */
+static void
+write_batch_details (gpgrt_stream_t fp, unsigned int number,
+                     const client_result_s &res)
+{
+  size_t i;
+
+  for (i = 0; i < res.shards.size (); i++)
+    gpgrt_fprintf (fp, "shard:%u:%u:%u:%u:\n", number, (unsigned int) i + 1,
+                   res.shards[i].nfiles, res.shards[i].rc);
+  write_file_lines (fp, "skipped", number, res.skipped);
+  write_file_lines (fp, "missing", number, res.missing);
+  for (i = 0; i < res.nospace.size (); i++)
+    {
+      gpgrt_fprintf (fp, "nospace:%u:", number);
+      write_field (fp, res.nospace[i].root);
+      gpgrt_fprintf (fp, "%llu:%llu:\n",
+                     (unsigned long long) res.nospace[i].need,
+                     (unsigned long long) res.nospace[i].avail);
+    }
+}
+
+
+/* Run CMD on FILENAMES in batches of BATCHSIZE with the FLAGS for
+   client_run_command and write the lines for each batch to RESULT if
+   not NULL.  The number of batches done is stored at R_DONE and the
+   number of files left out at R_LEFT_OUT.  */
+static gpg_error_t
+submit_batches (const char *cmd, const vector<string> &filenames,
+                unsigned int batchsize, HWND wid, unsigned int flags,
+                unsigned int *r_done, unsigned int *r_left_out,
+                gpgrt_stream_t result)
+{
+  gpg_error_t err = 0;
+  unsigned int done = 0;
+  unsigned int left_out = 0;
+  unsigned int n;
+  size_t pos;
+
+  TRACE_BEG (DEBUG_ASSUAN, "GpgexSubmit", cmd, "%u files, batch size %u",
+             (unsigned int) filenames.size (), batchsize);
+
+  if (!batchsize)
+    batchsize = filenames.size ();
+
+  for (pos = 0; !err && pos < filenames.size (); pos += batchsize)
+    {
+      size_t end = pos + batchsize;
+      client_result_s res;
+
+      if (end > filenames.size ())
+        end = filenames.size ();
+      vector<string> batch (filenames.begin () + pos,
+                            filenames.begin () + end);
+
+      gpgex_stats_op (cmd);
+      err = client_run_command (cmd, batch, wid, flags, &res);
+      n = res.skipped.size () + res.missing.size ();
+      left_out += n;
+      if (result)
+        {
+          write_batch_details (result, done + 1, res);
+          gpgrt_fprintf (result, "batch:%u:%u:%u:%u:\n", done + 1,
+                         (unsigned int) batch.size (), err, n);
+        }
+      if (!err)
+        done++;
+    }
+
+  if (r_done)
+    *r_done = done;
+  if (r_left_out)
+    *r_left_out = left_out;
+  (void) TRACE_LOG ("%u batches done, %u files left out", done, left_out);
+  return TRACE_GPGERR (err);
+}
+
+
+unsigned int WINAPI
+GpgexSubmit (const char *command, const char *const *files,
+             unsigned int nfiles, unsigned int batchsize, HWND wid,
+             const char *resultname, unsigned int *r_done)
+{
+  const char *cmd;
+  vector<string> filenames;
+  gpgrt_stream_t result = NULL;
+  gpg_error_t err;
+  unsigned int done, left_out;
+  unsigned int i;
+
+  if (r_done)
+    *r_done = 0;
+  if (!command || (nfiles && !files))
+    return gpg_error (GPG_ERR_INV_ARG);
+  cmd = lookup_command (command);
+  if (!cmd)
+    return gpg_error (GPG_ERR_UNKNOWN_COMMAND);
+  if (!nfiles)
+    return gpg_error (GPG_ERR_NO_DATA);
+
+  filenames.reserve (nfiles);
+  for (i = 0; i < nfiles; i++)
+    filenames.push_back (files[i]);
+
+  if (resultname)
+    {
+      result = gpgrt_fopen (resultname, "w");
+      if (!result)
+        return gpg_error_from_syserror ();
+    }
+
+  err = submit_batches (cmd, filenames, batchsize, wid, CLIENT_NO_UI,
+                        &done, &left_out, result);
+  if (r_done)
+    *r_done = done;
+  if (result)
+    {
+      gpgrt_fprintf (result, "result:%u:%u:%u:%u:\n", err, done, nfiles,
+                     left_out);
+      gpgrt_fclose (result);
+    }
+  return err;
+}
+
+
+/* Append the file names listed in the utf-8 file FNAME to
+   FILENAMES.  */
+static gpg_error_t
+read_list_file (const char *fname, vector<string> &filenames)
+{
+  gpgrt_stream_t fp;
+  char line[4096];
+  size_t n;
+
+  fp = gpgrt_fopen (fname, "r");
+  if (!fp)
+    return gpg_error_from_syserror ();
+  while (gpgrt_fgets (line, sizeof line, fp))
+    {
+      n = strlen (line);
+      if (n && line[n - 1] != '\n' && !gpgrt_feof (fp))
+        {
+          gpgrt_fclose (fp);
+          return gpg_error (GPG_ERR_LINE_TOO_LONG);
+        }
+      while (n && (line[n - 1] == '\n' || line[n - 1] == '\r'))
+        line[--n] = 0;
+      if (n)
+        filenames.push_back (line);
+    }
+  gpgrt_fclose (fp);
+  return 0;
+}
+
+
+void CALLBACK
+GpgexRunW (HWND hwnd, HINSTANCE hinst, LPWSTR cmdline, int nshow)
+{
+  gpg_error_t err = 0;
+  wchar_t **wargv;
+  int argc, i;
+  vector<string> args;
+  vector<string> filenames;
+  const char *cmd = NULL;
+  const char *resultname = NULL;
+  unsigned int batchsize = 0;
+  unsigned int done = 0;
+  unsigned int left_out = 0;
+  gpgrt_stream_t result = NULL;
+
+  (void) hinst;
+  (void) nshow;
+
+  wargv = CommandLineToArgvW (cmdline, &argc);
+  if (!wargv)
+    return;
+  for (i = 0; i < argc; i++)
+    {
+      char *arg = gpgrt_wchar_to_utf8 (wargv[i]);
+
+      args.push_back (arg ? arg : "");
+      free (arg);
+    }
+  LocalFree (wargv);
+
+  for (i = 0; !err && i < argc; i++)
+    {
+      const char *arg = args[i].c_str ();
+
+      if (!strcmp (arg, "--batch") && i + 1 < argc)
+        batchsize = strtoul (args[++i].c_str (), NULL, 10);
+      else if (!strcmp (arg, "--result") && i + 1 < argc)
+        resultname = args[++i].c_str ();
+      else if (!cmd)
+        {
+          cmd = lookup_command (arg);
+          if (!cmd)
+            err = gpg_error (GPG_ERR_UNKNOWN_COMMAND);
+        }
+      else if (*arg == '@')
+        err = read_list_file (arg + 1, filenames);
+      else
+        filenames.push_back (arg);
+    }
+  if (!err && !cmd)
+    err = gpg_error (GPG_ERR_MISSING_VALUE);
+  if (!err && filenames.empty ())
+    err = gpg_error (GPG_ERR_NO_DATA);
+
+  if (resultname)
+    result = gpgrt_fopen (resultname, "w");
+
+  if (!err)
+    {
+      /* With a result file the caller is a script, which gets the
+         details from there.  */
+      err = submit_batches (cmd, filenames, batchsize, hwnd,
+                            result ? CLIENT_NO_UI : 0, &done, &left_out,
+                            result);
+      if (err && !result)
+        {
+          client_result_s res;
+
+          res.connect_failed = 0;
+          client_show_error (hwnd, err, &res);
+        }
+    }
+  else if (!result)
+    {
+      char buf[256];
+
+      snprintf (buf, sizeof buf, "%s\r\n\r\nUsage: rundll32 gpgex.dll,"
+                "GpgexRun COMMAND [--batch N] [--result FILE] "
+                "{@LISTFILE | FILE}...", gpg_strerror (err));
+      MessageBox (hwnd, buf, "GpgEX", MB_ICONERROR);
+    }
+
+  if (result)
+    {
+      gpgrt_fprintf (result, "result:%u:%u:%u:%u:\n", err, done,
+                     (unsigned int) filenames.size (), left_out);
+      gpgrt_fclose (result);
+    }
+}
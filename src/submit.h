@@ -0,0 +1,71 @@
+/* submit.h - exported batch submission API
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#ifndef GPGEX_SUBMIT_H
+#define GPGEX_SUBMIT_H	1
+
+#include <windows.h>
+
+#ifdef __cplusplus
+extern "C" {
+#if 0
+}
+#endif
+#endif
+
+/* These functions are exported by gpgex.dll for scripts and other
+   programs which want to run operations on many files without going
+   through the shell.  See the manual for details.  */
+
+/* Run the UI server command COMMAND (e.g. "ENCRYPT_FILES") on the
+   NFILES utf-8 encoded file names in FILES.  The files are sent in
+   batches of at most BATCHSIZE files, each batch being a separate
+   operation; 0 sends all files in one batch.  WID is the parent
+   window or NULL.  No message boxes are shown; if RESULTNAME is not
+   NULL the details of each batch, including the files left out, are
+   written to that file as with the --result option of GpgexRunW.
+   The number of accepted batches is stored at R_DONE if not NULL.
+   Returns 0 or a gpg-error code.  The function blocks until the UI
+   server has accepted the last batch.  */
+unsigned int WINAPI GpgexSubmit (const char *command,
+                                 const char *const *files,
+                                 unsigned int nfiles,
+                                 unsigned int batchsize, HWND wid,
+                                 const char *resultname,
+                                 unsigned int *r_done);
+
+/* Entry point for rundll32:
+
+     rundll32 gpgex.dll,GpgexRun COMMAND [--batch N] [--result FILE]
+                                 {@LISTFILE | FILE}...
+
+   A list file has one utf-8 encoded file name per line.  The
+   result is written to FILE in a colon delimited format.  */
+void CALLBACK GpgexRunW (HWND hwnd, HINSTANCE hinst, LPWSTR cmdline,
+                         int nshow);
+
+#ifdef __cplusplus
+#if 0
+{
+#endif
+}
+#endif
+
+#endif /* GPGEX_SUBMIT_H */
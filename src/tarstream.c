@@ -0,0 +1,320 @@
+/* tarstream.c - streaming tar writer
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include "tarstream.h"
+
+#define BLOCKSIZE 512
+
+/* The ustar header.  */
+struct ustar_header_s
+{
+  char name[100];
+  char mode[8];
+  char uid[8];
+  char gid[8];
+  char size[12];
+  char mtime[12];
+  char checksum[8];
+  char typeflag[1];
+  char linkname[100];
+  char magic[6];
+  char version[2];
+  char uname[32];
+  char gname[32];
+  char devmajor[8];
+  char devminor[8];
+  char prefix[155];
+  char pad[12];
+};
+
+static const char zeros[BLOCKSIZE];
+
+
+/* Pass LENGTH bytes of BUFFER to the sink of TAR.  After an error
+   nothing more is written.  */
+static gpg_error_t
+emit (struct gpgex_tar_s *tar, const void *buffer, size_t length)
+{
+  if (tar->err)
+    return tar->err;
+  if (!length)
+    return 0;
+  tar->err = tar->sink (tar->opaque, buffer, length);
+  if (!tar->err)
+    tar->written += length;
+  return tar->err;
+}
+
+
+/* Store VALUE as octal number in the field FIELD of LENGTH bytes
+   including the terminating zero.  Returns false if it does not
+   fit.  */
+static int
+put_octal (char *field, size_t length, uint64_t value)
+{
+  size_t i;
+
+  field[length - 1] = 0;
+  for (i = length - 1; i-- > 0; )
+    {
+      field[i] = '0' + (value & 7);
+      value >>= 3;
+    }
+  return !value;
+}
+
+
+/* Store VALUE in the field FIELD of LENGTH bytes, in octal if it fits
+   and else in the base-256 encoding of GNU tar.  */
+static void
+put_number (char *field, size_t length, uint64_t value)
+{
+  size_t i;
+
+  if (put_octal (field, length, value))
+    return;
+  memset (field, 0, length);
+  for (i = length; i-- > 1 && value; )
+    {
+      field[i] = (char) (value & 0xff);
+      value >>= 8;
+    }
+  field[0] = (char) 0x80;
+}
+
+
+/* Return the length of the prefix if NAME of LENGTH bytes can be
+   split into the ustar prefix and name fields, else 0.  */
+static size_t
+split_name (const char *name, size_t length)
+{
+  size_t i;
+
+  for (i = length > 101 ? length - 101 : 1; i < length - 1; i++)
+    if (name[i] == '/')
+      return i <= sizeof ((struct ustar_header_s *) 0)->prefix ? i : 0;
+  return 0;
+}
+
+
+/* Append the pax record KEYWORD=VALUE to the buffer RECORDS of SIZE
+   bytes, of which *R_USED are used.  Returns false if it does not
+   fit.  */
+static int
+add_record (char *records, size_t size, size_t *r_used,
+            const char *keyword, const char *value)
+{
+  size_t base, length;
+  char digits[24];
+
+  /* The length of the record includes the length itself.  */
+  base = strlen (keyword) + strlen (value) + 3;
+  length = base + 1;
+  while (snprintf (digits, sizeof digits, "%u", (unsigned int) length),
+         base + strlen (digits) != length)
+    length = base + strlen (digits);
+
+  if (*r_used + length + 1 > size)
+    return 0;
+  snprintf (records + *r_used, size - *r_used, "%s %s=%s\n",
+            digits, keyword, value);
+  *r_used += length;
+  return 1;
+}
+
+
+/* Compute the checksum of the header HDR and write it out.  */
+static gpg_error_t
+emit_header (struct gpgex_tar_s *tar, struct ustar_header_s *hdr)
+{
+  const unsigned char *p = (const unsigned char *) hdr;
+  unsigned int sum = 0;
+  size_t i;
+
+  memcpy (hdr->magic, "ustar", 6);
+  memcpy (hdr->version, "00", 2);
+  memset (hdr->checksum, ' ', sizeof hdr->checksum);
+  for (i = 0; i < BLOCKSIZE; i++)
+    sum += p[i];
+  put_octal (hdr->checksum, 7, sum);
+  hdr->checksum[7] = ' ';
+  return emit (tar, hdr, BLOCKSIZE);
+}
+
+
+/* Write the header for NAME, which already has the trailing slash if
+   it is a directory.  A pax header is written first if needed.  */
+static gpg_error_t
+write_header (struct gpgex_tar_s *tar, const char *name, char typeflag,
+              unsigned int mode, uint64_t size, time_t mtime)
+{
+  struct ustar_header_s hdr;
+  size_t length = strlen (name);
+  size_t prefix = 0;
+  int long_name = 0;
+  char records[4096 + 64];
+  size_t used = 0;
+  char number[24];
+  const char *base;
+
+  if (!length)
+    return gpg_error (GPG_ERR_INV_NAME);
+
+  if (length > sizeof hdr.name)
+    {
+      prefix = split_name (name, length);
+      long_name = !prefix;
+    }
+
+  if (long_name || size > 077777777777ULL)
+    {
+      if (long_name && !add_record (records, sizeof records, &used,
+                                    "path", name))
+        return gpg_error (GPG_ERR_TOO_LARGE);
+      if (size > 077777777777ULL)
+        {
+          snprintf (number, sizeof number, "%llu", (unsigned long long) size);
+          add_record (records, sizeof records, &used, "size", number);
+        }
+
+      /* The name of the pax header is not used by readers which know
+         pax, but other readers create a file with it.  */
+      memset (&hdr, 0, sizeof hdr);
+      base = strrchr (name, '/');
+      base = base && base[1] ? base + 1 : name;
+      snprintf (hdr.name, sizeof hdr.name, "PaxHeaders/%.88s", base);
+      put_octal (hdr.mode, sizeof hdr.mode, 0644);
+      put_octal (hdr.uid, sizeof hdr.uid, 0);
+      put_octal (hdr.gid, sizeof hdr.gid, 0);
+      put_octal (hdr.size, sizeof hdr.size, used);
+      put_number (hdr.mtime, sizeof hdr.mtime, (uint64_t) mtime);
+      hdr.typeflag[0] = 'x';
+      if (emit_header (tar, &hdr)
+          || emit (tar, records, used)
+          || emit (tar, zeros, (BLOCKSIZE - used % BLOCKSIZE) % BLOCKSIZE))
+        return tar->err;
+    }
+
+  memset (&hdr, 0, sizeof hdr);
+  if (prefix)
+    {
+      memcpy (hdr.prefix, name, prefix);
+      memcpy (hdr.name, name + prefix + 1, length - prefix - 1);
+    }
+  else
+    memcpy (hdr.name, name, length < sizeof hdr.name ? length : sizeof hdr.name);
+  put_octal (hdr.mode, sizeof hdr.mode, mode);
+  put_octal (hdr.uid, sizeof hdr.uid, 0);
+  put_octal (hdr.gid, sizeof hdr.gid, 0);
+  put_number (hdr.size, sizeof hdr.size, size);
+  put_number (hdr.mtime, sizeof hdr.mtime, mtime > 0 ? (uint64_t) mtime : 0);
+  hdr.typeflag[0] = typeflag;
+  return emit_header (tar, &hdr);
+}
+
+
+void
+gpgex_tar_init (struct gpgex_tar_s *tar, gpgex_tar_sink_t sink, void *opaque)
+{
+  memset (tar, 0, sizeof *tar);
+  tar->sink = sink;
+  tar->opaque = opaque;
+}
+
+
+gpg_error_t
+gpgex_tar_add_dir (struct gpgex_tar_s *tar, const char *name, time_t mtime)
+{
+  char buffer[4096];
+  size_t length = strlen (name);
+
+  if (length + 2 > sizeof buffer)
+    return gpg_error (GPG_ERR_TOO_LARGE);
+  memcpy (buffer, name, length);
+  if (!length || buffer[length - 1] != '/')
+    buffer[length++] = '/';
+  buffer[length] = 0;
+  return write_header (tar, buffer, '5', 0755, 0, mtime);
+}
+
+
+gpg_error_t
+gpgex_tar_begin_file (struct gpgex_tar_s *tar, const char *name,
+                      uint64_t size, time_t mtime)
+{
+  gpg_error_t err;
+
+  err = write_header (tar, name, '0', 0644, size, mtime);
+  if (err)
+    return err;
+  tar->remaining = size;
+  tar->pad = (BLOCKSIZE - size % BLOCKSIZE) % BLOCKSIZE;
+  return 0;
+}
+
+
+gpg_error_t
+gpgex_tar_write (struct gpgex_tar_s *tar, const void *buffer, size_t length)
+{
+  size_t n = length;
+
+  if (n > tar->remaining)
+    n = (size_t) tar->remaining;
+  if (emit (tar, buffer, n))
+    return tar->err;
+  tar->remaining -= n;
+  return n < length ? gpg_error (GPG_ERR_TOO_LARGE) : 0;
+}
+
+
+gpg_error_t
+gpgex_tar_end_file (struct gpgex_tar_s *tar)
+{
+  int truncated = tar->remaining > 0;
+  size_t n;
+
+  while (tar->remaining)
+    {
+      n = tar->remaining < BLOCKSIZE ? (size_t) tar->remaining : BLOCKSIZE;
+      if (emit (tar, zeros, n))
+        return tar->err;
+      tar->remaining -= n;
+    }
+  if (emit (tar, zeros, tar->pad))
+    return tar->err;
+  tar->pad = 0;
+  return truncated ? gpg_error (GPG_ERR_TRUNCATED) : 0;
+}
+
+
+gpg_error_t
+gpgex_tar_finish (struct gpgex_tar_s *tar)
+{
+  if (emit (tar, zeros, BLOCKSIZE))
+    return tar->err;
+  return emit (tar, zeros, BLOCKSIZE);
+}
@@ -0,0 +1,93 @@
+/* tarstream.h - streaming tar writer
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#ifndef GPGEX_TARSTREAM_H
+#define GPGEX_TARSTREAM_H	1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <gpg-error.h>
+
+#ifdef __cplusplus
+extern "C" {
+#if 0
+}
+#endif
+#endif
+
+/* A writer for POSIX ustar archives which passes the archive to a
+   sink as it is made; nothing is staged.  Names are utf-8 with '/' as
+   separator.  Names which do not fit into the ustar header and files
+   of 8 GiB or more get a pax extended header, as written by gpgtar
+   and GNU tar.  */
+
+/* The sink gets the archive in pieces of any length; only the
+   complete archive is a multiple of 512 bytes.  */
+typedef gpg_error_t (*gpgex_tar_sink_t) (void *opaque,
+                                         const void *buffer, size_t length);
+
+struct gpgex_tar_s
+{
+  gpgex_tar_sink_t sink;
+  void *opaque;
+  uint64_t remaining;		/* Bytes still expected for the file.  */
+  size_t pad;			/* Padding after the file.  */
+  uint64_t written;		/* Bytes passed to the sink.  */
+  gpg_error_t err;		/* The first error of the sink.  */
+};
+
+/* Initialize TAR to write to SINK.  */
+void gpgex_tar_init (struct gpgex_tar_s *tar,
+                     gpgex_tar_sink_t sink, void *opaque);
+
+/* Add the directory NAME with the modification time MTIME.  */
+gpg_error_t gpgex_tar_add_dir (struct gpgex_tar_s *tar,
+                               const char *name, time_t mtime);
+
+/* Start the file NAME of SIZE bytes.  Its data is then passed with
+   gpgex_tar_write, followed by gpgex_tar_end_file.  On error nothing
+   has been written for the file.  */
+gpg_error_t gpgex_tar_begin_file (struct gpgex_tar_s *tar, const char *name,
+                                  uint64_t size, time_t mtime);
+
+/* Write LENGTH bytes of the current file.  Data beyond the size
+   given to gpgex_tar_begin_file is dropped and GPG_ERR_TOO_LARGE is
+   returned.  */
+gpg_error_t gpgex_tar_write (struct gpgex_tar_s *tar,
+                             const void *buffer, size_t length);
+
+/* Finish the current file.  If it had less data than announced, it
+   is filled up with zeros to keep the archive valid and
+   GPG_ERR_TRUNCATED is returned.  */
+gpg_error_t gpgex_tar_end_file (struct gpgex_tar_s *tar);
+
+/* Write the end of archive marker.  */
+gpg_error_t gpgex_tar_finish (struct gpgex_tar_s *tar);
+
+#ifdef __cplusplus
+#if 0
+{
+#endif
+}
+#endif
+
+#endif /* GPGEX_TARSTREAM_H */
@@ -0,0 +1,114 @@
+/* fuzz-pgpinfo.c - fuzz target for the OpenPGP header parser
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+/* This is a libFuzzer target; see README for how to build it as
+   such.  t-pgpinfo runs the same function on random input.  The
+   input is parsed once in one piece and once in pieces whose sizes
+   are taken from the first byte, and the results must agree.  */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pgpinfo.h"
+
+int LLVMFuzzerTestOneInput (const unsigned char *data, size_t size);
+
+
+static void
+check_info (const struct gpgex_pgp_info_s *info, size_t size)
+{
+  if (info->nrecipients > GPGEX_PGP_MAX_RECIPIENTS
+      || memchr (info->filename, 0, sizeof info->filename) == NULL
+      || info->consumed > size
+      || (info->is_openpgp && info->invalid && !info->armor))
+    abort ();
+}
+
+
+/* Return true if A and B tell the same about the file.  */
+static int
+same_info (const struct gpgex_pgp_info_s *a, const struct gpgex_pgp_info_s *b)
+{
+  return (a->is_openpgp == b->is_openpgp
+          && a->invalid == b->invalid
+          && a->truncated == b->truncated
+          && a->has_pubkey_enc == b->has_pubkey_enc
+          && a->has_symkey_enc == b->has_symkey_enc
+          && a->has_encrypted == b->has_encrypted
+          && a->has_compressed == b->has_compressed
+          && a->has_signature == b->has_signature
+          && a->has_literal == b->has_literal
+          && a->has_pubkey == b->has_pubkey
+          && a->has_seckey == b->has_seckey
+          && a->have_issuer == b->have_issuer
+          && a->armor == b->armor
+          && a->nrecipients == b->nrecipients
+          && a->more_recipients == b->more_recipients
+          && !memcmp (a->recipients, b->recipients, sizeof a->recipients)
+          && !memcmp (a->issuer, b->issuer, sizeof a->issuer)
+          && !strcmp (a->filename, b->filename));
+}
+
+
+int
+LLVMFuzzerTestOneInput (const unsigned char *data, size_t size)
+{
+  struct gpgex_pgp_parser_s whole, pieces;
+  const struct gpgex_pgp_info_s *a, *b;
+  size_t piece, n;
+  size_t off;
+
+  if (!size)
+    return 0;
+  piece = data[0] % 17 + 1;
+  data++;
+  size--;
+
+  gpgex_pgp_init (&whole, 0, 0);
+  gpgex_pgp_feed (&whole, data, size);
+  a = gpgex_pgp_finish (&whole);
+  check_info (a, size);
+
+  gpgex_pgp_init (&pieces, 0, 0);
+  for (off = 0; off < size; off += n)
+    {
+      n = size - off < piece ? size - off : piece;
+      if (gpgex_pgp_feed (&pieces, data + off, n) == GPGEX_PGP_DONE)
+        break;
+    }
+  b = gpgex_pgp_finish (&pieces);
+  check_info (b, size);
+
+  if (!same_info (a, b))
+    abort ();
+
+  /* The byte limit must hold.  */
+  gpgex_pgp_init (&pieces, size / 2 + 1, 0);
+  gpgex_pgp_feed (&pieces, data, size);
+  if (gpgex_pgp_finish (&pieces)->consumed > size / 2 + 1)
+    abort ();
+
+  return 0;
+}
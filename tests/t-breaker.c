@@ -0,0 +1,235 @@
+/* t-breaker.c - tests for the circuit breaker
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "breaker.h"
+#include "t-support.h"
+
+#define SEC 1000000ULL
+
+/* The state changes seen by the notify callback.  */
+static char changes[512];
+
+static void
+notify (gpgex_breaker_state_t oldstate, gpgex_breaker_state_t newstate,
+        unsigned int failures, uint64_t cooldown)
+{
+  char buffer[64];
+
+  snprintf (buffer, sizeof buffer, "%s%s>%s/%u/%u",
+            *changes ? " " : "",
+            gpgex_breaker_state_name (oldstate),
+            gpgex_breaker_state_name (newstate),
+            failures, (unsigned int) (cooldown / SEC));
+  if (strlen (changes) + strlen (buffer) < sizeof changes)
+    strcat (changes, buffer);
+  info ("  %s -> %s (failures=%u cooldown=%us)",
+        gpgex_breaker_state_name (oldstate),
+        gpgex_breaker_state_name (newstate),
+        failures, (unsigned int) (cooldown / SEC));
+}
+
+
+static void
+test_states (void)
+{
+  struct gpgex_breaker_s b
+    = GPGEX_BREAKER_INITIALIZER (2, 30 * SEC, 100 * SEC, notify);
+  uint64_t now = 1000 * SEC;
+
+  *changes = 0;
+
+  /* One failure does not open the breaker.  */
+  check (gpgex_breaker_allow (&b, now));
+  gpgex_breaker_failure (&b, now);
+  check (gpgex_breaker_state (&b) == GPGEX_BREAKER_CLOSED);
+
+  /* A success resets the count.  */
+  check (gpgex_breaker_allow (&b, now));
+  gpgex_breaker_success (&b);
+  check (gpgex_breaker_allow (&b, now));
+  gpgex_breaker_failure (&b, now);
+  check (gpgex_breaker_state (&b) == GPGEX_BREAKER_CLOSED);
+
+  /* The second consecutive failure opens it.  */
+  check (gpgex_breaker_allow (&b, now));
+  gpgex_breaker_failure (&b, now);
+  check (gpgex_breaker_state (&b) == GPGEX_BREAKER_OPEN);
+  check (!gpgex_breaker_allow (&b, now));
+  check (!gpgex_breaker_allow (&b, now + 29 * SEC));
+
+  /* After the cool-down one probe is let through.  */
+  check (gpgex_breaker_allow (&b, now + 30 * SEC));
+  check (gpgex_breaker_state (&b) == GPGEX_BREAKER_HALF_OPEN);
+  check (!gpgex_breaker_allow (&b, now + 30 * SEC));
+
+  /* A failed probe doubles the cool-down.  */
+  now += 31 * SEC;
+  gpgex_breaker_failure (&b, now);
+  check (gpgex_breaker_state (&b) == GPGEX_BREAKER_OPEN);
+  check (!gpgex_breaker_allow (&b, now + 59 * SEC));
+  check (gpgex_breaker_allow (&b, now + 60 * SEC));
+  now += 60 * SEC;
+  gpgex_breaker_failure (&b, now);
+
+  /* The cool-down is capped.  */
+  check (!gpgex_breaker_allow (&b, now + 99 * SEC));
+  check (gpgex_breaker_allow (&b, now + 100 * SEC));
+  now += 100 * SEC;
+  gpgex_breaker_failure (&b, now);
+  check (!gpgex_breaker_allow (&b, now + 99 * SEC));
+  check (gpgex_breaker_allow (&b, now + 100 * SEC));
+
+  /* A successful probe closes it and resets the cool-down.  */
+  gpgex_breaker_success (&b);
+  check (gpgex_breaker_state (&b) == GPGEX_BREAKER_CLOSED);
+  now += 200 * SEC;
+  gpgex_breaker_allow (&b, now);
+  gpgex_breaker_failure (&b, now);
+  gpgex_breaker_allow (&b, now);
+  gpgex_breaker_failure (&b, now);
+  check (!gpgex_breaker_allow (&b, now + 29 * SEC));
+  check (gpgex_breaker_allow (&b, now + 30 * SEC));
+
+  /* The probe fails; a late failure of a request allowed while the
+     breaker was closed does not restart the cool-down.  */
+  gpgex_breaker_failure (&b, now + 30 * SEC);
+  gpgex_breaker_failure (&b, now + 40 * SEC);
+  check (gpgex_breaker_state (&b) == GPGEX_BREAKER_OPEN);
+  check (!gpgex_breaker_allow (&b, now + 89 * SEC));
+  check (gpgex_breaker_allow (&b, now + 90 * SEC));
+
+  if (strcmp (changes,
+              "closed>open/2/30"
+              " open>half-open/2/30 half-open>open/3/60"
+              " open>half-open/3/60 half-open>open/4/100"
+              " open>half-open/4/100 half-open>open/5/100"
+              " open>half-open/5/100 half-open>closed/0/30"
+              " closed>open/2/30"
+              " open>half-open/2/30 half-open>open/3/60"
+              " open>half-open/4/60"))
+    fail ("wrong state changes: %s", changes);
+}
+
+
+/* The UI server launch breaker sees a failure when a launch fails
+   and a success whenever a connection works, which is usually
+   without a launch and thus without gpgex_breaker_allow.  Failures
+   with successes between them must not add up.  */
+static void
+test_interleaved (void)
+{
+  struct gpgex_breaker_s b
+    = GPGEX_BREAKER_INITIALIZER (3, 30 * SEC, 100 * SEC, notify);
+  uint64_t now = 1000 * SEC;
+  int i;
+
+  *changes = 0;
+  for (i = 0; i < 10; i++)
+    {
+      check (gpgex_breaker_allow (&b, now));
+      gpgex_breaker_failure (&b, now);
+      now += 86400 * SEC;
+      gpgex_breaker_success (&b);
+      check (b.failures == 0);
+    }
+  check (gpgex_breaker_state (&b) == GPGEX_BREAKER_CLOSED);
+
+  /* Fail, success, fail.  */
+  gpgex_breaker_allow (&b, now);
+  gpgex_breaker_failure (&b, now);
+  gpgex_breaker_allow (&b, now);
+  gpgex_breaker_failure (&b, now);
+  gpgex_breaker_success (&b);
+  gpgex_breaker_allow (&b, now);
+  gpgex_breaker_failure (&b, now);
+  check (gpgex_breaker_state (&b) == GPGEX_BREAKER_CLOSED);
+  check (b.failures == 1);
+  if (*changes)
+    fail ("unexpected state changes: %s", changes);
+}
+
+
+/* Many threads ask an open breaker after the cool-down; only one of
+   them may probe.  */
+static struct gpgex_breaker_s shared
+  = GPGEX_BREAKER_INITIALIZER (1, SEC, 10 * SEC, NULL);
+static volatile int go;
+
+static void *
+probe_thread (void *arg)
+{
+  int *allowed = arg;
+
+  while (!go)
+    ;
+  *allowed = gpgex_breaker_allow (&shared, 100 * SEC);
+  return NULL;
+}
+
+
+static void
+test_one_probe (void)
+{
+  pthread_t threads[16];
+  int allowed[16];
+  int i, n;
+
+  gpgex_breaker_allow (&shared, 0);
+  gpgex_breaker_failure (&shared, 0);
+  check (gpgex_breaker_state (&shared) == GPGEX_BREAKER_OPEN);
+
+  for (i = 0; i < 16; i++)
+    if (pthread_create (&threads[i], NULL, probe_thread, &allowed[i]))
+      {
+        fail ("pthread_create failed");
+        return;
+      }
+  go = 1;
+  for (i = n = 0; i < 16; i++)
+    {
+      pthread_join (threads[i], NULL);
+      n += allowed[i];
+    }
+  if (n != 1)
+    fail ("%d probes allowed", n);
+  check (gpgex_breaker_state (&shared) == GPGEX_BREAKER_HALF_OPEN);
+}
+
+
+int
+main (int argc, char **argv)
+{
+  t_init (argc, argv);
+
+  test_states ();
+  test_interleaved ();
+  test_one_probe ();
+
+  return !!errorcount;
+}
@@ -0,0 +1,382 @@
+/* t-exechelp.c - tests for the POSIX exechelp
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+/* Besides some basic tests of the spawn functions this runs many
+   concurrent "clients" which race to start one mock server through
+   the launch coordinator, and reports the time until each of them
+   sees the server ready.  Usage:
+
+     t-exechelp [--verbose] [CLIENTS [ROUNDS]]  */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <gpg-error.h>
+
+#include "exechelp.h"
+#include "t-support.h"
+
+/* The time the mock server needs to become ready.  */
+#define SERVER_DELAY "0.2"
+
+/* Time in milliseconds a client waits for the launcher.  */
+#define CLIENT_WAIT 5000
+
+static char *tmpdir;
+static char readyname[256];
+static char countname[256];
+
+
+static void
+test_get_string (void)
+{
+  gpg_error_t err;
+  char *string;
+
+  err = gpgex_spawn_get_string ("/bin/sh", "sh -c \"echo hello world\"",
+                                &string);
+  if (err)
+    {
+      fail ("spawn_get_string: %s", gpg_strerror (err));
+      return;
+    }
+  check (!strcmp (string, "hello world\n"));
+  free (string);
+
+  /* Quoting as in a Windows command line.  */
+  err = gpgex_spawn_get_string
+    ("/bin/sh", "sh -c \"printf %s/ \\\"$0\\\" \\\"$1\\\"\" \"a b\" c\\\"d",
+     &string);
+  if (err)
+    {
+      fail ("spawn_get_string: %s", gpg_strerror (err));
+      return;
+    }
+  if (strcmp (string, "a b/c\"d/"))
+    fail ("wrong arguments '%s'", string);
+  free (string);
+
+  err = gpgex_spawn_get_string ("/nonexistent/program", "program", &string);
+  check (err);
+}
+
+
+static void
+test_capture (void)
+{
+  gpg_error_t err;
+  char *output;
+  size_t outputlen;
+  int exitcode;
+  uint64_t start;
+
+  err = gpgex_spawn_capture ("/bin/sh", "sh -c \"echo out; exit 3\"",
+                             0, 0, NULL, NULL,
+                             &output, &outputlen, &exitcode);
+  check (!err);
+  if (!err)
+    {
+      check (outputlen == 4 && !strcmp (output, "out\n"));
+      check (exitcode == 3);
+      free (output);
+    }
+
+  start = t_now ();
+  err = gpgex_spawn_capture ("/bin/sh", "sh -c \"sleep 10\"",
+                             200, GPGEX_CAPTURE_KILL, NULL, NULL,
+                             &output, NULL, &exitcode);
+  check (gpg_err_code (err) == GPG_ERR_TIMEOUT);
+  check (t_now () - start < 2000000);
+  check (exitcode == -1);
+}
+
+
+/* Start the mock server.  It becomes ready after SERVER_DELAY
+   seconds and counts how often it has been started.  */
+static void
+start_server (void)
+{
+  char cmdline[1024];
+  gpg_error_t err;
+
+  snprintf (cmdline, sizeof cmdline,
+            "sh -c \"echo x >> '%s'; sleep " SERVER_DELAY
+            "; touch '%s'\"", countname, readyname);
+  err = gpgex_spawn_detached ("/bin/sh", cmdline);
+  if (err)
+    fail ("spawn_detached: %s", gpg_strerror (err));
+}
+
+
+static int
+server_ready (void)
+{
+  return !access (readyname, F_OK);
+}
+
+
+/* Wait at most CLIENT_WAIT milliseconds for the mock server.  */
+static int
+wait_server (void)
+{
+  uint64_t start = t_now ();
+
+  while (!server_ready ())
+    {
+      if (t_now () - start > CLIENT_WAIT * 1000)
+        return 0;
+      usleep (1000);
+    }
+  return 1;
+}
+
+
+/* Return the number of starts of the mock server.  */
+static int
+server_starts (void)
+{
+  FILE *fp;
+  int n = 0;
+  int c;
+
+  fp = fopen (countname, "r");
+  if (!fp)
+    return 0;
+  while ((c = getc (fp)) != EOF)
+    if (c == '\n')
+      n++;
+  fclose (fp);
+  return n;
+}
+
+
+/* The result of one client.  */
+struct result_s
+{
+  int launcher;
+  int ok;
+  unsigned int msec;
+};
+
+
+/* Run one client.  Like the real client it only tries to launch the
+   server if it is not ready.  If GIVE_UP is not NULL and the client
+   is the first launcher it gives up without starting the server.  */
+static void
+run_client (int fd, int use_launch, const char *give_up)
+{
+  struct result_s res;
+  uint64_t start = t_now ();
+  gpgex_launch_t launch;
+  lock_spawn_t lock;
+  int launcher;
+
+  memset (&res, 0, sizeof res);
+  if (server_ready ())
+    res.ok = 1;
+  else if (!use_launch)
+    {
+      /* The old scheme: serialize on the spawn lock.  */
+      if (!gpgex_lock_spawning (&lock))
+        {
+          if (!server_ready () && !server_starts ())
+            {
+              res.launcher = 1;
+              start_server ();
+            }
+          res.ok = wait_server ();
+          gpgex_unlock_spawning (&lock);
+        }
+    }
+  else if (!gpgex_launch_begin (&launch, &launcher))
+    {
+      if (!launcher)
+        gpgex_launch_wait (launch, CLIENT_WAIT, &launcher);
+      if (launcher && give_up && !mkdir (give_up, 0700))
+        {
+          /* Simulate a launcher which fails.  */
+          gpgex_launch_release (launch);
+          res.launcher = 2;
+          if (write (fd, &res, sizeof res) != sizeof res)
+            _exit (1);
+          _exit (0);
+        }
+      if (launcher)
+        {
+          if (!server_ready ())
+            {
+              res.launcher = 1;
+              start_server ();
+            }
+          res.ok = wait_server ();
+          gpgex_launch_done (launch, res.ok);
+        }
+      else
+        res.ok = server_ready ();
+      gpgex_launch_release (launch);
+    }
+
+  res.msec = (t_now () - start) / 1000;
+  if (write (fd, &res, sizeof res) != sizeof res)
+    _exit (1);
+  _exit (0);
+}
+
+
+static int
+cmp_uint (const void *a, const void *b)
+{
+  unsigned int x = *(const unsigned int *) a;
+  unsigned int y = *(const unsigned int *) b;
+
+  return x < y ? -1 : x > y;
+}
+
+
+/* Run NCLIENTS concurrent clients.  */
+static void
+race (const char *desc, int nclients, int use_launch, int give_up)
+{
+  char giveupname[256];
+  struct result_s res;
+  unsigned int *times;
+  int fds[2];
+  int i, n, nok, nlaunchers, ngaveup;
+
+  unlink (readyname);
+  unlink (countname);
+  snprintf (giveupname, sizeof giveupname, "%s/gave-up", tmpdir);
+  rmdir (giveupname);
+
+  times = calloc (nclients, sizeof *times);
+  if (!times || pipe (fds))
+    {
+      fail ("out of core");
+      exit (1);
+    }
+
+  for (i = 0; i < nclients; i++)
+    {
+      pid_t pid = fork ();
+
+      if (pid == -1)
+        {
+          fail ("fork failed: %s", strerror (errno));
+          break;
+        }
+      if (!pid)
+        {
+          close (fds[0]);
+          run_client (fds[1], use_launch, give_up ? giveupname : NULL);
+        }
+    }
+  close (fds[1]);
+
+  n = nok = nlaunchers = ngaveup = 0;
+  while (read (fds[0], &res, sizeof res) == sizeof res)
+    {
+      if (res.launcher == 2)
+        {
+          ngaveup++;
+          continue;
+        }
+      times[n++] = res.msec;
+      nok += res.ok;
+      nlaunchers += res.launcher;
+    }
+  close (fds[0]);
+  while (wait (NULL) > 0 || errno == EINTR)
+    ;
+  rmdir (giveupname);
+
+  if (nok != n || n + ngaveup != nclients)
+    fail ("%s: only %d of %d clients saw the server", desc, nok, nclients);
+  if (nlaunchers != 1)
+    fail ("%s: %d launchers", desc, nlaunchers);
+  if (give_up && ngaveup != 1)
+    fail ("%s: %d launchers gave up", desc, ngaveup);
+  if (server_starts () != 1)
+    fail ("%s: server started %d times", desc, server_starts ());
+
+  qsort (times, n, sizeof *times, cmp_uint);
+  if (n)
+    info ("%-22s %3d clients  ready after: median %u ms  max %u ms",
+          desc, n, times[n / 2], times[n - 1]);
+  free (times);
+}
+
+
+int
+main (int argc, char **argv)
+{
+  char template[] = "/tmp/t-exechelp-XXXXXX";
+  int nclients = 32;
+  int rounds = 1;
+  int i;
+
+  i = t_init (argc, argv) + 1;
+  if (i < argc)
+    nclients = atoi (argv[i++]);
+  if (i < argc)
+    rounds = atoi (argv[i++]);
+
+  /* Use our own directory for the spawn sentinel.  */
+  tmpdir = mkdtemp (template);
+  if (!tmpdir)
+    {
+      fail ("mkdtemp failed: %s", strerror (errno));
+      return 1;
+    }
+  setenv ("XDG_RUNTIME_DIR", tmpdir, 1);
+  snprintf (readyname, sizeof readyname, "%s/ready", tmpdir);
+  snprintf (countname, sizeof countname, "%s/count", tmpdir);
+
+  test_get_string ();
+  test_capture ();
+
+  for (i = 0; i < rounds; i++)
+    {
+      race ("spawn lock", nclients, 0, 0);
+      race ("launch", nclients, 1, 0);
+      race ("launch, first gives up", nclients, 1, 1);
+    }
+
+  /* Give detached servers time to finish before cleaning up.  */
+  usleep (300000);
+  unlink (readyname);
+  unlink (countname);
+  snprintf (readyname, sizeof readyname, "%s/gpgex-spawn-sentinel-%lu",
+            tmpdir, (unsigned long) getuid ());
+  unlink (readyname);
+  rmdir (tmpdir);
+
+  return !!errorcount;
+}
@@ -0,0 +1,167 @@
+/* t-homedir.c - tests for the socket directory computation
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "homedir.h"
+#include "t-support.h"
+
+#define V22	GPGEX_GNUPG_VERSION (2, 2, 41)
+#define V23	GPGEX_GNUPG_VERSION (2, 3, 0)
+#define V24	GPGEX_GNUPG_VERSION (2, 4, 5)
+
+#define BIN	"C:\\Program Files (x86)\\GnuPG\\bin"
+#define ROAMING	"C:\\Users\\Alice\\AppData\\Roaming"
+#define LOCAL	"C:\\Users\\Alice\\AppData\\Local"
+
+
+/* Installation layouts and the socket directory "gpgconf --list-dirs
+   socketdir" reports for them.  NULL means that the socket directory
+   can't be computed without gpgconf.  The rules are those of
+   common/homedir.c in GnuPG 2.2 and 2.4.  */
+static struct
+{
+  const char *desc;
+  struct gpgex_homedir_env_s env;
+  const char *socketdir;
+} fixtures[] =
+  {
+    { "2.4 standard",
+      { V24, BIN, 0, NULL, NULL, NULL, ROAMING, LOCAL },
+      LOCAL "\\gnupg" },
+    { "2.3 standard",
+      { V23, BIN, 0, NULL, NULL, NULL, ROAMING, LOCAL },
+      LOCAL "\\gnupg" },
+    { "2.4 trailing slash",
+      { V24, BIN, 0, NULL, NULL, NULL, ROAMING "\\", LOCAL "/" },
+      LOCAL "\\gnupg" },
+    { "2.4 GNUPGHOME is the default",
+      { V24, BIN, 0, NULL, "c:/users/alice/appdata/roaming/gnupg/", NULL,
+        ROAMING, LOCAL },
+      LOCAL "\\gnupg" },
+    { "2.4 HomeDir is the default",
+      { V24, BIN, 0, NULL, NULL, ROAMING "\\gnupg", ROAMING, LOCAL },
+      LOCAL "\\gnupg" },
+    { "2.4 empty GNUPGHOME",
+      { V24, BIN, 0, NULL, "", NULL, ROAMING, LOCAL },
+      LOCAL "\\gnupg" },
+    { "2.4 GNUPGHOME elsewhere",
+      { V24, BIN, 0, NULL, "D:\\keys", NULL, ROAMING, LOCAL },
+      NULL },
+    { "2.4 HomeDir elsewhere",
+      { V24, BIN, 0, NULL, NULL, "D:\\keys", ROAMING, LOCAL },
+      NULL },
+    { "2.4 GNUPGHOME wins over HomeDir",
+      { V24, BIN, 0, NULL, ROAMING "\\gnupg", "D:\\keys", ROAMING, LOCAL },
+      LOCAL "\\gnupg" },
+    { "2.4 unexpanded variable",
+      { V24, BIN, 0, NULL, NULL, "%APPDATA%\\gnupg", ROAMING, LOCAL },
+      NULL },
+    { "2.4 portable",
+      { V24, "D:\\Stick\\GnuPG\\bin", 1, "", NULL, NULL, ROAMING, LOCAL },
+      "D:\\Stick\\GnuPG\\gnupg" },
+    { "2.4 portable with comments",
+      { V24, "D:\\Stick\\GnuPG\\bin", 1, "# portable\r\n\r\n", NULL, NULL,
+        ROAMING, LOCAL },
+      "D:\\Stick\\GnuPG\\gnupg" },
+    { "2.4 portable with keywords",
+      { V24, "D:\\Stick\\GnuPG\\bin", 1, "rootdir=E:\\gnupg\n", NULL, NULL,
+        ROAMING, LOCAL },
+      NULL },
+    { "2.4 portable, unreadable gpgconf.ctl",
+      { V24, "D:\\Stick\\GnuPG\\bin", 1, NULL, NULL, NULL, ROAMING, LOCAL },
+      NULL },
+    { "2.4 no LOCALAPPDATA",
+      { V24, BIN, 0, NULL, NULL, NULL, ROAMING, NULL },
+      NULL },
+    { "2.2 standard",
+      { V22, BIN, 0, NULL, NULL, NULL, ROAMING, LOCAL },
+      ROAMING "\\gnupg" },
+    { "2.2 GNUPGHOME elsewhere",
+      { V22, BIN, 0, NULL, "D:/keys/", NULL, ROAMING, LOCAL },
+      "D:\\keys" },
+    { "2.2 HomeDir elsewhere",
+      { V22, BIN, 0, NULL, NULL, "\\\\server\\share\\keys", ROAMING, LOCAL },
+      "\\\\server\\share\\keys" },
+    { "2.2 relative GNUPGHOME",
+      { V22, BIN, 0, NULL, "keys", NULL, ROAMING, LOCAL },
+      NULL },
+    { "2.2 portable",
+      { V22, BIN, 1, "", NULL, NULL, ROAMING, LOCAL },
+      NULL },
+    { "unknown version",
+      { 0, BIN, 0, NULL, NULL, NULL, ROAMING, LOCAL },
+      NULL },
+    { "no bindir",
+      { V24, NULL, 0, NULL, NULL, NULL, ROAMING, LOCAL },
+      NULL }
+  };
+
+
+static void
+test_socketdir (void)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof fixtures / sizeof *fixtures; i++)
+    {
+      char *dir = gpgex_compute_socketdir (&fixtures[i].env);
+      const char *want = fixtures[i].socketdir;
+
+      if ((!dir != !want) || (dir && strcmp (dir, want)))
+        fail ("%s: got '%s', want '%s'", fixtures[i].desc,
+              dir ? dir : "(null)", want ? want : "(null)");
+      else
+        info ("%-36s %s", fixtures[i].desc, dir ? dir : "(gpgconf)");
+      free (dir);
+    }
+}
+
+
+static void
+test_version (void)
+{
+  check (gpgex_parse_gnupg_version ("2.4.5") == V24);
+  check (gpgex_parse_gnupg_version ("2.2.41-beta12") == V22);
+  check (gpgex_parse_gnupg_version ("2.3.0.12345") == V23);
+  check (gpgex_parse_gnupg_version ("2.4") == 0);
+  check (gpgex_parse_gnupg_version ("2.x.1") == 0);
+  check (gpgex_parse_gnupg_version ("2.256.1") == 0);
+  check (gpgex_parse_gnupg_version ("") == 0);
+  check (gpgex_parse_gnupg_version (NULL) == 0);
+}
+
+
+int
+main (int argc, char **argv)
+{
+  t_init (argc, argv);
+
+  test_version ();
+  test_socketdir ();
+
+  return !!errorcount;
+}
@@ -0,0 +1,274 @@
+/* t-metacache.c - tests for the metadata cache
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+/* Besides the tests of the cache this measures the lookups done for
+   each file the Explorer shows (IsMemberOf of the icon overlays),
+   alone and while a writer fills the cache like the metadata worker
+   does.  Lookups take no lock; with the writer none of them may miss,
+   give up or see a half written entry.  Usage:
+
+     t-metacache [--verbose] [FILES [ROUNDS]]  */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "metacache.h"
+#include "t-support.h"
+
+
+static void
+make_meta (struct gpgex_meta_s *meta, unsigned int flags, unsigned int id)
+{
+  memset (meta, 0, sizeof *meta);
+  meta->flags = flags;
+  meta->nrecipients = 1;
+  memcpy (meta->recipients[0], &id, sizeof id);
+}
+
+
+static void
+test_basic (void)
+{
+  struct gpgex_meta_s meta, pending, got;
+
+  gpgex_metacache_clear ();
+  make_meta (&meta, GPGEX_META_OPENPGP | GPGEX_META_ENCRYPTED, 1);
+  memset (&pending, 0, sizeof pending);
+  pending.flags = GPGEX_META_PENDING;
+
+  check (gpgex_metacache_get ("C:\\a\\x.gpg", &got) == GPGEX_META_MISS);
+  check (gpgex_metacache_put ("C:\\a\\x.gpg", &meta, 0) == 1);
+  check (gpgex_metacache_get ("C:\\a\\x.gpg", &got) == GPGEX_META_HIT);
+  check (!memcmp (&got, &meta, sizeof meta));
+
+  /* Names are compared like the file system does.  */
+  check (gpgex_metacache_get ("c:/A/X.GPG", &got) == GPGEX_META_HIT);
+  check (gpgex_metacache_get ("C:\\a\\x.gp", &got) == GPGEX_META_MISS);
+  check (gpgex_metacache_get ("C:\\a\\x.gpgg", &got) == GPGEX_META_MISS);
+
+  /* Storing the same again is no change.  */
+  check (gpgex_metacache_put ("C:\\a\\x.gpg", &meta, 1) == 0);
+
+  /* A pending entry does not replace a real one, but is replaced.  */
+  check (gpgex_metacache_put ("C:\\a\\x.gpg", &pending, 0) == 0);
+  check (gpgex_metacache_get ("C:\\a\\x.gpg", &got) == GPGEX_META_HIT);
+  check (got.flags == meta.flags);
+  check (gpgex_metacache_put ("C:\\a\\y.gpg", &pending, 0) == 1);
+  check (gpgex_metacache_put ("C:\\a\\y.gpg", &meta, 0) == 1);
+  check (gpgex_metacache_get ("C:\\a\\y.gpg", &got) == GPGEX_META_HIT);
+  check (got.flags == meta.flags);
+
+  gpgex_metacache_clear ();
+  check (gpgex_metacache_get ("C:\\a\\x.gpg", &got) == GPGEX_META_MISS);
+}
+
+
+static void
+test_eviction (void)
+{
+  struct gpgex_meta_s meta, got;
+  char name[64];
+  unsigned int i, n = 50000;
+
+  gpgex_metacache_clear ();
+  for (i = 0; i < n; i++)
+    {
+      snprintf (name, sizeof name, "C:\\dir\\file%u.gpg", i);
+      make_meta (&meta, GPGEX_META_OPENPGP, i);
+      if (gpgex_metacache_put (name, &meta, 0) != 1)
+        {
+          fail ("put %u failed", i);
+          break;
+        }
+    }
+
+  /* The table is far smaller than N; the newest entries are kept and
+     each entry is the one stored for its name.  */
+  for (i = 0; i < n; i++)
+    {
+      snprintf (name, sizeof name, "C:\\dir\\file%u.gpg", i);
+      if (gpgex_metacache_get (name, &got) == GPGEX_META_HIT)
+        {
+          make_meta (&meta, GPGEX_META_OPENPGP, i);
+          check (!memcmp (&got, &meta, sizeof meta));
+        }
+      else if (i >= n - 16)
+        fail ("recent entry %u was dropped", i);
+    }
+  gpgex_metacache_clear ();
+}
+
+
+/* The names of the benchmark.  Those with an even index are in the
+   cache with their index as the key ID.  */
+static char **names;
+static unsigned int nnames;
+static volatile int stop_writer;
+
+
+static void *
+writer_thread (void *arg)
+{
+  struct gpgex_meta_s meta;
+  unsigned long *r_puts = arg;
+  unsigned int i = 0;
+  unsigned long gen = 0;
+
+  /* Store the cached entries again and again, like the worker
+     refreshing stale entries.  The issuer and the second recipient
+     are the same in each version; a torn read would mix them.  */
+  while (!stop_writer)
+    {
+      make_meta (&meta, GPGEX_META_OPENPGP | GPGEX_META_ENCRYPTED, i);
+      gen++;
+      memcpy (meta.recipients[1], &gen, sizeof gen);
+      memcpy (meta.issuer, &gen, sizeof gen);
+      gpgex_metacache_put (names[i], &meta, 0);
+      (*r_puts)++;
+      i += 2;
+      if (i >= nnames)
+        i = 0;
+    }
+  return NULL;
+}
+
+
+/* Look up all names ROUNDS times.  Returns the time per lookup in
+   nanoseconds and stores the number of misses of cached names at
+   R_LOST and the number of busy lookups at R_BUSY.  */
+static double
+lookup_all (unsigned int rounds, unsigned long *r_lost,
+            unsigned long *r_busy)
+{
+  struct gpgex_meta_s got;
+  uint64_t start, usec;
+  unsigned int r, i;
+  int res;
+
+  *r_lost = *r_busy = 0;
+  start = t_now ();
+  for (r = 0; r < rounds; r++)
+    for (i = 0; i < nnames; i++)
+      {
+        res = gpgex_metacache_get (names[i], &got);
+        if (res == GPGEX_META_BUSY)
+          (*r_busy)++;
+        else if (i % 2)
+          check (res == GPGEX_META_MISS);
+        else if (res == GPGEX_META_MISS)
+          (*r_lost)++;
+        else
+          {
+            check (!memcmp (got.recipients[0], &i, sizeof i));
+            check (!memcmp (got.recipients[1], got.issuer, 8));
+          }
+      }
+  usec = t_now () - start;
+  return (double) usec * 1000 / ((double) rounds * nnames);
+}
+
+
+static void
+bench_lookup (unsigned int nfiles, unsigned int rounds)
+{
+  struct gpgex_meta_s meta;
+  char name[128];
+  pthread_t writer;
+  unsigned long lost, busy, puts;
+  double ns;
+  unsigned int i;
+
+  /* A directory as the Explorer shows it.  */
+  nnames = nfiles;
+  names = calloc (nnames, sizeof *names);
+  if (!names)
+    abort ();
+  for (i = 0; i < nnames; i++)
+    {
+      snprintf (name, sizeof name,
+                "C:\\Users\\someone\\Documents\\Project\\report-%u.pdf.gpg",
+                i);
+      names[i] = strdup (name);
+      if (!names[i])
+        abort ();
+    }
+  gpgex_metacache_clear ();
+  for (i = 0; i < nnames; i += 2)
+    {
+      make_meta (&meta, GPGEX_META_OPENPGP | GPGEX_META_ENCRYPTED, i);
+      gpgex_metacache_put (names[i], &meta, 0);
+    }
+
+  ns = lookup_all (rounds, &lost, &busy);
+  info ("%u files, %u rounds: %.0f ns per lookup", nnames, rounds, ns);
+  check (!busy);
+  /* The cache may be too small for all of them.  */
+  if (nnames <= 1024)
+    check (!lost);
+
+  puts = 0;
+  stop_writer = 0;
+  if (pthread_create (&writer, NULL, writer_thread, &puts))
+    fail ("pthread_create failed");
+  else
+    {
+      ns = lookup_all (rounds, &lost, &busy);
+      stop_writer = 1;
+      pthread_join (writer, NULL);
+      info ("  with a writer: %.0f ns per lookup, %lu stores", ns, puts);
+      /* The writer only stores entries again.  */
+      check (!busy);
+      if (nnames <= 1024)
+        check (!lost);
+    }
+
+  gpgex_metacache_clear ();
+  for (i = 0; i < nnames; i++)
+    free (names[i]);
+  free (names);
+}
+
+
+int
+main (int argc, char **argv)
+{
+  unsigned int nfiles = 1000;
+  unsigned int rounds = 100;
+  int i;
+
+  i = t_init (argc, argv) + 1;
+  if (i < argc)
+    nfiles = strtoul (argv[i++], NULL, 10);
+  if (i < argc)
+    rounds = strtoul (argv[i++], NULL, 10);
+
+  test_basic ();
+  test_eviction ();
+  if (nfiles && rounds)
+    bench_lookup (nfiles, rounds);
+
+  return !!errorcount;
+}
@@ -0,0 +1,180 @@
+/* t-pathclass.c - tests for the path classification and I/O budget
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pathclass.h"
+#include "t-support.h"
+
+
+static void
+test_unc (void)
+{
+  check (gpgex_path_is_unc ("\\\\server\\share\\file"));
+  check (gpgex_path_is_unc ("//server/share/file"));
+  check (gpgex_path_is_unc ("\\\\?\\UNC\\server\\share\\file"));
+  check (gpgex_path_is_unc ("\\\\?\\unc\\server\\share\\file"));
+  check (!gpgex_path_is_unc ("\\\\?\\C:\\file"));
+  check (!gpgex_path_is_unc ("\\\\.\\C:\\file"));
+  check (!gpgex_path_is_unc ("\\\\?\\UNCX\\file"));
+  check (!gpgex_path_is_unc ("C:\\file"));
+  check (!gpgex_path_is_unc ("\\file"));
+  check (!gpgex_path_is_unc ("file"));
+  check (!gpgex_path_is_unc (""));
+}
+
+
+static void
+test_classify (void)
+{
+  static const struct
+  {
+    const char *name;
+    gpgex_volume_kind_t volume;
+    unsigned long attributes;
+    gpgex_path_type_t expect;
+  } tests[] =
+    {
+      { "C:\\a", GPGEX_VOLUME_FIXED, 0, GPGEX_PATH_LOCAL },
+      { "C:\\a", GPGEX_VOLUME_FIXED, GPGEX_ATTR_DIRECTORY,
+        GPGEX_PATH_LOCAL },
+      { "E:\\a", GPGEX_VOLUME_REMOVABLE, 0, GPGEX_PATH_REMOVABLE },
+      { "Z:\\a", GPGEX_VOLUME_REMOTE, 0, GPGEX_PATH_NETWORK },
+      { "C:\\a", GPGEX_VOLUME_UNKNOWN, 0, GPGEX_PATH_UNKNOWN },
+
+      /* A UNC name is a network path whatever the volume says.  */
+      { "\\\\srv\\share\\a", GPGEX_VOLUME_FIXED, 0, GPGEX_PATH_NETWORK },
+      { "\\\\srv\\share\\a", GPGEX_VOLUME_UNKNOWN, 0, GPGEX_PATH_NETWORK },
+      { "\\\\?\\UNC\\srv\\share\\a", GPGEX_VOLUME_UNKNOWN,
+        GPGEX_ATTR_OFFLINE, GPGEX_PATH_NETWORK },
+
+      /* Placeholders of sync clients on local and removable
+         drives.  */
+      { "C:\\a", GPGEX_VOLUME_FIXED, GPGEX_ATTR_OFFLINE,
+        GPGEX_PATH_PLACEHOLDER },
+      { "C:\\a", GPGEX_VOLUME_FIXED, GPGEX_ATTR_RECALL_ON_OPEN,
+        GPGEX_PATH_PLACEHOLDER },
+      { "C:\\a", GPGEX_VOLUME_FIXED,
+        GPGEX_ATTR_RECALL_ON_DATA_ACCESS | 0x20, GPGEX_PATH_PLACEHOLDER },
+      { "E:\\a", GPGEX_VOLUME_REMOVABLE, GPGEX_ATTR_OFFLINE,
+        GPGEX_PATH_PLACEHOLDER },
+      { "\\\\?\\C:\\a", GPGEX_VOLUME_FIXED, 0, GPGEX_PATH_LOCAL }
+    };
+  gpgex_path_type_t type;
+  size_t i;
+
+  for (i = 0; i < sizeof tests / sizeof tests[0]; i++)
+    {
+      type = gpgex_classify_path (tests[i].name, tests[i].volume,
+                                  tests[i].attributes);
+      if (type != tests[i].expect)
+        fail ("test %u (%s): got %s, want %s", (unsigned int) i,
+              tests[i].name, gpgex_path_type_name (type),
+              gpgex_path_type_name (tests[i].expect));
+    }
+}
+
+
+static void
+test_policy (void)
+{
+  /* Only local and removable files are ever opened.  */
+  check (gpgex_io_policy (GPGEX_PATH_LOCAL)->allow_open);
+  check (gpgex_io_policy (GPGEX_PATH_REMOVABLE)->allow_open);
+  check (!gpgex_io_policy (GPGEX_PATH_NETWORK)->allow_open);
+  check (!gpgex_io_policy (GPGEX_PATH_PLACEHOLDER)->allow_open);
+  check (!gpgex_io_policy (GPGEX_PATH_UNKNOWN)->allow_open);
+  check (!gpgex_io_policy ((gpgex_path_type_t) 1000)->allow_open);
+
+  check (gpgex_io_policy (GPGEX_PATH_LOCAL)->max_bytes > 0);
+  check (gpgex_io_policy (GPGEX_PATH_REMOVABLE)->budget_ms
+         <= gpgex_io_policy (GPGEX_PATH_LOCAL)->budget_ms);
+
+  check (!strcmp (gpgex_path_type_name (GPGEX_PATH_NETWORK), "network"));
+  check (!strcmp (gpgex_path_type_name ((gpgex_path_type_t) 1000),
+                  "unknown"));
+}
+
+
+static void
+test_budget (void)
+{
+  struct gpgex_io_budget_s budget;
+  uint64_t local_us, removable_us;
+  int i;
+
+  local_us = gpgex_io_policy (GPGEX_PATH_LOCAL)->budget_ms * 1000ULL;
+  removable_us = gpgex_io_policy (GPGEX_PATH_REMOVABLE)->budget_ms * 1000ULL;
+
+  gpgex_io_budget_init (&budget);
+  check (!budget.denied);
+
+  /* Files which are never opened count as denied.  */
+  check (!gpgex_io_budget_allow (&budget, GPGEX_PATH_NETWORK));
+  check (!gpgex_io_budget_allow (&budget, GPGEX_PATH_PLACEHOLDER));
+  check (!gpgex_io_budget_allow (&budget, (gpgex_path_type_t) 1000));
+  check (budget.denied == 3);
+
+  /* The budget lasts until the time is used up.  */
+  check (gpgex_io_budget_allow (&budget, GPGEX_PATH_LOCAL));
+  gpgex_io_budget_charge (&budget, GPGEX_PATH_LOCAL, local_us - 1);
+  check (gpgex_io_budget_allow (&budget, GPGEX_PATH_LOCAL));
+  gpgex_io_budget_charge (&budget, GPGEX_PATH_LOCAL, 1);
+  check (!gpgex_io_budget_allow (&budget, GPGEX_PATH_LOCAL));
+  check (budget.denied == 4);
+
+  /* Each type has a budget of its own.  */
+  check (gpgex_io_budget_allow (&budget, GPGEX_PATH_REMOVABLE));
+  for (i = 0; i < 10; i++)
+    gpgex_io_budget_charge (&budget, GPGEX_PATH_REMOVABLE,
+                            removable_us / 10);
+  check (!gpgex_io_budget_allow (&budget, GPGEX_PATH_REMOVABLE));
+  check (budget.used_us[GPGEX_PATH_REMOVABLE] == removable_us / 10 * 10);
+
+  /* A charge for a bad type is ignored.  */
+  gpgex_io_budget_charge (&budget, (gpgex_path_type_t) 1000, 1);
+  gpgex_io_budget_charge (&budget, GPGEX_PATH_N_TYPES, 1);
+
+  /* A new menu starts over.  */
+  gpgex_io_budget_init (&budget);
+  check (gpgex_io_budget_allow (&budget, GPGEX_PATH_LOCAL));
+  check (gpgex_io_budget_allow (&budget, GPGEX_PATH_REMOVABLE));
+  check (!budget.denied);
+}
+
+
+int
+main (int argc, char **argv)
+{
+  t_init (argc, argv);
+
+  test_unc ();
+  test_classify ();
+  test_policy ();
+  test_budget ();
+
+  return !!errorcount;
+}
@@ -0,0 +1,453 @@
+/* t-pgpinfo.c - tests for the OpenPGP header parser
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+/* Besides tests on known packets this runs the fuzz target on random
+   and on mutated input, measures how many small files the parser
+   classifies per second, binary and armored, and measures its
+   throughput on large armored and cleartext signed files, which are
+   read to the end.  Usage:
+
+     t-pgpinfo [--verbose] [ITERATIONS [FILES [MEGABYTES]]]  */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pgpinfo.h"
+#include "t-support.h"
+
+int LLVMFuzzerTestOneInput (const unsigned char *data, size_t size);
+
+/* The bytes read from each file by the metadata worker.  */
+#define HEAD_SIZE 4096
+
+/* A public key encrypted session key for the key ID 0102030405060708,
+   followed by the start of an encrypted data packet.  */
+static const unsigned char encrypted[] =
+  {
+    0xc1, 0x0e, 0x03, 1, 2, 3, 4, 5, 6, 7, 8, 0x01, 0x00, 0x08, 0xff,
+    0x00,
+    0xd2, 0x01, 0x01
+  };
+
+/* A one-pass signature, a literal data packet named "x.txt" and a
+   version 4 signature with the issuer A1A2A3A4A5A6A7A8 in the
+   unhashed area.  */
+static const unsigned char signedmsg[] =
+  {
+    0xc4, 0x0d, 0x03, 0x00, 0x08, 0x01,
+    0xa1, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0x01,
+    0xcb, 0x0e, 'b', 5, 'x', '.', 't', 'x', 't', 0, 0, 0, 0, 'a', 'b', 'c',
+    0xc2, 0x14, 0x04, 0x00, 0x01, 0x08, 0x00, 0x00, 0x00, 0x0a,
+    0x09, 0x10, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8,
+    0x12, 0x34
+  };
+
+/* The start of a public key packet in the old format.  */
+static const unsigned char pubkey[] =
+  {
+    0x99, 0x00, 0x04, 0x04, 0x00, 0x00, 0x00
+  };
+
+
+/* Return the LEN bytes at DATA armored as TYPE in a new buffer and
+   store its length at R_LEN.  */
+static char *
+armor (const char *type, const unsigned char *data, size_t len,
+       size_t *r_len)
+{
+  static const char b64[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  char *buffer, *p;
+  size_t i, col;
+  unsigned int v;
+
+  buffer = malloc (len / 3 * 4 + len / 48 + 256);
+  if (!buffer)
+    abort ();
+  p = buffer + sprintf (buffer, "-----BEGIN PGP %s-----\r\n"
+                        "Comment: test\r\n\r\n", type);
+  col = 0;
+  for (i = 0; i < len; i += 3)
+    {
+      v = data[i] << 16;
+      if (i + 1 < len)
+        v |= data[i + 1] << 8;
+      if (i + 2 < len)
+        v |= data[i + 2];
+      *p++ = b64[(v >> 18) & 63];
+      *p++ = b64[(v >> 12) & 63];
+      *p++ = i + 1 < len ? b64[(v >> 6) & 63] : '=';
+      *p++ = i + 2 < len ? b64[v & 63] : '=';
+      if ((col += 4) == 64)
+        {
+          *p++ = '\n';
+          col = 0;
+        }
+    }
+  p += sprintf (p, "\n=AAAA\n-----END PGP %s-----\n", type);
+  *r_len = p - buffer;
+  return buffer;
+}
+
+
+static const struct gpgex_pgp_info_s *
+parse (struct gpgex_pgp_parser_s *parser, const void *data, size_t len)
+{
+  gpgex_pgp_init (parser, 0, 0);
+  gpgex_pgp_feed (parser, data, len);
+  return gpgex_pgp_finish (parser);
+}
+
+
+static void
+test_known (void)
+{
+  static const unsigned char keyid[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+  static const unsigned char issuer[8] =
+    { 0xa1, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8 };
+  struct gpgex_pgp_parser_s parser;
+  const struct gpgex_pgp_info_s *info;
+  char *text;
+  size_t len;
+
+  info = parse (&parser, encrypted, sizeof encrypted);
+  check (info->is_openpgp && !info->invalid);
+  check (info->has_pubkey_enc && info->has_encrypted);
+  check (info->nrecipients == 1 && !memcmp (info->recipients[0], keyid, 8));
+  check (info->armor == GPGEX_PGP_ARMOR_NONE);
+
+  info = parse (&parser, signedmsg, sizeof signedmsg);
+  check (info->is_openpgp && !info->invalid);
+  check (info->has_signature && info->has_literal);
+  check (!info->has_encrypted);
+  check (info->have_issuer && !memcmp (info->issuer, issuer, 8));
+  check (!strcmp (info->filename, "x.txt"));
+
+  /* Cut off in the literal data packet.  */
+  info = parse (&parser, signedmsg, 23);
+  check (info->has_literal && !strcmp (info->filename, "x.tx"));
+
+  info = parse (&parser, pubkey, sizeof pubkey);
+  check (info->is_openpgp && info->has_pubkey);
+
+  text = armor ("MESSAGE", encrypted, sizeof encrypted, &len);
+  info = parse (&parser, text, len);
+  check (info->armor == GPGEX_PGP_ARMOR_MESSAGE);
+  check (info->has_pubkey_enc && info->nrecipients == 1);
+  free (text);
+
+  text = armor ("PUBLIC KEY BLOCK", pubkey, sizeof pubkey, &len);
+  info = parse (&parser, text, len);
+  check (info->armor == GPGEX_PGP_ARMOR_PUBLIC_KEY && info->has_pubkey);
+  free (text);
+
+  info = parse (&parser, "Hello world\n", 12);
+  check (info->invalid && !info->is_openpgp);
+  info = parse (&parser, "", 0);
+  check (info->invalid);
+
+  /* The byte limit.  */
+  gpgex_pgp_init (&parser, 10, 0);
+  check (gpgex_pgp_feed (&parser, signedmsg, sizeof signedmsg)
+         == GPGEX_PGP_DONE);
+  info = gpgex_pgp_finish (&parser);
+  check (info->truncated && info->consumed == 10);
+}
+
+
+/* Run the fuzz target on ITERATIONS random inputs and on as many
+   mutations of the known packets.  */
+static void
+run_fuzz (unsigned int iterations)
+{
+  static const struct { const void *data; size_t len; } seeds[] =
+    {
+      { encrypted, sizeof encrypted },
+      { signedmsg, sizeof signedmsg },
+      { pubkey, sizeof pubkey }
+    };
+  unsigned char buffer[1024];
+  char *text;
+  size_t len, armorlen;
+  unsigned int i, k, nflips;
+  uint64_t start;
+
+  start = t_now ();
+  t_srand (4711);
+  for (i = 0; i < iterations; i++)
+    {
+      /* Random bytes; those with the high bit set look like packets
+         and are made more likely.  */
+      len = t_rand () % sizeof buffer;
+      for (k = 0; k < len; k++)
+        buffer[k] = t_rand () % 3 ? t_rand () | 0x80 : t_rand ();
+      LLVMFuzzerTestOneInput (buffer, len);
+
+      /* A known packet with some bytes changed, in binary or
+         armored.  */
+      k = i % (sizeof seeds / sizeof seeds[0]);
+      len = seeds[k].len;
+      buffer[0] = t_rand ();
+      memcpy (buffer + 1, seeds[k].data, len);
+      for (nflips = t_rand () % 4; nflips; nflips--)
+        buffer[1 + t_rand () % len] = t_rand ();
+      len = 1 + t_rand () % len;
+      if (i % 2)
+        LLVMFuzzerTestOneInput (buffer, len + 1);
+      else
+        {
+          text = armor ("MESSAGE", buffer + 1, len, &armorlen);
+          if (armorlen < sizeof buffer)
+            {
+              memcpy (buffer + 1, text, armorlen);
+              for (nflips = t_rand () % 3; nflips; nflips--)
+                buffer[1 + t_rand () % armorlen] = t_rand ();
+              LLVMFuzzerTestOneInput (buffer, armorlen + 1);
+            }
+          free (text);
+        }
+    }
+  info ("fuzz: %u inputs in %llu ms", iterations * 2,
+        (unsigned long long) (t_now () - start) / 1000);
+}
+
+
+static void
+bench_one (const char *what, const void *data, size_t len)
+{
+  struct gpgex_pgp_parser_s parser;
+  const struct gpgex_pgp_info_s *info;
+  uint64_t start, usec;
+
+  start = t_now ();
+  info = parse (&parser, data, len);
+  usec = t_now () - start;
+  check (!info->invalid && !info->truncated && info->consumed == len);
+  info ("%-12s %6u MiB in %6llu us: %7.1f MiB/s", what,
+        (unsigned int) (len >> 20), (unsigned long long) usec,
+        usec ? (double) len / usec * 1000000 / (1 << 20) : 0.0);
+}
+
+
+/* Store a new format header for a packet with TAG and a body of LEN
+   bytes at P and return its length.  */
+static size_t
+put_header (unsigned char *p, int tag, size_t len)
+{
+  p[0] = 0xc0 | tag;
+  if (len < 192)
+    {
+      p[1] = len;
+      return 2;
+    }
+  if (len < 8384)
+    {
+      len -= 192;
+      p[1] = (len >> 8) + 192;
+      p[2] = len;
+      return 3;
+    }
+  p[1] = 0xff;
+  p[2] = len >> 24;
+  p[3] = len >> 16;
+  p[4] = len >> 8;
+  p[5] = len;
+  return 6;
+}
+
+
+/* Store a small message of the kind K at P, which has room for 16
+   KiB, and return its length: an encrypted message for 1 to 3
+   recipients, a signed message or a public key, each with a body of
+   up to 12 KiB.  */
+static size_t
+make_message (unsigned char *p, unsigned int k)
+{
+  size_t len = 0, body;
+  unsigned int i, n;
+
+  body = t_rand () % (12 << 10);
+  switch (k % 3)
+    {
+    case 0:
+      for (n = 1 + t_rand () % 3; n; n--)
+        {
+          memcpy (p + len, encrypted, 16);
+          len += 16;
+        }
+      len += put_header (p + len, 18, body + 1);
+      p[len++] = 1;
+      break;
+    case 1:
+      /* The one-pass signature, the literal data and the signature
+         of SIGNEDMSG.  */
+      memcpy (p + len, signedmsg, 15);
+      len += 15;
+      len += put_header (p + len, 11, body + 11);
+      memcpy (p + len, "b\x05x.txt\0\0\0\0", 11);
+      len += 11;
+      break;
+    default:
+      len += put_header (p + len, 6, body + 1);
+      p[len++] = 4;
+      break;
+    }
+  for (i = 0; i < body; i++)
+    p[len++] = t_rand ();
+  if (k % 3 == 1)
+    {
+      memcpy (p + len, signedmsg + 31, sizeof signedmsg - 31);
+      len += sizeof signedmsg - 31;
+    }
+  return len;
+}
+
+
+/* Classify NFILES small messages, as binary and as armored, from
+   their first HEAD_SIZE bytes like the metadata worker does for each
+   file shown by the Explorer.  Most of a binary file is skipped by
+   the packet lengths, so the number of files per second is reported
+   and not the bytes.  */
+static void
+bench_files (unsigned int nfiles)
+{
+  struct gpgex_pgp_parser_s parser;
+  const struct gpgex_pgp_info_s *info;
+  unsigned char **files;
+  size_t *lengths;
+  uint64_t start, usec;
+  unsigned int i, pass, bad;
+  char *text;
+
+  files = calloc (nfiles, sizeof *files);
+  lengths = calloc (nfiles, sizeof *lengths);
+  if (!files || !lengths)
+    abort ();
+
+  t_srand (17);
+  for (pass = 0; pass < 2; pass++)
+    {
+      for (i = 0; i < nfiles; i++)
+        {
+          files[i] = malloc (16 << 10);
+          if (!files[i])
+            abort ();
+          lengths[i] = make_message (files[i], i);
+          if (pass)
+            {
+              text = armor (i % 3 == 2 ? "PUBLIC KEY BLOCK" : "MESSAGE",
+                            files[i], lengths[i], &lengths[i]);
+              free (files[i]);
+              files[i] = (unsigned char *) text;
+            }
+        }
+
+      bad = 0;
+      start = t_now ();
+      for (i = 0; i < nfiles; i++)
+        {
+          gpgex_pgp_init (&parser, HEAD_SIZE, 0);
+          gpgex_pgp_feed (&parser, files[i],
+                          lengths[i] < HEAD_SIZE ? lengths[i] : HEAD_SIZE);
+          info = gpgex_pgp_finish (&parser);
+          if (!info->is_openpgp || info->invalid)
+            bad++;
+        }
+      usec = t_now () - start;
+      check (!bad);
+      info ("%-12s %6u files in %6llu us: %8.0f files/s",
+            pass ? "armored" : "binary", nfiles, (unsigned long long) usec,
+            usec ? (double) nfiles / usec * 1000000 : 0.0);
+
+      for (i = 0; i < nfiles; i++)
+        free (files[i]);
+    }
+  free (files);
+  free (lengths);
+}
+
+
+/* Measure the throughput on files of MEGABYTES MiB which have to be
+   read to the end: armored literal data and the text of a cleartext
+   signature.  */
+static void
+bench_throughput (unsigned int megabytes)
+{
+  size_t size = (size_t) megabytes << 20;
+  unsigned char *data;
+  char *text;
+  size_t i, len;
+
+  /* A literal data packet with a five octet length.  The buffer is
+     used again for the cleartext signature.  */
+  data = malloc (size + 256);
+  if (!data)
+    abort ();
+  len = put_header (data, 11, size);
+  for (i = 0; i < size; i++)
+    data[len + i] = t_rand ();
+
+  text = armor ("MESSAGE", data, size + len, &len);
+  bench_one ("armored", text, len);
+  free (text);
+
+  len = sprintf ((char *) data, "-----BEGIN PGP SIGNED MESSAGE-----\n"
+                 "Hash: SHA256\n\n");
+  for (i = len; i < size; i++)
+    data[i] = (i % 72) ? 'a' + i % 26 : '\n';
+  len = size;
+  len += sprintf ((char *) data + len, "\n-----BEGIN PGP SIGNATURE-----\n\n"
+                  "wnUEARYIAB0WIQQ=\n=AAAA\n-----END PGP SIGNATURE-----\n");
+  bench_one ("cleartext", data, len);
+
+  free (data);
+}
+
+
+int
+main (int argc, char **argv)
+{
+  unsigned int iterations = 20000;
+  unsigned int nfiles = 10000;
+  unsigned int megabytes = 16;
+  int i;
+
+  i = t_init (argc, argv) + 1;
+  if (i < argc)
+    iterations = strtoul (argv[i++], NULL, 10);
+  if (i < argc)
+    nfiles = strtoul (argv[i++], NULL, 10);
+  if (i < argc)
+    megabytes = strtoul (argv[i++], NULL, 10);
+
+  test_known ();
+  run_fuzz (iterations);
+  if (nfiles)
+    bench_files (nfiles);
+  if (megabytes)
+    bench_throughput (megabytes);
+
+  return !!errorcount;
+}
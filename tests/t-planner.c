@@ -0,0 +1,923 @@
+/* t-planner.c - tests for the submission planner
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+/* Besides the tests of the planner functions this runs a selection
+   of files against a mock UI server, once as one session and once
+   split into shards in several ways, and reports the wall time of
+   each.  A session of the mock server costs a fixed setup time plus
+   a time for each file and for each byte.  It also orders shuffled
+   selections from synthetic directory trees for locality and reports
+   the time taken and the number of directory changes, and the time
+   to find the redundant files of such selections.  Finally it
+   compares encrypting many files as one archive with encrypting
+   them one by one.  Usage:
+
+     t-planner [--verbose] [FILES [SHARDS]]  */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "planner.h"
+#include "tarstream.h"
+#include "t-support.h"
+
+/* The cost model of the mock server in microseconds.  */
+#define SESSION_SETUP 20000
+#define FILE_COST 200
+#define BYTES_PER_USEC 4096
+
+/* The per file cost given to the planner, as in client.cc.  */
+#define PER_FILE_COST (64 * 1024)
+
+#define MAX_SHARDS 16
+
+
+static uint64_t
+file_time (uint64_t size)
+{
+  return FILE_COST + size / BYTES_PER_USEC;
+}
+
+
+/* Return random sizes for N files, spread evenly over the orders of
+   magnitude from 1 KiB to 16 MiB.  */
+static uint64_t *
+make_sizes (size_t n)
+{
+  uint64_t *sizes;
+  size_t i;
+
+  sizes = calloc (n, sizeof *sizes);
+  if (!sizes)
+    abort ();
+  for (i = 0; i < n; i++)
+    sizes[i] = (1024ULL << (t_rand () % 15)) + t_rand () % 1024;
+  return sizes;
+}
+
+
+static void
+test_shards (void)
+{
+  uint64_t sizes[] = { 100, 900, 300, 700, 500, 500 };
+  unsigned int shard[6];
+  uint64_t load[3];
+  int used;
+  size_t i;
+
+  /* Everything in one shard.  */
+  used = gpgex_plan_shards (sizes, 6, 1, 0, shard);
+  check (used == 1);
+  for (i = 0; i < 6; i++)
+    check (shard[i] == 0);
+
+  /* More shards than items.  */
+  used = gpgex_plan_shards (sizes, 2, 5, 0, shard);
+  check (used == 2);
+  check (shard[0] != shard[1]);
+
+  /* The sizes add up to 1000 in each of three shards.  */
+  used = gpgex_plan_shards (sizes, 6, 3, 0, shard);
+  check (used == 3);
+  memset (load, 0, sizeof load);
+  for (i = 0; i < 6; i++)
+    {
+      check (shard[i] < 3);
+      if (shard[i] < 3)
+        load[shard[i]] += sizes[i];
+    }
+  for (i = 0; i < 3; i++)
+    check (load[i] == 1000);
+
+  used = gpgex_plan_shards (sizes, 6, 0, 0, shard);
+  check (used == -1);
+}
+
+
+static void
+test_shardable (void)
+{
+  check (gpgex_plan_shardable ("DECRYPT_VERIFY_FILES"));
+  check (gpgex_plan_shardable ("VERIFY_FILES"));
+  check (gpgex_plan_shardable ("IMPORT_FILES"));
+  check (gpgex_plan_shardable ("CHECKSUM_CREATE_FILES"));
+
+  /* These ask for the recipients or the signing key.  */
+  check (!gpgex_plan_shardable ("ENCRYPT_FILES"));
+  check (!gpgex_plan_shardable ("ENCRYPT_SIGN_FILES"));
+  check (!gpgex_plan_shardable ("SIGN_FILES"));
+  check (!gpgex_plan_shardable ("ENCRYPT_ARCHIVE"));
+  check (!gpgex_plan_shardable (""));
+}
+
+
+static void
+test_locality (void)
+{
+  const char *names[] =
+    {
+      "D:\\b\\one",
+      "C:\\a\\big",
+      "\\\\server\\share\\x",
+      "c:/A/small",
+      "C:\\a\\sub\\f",
+      "\\\\?\\C:\\a\\second",
+      "\\\\?\\UNC\\server\\share\\y"
+    };
+  uint64_t sizes[] = { 10, 1 << 30, 10, 10, 10, 10, 10 };
+  /* Volume C: with the small files of C:\a first, then D:, then the
+     share.  */
+  size_t expect[] = { 3, 5, 1, 4, 0, 2, 6 };
+  size_t order[7];
+  size_t i;
+
+  check (!gpgex_plan_locality (names, sizes, 7, order));
+  for (i = 0; i < 7; i++)
+    if (order[i] != expect[i])
+      {
+        fail ("position %u: got %u, want %u", (unsigned int) i,
+              (unsigned int) order[i], (unsigned int) expect[i]);
+        break;
+      }
+
+  check (!gpgex_plan_locality (names, sizes, 0, order));
+}
+
+
+static void
+test_dedup (void)
+{
+  /* VOLUME, FILE, VALID, IS_DIR.  */
+  static const struct
+  {
+    const char *name;
+    struct gpgex_file_id_s id;
+    int keep;
+  } files[] =
+    {
+      { "C:\\a\\x",			{ 1, 10, 1, 0 }, 1 },
+      /* The same file under another name, e.g. through a junction.  */
+      { "D:\\link\\x",			{ 1, 10, 1, 0 }, 0 },
+      /* Other spellings of the first name.  */
+      { "c:/A/X",			{ 0, 0, 0, 0 }, 0 },
+      { "\\\\?\\C:\\a\\x",		{ 0, 0, 0, 0 }, 0 },
+      { "\\\\?\\UNC\\server\\share\\z",	{ 2, 1, 1, 0 }, 1 },
+      { "\\\\SERVER\\Share\\z",		{ 0, 0, 0, 0 }, 0 },
+      /* A folder with a trailing separator and its contents.  */
+      { "C:\\dir\\",			{ 1, 20, 1, 1 }, 1 },
+      { "c:\\dir",			{ 0, 0, 0, 0 }, 0 },
+      { "C:\\dir\\sub\\deep\\f",	{ 1, 21, 1, 0 }, 0 },
+      { "C:\\dirx\\f",			{ 1, 22, 1, 0 }, 1 },
+      { "C:\\dirx",			{ 1, 23, 1, 0 }, 1 },
+      /* A sibling whose name starts like the folder.  */
+      { "f:\\a",			{ 3, 1, 1, 1 }, 1 },
+      { "f:\\ab",			{ 3, 2, 1, 0 }, 1 },
+      { "f:\\ab\\g",			{ 3, 3, 1, 0 }, 1 },
+      { "F:/A/b/c",			{ 3, 4, 1, 0 }, 0 },
+      /* Without an identity only the names are compared.  */
+      { "E:\\one",			{ 0, 0, 0, 0 }, 1 },
+      { "E:\\two",			{ 0, 0, 0, 0 }, 1 },
+      /* Contents listed before their folder.  */
+      { "G:\\late\\f",			{ 4, 1, 1, 0 }, 0 },
+      { "G:\\late\\",			{ 4, 2, 1, 1 }, 1 },
+    };
+  enum { N = sizeof files / sizeof *files };
+  const char *names[N];
+  struct gpgex_file_id_s ids[N];
+  unsigned char keep[N];
+  size_t i;
+
+  for (i = 0; i < N; i++)
+    {
+      names[i] = files[i].name;
+      ids[i] = files[i].id;
+      keep[i] = 2;
+    }
+  check (!gpgex_plan_dedup (names, ids, N, keep));
+  for (i = 0; i < N; i++)
+    if (keep[i] != files[i].keep)
+      fail ("%s: got %d, want %d", names[i], keep[i], files[i].keep);
+
+  check (!gpgex_plan_dedup (names, ids, 0, keep));
+}
+
+
+static void
+test_output_kind (void)
+{
+  check (gpgex_plan_output_kind ("ENCRYPT_FILES") == GPGEX_OUTPUT_ENCRYPT);
+  check (gpgex_plan_output_kind ("ENCRYPT_SIGN_FILES")
+         == GPGEX_OUTPUT_SIGN_ENCRYPT);
+  check (gpgex_plan_output_kind ("SIGN_FILES") == GPGEX_OUTPUT_SIGN);
+  check (gpgex_plan_output_kind ("DECRYPT_FILES") == GPGEX_OUTPUT_DECRYPT);
+  check (gpgex_plan_output_kind ("DECRYPT_VERIFY_FILES")
+         == GPGEX_OUTPUT_DECRYPT);
+  check (gpgex_plan_output_kind ("ENCRYPT_ARCHIVE") == GPGEX_OUTPUT_ARCHIVE);
+  check (gpgex_plan_output_kind ("VERIFY_FILES") == GPGEX_OUTPUT_NONE);
+  check (gpgex_plan_output_kind ("IMPORT_FILES") == GPGEX_OUTPUT_NONE);
+  check (gpgex_plan_output_kind ("SIGN_ENCRYPT_FILES") == GPGEX_OUTPUT_NONE);
+  check (gpgex_plan_output_kind ("") == GPGEX_OUTPUT_NONE);
+}
+
+
+static void
+test_output_size (void)
+{
+  const uint64_t mb = 1024 * 1024;
+  uint64_t enc, out;
+
+  /* Encryption adds a little and never less than the input.  */
+  enc = gpgex_plan_output_size (GPGEX_OUTPUT_ENCRYPT, mb, 0, 0);
+  check (enc > mb && enc < mb + mb / 100 + 8192);
+  check (gpgex_plan_output_size (GPGEX_OUTPUT_ENCRYPT, 0, 0, 0) > 0);
+  out = gpgex_plan_output_size (GPGEX_OUTPUT_ENCRYPT, 1ULL << 40, 0, 0);
+  check (out > 1ULL << 40);
+  check (gpgex_plan_output_size (GPGEX_OUTPUT_SIGN_ENCRYPT, mb, 0, 0) > enc);
+  check (gpgex_plan_output_size (GPGEX_OUTPUT_ARCHIVE, mb, 0, 0) >= enc);
+
+  /* Armor takes 4 characters for 3 bytes plus the line ends.  */
+  out = gpgex_plan_output_size (GPGEX_OUTPUT_ENCRYPT, mb, 1, 0);
+  check (out > enc / 3 * 4 && out < enc / 3 * 4 + enc / 16);
+
+  /* A detached signature does not depend on the input.  */
+  out = gpgex_plan_output_size (GPGEX_OUTPUT_SIGN, 0, 0, 0);
+  check (out > 0 && out <= 4096);
+  check (gpgex_plan_output_size (GPGEX_OUTPUT_SIGN, 1ULL << 40, 0, 0) == out);
+  check (gpgex_plan_output_size (GPGEX_OUTPUT_SIGN, 0, 1, 0) > out);
+
+  /* The plaintext is at most as large as an uncompressed message,
+     which for armored input is 3 bytes for 4 characters.  */
+  check (gpgex_plan_output_size (GPGEX_OUTPUT_DECRYPT, mb, 0, 0) == mb);
+  check (gpgex_plan_output_size (GPGEX_OUTPUT_DECRYPT, mb, 1, 0) == mb);
+  check (gpgex_plan_output_size (GPGEX_OUTPUT_DECRYPT, mb, 0, 1)
+         == mb / 4 * 3);
+
+  check (!gpgex_plan_output_size (GPGEX_OUTPUT_NONE, mb, 0, 0));
+}
+
+
+/* Return the volume with the root ROOT among the COUNT VOLUMES or
+   NULL.  */
+static struct gpgex_volume_need_s *
+find_volume (struct gpgex_volume_need_s *volumes, size_t count,
+             const char *root)
+{
+  size_t i;
+
+  for (i = 0; i < count; i++)
+    if (!strcmp (volumes[i].root, root))
+      return volumes + i;
+  return NULL;
+}
+
+
+static void
+test_volumes (void)
+{
+  const char *names[] =
+    {
+      "C:\\a\\x",
+      "D:\\b\\y.asc",
+      "c:/a/z",
+      "\\\\?\\C:\\c\\w",
+      "\\\\server\\share\\v",
+      "\\\\?\\UNC\\SERVER\\Share\\u",
+      "relative\\t"
+    };
+  uint64_t sizes[] = { 1000, 4000, 20000, 300000, 50, 60, 1 << 20 };
+  struct gpgex_volume_need_s *volumes, *v;
+  size_t count, i;
+  uint64_t want, tar;
+
+  /* Each output goes next to its input; all spellings of a volume
+     are one volume, and relative names are not counted.  */
+  check (!gpgex_plan_volumes (GPGEX_OUTPUT_ENCRYPT, names, sizes, 7, 0,
+                              &volumes, &count));
+  check (count == 3);
+  v = find_volume (volumes, count, "C:\\");
+  check (v && v->nfiles == 3);
+  want = (gpgex_plan_output_size (GPGEX_OUTPUT_ENCRYPT, 1000, 0, 0)
+          + gpgex_plan_output_size (GPGEX_OUTPUT_ENCRYPT, 20000, 0, 0)
+          + gpgex_plan_output_size (GPGEX_OUTPUT_ENCRYPT, 300000, 0, 0));
+  check (v && v->need == want);
+  v = find_volume (volumes, count, "D:\\");
+  check (v && v->nfiles == 1
+         && v->need == gpgex_plan_output_size (GPGEX_OUTPUT_ENCRYPT,
+                                               4000, 0, 0));
+  v = find_volume (volumes, count, "\\\\server\\share\\");
+  check (v && v->nfiles == 2);
+  gpgex_plan_volumes_free (volumes, count);
+
+  /* The ".asc" suffix marks armored input.  */
+  check (!gpgex_plan_volumes (GPGEX_OUTPUT_DECRYPT, names + 1, sizes + 1, 1,
+                              0, &volumes, &count));
+  check (count == 1 && volumes[0].need == 3000);
+  gpgex_plan_volumes_free (volumes, count);
+
+  /* An archive is written next to the first file and takes at least
+     a block for each member.  */
+  check (!gpgex_plan_volumes (GPGEX_OUTPUT_ARCHIVE, names + 1, sizes + 1, 6,
+                              0, &volumes, &count));
+  check (count == 1);
+  if (count == 1)
+    {
+      check (!strcmp (volumes[0].root, "D:\\"));
+      check (volumes[0].nfiles == 6);
+      tar = 0;
+      for (i = 1; i < 7; i++)
+        tar += (sizes[i] + 511) / 512 * 512 + 512;
+      check (volumes[0].need
+             > gpgex_plan_output_size (GPGEX_OUTPUT_ENCRYPT, tar, 0, 0));
+    }
+  gpgex_plan_volumes_free (volumes, count);
+
+  /* Nothing to write.  */
+  check (!gpgex_plan_volumes (GPGEX_OUTPUT_NONE, names, sizes, 7, 0,
+                              &volumes, &count));
+  check (!volumes && !count);
+  check (!gpgex_plan_volumes (GPGEX_OUTPUT_ENCRYPT, names, sizes, 0, 0,
+                              &volumes, &count));
+  check (!volumes && !count);
+  check (!gpgex_plan_volumes (GPGEX_OUTPUT_ENCRYPT, names + 6, sizes + 6, 1,
+                              0, &volumes, &count));
+  check (!volumes && !count);
+}
+
+
+/* Return the number of times the directory changes between
+   consecutive files of the N files NAMES in the order ORDER.  */
+static size_t
+count_dir_changes (char **names, const size_t *order, size_t n)
+{
+  const char *a, *b, *pa, *pb;
+  size_t changes = 0;
+  size_t i;
+
+  for (i = 1; i < n; i++)
+    {
+      a = names[order ? order[i - 1] : i - 1];
+      b = names[order ? order[i] : i];
+      pa = strrchr (a, '\\');
+      pb = strrchr (b, '\\');
+      if (pa - a != pb - b || strncmp (a, b, pa - a))
+        changes++;
+    }
+  return changes;
+}
+
+
+/* Make a shuffled selection of N files from a synthetic tree of
+   NDIRS directories on a few volumes, as from a search result.  The
+   number of directories used is stored at R_USED.  */
+static char **
+make_tree (size_t n, size_t ndirs, size_t *r_used)
+{
+  static const char *const volumes[] =
+    { "C:", "D:", "\\\\server\\share", "\\\\?\\E:" };
+  char **names;
+  unsigned char *used;
+  char buffer[256];
+  size_t i, j, dir;
+  char *tmp;
+
+  names = calloc (n, sizeof *names);
+  used = calloc (ndirs, 1);
+  if (!names || !used)
+    abort ();
+  *r_used = 0;
+  for (i = 0; i < n; i++)
+    {
+      /* The directories are three levels deep with 8 entries each.  */
+      dir = t_rand () % ndirs;
+      if (!used[dir])
+        {
+          used[dir] = 1;
+          (*r_used)++;
+        }
+      snprintf (buffer, sizeof buffer,
+                "%s\\Users\\dir%u\\sub%u\\leaf%u\\file%u.txt",
+                volumes[dir % 4], (unsigned int) (dir / 4 / 64),
+                (unsigned int) (dir / 4 / 8 % 8),
+                (unsigned int) (dir / 4 % 8), (unsigned int) i);
+      names[i] = strdup (buffer);
+      if (!names[i])
+        abort ();
+    }
+  for (i = n; i > 1; i--)
+    {
+      j = t_rand () % i;
+      tmp = names[i - 1];
+      names[i - 1] = names[j];
+      names[j] = tmp;
+    }
+  free (used);
+  return names;
+}
+
+
+static void
+bench_locality (size_t n, size_t ndirs)
+{
+  char **names;
+  uint64_t *sizes;
+  size_t *order;
+  unsigned char *seen;
+  uint64_t start, usec;
+  size_t i, used, before, after;
+
+  t_srand (7);
+  names = make_tree (n, ndirs, &used);
+  sizes = make_sizes (n);
+  order = calloc (n, sizeof *order);
+  seen = calloc (n, 1);
+  if (!order || !seen)
+    abort ();
+
+  start = t_now ();
+  if (gpgex_plan_locality ((const char *const *) names, sizes, n, order))
+    {
+      fail ("gpgex_plan_locality failed");
+      goto leave;
+    }
+  usec = t_now () - start;
+
+  for (i = 0; i < n; i++)
+    {
+      check (order[i] < n && !seen[order[i]]);
+      if (order[i] < n)
+        seen[order[i]] = 1;
+    }
+
+  /* The files of a directory are all next to each other.  */
+  before = count_dir_changes (names, NULL, n);
+  after = count_dir_changes (names, order, n);
+  check (after == used - 1);
+  info ("%7u files in %5u dirs: %6llu us, %7u directory changes -> %u",
+        (unsigned int) n, (unsigned int) used, (unsigned long long) usec,
+        (unsigned int) before, (unsigned int) after);
+
+ leave:
+  for (i = 0; i < n; i++)
+    free (names[i]);
+  free (names);
+  free (sizes);
+  free (order);
+  free (seen);
+}
+
+
+/* Return NAME as the reference for gpgex_plan_dedup compares it as a
+   new string: without a "\\?\" prefix and trailing separators, with
+   backslashes and in lower case.  */
+static char *
+fold_dedup_name (const char *name)
+{
+  char *folded, *p;
+  size_t len;
+
+  if (!strncmp (name, "\\\\?\\", 4))
+    name += 4;
+  folded = strdup (name);
+  if (!folded)
+    abort ();
+  for (p = folded; *p; p++)
+    if (*p == '/')
+      *p = '\\';
+    else if (*p >= 'A' && *p <= 'Z')
+      *p += 'a' - 'A';
+  len = strlen (folded);
+  while (len > 2 && folded[len - 1] == '\\')
+    folded[--len] = 0;
+  return folded;
+}
+
+
+/* Store a selection of N files from make_tree at R_NAMES and R_IDS
+   with the redundant entries a real selection may have: every 50th
+   entry is another spelling of an earlier one, every 70th the same
+   file under another name, and every 500th a folder above an
+   earlier entry.  */
+static void
+make_dedup_selection (size_t n, char ***r_names,
+                      struct gpgex_file_id_s **r_ids)
+{
+  struct gpgex_file_id_s *ids;
+  char **names;
+  char *p;
+  size_t i, j, used;
+
+  names = make_tree (n, n / 20 + 1, &used);
+  ids = calloc (n, sizeof *ids);
+  if (!ids)
+    abort ();
+  for (i = 0; i < n; i++)
+    {
+      ids[i].volume = 1;
+      ids[i].file = i + 1;
+      ids[i].valid = 1;
+      if (!i)
+        continue;
+      j = t_rand () % i;
+      if (!(i % 50))
+        {
+          /* Upper case and slashes after the volume.  */
+          free (names[i]);
+          names[i] = strdup (names[j]);
+          if (!names[i])
+            abort ();
+          for (p = names[i]; *p; p++)
+            if (*p == '\\' && p - names[i] > 4)
+              *p = '/';
+            else if (*p >= 'a' && *p <= 'z')
+              *p -= 'a' - 'A';
+          ids[i].valid = 0;
+        }
+      else if (!(i % 70))
+        ids[i] = ids[j];
+      else if (!(i % 500))
+        {
+          free (names[i]);
+          names[i] = strdup (names[j]);
+          if (!names[i])
+            abort ();
+          /* Cut off the file name and maybe a directory.  */
+          *strrchr (names[i], '\\') = 0;
+          if (t_rand () & 1)
+            *strrchr (names[i], '\\') = 0;
+          ids[i].is_dir = 1;
+        }
+    }
+  *r_names = names;
+  *r_ids = ids;
+}
+
+
+/* Compare gpgex_plan_dedup on N files with a quadratic
+   implementation of its definition.  */
+static void
+test_dedup_reference (size_t n)
+{
+  struct gpgex_file_id_s *ids;
+  char **names, **folded;
+  unsigned char *keep;
+  size_t i, j, len, dropped;
+  int want;
+
+  t_srand (11);
+  make_dedup_selection (n, &names, &ids);
+  folded = calloc (n, sizeof *folded);
+  keep = calloc (n, 1);
+  if (!folded || !keep)
+    abort ();
+  for (i = 0; i < n; i++)
+    folded[i] = fold_dedup_name (names[i]);
+
+  check (!gpgex_plan_dedup ((const char *const *) names, ids, n, keep));
+  dropped = 0;
+  for (i = 0; i < n; i++)
+    {
+      want = 1;
+      for (j = 0; want && j < i; j++)
+        if ((ids[i].valid && ids[j].valid && ids[i].volume == ids[j].volume
+             && ids[i].file == ids[j].file)
+            || !strcmp (folded[i], folded[j]))
+          want = 0;
+      for (j = 0; want && j < n; j++)
+        {
+          len = strlen (folded[j]);
+          if (j != i && ids[j].is_dir && !strncmp (folded[i], folded[j], len)
+              && folded[i][len] == '\\')
+            want = 0;
+        }
+      if (keep[i] != want)
+        {
+          fail ("%s: got %d, want %d", names[i], keep[i], want);
+          break;
+        }
+      dropped += !want;
+    }
+  info ("%u of %u files are redundant", (unsigned int) dropped,
+        (unsigned int) n);
+
+  for (i = 0; i < n; i++)
+    {
+      free (names[i]);
+      free (folded[i]);
+    }
+  free (names);
+  free (folded);
+  free (ids);
+  free (keep);
+}
+
+
+static void
+bench_dedup (size_t n)
+{
+  struct gpgex_file_id_s *ids;
+  char **names;
+  unsigned char *keep;
+  uint64_t start, usec;
+  size_t i, kept;
+
+  t_srand (13);
+  make_dedup_selection (n, &names, &ids);
+  keep = calloc (n, 1);
+  if (!keep)
+    abort ();
+
+  start = t_now ();
+  if (gpgex_plan_dedup ((const char *const *) names, ids, n, keep))
+    fail ("gpgex_plan_dedup failed");
+  usec = t_now () - start;
+  for (i = kept = 0; i < n; i++)
+    kept += keep[i];
+  info ("%7u files dedup: %6llu us, %5.1f ns per file, %u kept",
+        (unsigned int) n, (unsigned long long) usec,
+        usec * 1000.0 / n, (unsigned int) kept);
+
+  for (i = 0; i < n; i++)
+    free (names[i]);
+  free (names);
+  free (ids);
+  free (keep);
+}
+
+
+/* A session of the mock server.  */
+struct session_s
+{
+  const uint64_t *sizes;
+  const unsigned int *shard;
+  size_t n;
+  unsigned int id;
+  pthread_t thread;
+};
+
+
+static void *
+mock_session (void *arg)
+{
+  struct session_s *session = arg;
+  uint64_t usec = SESSION_SETUP;
+  size_t i;
+
+  for (i = 0; i < session->n; i++)
+    if (session->shard[i] == session->id)
+      usec += file_time (session->sizes[i]);
+  usleep (usec);
+  return NULL;
+}
+
+
+/* Run the N files with SIZES in the USED sessions given by SHARD
+   against the mock server and return the wall time.  The time the
+   model predicts is stored at R_MODEL.  */
+static uint64_t
+run_mock (const uint64_t *sizes, const unsigned int *shard, size_t n,
+          unsigned int used, uint64_t *r_model)
+{
+  struct session_s sessions[MAX_SHARDS];
+  uint64_t load[MAX_SHARDS];
+  uint64_t start;
+  unsigned int k;
+  size_t i;
+
+  for (k = 0; k < used; k++)
+    load[k] = SESSION_SETUP;
+  for (i = 0; i < n; i++)
+    load[shard[i]] += file_time (sizes[i]);
+  *r_model = 0;
+  for (k = 0; k < used; k++)
+    if (load[k] > *r_model)
+      *r_model = load[k];
+
+  start = t_now ();
+  for (k = 0; k < used; k++)
+    {
+      sessions[k].sizes = sizes;
+      sessions[k].shard = shard;
+      sessions[k].n = n;
+      sessions[k].id = k;
+      if (pthread_create (&sessions[k].thread, NULL, mock_session,
+                          &sessions[k]))
+        {
+          fail ("pthread_create failed");
+          return 0;
+        }
+    }
+  for (k = 0; k < used; k++)
+    pthread_join (sessions[k].thread, NULL);
+  return t_now () - start;
+}
+
+
+static void
+bench_shards (size_t n, unsigned int nshards)
+{
+  uint64_t *sizes;
+  unsigned int *shard;
+  uint64_t wall, model, single, planned, total;
+  int used;
+  size_t i;
+
+  if (nshards > MAX_SHARDS)
+    nshards = MAX_SHARDS;
+  if (nshards > n)
+    nshards = n;
+
+  t_srand (42);
+  sizes = make_sizes (n);
+  shard = calloc (n, sizeof *shard);
+  if (!shard)
+    abort ();
+  total = 0;
+  for (i = 0; i < n; i++)
+    total += sizes[i];
+  info ("%u files of %llu MiB in up to %u shards", (unsigned int) n,
+        (unsigned long long) (total >> 20), nshards);
+
+  wall = run_mock (sizes, shard, n, 1, &single);
+  info ("  one session:  %6llu ms (model %llu ms)",
+        (unsigned long long) wall / 1000,
+        (unsigned long long) single / 1000);
+
+  /* The naive splits, for comparison.  */
+  for (i = 0; i < n; i++)
+    shard[i] = i % nshards;
+  wall = run_mock (sizes, shard, n, nshards, &model);
+  info ("  round robin:  %6llu ms (model %llu ms)",
+        (unsigned long long) wall / 1000,
+        (unsigned long long) model / 1000);
+  for (i = 0; i < n; i++)
+    shard[i] = i * nshards / n;
+  wall = run_mock (sizes, shard, n, nshards, &model);
+  info ("  in order:     %6llu ms (model %llu ms)",
+        (unsigned long long) wall / 1000,
+        (unsigned long long) model / 1000);
+
+  used = gpgex_plan_shards (sizes, n, nshards, PER_FILE_COST, shard);
+  check (used >= 1 && (unsigned int) used <= nshards);
+  if (used >= 1)
+    {
+      wall = run_mock (sizes, shard, n, used, &planned);
+      info ("  planned:      %6llu ms (model %llu ms, %d shards)",
+            (unsigned long long) wall / 1000,
+            (unsigned long long) planned / 1000, used);
+
+      /* The wall time depends on the machine and is not checked.  */
+      if (nshards > 1)
+        check (planned < single);
+    }
+
+  free (shard);
+  free (sizes);
+}
+
+/* Count the bytes of the archive written by bench_archive.  */
+static gpg_error_t
+count_sink (void *opaque, const void *buffer, size_t length)
+{
+  (void) buffer;
+  *(uint64_t *) opaque += length;
+  return 0;
+}
+
+
+/* Compare encrypting N files as one ENCRYPT_ARCHIVE stream with an
+   ENCRYPT_FILES operation for each file and with one for all of
+   them.  The archive is made by the tar writer into a counting sink;
+   the sessions of the server are taken from the model.  */
+static void
+bench_archive (size_t n)
+{
+  static char data[64 * 1024];
+  struct gpgex_tar_s tar;
+  uint64_t *sizes;
+  uint64_t start, usec, left, want;
+  uint64_t written = 0;
+  uint64_t total = 0;
+  uint64_t single = 0;
+  uint64_t out_files = 0;
+  uint64_t archive, out_archive;
+  char name[64];
+  size_t i, chunk;
+
+  t_srand (5);
+  sizes = make_sizes (n);
+
+  start = t_now ();
+  gpgex_tar_init (&tar, count_sink, &written);
+  for (i = 0; i < n && !tar.err; i++)
+    {
+      snprintf (name, sizeof name, "archive/dir%u/file%u.dat",
+                (unsigned int) (i / 100), (unsigned int) i);
+      if (!(i % 100))
+        gpgex_tar_add_dir (&tar, name, 0);
+      if (gpgex_tar_begin_file (&tar, name, sizes[i], 0))
+        break;
+      for (left = sizes[i]; left; left -= chunk)
+        {
+          chunk = left < sizeof data ? left : sizeof data;
+          gpgex_tar_write (&tar, data, chunk);
+        }
+      gpgex_tar_end_file (&tar);
+    }
+  gpgex_tar_finish (&tar);
+  usec = t_now () - start;
+  check (!tar.err);
+
+  /* A header and the padded data for each file, a header for each
+     directory and the two end blocks.  */
+  want = ((n + 99) / 100 + 2) * 512;
+  for (i = 0; i < n; i++)
+    {
+      want += 512 + (sizes[i] + 511) / 512 * 512;
+      total += sizes[i];
+      single += file_time (sizes[i]);
+      out_files += gpgex_plan_output_size (GPGEX_OUTPUT_ENCRYPT,
+                                           sizes[i], 0, 0);
+    }
+  check (written == want);
+
+  archive = SESSION_SETUP + file_time (written) + usec;
+  out_archive = gpgex_plan_output_size (GPGEX_OUTPUT_ARCHIVE, written, 0, 0);
+  info ("%u files of %llu MiB, tar overhead %.2f%%, written in %llu us",
+        (unsigned int) n, (unsigned long long) (total >> 20),
+        (written - total) * 100.0 / total, (unsigned long long) usec);
+  info ("  one op per file: %6llu ms, %llu bytes out in %u files",
+        (unsigned long long) (n * SESSION_SETUP + single) / 1000,
+        (unsigned long long) out_files, (unsigned int) n);
+  info ("  one op:          %6llu ms",
+        (unsigned long long) (SESSION_SETUP + single) / 1000);
+  info ("  archive:         %6llu ms, %llu bytes out in 1 file",
+        (unsigned long long) archive / 1000,
+        (unsigned long long) out_archive);
+  if (n > 1)
+    check (archive < n * SESSION_SETUP + single);
+
+  free (sizes);
+}
+
+
+
+int
+main (int argc, char **argv)
+{
+  size_t nfiles = 64;
+  unsigned int nshards = 4;
+  int i;
+
+  i = t_init (argc, argv) + 1;
+  if (i < argc)
+    nfiles = strtoul (argv[i++], NULL, 10);
+  if (i < argc)
+    nshards = strtoul (argv[i++], NULL, 10);
+
+  test_shards ();
+  test_shardable ();
+  test_locality ();
+  test_dedup ();
+  test_dedup_reference (3000);
+  test_output_kind ();
+  test_output_size ();
+  test_volumes ();
+  if (nfiles && nshards)
+    bench_shards (nfiles, nshards);
+
+  bench_locality (1000, 16);
+  bench_locality (10000, 256);
+  bench_locality (100000, 2048);
+
+  bench_dedup (10000);
+  bench_dedup (100000);
+
+  bench_archive (100);
+  bench_archive (1000);
+
+  return !!errorcount;
+}
@@ -0,0 +1,221 @@
+/* t-stats.c - tests for the shared statistics block
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+/* The test uses the block of the current user, which on a POSIX
+   system only GpgEX tests ever create, and removes it again.  */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "stats.h"
+#include "t-support.h"
+
+#define NTHREADS 4
+#define NLOOPS 20000
+
+
+/* Store the name of the block, as built by stats.c, at NAME.  */
+static void
+block_name (char *name, size_t size)
+{
+  snprintf (name, size, "/GpgEX-Stats-%d-%lu", GPGEX_STATS_VERSION,
+            (unsigned long) getuid ());
+}
+
+
+static void
+test_snapshot_layout (void)
+{
+  struct gpgex_stats_s block, snapshot;
+
+  memset (&block, 0, sizeof block);
+  block.magic = GPGEX_STATS_MAGIC;
+  block.version = GPGEX_STATS_VERSION;
+  block.size = sizeof block;
+  block.counters[GPGEX_STAT_SPAWNS] = 42;
+  check (!gpgex_stats_snapshot (&block, &snapshot));
+  check (snapshot.counters[GPGEX_STAT_SPAWNS] == 42);
+
+  block.version = GPGEX_STATS_VERSION + 1;
+  check (gpgex_stats_snapshot (&block, &snapshot) == -1);
+  block.version = GPGEX_STATS_VERSION;
+  block.size = sizeof block + 4;
+  check (gpgex_stats_snapshot (&block, &snapshot) == -1);
+  block.size = sizeof block;
+  block.magic = 0;
+  check (gpgex_stats_snapshot (&block, &snapshot) == -1);
+}
+
+
+static void *
+writer_thread (void *arg)
+{
+  unsigned int i;
+
+  (void) arg;
+  for (i = 0; i < NLOOPS; i++)
+    {
+      gpgex_stats_gauge_inc (GPGEX_STAT_QUEUE_DEPTH,
+                             GPGEX_STAT_QUEUE_DEPTH_MAX);
+      gpgex_stats_inc (GPGEX_STAT_MENUS_SHOWN);
+      gpgex_stats_op ("VERIFY_FILES");
+      gpgex_stats_hist (GPGEX_HIST_CONNECT, i % 1000);
+      gpgex_stats_dec (GPGEX_STAT_QUEUE_DEPTH);
+    }
+  return NULL;
+}
+
+
+/* Update the block from several threads and read it back.  */
+static void
+test_writer (void)
+{
+  const struct gpgex_stats_s *reader;
+  struct gpgex_stats_s snapshot;
+  pthread_t threads[NTHREADS];
+  char name[64];
+  uint32_t count;
+  int i, n;
+
+  block_name (name, sizeof name);
+  shm_unlink (name);
+  check (!gpgex_stats_open_reader ());
+
+  gpgex_stats_init ();
+  reader = gpgex_stats_open_reader ();
+  if (!reader)
+    {
+      fail ("can't open the block %s", name);
+      gpgex_stats_deinit ();
+      return;
+    }
+  check (!gpgex_stats_snapshot (reader, &snapshot));
+  check (snapshot.counters[GPGEX_STAT_HOSTS] == 1);
+
+  for (n = 0; n < NTHREADS; n++)
+    if (pthread_create (&threads[n], NULL, writer_thread, NULL))
+      break;
+  check (n == NTHREADS);
+  for (i = 0; i < n; i++)
+    pthread_join (threads[i], NULL);
+
+  check (!gpgex_stats_snapshot (reader, &snapshot));
+  check (snapshot.counters[GPGEX_STAT_MENUS_SHOWN] == n * NLOOPS);
+  check (snapshot.counters[GPGEX_STAT_QUEUE_DEPTH] == 0);
+  check (snapshot.counters[GPGEX_STAT_QUEUE_DEPTH_MAX] >= 1
+         && snapshot.counters[GPGEX_STAT_QUEUE_DEPTH_MAX] <= n);
+  check (snapshot.ops[2] == n * NLOOPS);
+  check (!strcmp (gpgex_stats_op_name (2), "VERIFY_FILES"));
+
+  /* The durations are 0 to 999 us, each as often.  */
+  check (gpgex_stats_percentile (&snapshot, GPGEX_HIST_CONNECT, 0, &count)
+         == 0);
+  check (count == (uint32_t) n * NLOOPS);
+  check (gpgex_stats_percentile (&snapshot, GPGEX_HIST_CONNECT, 50, &count)
+         == 511);
+  check (gpgex_stats_percentile (&snapshot, GPGEX_HIST_CONNECT, 100, &count)
+         == 1023);
+  check (snapshot.hists[GPGEX_HIST_CONNECT][0] == n * NLOOPS / 1000);
+  check (snapshot.hists[GPGEX_HIST_CONNECT][10] == n * NLOOPS / 1000 * 488);
+  gpgex_stats_percentile (&snapshot, GPGEX_HIST_LAUNCH, 50, &count);
+  check (count == 0);
+
+  if (verbose)
+    gpgex_stats_print (stderr, &snapshot, 0);
+
+  gpgex_stats_deinit ();
+  check (!gpgex_stats_snapshot (reader, &snapshot));
+  check (snapshot.counters[GPGEX_STAT_HOSTS] == 0);
+
+  /* Nothing is counted without the block.  */
+  gpgex_stats_inc (GPGEX_STAT_MENUS_SHOWN);
+  check (!gpgex_stats_snapshot (reader, &snapshot));
+  check (snapshot.counters[GPGEX_STAT_MENUS_SHOWN] == n * NLOOPS);
+
+  gpgex_stats_close_reader (reader);
+}
+
+
+/* A block of another layout is neither used nor changed.  */
+static void
+test_foreign_layout (void)
+{
+  struct gpgex_stats_s *block;
+  struct gpgex_stats_s snapshot;
+  const struct gpgex_stats_s *reader;
+  char name[64];
+  int fd;
+
+  block_name (name, sizeof name);
+  fd = shm_open (name, O_RDWR, 0600);
+  if (fd == -1)
+    {
+      fail ("can't open the block %s", name);
+      return;
+    }
+  block = mmap (NULL, sizeof *block, PROT_READ | PROT_WRITE, MAP_SHARED,
+                fd, 0);
+  close (fd);
+  if (block == MAP_FAILED)
+    {
+      fail ("can't map the block %s", name);
+      return;
+    }
+  block->size = sizeof *block + 64;
+
+  gpgex_stats_init ();
+  gpgex_stats_inc (GPGEX_STAT_SPAWNS);
+  check (block->counters[GPGEX_STAT_HOSTS] == 0);
+  check (block->counters[GPGEX_STAT_SPAWNS] == 0);
+  gpgex_stats_deinit ();
+
+  reader = gpgex_stats_open_reader ();
+  check (reader != NULL);
+  if (reader)
+    {
+      check (gpgex_stats_snapshot (reader, &snapshot) == -1);
+      gpgex_stats_close_reader (reader);
+    }
+
+  munmap (block, sizeof *block);
+  shm_unlink (name);
+}
+
+
+int
+main (int argc, char **argv)
+{
+  t_init (argc, argv);
+
+  test_snapshot_layout ();
+  test_writer ();
+  test_foreign_layout ();
+
+  return !!errorcount;
+}
@@ -0,0 +1,134 @@
+/* t-support.c - helper for the tests
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+#include "debug.h"
+#include "t-support.h"
+
+int verbose;
+int debug;
+int errorcount;
+
+static unsigned int rand_state = 1;
+
+
+/* The debug functions of the DLL which are used by the code under
+   test.  With --debug the lines go to stderr.  */
+unsigned int debug_flags;
+FILE *debug_file;
+
+static void
+debug_vprint (const char *func, const char *tagname, void *tag,
+              const char *format, va_list arg_ptr)
+{
+  if (func)
+    fprintf (stderr, "%s (%s=%p): ", func, tagname, tag);
+  vfprintf (stderr, format, arg_ptr);
+  putc ('\n', stderr);
+}
+
+
+void
+_gpgex_debug (unsigned int flags, const char *format, ...)
+{
+  va_list arg_ptr;
+
+  if (! (debug_flags & flags))
+    return;
+
+  va_start (arg_ptr, format);
+  debug_vprint (NULL, NULL, NULL, format, arg_ptr);
+  va_end (arg_ptr);
+}
+
+
+void
+_gpgex_trace (unsigned int flags, const char *func, const char *tagname,
+              void *tag, const char *format, ...)
+{
+  va_list arg_ptr;
+
+  if (! (debug_flags & flags))
+    return;
+
+  va_start (arg_ptr, format);
+  debug_vprint (func, tagname, tag, format, arg_ptr);
+  va_end (arg_ptr);
+}
+
+
+int
+t_init (int argc, char **argv)
+{
+  int consumed = 0;
+
+  for (argc--, argv++; argc; argc--, argv++, consumed++)
+    {
+      if (!strcmp (*argv, "--verbose"))
+        verbose = 1;
+      else if (!strcmp (*argv, "--debug"))
+        {
+          verbose = debug = 1;
+          debug_flags = DEBUG_INIT | DEBUG_CONTEXT_MENU | DEBUG_ASSUAN;
+          debug_file = stderr;
+        }
+      else
+        break;
+    }
+  return consumed;
+}
+
+
+uint64_t
+t_now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+void
+t_srand (unsigned int seed)
+{
+  rand_state = seed ? seed : 1;
+}
+
+
+/* A xorshift generator; good enough for the tests and the same on
+   all platforms.  */
+unsigned int
+t_rand (void)
+{
+  rand_state ^= rand_state << 13;
+  rand_state ^= rand_state >> 17;
+  rand_state ^= rand_state << 5;
+  return rand_state;
+}
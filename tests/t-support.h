@@ -0,0 +1,80 @@
+/* t-support.h - helper for the tests
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#ifndef GPGEX_T_SUPPORT_H
+#define GPGEX_T_SUPPORT_H	1
+
+#include <stdio.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#if 0
+}
+#endif
+#endif
+
+/* Set by t_init from the options --verbose and --debug.  */
+extern int verbose;
+extern int debug;
+
+/* Number of failed checks.  */
+extern int errorcount;
+
+/* Parse the common options in ARGV and return the number of
+   arguments consumed, not counting the program name.  */
+int t_init (int argc, char **argv);
+
+/* Return the time in microseconds from a monotonic clock.  */
+uint64_t t_now (void);
+
+/* Return a number from a fixed pseudo random sequence.  The sequence
+   is reset by t_srand.  */
+unsigned int t_rand (void);
+void t_srand (unsigned int seed);
+
+#define fail(...)  do {                                         \
+    fprintf (stderr, "%s:%d: ", __FILE__, __LINE__);            \
+    fprintf (stderr, __VA_ARGS__);                              \
+    putc ('\n', stderr);                                        \
+    errorcount++;                                               \
+  } while (0)
+
+#define check(expr)  do {                                       \
+    if (!(expr))                                                \
+      fail ("check '%s' failed", #expr);                        \
+  } while (0)
+
+#define info(...)  do {                                         \
+    if (verbose)                                                \
+      {                                                         \
+        fprintf (stderr, __VA_ARGS__);                          \
+        putc ('\n', stderr);                                    \
+      }                                                         \
+  } while (0)
+
+#ifdef __cplusplus
+#if 0
+{
+#endif
+}
+#endif
+
+#endif /* GPGEX_T_SUPPORT_H */
@@ -0,0 +1,342 @@
+/* t-tarstream.c - tests for the tar writer
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tarstream.h"
+#include "t-support.h"
+
+#define BLOCK 512
+
+/* The offsets of the ustar header fields.  */
+#define H_NAME		0
+#define H_SIZE		124
+#define H_MTIME		136
+#define H_CHKSUM	148
+#define H_TYPEFLAG	156
+#define H_MAGIC		257
+#define H_PREFIX	345
+
+/* The archive as passed to the sink.  */
+struct archive_s
+{
+  unsigned char *data;
+  size_t length;
+  size_t calls;
+  size_t fail_at;		/* Fail the call with this number if not 0.  */
+};
+
+
+static gpg_error_t
+memory_sink (void *opaque, const void *buffer, size_t length)
+{
+  struct archive_s *ar = opaque;
+
+  if (++ar->calls == ar->fail_at)
+    return gpg_error (GPG_ERR_EPIPE);
+  ar->data = realloc (ar->data, ar->length + length);
+  if (!ar->data)
+    abort ();
+  memcpy (ar->data + ar->length, buffer, length);
+  ar->length += length;
+  return 0;
+}
+
+
+static void
+reset (struct archive_s *ar, struct gpgex_tar_s *tar)
+{
+  free (ar->data);
+  memset (ar, 0, sizeof *ar);
+  gpgex_tar_init (tar, memory_sink, ar);
+}
+
+
+/* Return the octal number in the field FIELD of LENGTH bytes.  */
+static unsigned long long
+get_octal (const unsigned char *field, size_t length)
+{
+  unsigned long long value = 0;
+  size_t i;
+
+  for (i = 0; i < length && field[i] >= '0' && field[i] <= '7'; i++)
+    value = value * 8 + (field[i] - '0');
+  return value;
+}
+
+
+/* Check the header block HDR: magic and checksum.  */
+static void
+check_header (const unsigned char *hdr)
+{
+  unsigned int sum = 0;
+  size_t i;
+
+  check (!memcmp (hdr + H_MAGIC, "ustar\0" "00", 8));
+  for (i = 0; i < BLOCK; i++)
+    sum += (i >= H_CHKSUM && i < H_CHKSUM + 8) ? ' ' : hdr[i];
+  if (get_octal (hdr + H_CHKSUM, 8) != sum)
+    fail ("checksum %llo, want %o", get_octal (hdr + H_CHKSUM, 8), sum);
+  check (hdr[H_CHKSUM + 6] == 0 && hdr[H_CHKSUM + 7] == ' ');
+}
+
+
+/* Return true if the LENGTH bytes at P are all zero.  */
+static int
+all_zero (const unsigned char *p, size_t length)
+{
+  while (length--)
+    if (*p++)
+      return 0;
+  return 1;
+}
+
+
+static void
+test_file (void)
+{
+  struct archive_s ar = { NULL };
+  struct gpgex_tar_s tar;
+  char data[700];
+
+  reset (&ar, &tar);
+  memset (data, 'x', sizeof data);
+  check (!gpgex_tar_add_dir (&tar, "top", 1700000000));
+  check (!gpgex_tar_begin_file (&tar, "top/file.txt", sizeof data,
+                                1700000000));
+  check (!gpgex_tar_write (&tar, data, 300));
+  check (!gpgex_tar_write (&tar, data + 300, 400));
+  check (!gpgex_tar_end_file (&tar));
+  check (!gpgex_tar_finish (&tar));
+
+  /* Directory, file header, two data blocks and two end blocks.  */
+  check (ar.length == 6 * BLOCK);
+  check (tar.written == ar.length);
+  if (ar.length != 6 * BLOCK)
+    goto leave;
+
+  check_header (ar.data);
+  check (!strcmp ((char *) ar.data + H_NAME, "top/"));
+  check (ar.data[H_TYPEFLAG] == '5');
+  check (get_octal (ar.data + H_SIZE, 12) == 0);
+  check (get_octal (ar.data + H_MTIME, 12) == 1700000000);
+
+  check_header (ar.data + BLOCK);
+  check (!strcmp ((char *) ar.data + BLOCK + H_NAME, "top/file.txt"));
+  check (ar.data[BLOCK + H_TYPEFLAG] == '0');
+  check (get_octal (ar.data + BLOCK + H_SIZE, 12) == sizeof data);
+
+  /* The data is padded with zeros to the block size.  */
+  check (!memcmp (ar.data + 2 * BLOCK, data, sizeof data));
+  check (all_zero (ar.data + 2 * BLOCK + sizeof data,
+                   2 * BLOCK - sizeof data));
+  check (all_zero (ar.data + 4 * BLOCK, 2 * BLOCK));
+
+ leave:
+  free (ar.data);
+}
+
+
+static void
+test_prefix (void)
+{
+  struct archive_s ar = { NULL };
+  struct gpgex_tar_s tar;
+  char name[160];
+
+  /* 150 bytes with the last slash after 60 bytes.  */
+  memset (name, 'd', 60);
+  name[60] = '/';
+  memset (name + 61, 'f', 89);
+  name[150] = 0;
+
+  reset (&ar, &tar);
+  check (!gpgex_tar_begin_file (&tar, name, 0, 0));
+  check (!gpgex_tar_end_file (&tar));
+  check (ar.length == BLOCK);
+  if (ar.length == BLOCK)
+    {
+      check_header (ar.data);
+      check (!memcmp (ar.data + H_PREFIX, name, 60)
+             && !ar.data[H_PREFIX + 60]);
+      check (!memcmp (ar.data + H_NAME, name + 61, 89)
+             && !ar.data[H_NAME + 89]);
+    }
+  free (ar.data);
+}
+
+
+/* Check that the pax header at P has the record "KEYWORD=VALUE" and
+   return the number of blocks of the header and its data.  */
+static size_t
+check_pax (const unsigned char *p, const char *keyword, const char *value)
+{
+  unsigned long long size;
+  const char *rec, *end;
+  char *want;
+  size_t len;
+  int found = 0;
+
+  check_header (p);
+  check (p[H_TYPEFLAG] == 'x');
+  size = get_octal (p + H_SIZE, 12);
+
+  want = malloc (strlen (keyword) + strlen (value) + 3);
+  if (!want)
+    abort ();
+  sprintf (want, "%s=%s\n", keyword, value);
+  rec = (const char *) p + BLOCK;
+  end = rec + size;
+  while (rec < end)
+    {
+      /* Each record starts with its own length in decimal.  */
+      len = strtoul (rec, NULL, 10);
+      if (!len || rec + len > end || rec[len - 1] != '\n')
+        {
+          fail ("bad pax record");
+          break;
+        }
+      if (!strncmp (strchr (rec, ' ') + 1, want, strlen (want)))
+        found = 1;
+      rec += len;
+    }
+  if (!found)
+    fail ("pax record %s missing", want);
+  free (want);
+  check (all_zero (p + BLOCK + size, (BLOCK - size % BLOCK) % BLOCK));
+  return 1 + (size + BLOCK - 1) / BLOCK;
+}
+
+
+static void
+test_pax (void)
+{
+  struct archive_s ar = { NULL };
+  struct gpgex_tar_s tar;
+  char name[300];
+  char big[4200];
+  const unsigned char *hdr;
+  size_t n;
+
+  /* A name which can not be split.  */
+  memset (name, 'n', 299);
+  name[299] = 0;
+  name[10] = '/';
+  reset (&ar, &tar);
+  check (!gpgex_tar_begin_file (&tar, name, 5, 0));
+  check (!gpgex_tar_write (&tar, "hello", 5));
+  check (!gpgex_tar_end_file (&tar));
+  n = check_pax (ar.data, "path", name);
+  check (ar.length == (n + 2) * BLOCK);
+  if (ar.length == (n + 2) * BLOCK)
+    {
+      hdr = ar.data + n * BLOCK;
+      check_header (hdr);
+      check (get_octal (hdr + H_SIZE, 12) == 5);
+      check (!memcmp (hdr + BLOCK, "hello", 5));
+    }
+
+  /* A file of 8 GiB or more gets a size record and a base-256 size
+     in the header.  The data is not written.  */
+  reset (&ar, &tar);
+  check (!gpgex_tar_begin_file (&tar, "big", 0x200000001ULL, 0));
+  n = check_pax (ar.data, "size", "8589934593");
+  check (ar.length == (n + 1) * BLOCK);
+  if (ar.length == (n + 1) * BLOCK)
+    {
+      hdr = ar.data + n * BLOCK;
+      check_header (hdr);
+      check (hdr[H_SIZE] == 0x80);
+      check (all_zero (hdr + H_SIZE + 1, 6));
+      check (!memcmp (hdr + H_SIZE + 7, "\x02\x00\x00\x00\x01", 5));
+    }
+
+  /* Names which can not be stored; nothing is written.  */
+  memset (big, 'b', sizeof big - 1);
+  big[sizeof big - 1] = 0;
+  reset (&ar, &tar);
+  check (gpg_err_code (gpgex_tar_begin_file (&tar, big, 1, 0))
+         == GPG_ERR_TOO_LARGE);
+  check (gpg_err_code (gpgex_tar_add_dir (&tar, big, 0))
+         == GPG_ERR_TOO_LARGE);
+  check (gpg_err_code (gpgex_tar_begin_file (&tar, "", 1, 0))
+         == GPG_ERR_INV_NAME);
+  check (!ar.length && !tar.err);
+
+  free (ar.data);
+}
+
+
+static void
+test_errors (void)
+{
+  struct archive_s ar = { NULL };
+  struct gpgex_tar_s tar;
+  char data[1000];
+
+  /* A file which has shrunk is filled up with zeros.  */
+  memset (data, 'y', sizeof data);
+  reset (&ar, &tar);
+  check (!gpgex_tar_begin_file (&tar, "short", sizeof data, 0));
+  check (!gpgex_tar_write (&tar, data, 300));
+  check (gpg_err_code (gpgex_tar_end_file (&tar)) == GPG_ERR_TRUNCATED);
+  check (!tar.err);
+  check (ar.length == 3 * BLOCK);
+  if (ar.length == 3 * BLOCK)
+    check (all_zero (ar.data + BLOCK + 300, 2 * BLOCK - 300));
+
+  /* One which has grown is cut.  */
+  check (!gpgex_tar_begin_file (&tar, "long", 10, 0));
+  check (gpg_err_code (gpgex_tar_write (&tar, data, 20))
+         == GPG_ERR_TOO_LARGE);
+  check (!gpgex_tar_end_file (&tar));
+  check (ar.length == 5 * BLOCK);
+
+  /* An error of the sink sticks.  */
+  reset (&ar, &tar);
+  ar.fail_at = 2;
+  check (!gpgex_tar_begin_file (&tar, "a", 10, 0));
+  check (gpg_err_code (gpgex_tar_write (&tar, data, 10)) == GPG_ERR_EPIPE);
+  check (gpg_err_code (gpgex_tar_end_file (&tar)) == GPG_ERR_EPIPE);
+  check (gpg_err_code (gpgex_tar_finish (&tar)) == GPG_ERR_EPIPE);
+  check (ar.calls == 2 && ar.length == BLOCK);
+
+  free (ar.data);
+}
+
+
+int
+main (int argc, char **argv)
+{
+  t_init (argc, argv);
+
+  test_file ();
+  test_prefix ();
+  test_pax ();
+  test_errors ();
+
+  return !!errorcount;
+}
@@ -0,0 +1,146 @@
+/* t-trace.c - tests for the trace macros
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "t-support.h"
+
+/* Number of times an argument of a trace line has been evaluated.  */
+static unsigned int nevals;
+
+/* Keeps the compiler from removing the loops of the benchmark.  */
+static volatile unsigned int sink;
+
+
+/* An argument which is costly to compute.  */
+static int
+expensive (void)
+{
+  nevals++;
+  return (int) nevals;
+}
+
+
+/* A function traced in category LVL, which only counts the calls.  */
+static __attribute__ ((noinline)) gpg_error_t
+traced (unsigned int lvl, unsigned int n)
+{
+  TRACE_BEG (lvl, "traced", n, "n=%u value=%d", n, expensive ());
+
+  sink += n;
+  (void) TRACE_LOG ("value=%d", expensive ());
+  (void) TRACE (lvl, "traced_call", n, "value=%d", expensive ());
+  return TRACE_GPGERR (0);
+}
+
+
+/* The same function without tracing.  */
+static __attribute__ ((noinline)) gpg_error_t
+untraced (unsigned int lvl, unsigned int n)
+{
+  (void) lvl;
+  sink += n;
+  return 0;
+}
+
+
+/* Check that the arguments are evaluated only if the category is
+   enabled.  */
+static void
+test_evaluation (void)
+{
+  unsigned int saved_flags = debug_flags;
+
+  debug_flags = 0;
+  nevals = 0;
+  traced (DEBUG_ASSUAN, 1);
+  check (nevals == 0);
+
+  /* Another category does not enable it.  */
+  debug_flags = DEBUG_INIT | DEBUG_CONTEXT_MENU;
+  traced (DEBUG_ASSUAN, 2);
+  check (nevals == 0);
+
+  /* Lines are written for an enabled category which is compiled in.  */
+  debug_flags = DEBUG_ASSUAN;
+  traced (DEBUG_ASSUAN, 3);
+  if (GPGEX_TRACE_COMPILED & DEBUG_ASSUAN)
+    check (nevals == 3);
+  else
+    check (nevals == 0);
+
+  debug_flags = saved_flags;
+}
+
+
+/* Compare N calls of a function with disabled trace lines with N
+   calls of the function without them.  */
+static void
+bench_disabled (unsigned int n)
+{
+  unsigned int saved_flags = debug_flags;
+  uint64_t start, usec_traced, usec_untraced;
+  unsigned int i;
+
+  debug_flags = 0;
+  nevals = 0;
+
+  start = t_now ();
+  for (i = 0; i < n; i++)
+    traced (DEBUG_ASSUAN, i);
+  usec_traced = t_now () - start;
+
+  start = t_now ();
+  for (i = 0; i < n; i++)
+    untraced (DEBUG_ASSUAN, i);
+  usec_untraced = t_now () - start;
+
+  check (nevals == 0);
+  info ("%u calls: %.2f ns with disabled tracing, %.2f ns without",
+        n, (double) usec_traced * 1000 / n,
+        (double) usec_untraced * 1000 / n);
+
+  debug_flags = saved_flags;
+}
+
+
+int
+main (int argc, char **argv)
+{
+  unsigned int calls = 10000000;
+  int i;
+
+  i = t_init (argc, argv) + 1;
+  if (i < argc)
+    calls = strtoul (argv[i++], NULL, 10);
+
+  test_evaluation ();
+  if (calls)
+    bench_disabled (calls);
+
+  return !!errorcount;
+}
@@ -0,0 +1,574 @@
+/* gpgex-broker.cc - run GpgEX operations outside of the Explorer
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+/* The broker is started by the DLL on demand if the registry value
+   HKCU\Software\Gpg4win:GpgEX Broker is set.  It serves all Explorer
+   and file dialog processes of the session (see src/broker.h), keeps
+   connections to the UI server open for reuse and runs the
+   operations in the system thread pool.  It terminates after being
+   idle for some time.  */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include <algorithm>
+
+#include <winsock2.h>
+#include <windows.h>
+
+#include <assuan.h>
+
+#include "main.h"
+#include "stats.h"
+#include "client.h"
+#include "broker.h"
+
+/* Maximum size of a request.  */
+#define MAX_REQUEST (1024 * 1024)
+
+/* Milliseconds to wait for a client to send its request.  */
+#define REQUEST_TIMEOUT 5000
+
+/* The command sent by --bench.  The UI server rejects it once the
+   connection has been set up, so it costs what every operation pays
+   before the work starts, and no error is shown for it.  */
+#define BENCH_COMMAND "GPGEX_BENCH"
+
+
+/* The definitions the client code expects from the DLL.  */
+HINSTANCE gpgex_server::instance;
+LONG gpgex_server::refcount;
+const char *gpgex_server::ui_server;
+
+unsigned int debug_flags;
+FILE *debug_file;
+static CRITICAL_SECTION debug_lock;
+
+/* Seconds without requests after which we terminate.  */
+static unsigned int idle_timeout = 600;
+
+/* Number of requests being processed.  */
+static volatile LONG active_requests;
+
+/* Signalled when a request has been processed.  */
+static HANDLE request_done;
+
+
+static void
+debug_vlog (const char *func, const char *tagname, void *tag,
+            const char *format, va_list arg_ptr)
+{
+  size_t len = strlen (format);
+
+  EnterCriticalSection (&debug_lock);
+  fprintf (debug_file, "[%lu] ", (unsigned long) GetCurrentThreadId ());
+  if (func)
+    fprintf (debug_file, "%s (%s=%p): ", func, tagname, tag);
+  vfprintf (debug_file, format, arg_ptr);
+  if (!len || format[len - 1] != '\n')
+    putc ('\n', debug_file);
+  fflush (debug_file);
+  LeaveCriticalSection (&debug_lock);
+}
+
+
+extern "C" void
+_gpgex_debug (unsigned int flags, const char *format, ...)
+{
+  va_list arg_ptr;
+
+  if (! (debug_flags & flags))
+    return;
+
+  va_start (arg_ptr, format);
+  debug_vlog (NULL, NULL, NULL, format, arg_ptr);
+  va_end (arg_ptr);
+}
+
+
+extern "C" void
+_gpgex_trace (unsigned int flags, const char *func, const char *tagname,
+              void *tag, const char *format, ...)
+{
+  va_list arg_ptr;
+
+  if (! (debug_flags & flags))
+    return;
+
+  va_start (arg_ptr, format);
+  debug_vlog (func, tagname, tag, format, arg_ptr);
+  va_end (arg_ptr);
+}
+
+
+/* Return the installation directory with standard slashes.  The
+   broker is installed in its bin sub directory.  */
+const char *
+get_gpg4win_dir (void)
+{
+  static char *mydir;
+
+  if (!mydir)
+    {
+      wchar_t wname[MAX_PATH];
+      char *name, *p;
+
+      if (!GetModuleFileNameW (NULL, wname, MAX_PATH))
+        return NULL;
+      name = gpgrt_wchar_to_utf8 (wname);
+      if (!name)
+        return NULL;
+      for (p = name; *p; p++)
+        if (*p == '\\')
+          *p = '/';
+      /* Strip the file name and the bin directory.  */
+      if ((p = strrchr (name, '/')))
+        *p = 0;
+      if ((p = strrchr (name, '/')))
+        {
+          *p = 0;
+          mydir = name;
+        }
+      else
+        free (name);
+    }
+  return mydir;
+}
+
+
+
+/* A parsed request.  */
+struct request_s
+{
+  HWND wid;
+  string cmd;
+  vector<string> filenames;
+};
+
+
+/* Parse the request in BUFFER into REQ.  Returns 0 on success.  */
+static gpg_error_t
+parse_request (char *buffer, struct request_s *req)
+{
+  char *line, *next;
+  int seen_version = 0;
+
+  for (line = buffer; line && *line; line = next)
+    {
+      next = strchr (line, '\n');
+      if (next)
+        *next++ = 0;
+
+      if (!seen_version)
+        {
+          if (strcmp (line, GPGEX_BROKER_VERSION_LINE))
+            return gpg_error (GPG_ERR_UNSUPPORTED_PROTOCOL);
+          seen_version = 1;
+        }
+      else if (!strncmp (line, "WID ", 4))
+        req->wid = (HWND) (uintptr_t) strtoul (line + 4, NULL, 16);
+      else if (!strncmp (line, "CMD ", 4))
+        {
+          const char *s;
+
+          for (s = line + 4; *s; s++)
+            if (!((*s >= 'A' && *s <= 'Z') || *s == '_'))
+              return gpg_error (GPG_ERR_INV_VALUE);
+          req->cmd = line + 4;
+        }
+      else if (!strncmp (line, "FILE ", 5))
+        req->filenames.push_back (line + 5);
+      else if (!strcmp (line, "END"))
+        return req->cmd.empty () ? gpg_error (GPG_ERR_MISSING_VALUE) : 0;
+      else
+        return gpg_error (GPG_ERR_INV_REQUEST);
+    }
+  return gpg_error (GPG_ERR_INCOMPLETE_LINE);
+}
+
+
+/* Run an overlapped read or write on HD with a timeout.  Returns the
+   number of bytes transferred or -1 on error.  */
+static int
+pipe_io (HANDLE hd, int writing, void *buffer, DWORD length)
+{
+  OVERLAPPED ov;
+  DWORD nbytes = 0;
+  BOOL ok;
+
+  memset (&ov, 0, sizeof ov);
+  ov.hEvent = CreateEvent (NULL, TRUE, FALSE, NULL);
+  if (!ov.hEvent)
+    return -1;
+
+  if (writing)
+    ok = WriteFile (hd, buffer, length, NULL, &ov);
+  else
+    ok = ReadFile (hd, buffer, length, NULL, &ov);
+  if (!ok && GetLastError () != ERROR_IO_PENDING)
+    {
+      CloseHandle (ov.hEvent);
+      return -1;
+    }
+  if (WaitForSingleObject (ov.hEvent, REQUEST_TIMEOUT) != WAIT_OBJECT_0)
+    {
+      CancelIo (hd);
+      GetOverlappedResult (hd, &ov, &nbytes, TRUE);
+      CloseHandle (ov.hEvent);
+      return -1;
+    }
+  ok = GetOverlappedResult (hd, &ov, &nbytes, FALSE);
+  CloseHandle (ov.hEvent);
+  return ok ? (int) nbytes : -1;
+}
+
+
+/* Read a request from the connected pipe HD into REQ.  */
+static gpg_error_t
+read_request (HANDLE hd, struct request_s *req)
+{
+  string buffer;
+  char chunk[4096];
+  int n;
+
+  while (buffer.size () < MAX_REQUEST)
+    {
+      n = pipe_io (hd, 0, chunk, sizeof chunk);
+      if (n <= 0)
+        return gpg_error (GPG_ERR_EIO);
+      buffer.append (chunk, n);
+      if (buffer.find ("\nEND\n") != string::npos)
+        return parse_request (&buffer[0], req);
+    }
+  return gpg_error (GPG_ERR_TOO_LARGE);
+}
+
+
+/* Work item run in the thread pool for one connection.  */
+static DWORD WINAPI
+handle_connection (LPVOID arg)
+{
+  HANDLE hd = (HANDLE) arg;
+  struct request_s req;
+  gpg_error_t err;
+  client_result_s result;
+  char reply[64];
+
+  TRACE_BEG (DEBUG_ASSUAN, "handle_connection", hd);
+
+  req.wid = NULL;
+  err = read_request (hd, &req);
+  if (err)
+    snprintf (reply, sizeof reply, "ERR %u\n", err);
+  else
+    strcpy (reply, "OK\n");
+  pipe_io (hd, 1, reply, strlen (reply));
+  FlushFileBuffers (hd);
+  DisconnectNamedPipe (hd);
+  CloseHandle (hd);
+
+  if (!err && req.cmd == BENCH_COMMAND)
+    client_run_command (req.cmd.c_str (), req.filenames, req.wid,
+                        CLIENT_NO_UI, &result);
+  else if (!err)
+    {
+      err = client_run_command (req.cmd.c_str (), req.filenames, req.wid,
+                                0, &result);
+      if (err)
+        client_show_error (req.wid, err, &result);
+    }
+
+  (void) TRACE_GPGERR (err);
+  InterlockedDecrement (&active_requests);
+  SetEvent (request_done);
+  return 0;
+}
+
+
+/* Create a new instance of the broker pipe with the security
+   attributes SA.  */
+static HANDLE
+create_pipe_instance (const wchar_t *name, SECURITY_ATTRIBUTES *sa,
+                      int first)
+{
+  return CreateNamedPipeW (name,
+                           PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED
+                           | (first ? FILE_FLAG_FIRST_PIPE_INSTANCE : 0),
+                           PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT
+                           | PIPE_REJECT_REMOTE_CLIENTS,
+                           PIPE_UNLIMITED_INSTANCES, 4096, 4096, 0, sa);
+}
+
+
+/* Accept connections until we have been idle for IDLE_TIMEOUT.  */
+static int
+serve (void)
+{
+  wchar_t name[GPGEX_BROKER_PIPE_NAME_SIZE];
+  SECURITY_ATTRIBUTES sa;
+  HANDLE hd;
+  HANDLE events[2];
+  OVERLAPPED ov;
+  DWORD idle_since = GetTickCount ();
+  int rc = 1;
+
+  memset (&sa, 0, sizeof sa);
+  sa.nLength = sizeof sa;
+  sa.lpSecurityDescriptor = gpgex_broker_pipe_sd ();
+  if (gpgex_broker_pipe_name (name, sizeof name / sizeof *name)
+      || !sa.lpSecurityDescriptor)
+    {
+      _gpgex_debug (DEBUG_INIT, "can't build the pipe name or the DACL");
+      LocalFree (sa.lpSecurityDescriptor);
+      return 1;
+    }
+  hd = create_pipe_instance (name, &sa, 1);
+  if (hd == INVALID_HANDLE_VALUE)
+    {
+      /* Another broker is already running or another user created
+         the pipe; the DLL does not talk to the latter.  */
+      _gpgex_debug (DEBUG_INIT, "creating the pipe failed: ec=%d",
+                    (int) GetLastError ());
+      LocalFree (sa.lpSecurityDescriptor);
+      return 1;
+    }
+
+  memset (&ov, 0, sizeof ov);
+  ov.hEvent = CreateEvent (NULL, TRUE, FALSE, NULL);
+  request_done = CreateEvent (NULL, FALSE, FALSE, NULL);
+  events[0] = ov.hEvent;
+  events[1] = request_done;
+
+  for (;;)
+    {
+      DWORD waitrc;
+      DWORD nbytes;
+      int connected = 0;
+
+      ResetEvent (ov.hEvent);
+      if (ConnectNamedPipe (hd, &ov))
+        connected = 1;
+      else if (GetLastError () == ERROR_PIPE_CONNECTED)
+        connected = 1;
+      else if (GetLastError () != ERROR_IO_PENDING)
+        {
+          _gpgex_debug (DEBUG_ASSUAN, "ConnectNamedPipe failed: ec=%d",
+                        (int) GetLastError ());
+          break;
+        }
+
+      while (!connected)
+        {
+          waitrc = WaitForMultipleObjects (2, events, FALSE, 1000);
+          if (waitrc == WAIT_OBJECT_0)
+            connected = GetOverlappedResult (hd, &ov, &nbytes, FALSE);
+          else if (!active_requests
+                   && GetTickCount () - idle_since >= idle_timeout * 1000)
+            {
+              _gpgex_debug (DEBUG_INIT, "idle - terminating");
+              CancelIo (hd);
+              CloseHandle (hd);
+              rc = 0;
+              goto leave;
+            }
+          else if (active_requests)
+            idle_since = GetTickCount ();
+        }
+
+      /* Hand the connection to a worker and create a new instance
+         for the next client.  */
+      InterlockedIncrement (&active_requests);
+      idle_since = GetTickCount ();
+      if (!QueueUserWorkItem (handle_connection, hd,
+                              WT_EXECUTELONGFUNCTION))
+        {
+          InterlockedDecrement (&active_requests);
+          DisconnectNamedPipe (hd);
+          CloseHandle (hd);
+        }
+      hd = create_pipe_instance (name, &sa, 0);
+      if (hd == INVALID_HANDLE_VALUE)
+        break;
+    }
+
+ leave:
+  LocalFree (sa.lpSecurityDescriptor);
+  return rc;
+}
+
+
+/* Print the median, the 90th percentile and the maximum of TIMES.  */
+static void
+print_times (const char *what, vector<uint64_t> &times)
+{
+  std::sort (times.begin (), times.end ());
+  printf ("%-8s %5u requests: median %7lu us, 90%% %7lu us, max %7lu us\n",
+          what, (unsigned int) times.size (),
+          (unsigned long) times[times.size () / 2],
+          (unsigned long) times[times.size () * 9 / 10],
+          (unsigned long) times.back ());
+}
+
+
+/* Send N requests for FILENAME directly to the UI server and N to the
+   running broker and print how long each took.  A direct request
+   sets up a new connection like the DLL does without the broker; a
+   brokered one is done when the broker has queued it, which is all
+   the Explorer waits for.  */
+static int
+bench (unsigned int n, const char *filename)
+{
+  vector<string> filenames (1, filename);
+  vector<uint64_t> direct, brokered;
+  client_result_s result;
+  uint64_t start;
+  gpg_error_t err;
+  unsigned int i;
+
+  for (i = 0; i < n; i++)
+    {
+      start = gpgex_stats_now ();
+      err = client_run_command (BENCH_COMMAND, filenames, NULL,
+                                CLIENT_NO_UI, &result);
+      if (result.connect_failed)
+        {
+          fprintf (stderr, "gpgex-broker: can't connect to the UI server: "
+                   "%s\n", gpg_strerror (err));
+          return 1;
+        }
+      direct.push_back (gpgex_stats_now () - start);
+    }
+
+  for (i = 0; i < n; i++)
+    {
+      start = gpgex_stats_now ();
+      err = gpgex_broker_submit (BENCH_COMMAND, filenames, NULL);
+      if (err)
+        {
+          fprintf (stderr, "gpgex-broker: can't reach the broker: %s\n",
+                   gpg_strerror (err));
+          return 1;
+        }
+      brokered.push_back (gpgex_stats_now () - start);
+    }
+
+  print_times ("direct", direct);
+  print_times ("broker", brokered);
+  return 0;
+}
+
+
+static void
+usage (int ec)
+{
+  fputs ("Usage: gpgex-broker [OPTIONS]\n"
+         "Run GpgEX operations for all Explorer processes.\n"
+         "\n"
+         "  --debug-file FILE    write debug output to FILE\n"
+         "  --idle-timeout N     terminate after N idle seconds\n"
+         "  --connections N      keep up to N connections open\n"
+         "  --bench N FILE       compare N requests through the running\n"
+         "                       broker with N direct connections\n",
+         ec ? stderr : stdout);
+  exit (ec);
+}
+
+
+int
+main (int argc, char **argv)
+{
+  const char *debug_filename = NULL;
+  unsigned int connections = 2;
+  unsigned int nbench = 0;
+  const char *bench_file = NULL;
+  char *locale_dir;
+  WSADATA wsadat;
+  int rc;
+
+  for (argc--, argv++; argc; argc--, argv++)
+    {
+      if (!strcmp (*argv, "--debug-file") && argc > 1)
+        {
+          argc--, argv++;
+          debug_filename = *argv;
+        }
+      else if (!strcmp (*argv, "--idle-timeout") && argc > 1)
+        {
+          argc--, argv++;
+          idle_timeout = atoi (*argv);
+        }
+      else if (!strcmp (*argv, "--connections") && argc > 1)
+        {
+          argc--, argv++;
+          connections = atoi (*argv);
+        }
+      else if (!strcmp (*argv, "--bench") && argc > 2)
+        {
+          nbench = atoi (argv[1]);
+          bench_file = argv[2];
+          argc -= 2, argv += 2;
+        }
+      else if (!strcmp (*argv, "--help"))
+        usage (0);
+      else
+        usage (1);
+    }
+
+  gpg_err_init ();
+  InitializeCriticalSection (&debug_lock);
+  if (debug_filename && (debug_file = fopen (debug_filename, "a")))
+    {
+      debug_flags = DEBUG_INIT | DEBUG_ASSUAN;
+      assuan_set_assuan_log_stream (debug_file);
+      assuan_set_assuan_log_prefix ("gpgex-broker:assuan");
+    }
+  assuan_set_gpg_err_source (GPG_ERR_SOURCE_DEFAULT);
+  gpgex_stats_init ();
+
+  locale_dir = gpgrt_fconcat (0, get_gpg4win_dir (), "share/locale", NULL);
+  if (locale_dir)
+    {
+      bindtextdomain (PACKAGE_GT, locale_dir);
+      free (locale_dir);
+    }
+  textdomain (PACKAGE_GT);
+
+  WSAStartup (0x202, &wsadat);
+  if (nbench)
+    rc = bench (nbench, bench_file);
+  else
+    {
+      client_keep_connections (connections);
+      rc = serve ();
+    }
+
+  client_keep_connections (0);
+  WSACleanup ();
+  gpgex_stats_deinit ();
+  if (debug_file)
+    fclose (debug_file);
+  return rc;
+}
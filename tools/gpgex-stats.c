@@ -0,0 +1,108 @@
+/* gpgex-stats.c - print the GpgEX live statistics
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GpgEX.
+
+   GpgEX is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   GpgEX is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+/* This tool reads the statistics block which all processes with a
+   loaded GpgEX update (see src/stats.h) and prints it.  It does not
+   need to attach to the Explorer processes.  */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_W32_SYSTEM
+# include <windows.h>
+#else
+# include <unistd.h>
+#endif
+
+#include "stats.h"
+
+
+static void
+usage (int ec)
+{
+  fputs ("Usage: gpgex-stats [--colons] [--interval SECONDS]\n"
+         "Print the live statistics of GpgEX.\n"
+         "\n"
+         "  --colons       print a colon delimited format\n"
+         "  --interval N   print every N seconds\n",
+         ec ? stderr : stdout);
+  exit (ec);
+}
+
+
+int
+main (int argc, char **argv)
+{
+  const struct gpgex_stats_s *live;
+  struct gpgex_stats_s snapshot;
+  int machine = 0;
+  int interval = 0;
+
+  for (argc--, argv++; argc; argc--, argv++)
+    {
+      if (!strcmp (*argv, "--colons"))
+        machine = 1;
+      else if (!strcmp (*argv, "--interval") && argc > 1)
+        {
+          argc--, argv++;
+          interval = atoi (*argv);
+        }
+      else if (!strcmp (*argv, "--help"))
+        usage (0);
+      else
+        usage (1);
+    }
+
+  live = gpgex_stats_open_reader ();
+  if (!live)
+    {
+      fputs ("gpgex-stats: no statistics available"
+             " (GpgEX not loaded)\n", stderr);
+      return 1;
+    }
+
+  for (;;)
+    {
+      if (gpgex_stats_snapshot (live, &snapshot))
+        {
+          fputs ("gpgex-stats: unknown statistics layout\n", stderr);
+          gpgex_stats_close_reader (live);
+          return 1;
+        }
+      gpgex_stats_print (stdout, &snapshot, machine);
+      fflush (stdout);
+      if (interval <= 0)
+        break;
+#ifdef HAVE_W32_SYSTEM
+      Sleep (interval * 1000);
+#else
+      sleep (interval);
+#endif
+      if (!machine)
+        putchar ('\n');
+    }
+
+  gpgex_stats_close_reader (live);
+  return 0;
+}